@@ -0,0 +1,216 @@
+#!/usr/bin/ruby
+#
+# Compiles l10n_<locale>_<n>.ini files into a single string table (l10n.xlt)
+# that xpl_l10n maps at startup instead of scanning the INI files on every miss.
+#
+# Usage:
+#   l10n_table_update.rb output.xlt input.ini [input.ini ...]
+#   l10n_table_update.rb                (Xcode build phase; uses the build environment)
+#
+# Inputs are given in lookup order: the first file to define a key wins, the
+# same as xpl_l10n walking l10n_<locale>_0.ini, l10n_<locale>_1.ini, ...
+#
+# Layout (little-endian):
+#   header      char magic[4] = "XLT1", uint32 entry_count, uint32 bucket_count, uint32 pool_size
+#   buckets     int32 displacement[bucket_count]
+#   entries     { uint32 key_offset, uint32 value_offset, uint32 count }[entry_count], in slot order
+#   pool        NUL-terminated lowercase "<locale>:<key>" and value strings, sorted by key
+#
+# Slots are assigned with a minimal perfect hash (hash and displace). A key's
+# bucket is l10n_hash(key, 0) % bucket_count; a non-negative displacement d puts
+# it in slot l10n_hash(key, d) % entry_count, a negative one in slot -d - 1.
+#
+# Random word families (prefix_0, prefix_1, ...) get an extra "<locale>:<prefix>_#"
+# entry whose count is the number of consecutive keys starting at 0.
+
+MAGIC = "XLT1"
+FAMILY_SUFFIX = "_#"
+MAX_DISPLACEMENT = 1 << 20
+
+def l10n_hash(s, seed)
+    h = (2166136261 ^ seed) & 0xffffffff
+    s.each_byte { |b|
+        h ^= b
+        h = (h * 16777619) & 0xffffffff
+    }
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    h
+end
+
+# Same rules as minIni's cleanstring + save_strncpy(QUOTE_DEQUOTE).
+def ini_clean_value(value)
+    in_string = false
+    i = 0
+    while i < value.length
+        c = value[i, 1]
+        if c == '"'
+            if value[i + 1, 1] == '"'
+                i += 1
+            else
+                in_string = !in_string
+            end
+        elsif c == '\\' && value[i + 1, 1] == '"'
+            i += 1
+        elsif (c == ';' || c == '#') && !in_string
+            break
+        end
+        i += 1
+    end
+    value = value[0, i].sub(/[\x00-\x20]+\z/n, '')
+    if value.length >= 2 && value[0, 1] == '"' && value[-1, 1] == '"'
+        value = value[1..-2].gsub(/["\\]"/n, '"')
+    elsif value == '"'
+        value = ''
+    end
+    value
+end
+
+# Same escapes as unescape() in xpl_l10n.c.
+def l10n_unescape(value)
+    value.gsub(/\\(0[0-7]{0,3}|[xX][0-9a-fA-F]+|.)/n) { |m|
+        seq = $1
+        case seq[0, 1]
+        when '0' then [seq.oct & 0xff].pack('C')
+        when 'x', 'X' then [seq[1..-1].hex & 0xff].pack('C')
+        when 'a' then "\a"
+        when 'b' then "\b"
+        when 'f' then "\f"
+        when 'n' then "\n"
+        when 'r' then "\r"
+        when 'u', 'U' then ''
+        else seq
+        end
+    }
+end
+
+def read_ini(filename)
+    entries = []
+    section = nil
+    File.open(filename, 'rb') { |f|
+        f.each_line { |line|
+            line = line.sub(/\A\xEF\xBB\xBF/n, '').sub(/\A[\x00-\x20]+/n, '').sub(/[\r\n]+\z/n, '')
+            next if line.empty? || line[0, 1] == ';' || line[0, 1] == '#'
+            if line =~ /\A\[([^\]]*)\]/n
+                section = $1.downcase
+                next
+            end
+            next unless section == 'l10n'
+            sep = line.index('=') || line.index(':')
+            next unless sep
+            key = line[0, sep].sub(/[\x00-\x20]+\z/n, '')
+            value = l10n_unescape(ini_clean_value(line[sep + 1..-1].sub(/\A[\x00-\x20]+/n, '')))
+            entries << [key, value]
+        }
+    }
+    entries
+end
+
+def locale_for(filename)
+    match = /l10n_(?:(.+)_)?\d+\.ini\z/.match(File.basename(filename))
+    raise "#{filename} is not named l10n_<locale>_<n>.ini" unless match
+    match[1] || ''
+end
+
+def collect_strings(inputs)
+    table = {}
+    inputs.each { |filename|
+        locale = locale_for(filename)
+        read_ini(filename).each { |key, value|
+            full_key = "#{locale}:#{key}".downcase
+            # Empty values read as missing, so a later file may still supply them.
+            table[full_key] = [value, 0] unless value.empty? || table.has_key?(full_key)
+        }
+    }
+
+    families = {}
+    table.keys.each { |full_key|
+        match = /\A(.+)_(\d+)\z/.match(full_key)
+        (families[match[1]] ||= {})[match[2].to_i] = true if match
+    }
+    families.each { |prefix, indices|
+        count = 0
+        count += 1 while indices[count]
+        table["#{prefix}#{FAMILY_SUFFIX}"] = ['', count] if count > 0
+    }
+    table
+end
+
+def assign_slots(keys)
+    n = keys.length
+    bucket_count = [(n + 1) / 2, 1].max
+    buckets = Array.new(bucket_count) { [] }
+    keys.each { |k| buckets[l10n_hash(k, 0) % bucket_count] << k }
+
+    slots = Array.new(n)
+    displacements = Array.new(bucket_count, 0)
+    order = (0...bucket_count).sort_by { |b| [-buckets[b].length, b] }
+    order.each { |b|
+        bucket = buckets[b]
+        next if bucket.empty?
+        if bucket.length == 1
+            free = slots.index(nil)
+            slots[free] = bucket[0]
+            displacements[b] = -free - 1
+            next
+        end
+        d = 1
+        while true
+            raise "Couldn't place bucket #{b} of #{bucket.length} keys" if d > MAX_DISPLACEMENT
+            candidate = bucket.map { |k| l10n_hash(k, d) % n }
+            break if candidate.uniq.length == candidate.length && candidate.all? { |s| slots[s].nil? }
+            d += 1
+        end
+        bucket.each_with_index { |k, i| slots[candidate[i]] = k }
+        displacements[b] = d
+    }
+    [slots, displacements]
+end
+
+def write_table(output, inputs)
+    table = collect_strings(inputs)
+    raise "No l10n strings found in #{inputs.join ' '}" if table.empty?
+
+    pool = ''
+    offsets = {}
+    table.keys.sort.each { |key|
+        value, count = table[key]
+        key_offset = pool.bytesize
+        pool << key << "\0"
+        value_offset = pool.bytesize
+        pool << value << "\0"
+        offsets[key] = [key_offset, value_offset, count]
+    }
+
+    slots, displacements = assign_slots(table.keys)
+    data = [MAGIC, slots.length, displacements.length, pool.bytesize].pack('a4VVV')
+    data << displacements.map { |d| d & 0xffffffff }.pack('V*')
+    data << slots.map { |key| offsets[key] }.flatten.pack('V*')
+    data << pool
+
+    File.open(output, 'wb') { |f| f.write(data) }
+    print "#{output}: #{slots.length} entries from #{inputs.length} files\n"
+end
+
+def process_build_phase
+    src_root = ENV['SOURCE_ROOT']
+    platform = (ENV['PLATFORM_NAME'] || '') =~ /iphone/ ? 'ios' : 'desktop'
+    output = "#{ENV['TARGET_BUILD_DIR']}/#{ENV['UNLOCALIZED_RESOURCES_FOLDER_PATH']}/l10n.xlt"
+    inputs = [ 'common', platform ].map { |dir|
+        Dir.glob("#{src_root}/../resources/#{dir}/l10n_*.ini")
+    }.flatten.sort_by { |f| [ locale_for(f), File.basename(f)[/(\d+)\.ini\z/, 1].to_i ] }
+    write_table(output, inputs)
+end
+
+if ARGV.length >= 2
+    output, *inputs = ARGV
+    write_table(output, inputs)
+elsif ENV['SOURCE_ROOT']
+    process_build_phase()
+else
+    puts "#{$0} output.xlt input.ini [input.ini ...]"
+    exit 1
+end
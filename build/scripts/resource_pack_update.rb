@@ -0,0 +1,83 @@
+#!/usr/bin/ruby
+#
+# Packs resources that are loaded through xpl_vfs_map (textures, fonts, sprite
+# sheets, the compiled l10n table) into a single file (resources.xpk), so that
+# startup maps one file instead of opening each resource.
+#
+# Usage:
+#   resource_pack_update.rb [--remove] output.xpk resource_dir [resource_dir ...]
+#
+# --remove deletes the packed loose files afterwards; loose app resources
+# override the pack, so a distribution shouldn't ship both.
+#
+# Names are relative to their resource_dir, with '/' separators. The first
+# directory to provide a name wins. Shaders, audio, INI and OBJ files are read
+# by path and must stay loose, so they aren't packed.
+#
+# Layout (little-endian):
+#   header      char magic[4] = "XPK1", uint32 entry_count, uint32 names_size, uint32 reserved
+#   entries     { uint32 name_offset, uint32 data_offset, uint32 length }[entry_count]
+#   names       NUL-terminated names
+#   data        file contents, each aligned to DATA_ALIGNMENT bytes
+
+MAGIC = "XPK1"
+PACKED_EXTENSIONS = %w{ .png .jpg .jpeg .tga .bmp .dds .json .xss .ttf .otf .xlt }
+DATA_ALIGNMENT = 16
+
+def collect_files(dirs)
+    files = {}
+    dirs.each { |dir|
+        Dir.glob("#{dir}/**/*").sort.each { |path|
+            next unless File.file?(path)
+            next unless PACKED_EXTENSIONS.include?(File.extname(path).downcase)
+            name = path[dir.length + 1..-1]
+            files[name] = path unless files.has_key?(name)
+        }
+    }
+    files
+end
+
+def align(offset)
+    (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT
+end
+
+def write_pack(output, dirs)
+    files = collect_files(dirs)
+    names = ''
+    name_offsets = {}
+    files.keys.sort.each { |name|
+        name_offsets[name] = names.bytesize
+        names << name << "\0"
+    }
+
+    header_size = 16 + files.length * 12 + names.bytesize
+    offset = align(header_size)
+    entries = []
+    files.keys.sort.each { |name|
+        length = File.size(files[name])
+        entries << [name_offsets[name], offset, length]
+        offset = align(offset + length)
+    }
+
+    File.open(output, 'wb') { |f|
+        f.write([MAGIC, files.length, names.bytesize, 0].pack('a4VVV'))
+        f.write(entries.flatten.pack('V*'))
+        f.write(names)
+        files.keys.sort.each_with_index { |name, i|
+            f.write("\0" * (entries[i][1] - f.pos))
+            f.write(File.open(files[name], 'rb') { |input| input.read })
+        }
+    }
+    print "#{output}: #{files.length} resources, #{offset} bytes\n"
+    files.values
+end
+
+remove = ARGV.delete('--remove')
+if ARGV.length >= 2
+    output, *dirs = ARGV
+    packed = write_pack(output, dirs.map { |dir| dir.chomp('/') })
+    packed.each { |path| File.delete(path) } if remove
+else
+    puts "#{$0} [--remove] output.xpk resource_dir [resource_dir ...]"
+    exit 1
+end
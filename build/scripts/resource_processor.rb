@@ -1,5 +1,6 @@
 #! /usr/bin/ruby
 require 'fileutils'
+require 'json'
 
 class Processor
   
@@ -11,7 +12,7 @@ class Processor
   end
   
   def process(target)
-    FileUtils.mkdir_p target unless File.exists? target and File.directory? target
+    FileUtils.mkdir_p target unless File.exist? target and File.directory? target
 		puts @files
     @files.each { |file| 
 	  	puts @file
@@ -29,7 +30,7 @@ class Processor
   end
   
   def process_r(sources, target)
-    sources.each { |source| 
+    [ sources ].flatten.each { |source| 
       print "#{source} "
       process_file(source, target)
       puts ""
@@ -43,7 +44,7 @@ end
 
 class FileTransformer < Transformer
   def can_process?(input)
-    return false unless (File.exists? input) && ! (File.directory? input)
+    return false unless (File.exist? input) && ! (File.directory? input)
     can_process_file?(input)
   end
   def target_filename(input, output, new_extension)
@@ -63,6 +64,82 @@ class WAV2AAC < FileTransformer
   @@classes << self
 end
 
+# Compiles a TexturePacker JSON hash sheet into the binary sheet read by
+# xpl_sprite_sheet_new, so the game doesn't parse JSON at load.
+#
+# Layout (little-endian):
+#   header      char magic[4] = "XSS1", uint32 entry_count, uint32 names_size,
+#               uint32 image_offset, int32 width, int32 height
+#   entries     { uint32 name_offset, int32 x, int32 y, int32 width, int32 height }[entry_count]
+#   names       NUL-terminated frame names, then the image name
+#
+# Entries are sorted by name, so an entry's index is its sprite ID. Regions are
+# stored with y flipped to GL orientation. With SPRITE_HEADER_DIR set, also
+# writes <sheet>_sprites.h there, enumerating the IDs along with a signature
+# that xpl_sprite_sheet_check_signature compares against the loaded sheet.
+class SpriteSheetCompile < FileTransformer
+  MAGIC = "XSS1"
+
+  def can_process_file?(input)
+    return false unless File.extname(input).downcase == '.json'
+    sheet = JSON.parse(File.read(input)) rescue nil
+    sheet.is_a?(Hash) && sheet['frames'].is_a?(Hash) && sheet['meta'].is_a?(Hash)
+  end
+
+  # FNV-1a over the NUL-terminated names in ID order; matches sheet_signature().
+  def signature(names)
+    h = 2166136261
+    names.each { |name|
+      (name + "\0").each_byte { |b| h = ((h ^ b) * 16777619) & 0xffffffff }
+    }
+    h
+  end
+
+  def process(input, output)
+    sheet = JSON.parse(File.read(input))
+    height = sheet['meta']['size']['h']
+    names = sheet['frames'].keys.sort
+
+    pool = ''
+    entries = names.map { |name|
+      frame = sheet['frames'][name]['frame']
+      offset = pool.bytesize
+      pool << name << "\0"
+      [ offset, frame['x'], height - frame['y'] - frame['h'], frame['w'], frame['h'] ]
+    }
+    image_offset = pool.bytesize
+    pool << sheet['meta']['image'] << "\0"
+
+    target = target_filename(input, output, ".xss")
+    print target
+    File.open(target, 'wb') { |f|
+      f.write([ MAGIC, names.length, pool.bytesize, image_offset, sheet['meta']['size']['w'], height ].pack('a4VVVl<l<'))
+      f.write(entries.map { |e| e.pack('Vl<l<l<l<') }.join)
+      f.write(pool)
+    }
+    write_header(input, names) if ENV['SPRITE_HEADER_DIR']
+  end
+
+  def write_header(input, names)
+    sheet_name = File.basename(input).chomp(File.extname(input))
+    prefix = "SPRITE_#{sheet_name.upcase.gsub(/\W/, '_')}"
+    header = File.join(ENV['SPRITE_HEADER_DIR'], "#{sheet_name}_sprites.h")
+    print " #{header}"
+    File.open(header, 'w') { |f|
+      f.write "//\n//  #{sheet_name}_sprites.h\n//  app\n//\n"
+      f.write "//  Generated by resource_processor.rb from #{File.basename(input)}. Do not edit.\n//\n\n"
+      f.write "#ifndef app_#{sheet_name}_sprites_h\n#define app_#{sheet_name}_sprites_h\n\n"
+      f.write "#define #{prefix}_SIGNATURE 0x%08xu\n\n" % signature(names)
+      f.write "enum #{sheet_name}_sprite {\n"
+      names.each_with_index { |name, i|
+        f.write "\t#{prefix}_#{name.chomp(File.extname(name)).upcase.gsub(/\W/, '_')} = #{i},\n"
+      }
+      f.write "\t#{prefix}_COUNT = #{names.length}\n};\n\n#endif\n"
+    }
+  end
+  @@classes << self
+end
+
 # class PNGProcess < Transformer
 #   def can_process?(input)
 #     File.directory? input
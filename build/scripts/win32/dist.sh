@@ -10,5 +10,8 @@ cp $SOURCE $DEST/
 cp ../lib/mingw/*.dll $DEST/
 cp -r ../resources/common/* $DEST/resources 
 cp -r ../resources/desktop/* $DEST/resources
+ruby ../build/scripts/l10n_table_update.rb $DEST/resources/l10n.xlt ../resources/common/l10n_*.ini ../resources/desktop/l10n_*.ini
+ruby ../build/scripts/resource_processor.rb $DEST/resources/bitmaps ../resources/common/bitmaps/*.json -t SpriteSheetCompile
+ruby ../build/scripts/resource_pack_update.rb --remove $DEST/resources/resources.xpk $DEST/resources
 
 echo "Done"
\ No newline at end of file
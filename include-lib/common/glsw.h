@@ -11,6 +11,7 @@ const char* glswGetShader(const char* effectKey);
 const char* glswGetError(void);
 void glswClearError(void);
 int glswAddDirectiveToken(const char* token, const char* directive);
+int glswForgetEffect(const char* effectName);
 
 #ifdef __cplusplus
 }
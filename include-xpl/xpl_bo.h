@@ -45,4 +45,8 @@ void xpl_bo_insert(xpl_bo_t *self, size_t insert_offset, const void *data, size_
 void xpl_bo_delete(xpl_bo_t *self, size_t delete_offset, size_t data_len_bytes);
 void xpl_bo_update(xpl_bo_t *self, size_t update_offset, const void *data, size_t data_len_bytes);
 
+// Replaces the buffer's contents with data straight from the caller, without a client copy.
+// The old storage is orphaned first, so the driver needn't wait on draws still reading it.
+void xpl_bo_stream(xpl_bo_t *self, const void *data, size_t data_len_bytes);
+
 #endif
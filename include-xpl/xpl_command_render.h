@@ -42,6 +42,7 @@ typedef struct xpl_render_cmd {
 
 		struct {
 
+			// Owned by the command queue's frame arena.
 			xpl_markup_t	*markup;
 			xvec2			position;
 			int				align;
@@ -11,6 +11,8 @@
 
 #include <stdlib.h>
 
+#include "xpl_memory.h"
+
 typedef struct xpl_dynamic_buffer {
 
 	size_t      capacity;
@@ -20,12 +22,24 @@ typedef struct xpl_dynamic_buffer {
 	size_t      dirty_range_min;
 	size_t      dirty_range_max;
 
+	const xpl_allocator_t *allocator; // NULL for the heap
+
 } xpl_dynamic_buffer_t;
 
 
 xpl_dynamic_buffer_t *xpl_dynamic_buffer_new(void);
+// Takes storage from the given allocator, which has to outlive the buffer's storage.
+xpl_dynamic_buffer_t *xpl_dynamic_buffer_new_with_allocator(const xpl_allocator_t *allocator);
 void xpl_dynamic_buffer_destroy(xpl_dynamic_buffer_t **ppbuffer);
 
+// Capacity grows geometrically as data is added; reserve sets aside at least this
+// much up front.
+void xpl_dynamic_buffer_reserve(xpl_dynamic_buffer_t *self, size_t capacity);
+// Gives the storage back to the allocator and empties the buffer. Call this before
+// resetting an arena the buffer draws from.
+void xpl_dynamic_buffer_release(xpl_dynamic_buffer_t *self);
+
+// Makes room for alloc_len more bytes; with as_data, they're zeroed and added to the length.
 void xpl_dynamic_buffer_alloc(xpl_dynamic_buffer_t *self, size_t alloc_len, int as_data);
 void xpl_dynamic_buffer_append(xpl_dynamic_buffer_t *self, const unsigned char *data, size_t data_len);
 void xpl_dynamic_buffer_insert(xpl_dynamic_buffer_t *self, size_t insert_offset, const unsigned char *data, size_t data_len);
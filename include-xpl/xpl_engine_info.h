@@ -44,6 +44,7 @@ typedef struct xpl_engine_execution_info {
 	double					current_time;
 	size_t                  retain_execution_sample_count;
 	xpl_execution_stats_t   *execution_stats;
+	xpl_pool_t              *execution_stats_pool;
     xpl_execution_stats_t   total_stats;
     uint64_t                frame_count;
 	xivec2					screen_size;
@@ -8,19 +8,33 @@
 #ifndef XPL_ES_H_
 #define XPL_ES_H_
 
-#include "uthash.h"
-#include "utlist.h"
-
 #include "xpl.h"
 #include "xpl_preprocessor_hash.h"
 #include "xpl_memory.h"
 
+// Entities with the same set of component types share an archetype, which keeps
+// each type's components in a dense column per chunk. Adding or removing a
+// component moves the entity's row to another archetype, so component pointers
+// are only good until the next component is added or removed or an entity is
+// destroyed. Entity handles stay valid for as long as the entity lives.
+
 #define XPL_ENTITY_NONE 0
 
+// The low bits of a handle index a slot; the high bits count the slot's reuses,
+// so a handle to a destroyed entity never refers to the slot's next occupant.
+#define XPL_ENTITY_INDEX_BITS       20
+#define XPL_ENTITY_INDEX_MASK       ((1u << XPL_ENTITY_INDEX_BITS) - 1)
+#define xpl_entity_index(entity)        ((entity) & XPL_ENTITY_INDEX_MASK)
+#define xpl_entity_generation(entity)   ((entity) >> XPL_ENTITY_INDEX_BITS)
+
+// Most component types a query can ask for.
+#define XPL_ES_QUERY_MAX            8
+
 typedef uint32_t xpl_entity;
 typedef uint32_t xpl_type_id;
 
-typedef void *(* xpl_component_allocator)(void);
+// Called on a component before it's removed or its entity is destroyed. It must
+// not free the component; the entity system owns the storage.
 typedef void (* xpl_component_destructor)(void *);
 
 typedef struct xpl_component_result {
@@ -36,29 +50,40 @@ typedef struct xpl_component_result_set {
 
 typedef struct xpl_es_context xpl_es_t;
 
+// Walks the chunks of every archetype with all of the query's types. Each step
+// exposes count entities and, for each type in query order, a dense array of count
+// components. Don't add or remove components or entities while iterating.
+typedef struct xpl_es_query {
+	xpl_es_t *es;
+	xpl_type_id type_ids[XPL_ES_QUERY_MAX];
+	size_t type_count;
+
+	size_t archetype;
+	size_t chunk;
+	size_t columns[XPL_ES_QUERY_MAX];
+
+	// The current chunk.
+	size_t count;
+	const xpl_entity *entities;
+	void *components[XPL_ES_QUERY_MAX];
+} xpl_es_query_t;
+
 xpl_es_t *xpl_es_new(void);
 void xpl_es_destroy(xpl_es_t **ppcontext);
 
 xpl_entity xpl_entity_new(xpl_es_t *context);
 void xpl_entity_destroy(xpl_es_t *context, xpl_entity entity);
+int xpl_entity_alive(xpl_es_t *context, xpl_entity entity);
 
-// Transfer an entity's components from the source entity system to a new entity
-// in the destination entity system (without reallocation). Returns the new entity.
+// Move an entity's components from the source entity system to a new entity in the
+// destination entity system, without running destructors. Returns the new entity.
 xpl_entity xpl_entity_transfer(xpl_es_t *source, xpl_entity source_entity, xpl_es_t *dest);
 
-void xpl_component_allocator_for_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_allocator allocator, xpl_component_destructor destructor);
-
-void *xpl_component_new_with_type_id(xpl_es_t *es, xpl_entity entity, const xpl_type_id type_id, const size_t size);
-//void *xpl_component_create_with_type_id(xpl_es_t *es, const xpl_type_id type_id, const size_t size);
-void xpl_component_destroy_with_type_id(xpl_es_t *es, void *component, const xpl_type_id type_id);
-void xpl_entity_component_destroy(xpl_es_t *es, const xpl_entity entity, void *component_data);
-
-xpl_entity xpl_entity_with_component(xpl_es_t *es, const void *component);
+void xpl_component_destructor_for_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_destructor destructor);
 
-xpl_type_id xpl_component_type_id(xpl_es_t *context, const void *component);
-
-void *xpl_component_assign_type_id(xpl_es_t *context, const xpl_entity entity, void *component, const xpl_type_id type_id);
-void *xpl_component_remove_type_id(xpl_es_t *context, const xpl_entity entity, void *component, const xpl_type_id type_id);
+// Adds a zeroed component. Every component of a type must have the same size.
+void *xpl_component_new_with_type_id(xpl_es_t *context, xpl_entity entity, const xpl_type_id type_id, const size_t size);
+void xpl_component_remove_type_id(xpl_es_t *context, const xpl_entity entity, const xpl_type_id type_id);
 
 size_t xpl_components_with_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_result_set_t *result);
 void * xpl_component_with_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_entity *entity_out);
@@ -69,32 +94,32 @@ void * xpl_entity_component_with_type_id(xpl_es_t *context, const xpl_entity ent
 xpl_component_result_set_t *xpl_component_result_set_new(void);
 void xpl_component_result_set_destroy(xpl_component_result_set_t **ppset);
 
-#define xpl_component_new(context, entity, type) \
-    ((type *)(xpl_component_new_with_type_id(context, entity, PS_HASH(#type), sizeof(type))))
+void xpl_es_query_init(xpl_es_query_t *query, xpl_es_t *context, const size_t type_count, const xpl_type_id *type_ids);
+// Advances to the next non-empty chunk; false when there are no more.
+int xpl_es_query_next(xpl_es_query_t *query);
 
-#define xpl_component_allocator(context, type, allocator, destructor) \
-    xpl_component_allocator_for_type_id(context, PS_HASH(#type), allocator, destructor);
+#define xpl_type_id_of(type) PS_HASH(#type)
 
-#define xpl_component_destroy(context, component, type) \
-    xpl_component_destroy_with_type_id(context, component, PS_HASH(#type));
+#define xpl_component_new(context, entity, type) \
+    ((type *)(xpl_component_new_with_type_id(context, entity, xpl_type_id_of(type), sizeof(type))))
 
-#define xpl_component_assign(context, entity, component_data, type) \
-    xpl_component_assign_type_id(context, entity, component_data, PS_HASH(#type))
+#define xpl_component_destructor(context, type, destructor) \
+    xpl_component_destructor_for_type_id(context, xpl_type_id_of(type), destructor)
 
-#define xpl_component_remove(context, entity, component_data) \
-    xpl_component_remove_type_id(context, entity, component_data, xpl_component_type_id(context, component_data))
+#define xpl_component_remove(context, entity, type) \
+    xpl_component_remove_type_id(context, entity, xpl_type_id_of(type))
 
 #define xpl_components_of_type(context, type, result) \
-	xpl_components_with_type_id(context, PS_HASH(#type), result)
+	xpl_components_with_type_id(context, xpl_type_id_of(type), result)
 
 #define xpl_component_of_type(context, type, entity_out) \
-    ((type *)xpl_component_with_type_id(context, PS_HASH(#type), entity_out))
+    ((type *)xpl_component_with_type_id(context, xpl_type_id_of(type), entity_out))
 
 #define xpl_only_entity_with_component_type(context, type) \
-    xpl_only_entity_with_component_type_id(context, PS_HASH(#type))
+    xpl_only_entity_with_component_type_id(context, xpl_type_id_of(type))
 
 #define xpl_entity_component(context, entity, type) \
-	((type *)xpl_entity_component_with_type_id(context, entity, PS_HASH(#type)))
+	((type *)xpl_entity_component_with_type_id(context, entity, xpl_type_id_of(type)))
 
 #define xpl_component_foreach(results, idx, entry_eid, el) \
 	for(idx = (el = results->result[0].component, entry_eid = results->result[0].eid, 0); \
@@ -13,9 +13,23 @@
 
 #include "xpl_dynamic_buffer.h"
 
+// Read-only view of a whole file. Memory mapped where the platform allows,
+// otherwise read into a buffer owned by the mapping. A slice borrows its
+// content from another mapping, which must outlive it.
+typedef struct xpl_file_mapping {
+	const unsigned char *content;
+	size_t length;
+
+	xpl_dynamic_buffer_t *buffer;
+	const struct xpl_file_mapping *source;
+} xpl_file_mapping_t;
+
 const char *xpl_file_extension(const char *filename);
 bool xpl_file_has_extension(const char *filename, const char *extension);
 void xpl_file_get_contents(const char *filename, xpl_dynamic_buffer_t *buffer);
+xpl_file_mapping_t *xpl_file_map(const char *filename);
+xpl_file_mapping_t *xpl_file_mapping_slice(const xpl_file_mapping_t *source, size_t offset, size_t length);
+void xpl_file_unmap(xpl_file_mapping_t **ppmapping);
 char *xpl_basename(const char *name);
 char *xpl_dirname(char *path);
 
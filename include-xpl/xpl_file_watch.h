@@ -0,0 +1,33 @@
+//
+//  xpl_file_watch.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-29.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_file_watch_h
+#define app_xpl_file_watch_h
+
+#include <stddef.h>
+
+// Reports changes to a set of files without blocking. Uses inotify where it's
+// available, watching each file's directory so that editors that save by
+// replacing the file are caught too; elsewhere it compares modification times
+// on every poll.
+
+typedef struct xpl_file_watch xpl_file_watch_t;
+
+typedef void (* xpl_file_watch_func)(const char *filename, void *data, void *context);
+
+xpl_file_watch_t *xpl_file_watch_new(void);
+void xpl_file_watch_destroy(xpl_file_watch_t **ppwatch);
+
+// Data comes back with the file's changes. Adding a file twice keeps the first data.
+int xpl_file_watch_add(xpl_file_watch_t *self, const char *filename, void *data);
+
+// Calls changed once for each watched file that changed since the last poll.
+// Returns how many did.
+size_t xpl_file_watch_poll(xpl_file_watch_t *self, xpl_file_watch_func changed, void *context);
+
+#endif
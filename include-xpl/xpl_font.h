@@ -13,6 +13,7 @@
 
 #include "uthash.h"
 
+#include "xpl_file.h"
 #include "xpl_markup.h"
 #include "xpl_texture_atlas.h"
 
@@ -81,7 +82,8 @@ typedef struct xpl_font {
 	xpl_glyph_t					*glyph_ttable; // hash
 	xpl_texture_atlas_t         *manager_atlas;
 
-	char                        *filename;
+	char                        *filename; // resource name
+	xpl_file_mapping_t          *source;
 	char						*name;
 	float                       size;
 	int                         hinting;
@@ -0,0 +1,50 @@
+//
+//  xpl_gl_record.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-30.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_gl_record_h
+#define app_xpl_gl_record_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A null GL backend that counts what the render path submits. Installing it
+// points the gl3w entry points at recorders, so the xpl_* modules run
+// unchanged without a context: names are handed out, queries answer as a
+// GL 3.2 core context would, compiles and links succeed, and nothing draws.
+// Where GL is linked directly (OS X, iOS) there are no entry points to swap
+// and install fails.
+
+typedef struct xpl_gl_record_stats {
+	size_t                      draw_calls;
+	size_t                      instanced_draw_calls;
+	size_t                      vertices;           // per instance; indices for element draws
+	size_t                      instances;
+	size_t                      state_changes;      // binds, enables, blend/depth/scissor/viewport, attribute setup
+	size_t                      redundant_binds;    // binds of what was already bound
+	size_t                      program_binds;
+	size_t                      texture_binds;
+	size_t                      uniform_updates;
+	size_t                      buffer_uploads;
+	size_t                      buffer_upload_bytes;
+	size_t                      texture_uploads;
+	size_t                      texture_upload_bytes;
+	size_t                      shader_compiles;
+} xpl_gl_record_stats_t;
+
+int xpl_gl_record_install(void);
+
+void xpl_gl_record_frame_begin(void);
+// Adds the frame to the totals and copies it out if frame_out isn't NULL.
+void xpl_gl_record_frame_end(xpl_gl_record_stats_t *frame_out);
+
+// Everything recorded since install, including work outside frames (loading).
+void xpl_gl_record_totals(xpl_gl_record_stats_t *totals_out, size_t *frames_out);
+
+void xpl_gl_record_stats_add(xpl_gl_record_stats_t *sum, const xpl_gl_record_stats_t *stats);
+
+#endif
@@ -83,6 +83,8 @@ typedef struct xpl_md5_context {
 	char digest_chars[33];
 } xpl_md5_context_t;
 
+// Begins a digest in a context the caller owns, e.g. on the stack.
+void xpl_md5_init(xpl_md5_context_t *context);
 xpl_md5_context_t *xpl_md5_new(void);
 void xpl_md5_destroy(xpl_md5_context_t **ppcontext);
 
@@ -0,0 +1,62 @@
+//
+//  xpl_imui_geometry.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-25.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_imui_geometry_h
+#define app_xpl_imui_geometry_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xpl_vec.h"
+#include "xpl_dynamic_buffer.h"
+
+// CPU-side tessellation of the immediate-mode UI shapes into antialiased
+// triangles. Doesn't touch GL, so it can run without a context.
+
+typedef struct xpl_imui_vertex {
+	xvec2                       position;
+	uint32_t                    color;          // RGBA
+} xpl_imui_vertex_t;
+
+typedef struct xpl_imui_geometry {
+	xpl_dynamic_buffer_t        *buffer;        // xpl_imui_vertex_t, GL_TRIANGLES
+	size_t                      count;
+	size_t                      reserve_bytes;  // what a frame starts with room for
+
+	bool                        has_transform;
+	xmat4                       transform;
+
+	// Scratch space for polygon edges.
+	xvec2                       *scratch;
+	size_t                      scratch_capacity;
+} xpl_imui_geometry_t;
+
+// Vertex storage comes from allocator, or the heap if it's NULL. With an arena, clear
+// before resetting it; each frame then takes one block sized to the largest so far.
+xpl_imui_geometry_t *xpl_imui_geometry_new(const xpl_allocator_t *allocator);
+void xpl_imui_geometry_destroy(xpl_imui_geometry_t **ppgeometry);
+
+// Drops the vertices. Heap storage is kept; allocator storage is given back.
+void xpl_imui_geometry_clear(xpl_imui_geometry_t *self);
+
+XPLINLINE xpl_imui_vertex_t *xpl_imui_geometry_vertices(const xpl_imui_geometry_t *self) {
+	return (xpl_imui_vertex_t *)self->buffer->content;
+}
+
+// Applied to the shapes added after it; NULL for identity.
+void xpl_imui_geometry_set_transform(xpl_imui_geometry_t *self, const xmat4 *transform);
+
+// Each shape is filled with color and fades to transparent over blend_r outside its edge.
+void xpl_imui_geometry_polygon(xpl_imui_geometry_t *self, const xvec2 *coords, size_t num_coords, float blend_r, uint32_t color);
+void xpl_imui_geometry_rect(xpl_imui_geometry_t *self, xrect rect, float blend_r, uint32_t color);
+void xpl_imui_geometry_rounded_rect(xpl_imui_geometry_t *self, xrect rect, float corner_r, float blend_r, uint32_t color);
+void xpl_imui_geometry_line(xpl_imui_geometry_t *self, xvec4 line, float width, float blend_r, uint32_t color);
+void xpl_imui_geometry_triangle(xpl_imui_geometry_t *self, const xvec2 *verts, float blend_r, uint32_t color);
+
+#endif
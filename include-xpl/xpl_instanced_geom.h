@@ -14,6 +14,7 @@
 typedef struct xpl_instanced_geom {
 	xpl_vao_t *vao;
 	xpl_bo_t *vbo;
+	xpl_bo_t *instance_vbo; // per-instance attributes, rewritten each frame
 	xpl_bo_t *ibo;
 	xpl_bo_t *ubo;
 } xpl_instanced_geom_t;
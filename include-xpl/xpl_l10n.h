@@ -23,4 +23,7 @@ void xpl_l10n_set_fallback_locale(const char *locale);
 
 const char * xpl_l10n_get(const char *key);
 
+// Number of consecutive keys <prefix>_0, <prefix>_1, ... that exist.
+int xpl_l10n_family_count(const char *key_prefix);
+
 #endif
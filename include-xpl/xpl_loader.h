@@ -0,0 +1,42 @@
+//
+//  xpl_loader.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-23.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_loader_h
+#define app_xpl_loader_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "xpl_file.h"
+
+// Runs on a worker thread with the resource mapped. Must not touch GL.
+// Returns the decoded result, or NULL if decoding failed.
+typedef void *(*xpl_loader_decode_func)(const char *resource, const xpl_file_mapping_t *source, void *context);
+
+// Runs on the primary thread from xpl_loader_poll; upload to GL here. Owns result,
+// which is NULL if the resource couldn't be read or decoded.
+typedef void (*xpl_loader_complete_func)(const char *resource, void *result, void *context);
+
+// Primary thread only. Decodes run as xpl_task jobs; without task workers,
+// requests complete synchronously.
+void xpl_loader_init(void);
+void xpl_loader_shutdown(void);
+
+void xpl_loader_request(const char *resource, xpl_loader_decode_func decode, xpl_loader_complete_func complete, void *context);
+
+// Requests that haven't completed yet.
+size_t xpl_loader_pending(void);
+
+// Runs completions for decoded requests until budget (in seconds) is spent; a budget
+// of 0 runs all that are ready. Returns the number completed.
+size_t xpl_loader_poll(double budget);
+
+// Blocks until all outstanding requests have completed.
+void xpl_loader_finish(void);
+
+#endif
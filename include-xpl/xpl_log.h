@@ -9,6 +9,8 @@
 #ifndef xpl_osx_log_h
 #define xpl_osx_log_h
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "xpl_platform.h"
@@ -34,7 +36,6 @@
 
 #define LOG_ANSI
 
-#include <libgen.h>
 #if defined(XPL_PLATFORM_OSX) || defined(XPL_PLATFORM_IOS) || defined(XPL_PLATFORM_WINDOWS)
 # undef LOG_ANSI
 #endif
@@ -42,6 +43,10 @@
 #if defined(XPL_PLATFORM_UNIX) || defined(XPL_PLATFORM_OSX) || defined(XPL_PLATFORM_IOS)
 # define XPL_STDERR stderr
 # define XPL_STDOUT stdout
+#else
+/* MinGW points to _iob which the IDEs don't like; NULL is stdout */
+# define XPL_STDERR NULL
+# define XPL_STDOUT NULL
 #endif
 
 #if !defined(LOG_ANSI)
@@ -116,17 +121,51 @@
 #define XPL_COLOR_txtrst "\033[0m"
 #endif
 
+#define LOG_MAX                         2048
+#define XPL_LOG_LINE_MAX                LOG_MAX
+#define XPL_LOG_ARG_MAX                 16
+
+// The argument layout of a format, worked out once per call site.
+typedef struct xpl_log_signature {
+	int                     arg_count;
+	unsigned char           kinds[XPL_LOG_ARG_MAX];
+	uint16_t                limits[XPL_LOG_ARG_MAX];
+} xpl_log_signature_t;
+
+typedef struct xpl_log_site {
+	const char              *color;
+	const char              *level;
+	const char              *file;
+	const char              *func;
+	int                     line;
+
+	int                     state;
+	const char              *format;
+	xpl_log_signature_t     signature;
+} xpl_log_site_t;
+
+void xpl_log_write(xpl_log_site_t *site, FILE *stream, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// Until started, each line is formatted and written on the calling thread.
+// Once started, calls copy their arguments into a per-thread ring and a
+// background thread formats and writes them. Lines from one thread stay in
+// order; lines from different threads may interleave out of order.
+void xpl_log_async_start(void);
+// Writes out what's queued and stops the background thread. Also run at exit.
+void xpl_log_async_stop(void);
+
+// Prefix lines with the local time, to the millisecond.
+void xpl_log_set_timestamps(bool enabled);
+
+// Lines lost because a thread's ring was full.
+uint64_t xpl_log_dropped(void);
+
 #if (XPL_LOG_LEVEL < XPL_LOG_LEVEL_OFF)
-#define LOG_MAX 2048
-static char __xpl_log_output[LOG_MAX] XPL_UNUSED;
-#	ifdef _WIN32
-/* MinGW points to _iob which the IDEs don't like */
-#		define xpl_log(stream, color, level, file, func, line, ...) \
-			printf("[%s]\t %s %s:%d %s\n", level, xpl_basename(file), func, line, (snprintf(__xpl_log_output, LOG_MAX, __VA_ARGS__), __xpl_log_output)); fflush(stdout)
-#	else
-#		define xpl_log(stream, color, level, file, func, line, ...) \
-			fprintf(stream, "[%s%s%s]\t %s %s:%d %s\n", color, level, XPL_COLOR_txtrst, basename(file), func, line, (snprintf(__xpl_log_output, LOG_MAX, __VA_ARGS__), __xpl_log_output)); fflush(stream)
-#	endif
+#	define xpl_log(stream, color, level, file, func, line, ...) \
+		do { \
+			static xpl_log_site_t __xpl_log_site = { color, level, file, func, line }; \
+			xpl_log_write(&__xpl_log_site, stream, __VA_ARGS__); \
+		} while (0)
 #else
 #define xpl_log(s, c, lv, f, fn, ln, ...)
 #endif
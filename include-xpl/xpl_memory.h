@@ -19,6 +19,10 @@
 #endif
 
 // ----------- tracking allocator -----------
+// 1 tracks every allocation in a table and catches double frees.
+// 2 is the cheap sampling mode: each block carries a small header naming its call
+// site, so per-site counts and live bytes are kept without any table insert.
+// Anything from xpl_alloc has to go back through xpl_free in either mode.
 #ifndef XPL_MEMORY_TRACKING_ALLOCATOR
 #define XPL_MEMORY_TRACKING_ALLOCATOR   0
 #endif
@@ -30,6 +34,21 @@
 #define xpl_realloc(ptr, size)	realloc(ptr, size)
 #define xpl_free(ptr)			free(ptr)
 
+#elif XPL_MEMORY_TRACKING_ALLOCATOR == 2
+
+#define xpl_alloc(size)			xpl_alloc_at(size, __FILE__, __LINE__)
+#define xpl_calloc(size)		xpl_calloc_at(size, __FILE__, __LINE__)
+#define xpl_realloc(ptr, size)	xpl_realloc_at(ptr, size, __FILE__, __LINE__)
+#define xpl_free(ptr)			xpl_free_at(ptr)
+
+void *xpl_alloc_at(size_t size, const char *file, int line);
+void *xpl_calloc_at(size_t size, const char *file, int line);
+void *xpl_realloc_at(void *ptr, size_t size, const char *file, int line);
+void xpl_free_at(void *ptr);
+
+// Logs the call sites with the most live bytes.
+void xpl_memory_log_sites(size_t count);
+
 #else
 // ------ memory management -----------
 void *xpl_alloc(size_t size);
@@ -44,6 +63,62 @@ void *xpl_realloc(void *ptr, size_t size);
 #define xpl_zero_struct(pinstance)	memset(pinstance, 0, sizeof(*pinstance))
 #define xpl_calloc_type(type)		(type *)xpl_calloc(sizeof(type))
 
+// An allocator that containers can be handed instead of the heap. Storage from an
+// arena can't be freed piece by piece, so an arena's free may do nothing.
+typedef struct xpl_allocator {
+    void *(*alloc)(void *context, size_t size);
+    void (*free)(void *context, void *ptr);
+    void *context;
+} xpl_allocator_t;
+
+// ----------- arenas -----------
+// Bump allocation out of large chunks, all given back at once by xpl_arena_reset:
+// for things that live exactly one frame. Not thread safe.
+typedef struct xpl_arena_chunk xpl_arena_chunk_t;
+
+typedef struct xpl_arena {
+    xpl_arena_chunk_t   *chunks;        // newest first
+    size_t              chunk_size;
+    size_t              used;           // in the newest chunk
+    size_t              frame_bytes;    // since the last reset
+    xpl_allocator_t     allocator;      // hands out storage from this arena; free does nothing
+} xpl_arena_t;
+
+xpl_arena_t *xpl_arena_new(size_t chunk_size);
+void xpl_arena_destroy(xpl_arena_t **pparena);
+
+// 16-byte aligned.
+void *xpl_arena_alloc(xpl_arena_t *arena, size_t size);
+void *xpl_arena_calloc(xpl_arena_t *arena, size_t size);
+char *xpl_arena_strdup(xpl_arena_t *arena, const char *str);
+// Invalidates everything allocated since the last reset. If the arena spilled into
+// more chunks, they're merged so the next frame of the same size fits in one.
+void xpl_arena_reset(xpl_arena_t *arena);
+
+#define xpl_arena_alloc_type(arena, type)	(type *)xpl_arena_alloc(arena, sizeof(type))
+
+// ----------- pools -----------
+// Fixed-size objects from blocks of many, recycled through a free list. Not thread safe.
+typedef struct xpl_pool {
+    size_t              object_size;
+    size_t              objects_per_block;
+    void                *free_list;
+    void                *blocks;
+    size_t              live;
+} xpl_pool_t;
+
+xpl_pool_t *xpl_pool_new(size_t object_size, size_t objects_per_block);
+// Frees every object from the pool, live or not.
+void xpl_pool_destroy(xpl_pool_t **pppool);
+
+void *xpl_pool_alloc(xpl_pool_t *pool);
+void *xpl_pool_calloc(xpl_pool_t *pool);
+void xpl_pool_free(xpl_pool_t *pool, void *ptr);
+
+#define xpl_pool_new_type(type, objects_per_block)	xpl_pool_new(sizeof(type), objects_per_block)
+#define xpl_pool_alloc_type(pool, type)				(type *)xpl_pool_alloc(pool)
+#define xpl_pool_calloc_type(pool, type)			(type *)xpl_pool_calloc(pool)
+
 typedef struct xpl_memory_comparison_result {
     int is_different;
     size_t first_difference_offset;
@@ -9,28 +9,22 @@
 #ifndef xpl_osx_xpl_model_loader_h
 #define xpl_osx_xpl_model_loader_h
 
-#include "utarray.h"
+#include <stdint.h>
 
 #include "xpl_vao.h"
 #include "xpl_bo.h"
 #include "xpl_shader.h"
 #include "xpl_vec.h"
 #include "xpl_texture.h"
+#include "xpl_file.h"
 
-#define MAX_VERTEX_COUNT 4
 #define MATERIAL_NAME_SIZE 255
 
-typedef struct xpl_model_face {
-
-	int                     vertex_indices[MAX_VERTEX_COUNT];
-	int                     normal_indices[MAX_VERTEX_COUNT];
-	int                     texture_indices[MAX_VERTEX_COUNT];
-	int                     vertex_count;
-	int                     material_index;
-
-	struct xpl_model_face   *prev;
-	struct xpl_model_face   *next;
-} xpl_model_face_t;
+// Wavefront models load into one deduplicated vertex buffer and a triangle index
+// buffer. The first load writes both, with the materials, to an .xmodel cache
+// beside the .obj; later loads map the cache directly as long as the .obj's
+// mtime and size (or, failing that, its content hash) still match. A changed .mtl
+// on its own doesn't invalidate the cache.
 
 typedef struct xpl_model_material {
 
@@ -46,27 +40,31 @@ typedef struct xpl_model_material {
 	float                   glossiness;
 
 	char                    name[MATERIAL_NAME_SIZE];
+	char                    texture_name[MATERIAL_NAME_SIZE];
 	xpl_texture_t           *texture;
 
 	struct xpl_model_material *prev;
 	struct xpl_model_material *next;
 } xpl_model_material_t;
 
+typedef struct xpl_model_vertex {
+	xvec3                   position;
+	xvec3                   normal;
+	xvec3                   texcoord;
+	int32_t                 material_index;
+} xpl_model_vertex_t;
+
 typedef struct xpl_model {
 
 	xpl_model_material_t    *materials;
 	int                     material_count;
 
-	xpl_model_face_t        *faces;
-	int                     face_count;
-	int                     face_vertex_count;
-
-	UT_array                *vertices; // xvec3
-	int                     vertex_count;
-	UT_array                *normals; // xvec3
-	int                     normal_count;
-	UT_array                *texcoords; // xvec3...
-	int                     texcoord_count;
+	// Either owned, or pointing into the mapped cache.
+	const xpl_model_vertex_t *vertices;
+	uint32_t                vertex_count;
+	const uint16_t          *indices; // triangles
+	uint32_t                index_count;
+	xpl_file_mapping_t      *cache;
 
 	xpl_vao_t               *vao;
 	xpl_bo_t                *vbo;
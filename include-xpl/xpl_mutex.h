@@ -20,4 +20,16 @@ bool xpl_mutex_is_valid(xpl_mutex_t *self);
 bool xpl_mutex_enter(xpl_mutex_t *self);
 bool xpl_mutex_leave(xpl_mutex_t *self);
 
+typedef struct xpl_condition xpl_condition_t;
+
+xpl_condition_t *xpl_condition_new(void);
+void xpl_condition_destroy(xpl_condition_t **ppcondition);
+
+// Releases mutex (which must be held) while waiting, and holds it again on return.
+// A negative timeout (ms) waits indefinitely. Returns false on timeout.
+// Wakeups may be spurious; recheck the condition.
+bool xpl_condition_wait(xpl_condition_t *self, xpl_mutex_t *mutex, int timeout);
+void xpl_condition_signal(xpl_condition_t *self);
+void xpl_condition_broadcast(xpl_condition_t *self);
+
 #endif
@@ -158,6 +158,7 @@ void xpl_create_generic_path(char *path_out, const char *path_in, size_t length)
 
 void xpl_resource_path(char *path_out, const char *path_in, size_t length);
 void xpl_library_resource_path(char *path_out, const char *path_in, size_t length);
+void xpl_dev_resource_path(char *path_out, const char *path_in, size_t length);
 void xpl_data_resource_path(char *path_out, const char *path_in, size_t length);
 int xpl_resolve_resource(char *path_out, const char *path_in, size_t length);
 int xpl_resource_exists(const char *resource_path);
@@ -27,6 +27,8 @@ void xpl_shader_release(xpl_shader_t **ppshader);
 
 int xpl_shaders_init(const char *path_prefix, const char *path_suffix);
 void xpl_shaders_add_directive(const char *define);
+// Recompiles and relinks shaders whose effect files changed on disk. Call once a frame.
+void xpl_shaders_reload_changed(void);
 void xpl_shaders_shutdown(void);
 
 
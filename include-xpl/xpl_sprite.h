@@ -14,6 +14,7 @@
 
 #include "xpl_gl.h"
 #include "xpl_vec.h"
+#include "xpl_sprite_instance.h"
 
 static const int BLEND_FUNCS_PREMULT[] = {
     GL_ONE, GL_ONE_MINUS_SRC_ALPHA,
@@ -45,6 +46,12 @@ void xpl_sprite_batch_destroy(struct xpl_sprite_batch **ppbatch);
 void xpl_sprite_batch_begin(struct xpl_sprite_batch *self);
 void xpl_sprite_batch_end(struct xpl_sprite_batch *self);
 
+// Sprites drawn after this go on the given layer (-128..127, 0 at begin). Lower layers draw first.
+void xpl_sprite_batch_set_layer(struct xpl_sprite_batch *self, int layer);
+
+// The queue as the last xpl_sprite_batch_end built it, vertices and runs included.
+const xpl_sprite_queue_t *xpl_sprite_batch_get_queue(const struct xpl_sprite_batch *self);
+
 xmat4 *xpl_sprite_batch_matrix_push(struct xpl_sprite_batch *self);
 void xpl_sprite_batch_matrix_pop(struct xpl_sprite_batch *self);
 
@@ -55,4 +62,10 @@ void xpl_sprite_draw(struct xpl_sprite *sprite, float x, float y, float width, f
 void xpl_sprite_draw_colored(struct xpl_sprite *sprite, float x, float y, float width, float height, xvec4 color);
 void xpl_sprite_draw_transformed(struct xpl_sprite *sprite, float x, float y, float origin_x, float origin_y, float width, float height, float scale_x, float scale_y, float rotation_rads, xvec4 *color);
 
+// Returns a square, centred instance of the sprite to fill in. Instances are expanded on the GPU
+// and draw before every other sprite in the batch, in the order they were added.
+xpl_sprite_instance_t *xpl_sprite_draw_instance(struct xpl_sprite *sprite);
+// As above, for count consecutive instances.
+xpl_sprite_instance_t *xpl_sprite_draw_instances(struct xpl_sprite *sprite, size_t count);
+
 #endif /* XPL_SPRITE_BATCH_H */
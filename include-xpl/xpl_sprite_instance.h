@@ -0,0 +1,53 @@
+//
+//  xpl_sprite_instance.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-27.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_sprite_instance_h
+#define app_xpl_sprite_instance_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xpl_vec.h"
+#include "xpl_sprite_queue.h"
+
+// Compact per-instance records for square, centred sprites (stars, particles):
+// the vertex shader expands each one into a quad. Doesn't touch GL, and
+// xpl_sprite_instance_expand is the CPU reference for what the shader draws.
+
+typedef struct xpl_sprite_instance {
+	xvec2                       center;
+	float                       size;
+	float                       rotation;       // radians
+	uint32_t                    color;          // RGBA8, as RGBA()
+} xpl_sprite_instance_t;
+
+typedef struct xpl_sprite_instances {
+	xpl_sprite_instance_t       *instances;
+	size_t                      count;
+	size_t                      capacity;
+} xpl_sprite_instances_t;
+
+xpl_sprite_instances_t *xpl_sprite_instances_new(void);
+void xpl_sprite_instances_destroy(xpl_sprite_instances_t **ppinstances);
+
+void xpl_sprite_instances_clear(xpl_sprite_instances_t *self);
+
+// Returns the instance to fill in.
+xpl_sprite_instance_t *xpl_sprite_instances_add(xpl_sprite_instances_t *self);
+// Returns count consecutive instances to fill in.
+xpl_sprite_instance_t *xpl_sprite_instances_extend(xpl_sprite_instances_t *self, size_t count);
+
+// Clamps each channel to 0..1 and rounds to the nearest 8-bit step.
+uint32_t xpl_sprite_instance_pack_color(xvec4 color);
+xvec4 xpl_sprite_instance_unpack_color(uint32_t color);
+
+// The quad the instanced vertex shader draws, in the same vertex order and with
+// the same UVs as a sprite queue quad centred on the instance.
+void xpl_sprite_instance_expand(const xpl_sprite_instance_t *instance, xrect region, xpl_sprite_vertex_t vtx[4]);
+
+#endif
@@ -0,0 +1,105 @@
+//
+//  xpl_sprite_queue.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-26.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_sprite_queue_h
+#define app_xpl_sprite_queue_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xpl_vec.h"
+
+// The CPU half of the sprite batch: collects quads, orders them by a 64-bit
+// state key with a radix sort, and emits their vertices and the runs of quads
+// that share state. Doesn't touch GL.
+
+#define XPL_SPRITE_QUEUE_LAYER_MIN  -128
+#define XPL_SPRITE_QUEUE_LAYER_MAX  127
+
+typedef struct xpl_sprite_vertex {
+	float                       x;
+	float                       y;
+	float                       u;
+	float                       v;
+	xvec4                       color;
+} xpl_sprite_vertex_t;
+
+typedef struct xpl_sprite_quad {
+	uint64_t                    key;
+	xvec2                       pos;
+	xvec2                       origin;
+	xvec2                       size;
+	xvec2                       scale;
+	float                       rot_radians;
+	xvec4                       color;
+	xrect                       region;         // UV
+	int32_t                     prebuilt;       // quad index in prebuilt, or -1
+} xpl_sprite_quad_t;
+
+// A run of quads, in emitted order, that draw with the same state.
+typedef struct xpl_sprite_run {
+	size_t                      first_quad;
+	size_t                      quads;
+	uint32_t                    texture;
+	const int                   *blend_funcs;
+	const xmat4                 *matrix;
+} xpl_sprite_run_t;
+
+typedef struct xpl_sprite_queue {
+	xpl_sprite_quad_t           *quads;
+	size_t                      count;
+	size_t                      capacity;
+	int                         layer;
+
+	// State tables, in order of first use this frame; the key holds the slot.
+	uint32_t                    *textures;
+	size_t                      texture_count;
+	const int                   **blends;
+	size_t                      blend_count;
+	xmat4                       *matrices;
+	size_t                      matrix_count;
+	size_t                      state_capacity;
+
+	// Vertices of quads added already transformed, 4 per quad.
+	xpl_sprite_vertex_t         *prebuilt;
+	size_t                      prebuilt_count;
+	size_t                      prebuilt_capacity;
+
+	// Output of xpl_sprite_queue_build.
+	xpl_sprite_vertex_t         *vertices;      // 4 per quad
+	xpl_sprite_run_t            *runs;
+	size_t                      run_count;
+
+	// Sort scratch.
+	uint64_t                    *sort_keys[2];
+	uint32_t                    *sort_order[2];
+	size_t                      sort_capacity;
+	size_t                      run_capacity;
+	size_t                      vertex_capacity;
+} xpl_sprite_queue_t;
+
+xpl_sprite_queue_t *xpl_sprite_queue_new(void);
+void xpl_sprite_queue_destroy(xpl_sprite_queue_t **ppqueue);
+
+void xpl_sprite_queue_clear(xpl_sprite_queue_t *self);
+
+// Lower layers draw first; within a layer quads group by texture, then blend, then matrix,
+// and otherwise keep the order they were added in.
+void xpl_sprite_queue_set_layer(xpl_sprite_queue_t *self, int layer);
+
+// Returns the quad to fill in; its key is already set.
+xpl_sprite_quad_t *xpl_sprite_queue_add(xpl_sprite_queue_t *self, uint32_t texture, const int *blend_funcs, const xmat4 *matrix);
+
+// As above, but the quad is already transformed: returns its 4 vertices to fill in,
+// in the order xpl_sprite_queue_build emits them.
+xpl_sprite_vertex_t *xpl_sprite_queue_add_vertices(xpl_sprite_queue_t *self, uint32_t texture, const int *blend_funcs, const xmat4 *matrix);
+
+// Sorts the quads and fills in vertices and runs.
+void xpl_sprite_queue_build(xpl_sprite_queue_t *self);
+
+#endif
@@ -9,6 +9,9 @@
 #ifndef app_xpl_sprite_sheet_h
 #define app_xpl_sprite_sheet_h
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "xpl_ivec2.h"
 #include "xpl_irect.h"
 
@@ -19,8 +22,15 @@ struct xpl_sprite_batch;
 typedef struct xpl_sprite_sheet_entry xpl_sprite_sheet_entry_t;
 typedef struct xpl_sprite_sheet xpl_sprite_sheet_t;
 
+// Loads the compiled .xss next to json_resource if there is one, else parses the JSON.
 xpl_sprite_sheet_t *xpl_sprite_sheet_new(struct xpl_sprite_batch *batch, const char *json_resource);
 struct xpl_sprite *xpl_sprite_get(struct xpl_sprite_sheet *sheet, const char *name);
+
+// Sprite IDs are indices into the name-sorted frames; resource_processor.rb generates
+// them as <sheet>_sprites.h. Returns XPL_SPRITE_SHEET_END if there's no such sprite.
+int xpl_sprite_sheet_find(struct xpl_sprite_sheet *sheet, const char *name);
+struct xpl_sprite *xpl_sprite_get_id(struct xpl_sprite_sheet *sheet, int sprite_id);
+bool xpl_sprite_sheet_check_signature(const struct xpl_sprite_sheet *sheet, uint32_t signature);
 void xpl_sprite_sheet_destroy(xpl_sprite_sheet_t **ppsheet);
 
 #endif
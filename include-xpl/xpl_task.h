@@ -0,0 +1,49 @@
+//
+//  xpl_task.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-24.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_task_h
+#define app_xpl_task_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Task scheduler on top of the xpl_thread pool. Each worker owns a work-stealing
+// deque; tasks submitted from a worker go on its own deque, others on a shared
+// queue. Idle workers park until work is submitted.
+
+typedef struct xpl_task xpl_task_t;
+
+typedef void (*xpl_task_function)(void *data);
+typedef void (*xpl_task_range_function)(size_t begin, size_t end, void *data);
+
+// Primary thread only. Assigns worker_count threads from the xpl_thread pool,
+// which must already be initialized.
+void xpl_tasks_init(size_t worker_count);
+void xpl_tasks_shutdown(void);
+bool xpl_tasks_initialized(void);
+size_t xpl_tasks_worker_count(void);
+
+// Creates a task that won't run until it's submitted and its dependencies are done.
+xpl_task_t *xpl_task_new(xpl_task_function func, void *data);
+// task runs after dependency. Call before submitting task.
+void xpl_task_depends(xpl_task_t *task, xpl_task_t *dependency);
+void xpl_task_submit(xpl_task_t *task);
+bool xpl_task_is_done(const xpl_task_t *task);
+// Runs other tasks until task is done.
+void xpl_task_wait(xpl_task_t *task);
+// Drops the caller's reference; the task still runs if submitted.
+void xpl_task_release(xpl_task_t **pptask);
+
+// Convenience: new + submit. Returns a reference the caller must release.
+xpl_task_t *xpl_task_run(xpl_task_function func, void *data);
+
+// Splits [0, count) into chunks of at most grain and runs them across the workers,
+// returning once all are done. Runs inline without workers.
+void xpl_parallel_for(size_t count, size_t grain, xpl_task_range_function func, void *data);
+
+#endif
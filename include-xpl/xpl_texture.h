@@ -29,6 +29,11 @@ xpl_texture_t *xpl_texture_new(void);
 void xpl_texture_destroy(xpl_texture_t **pptexture);
 
 GLuint xpl_texture_load(xpl_texture_t *self, const char *resource_name, bool allow_compress);
+// Starts decoding a texture on the loader workers, so that a later xpl_texture_load
+// of the same resource only has to upload it.
+void xpl_texture_prefetch(const char *resource_name);
+// Drops prefetched textures that were never loaded.
+void xpl_texture_prefetch_purge(void);
 // Loads a null-terminated list of texture resource names into a GL_TEXTURE_2D_ARRAY.
 GLuint xpl_texture_load_array(xpl_texture_t *self, ...);
 
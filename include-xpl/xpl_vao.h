@@ -26,6 +26,9 @@ void xpl_vao_define_vertex_attrib_xvec4(xpl_vao_t *vao, const char *name, xpl_bo
 void xpl_vao_enable_vertex_attrib(xpl_vao_t *vao, const char *name);
 void xpl_vao_disable_vertex_attrib(xpl_vao_t *vao, const char *name);
 
+// Advances the attribute once per divisor instances rather than once per vertex. Desktop GL only.
+void xpl_vao_set_vertex_attrib_divisor(xpl_vao_t *vao, const char *name, GLuint divisor);
+
 // Gets the vertex buffer to make modifications. Buffer info changes appear to be OK to make at any time.
 xpl_vertex_attrib_t *xpl_vao_get_vertex_attrib(xpl_vao_t *vao, const char *name);
 
@@ -31,6 +31,7 @@ typedef struct xpl_vertex_attrib {
 	GLboolean                   normalize;
 	GLsizei                     stride;
 	GLsizei                     offset;
+	GLuint                      divisor;        // 0 per vertex, n per n instances
 
 	// we'll hash by name
 	UT_hash_handle              hh;
@@ -0,0 +1,47 @@
+//
+//  xpl_vfs.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-22.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_xpl_vfs_h
+#define app_xpl_vfs_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "xpl_file.h"
+
+// Pack built by build/scripts/resource_pack_update.rb, read from the app resource path.
+#define XPL_VFS_PACK_RESOURCE "resources.xpk"
+
+// Where an indexed resource lives. Loose files in the app resource path win over
+// the pack, which wins over the library and dev resource paths.
+typedef enum xpl_vfs_location {
+	XPL_VFS_UNINDEXED = -2,     // no index; probe the file system
+	XPL_VFS_NOT_FOUND = -1,     // not in any read-only resource path
+	XPL_VFS_APP_RESOURCE = 0,
+	XPL_VFS_PACK,
+	XPL_VFS_LIBRARY_RESOURCE,
+	XPL_VFS_DEV_RESOURCE
+} xpl_vfs_location_t;
+
+// Scans the read-only resource paths and maps the pack once. Called lazily on first use,
+// but call it from the primary thread before loading from workers.
+void xpl_vfs_init(void);
+void xpl_vfs_shutdown(void);
+// Drops the index so that it is rebuilt on next use (e.g. after adding dev resources).
+void xpl_vfs_invalidate(void);
+
+xpl_vfs_location_t xpl_vfs_locate(const char *resource_name);
+
+// Zero-copy view of a resource: a slice of the pack, or the mapped loose file.
+// Returns NULL if the resource can't be found.
+xpl_file_mapping_t *xpl_vfs_map(const char *resource_name);
+
+// Copies a resource into the buffer, followed by a NUL that isn't counted in its length.
+bool xpl_vfs_get_contents(const char *resource_name, xpl_dynamic_buffer_t *buffer);
+
+#endif
@@ -64,6 +64,8 @@ typedef struct player_local {
 typedef struct player_id {
 	uint16_t	client_id;
 	uint16_t	nonce;
+	uint16_t	room;		// match to join; the server keeps rooms apart
+	uint32_t	cookie;		// the server's hello challenge, echoed back
 	char		name[NAME_SIZE];
 } player_id_t;
 
@@ -120,6 +122,13 @@ typedef struct damage {
 	uint8_t		flags;
 } damage_t;
 
+// A spectator's subscription to a room, repeated every few seconds to keep it.
+typedef struct watch {
+	uint16_t	room;
+	uint16_t	nonce;
+	uint32_t	cookie;		// the server's challenge, echoed back
+} watch_t;
+
 typedef struct game {
 	
 	xvec2		player_position_buffer[MAX_PLAYERS];
@@ -0,0 +1,45 @@
+//
+//  match.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-12.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_match_h
+#define app_match_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game/game.h"
+#include "game/packet.h"
+
+// The changes packets and time make to game, without the audio, particles and
+// UI context_game hangs off them, so headless tools can play a match too.
+// Slot 0 is the local player.
+
+// Returns -1 if the client isn't known and allow_allocate is false.
+int match_player_slot(uint16_t client_id, bool allow_allocate, bool *was_new);
+void match_player_spawn(int i);
+// Pass a negative type to prevent creation.
+int match_projectile_slot(uint16_t pid, int type, bool allow_dead, bool *was_new);
+
+void match_player_join(int i, const player_id_t *id);
+void match_player_leave(int i);
+void match_player_set(int i, const player_t *player);
+void match_projectile_set(int i, uint16_t owner, const projectile_t *projectile);
+// target and projectile may be -1 when they're already gone.
+void match_damage(int origin, int target, int projectile, const damage_t *damage);
+
+// As packet_handle in the client. Hellos addressed to the local player are
+// taken as its welcome, since a capture only holds its own.
+void match_packet_apply(uint16_t client_id, const packet_t *packet);
+
+// Moves by velocity over ticks engine timesteps, carrying the fraction.
+void match_player_move(int i, double ticks);
+void match_projectile_move(int i, double ticks);
+// Once a jiffy. Health kits don't age and armed mines linger at 1 health.
+void match_projectile_age(int i);
+
+#endif
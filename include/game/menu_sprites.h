@@ -0,0 +1,19 @@
+//
+//  menu_sprites.h
+//  app
+//
+//  Generated by resource_processor.rb from menu.json. Do not edit.
+//
+
+#ifndef app_menu_sprites_h
+#define app_menu_sprites_h
+
+#define SPRITE_MENU_SIGNATURE 0x493959dfu
+
+enum menu_sprite {
+	SPRITE_MENU_STAR = 0,
+	SPRITE_MENU_TILE_UP = 1,
+	SPRITE_MENU_COUNT = 2
+};
+
+#endif
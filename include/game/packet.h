@@ -19,9 +19,23 @@ typedef enum packet_type {
 	pt_player,
 	pt_projectile,
 	pt_damage,
-	pt_chat
+	pt_chat,
+	pt_watch
 } packet_type_t;
 
+#define PACKET_TYPE_COUNT (pt_watch + 1)
+
+// Encoded sizes: magic, version, client id, seq and type, then the payload.
+#define PACKET_HEADER_SIZE 10
+#define PACKET_SIZE_MAX (PACKET_HEADER_SIZE + CHAT_MAX)
+
+// The header alone, for relaying a packet without decoding its payload.
+typedef struct packet_header {
+	uint16_t client_source;
+	uint32_t seq;
+	uint8_t type;
+} packet_header_t;
+
 typedef struct packet {
 	uint32_t seq;
 	uint8_t type;
@@ -33,6 +47,7 @@ typedef struct packet {
 		projectile_t	projectile;
 		damage_t		damage;
 		char			chat[CHAT_MAX];
+		watch_t			watch;
 	};
 	
 } packet_t;
@@ -40,4 +55,13 @@ typedef struct packet {
 size_t packet_encode(packet_t *packet, uint16_t client_id, uint8_t *buffer);
 bool packet_decode(packet_t *packet, uint16_t *client_source, uint8_t *buffer);
 
+// Checks the header and that length covers the whole packet of its type.
+bool packet_decode_header(packet_header_t *header, const uint8_t *buffer, size_t length);
+// Rewrites the client id of an encoded packet in place.
+void packet_set_client_source(uint8_t *buffer, uint16_t client_source);
+// The encoded size of a packet of that type, or 0 for an unknown type.
+size_t packet_size(uint8_t type);
+
+const char *packet_type_name(uint8_t type);
+
 #endif
@@ -0,0 +1,22 @@
+//
+//  playfield_sprites.h
+//  app
+//
+//  Generated by resource_processor.rb from playfield.json. Do not edit.
+//
+
+#ifndef app_playfield_sprites_h
+#define app_playfield_sprites_h
+
+#define SPRITE_PLAYFIELD_SIGNATURE 0x145b6164u
+
+enum playfield_sprite {
+	SPRITE_PLAYFIELD_COIN = 0,
+	SPRITE_PLAYFIELD_INDICATOR = 1,
+	SPRITE_PLAYFIELD_PARTICLE = 2,
+	SPRITE_PLAYFIELD_SHIP = 3,
+	SPRITE_PLAYFIELD_STAR = 4,
+	SPRITE_PLAYFIELD_COUNT = 5
+};
+
+#endif
@@ -13,12 +13,18 @@
 
 #include "game/game.h"
 
+#define REPLAY_PATH_SIZE 256
+
 typedef struct prefs {
 	bool skip_tutorial;
 	bool bgm_on;
 	char name[NAME_SIZE];
 	char server[SERVER_SIZE];
 	int port;
+	int room;
+	bool record_replay;             // each session, beside prefs.ini
+	char replay[REPLAY_PATH_SIZE];  // played back instead of connecting
+	bool spectate;                  // watch the room until connecting
 } prefs_t;
 
 void prefs_reset(void);
@@ -0,0 +1,62 @@
+//
+//  replay.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-05.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_replay_h
+#define app_replay_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A capture of the datagrams a client received, or a room broadcast: a
+// header, then each datagram behind a 6-byte record header giving the
+// milliseconds since the capture began and its length. Datagrams are stored
+// as they came off the wire; the rest is in host byte order, which the header
+// says.
+
+#define REPLAY_MAGIC            "UPRP"
+#define REPLAY_VERSION          1
+#define REPLAY_BYTE_ORDER       0x0102
+#define REPLAY_EXTENSION        ".xrp"
+#define REPLAY_DATAGRAM_MAX     1024
+
+typedef struct replay_header {
+	char                    magic[4];
+	uint16_t                version;
+	uint16_t                byte_order;
+	uint16_t                room;
+	uint16_t                reserved;
+	uint32_t                reserved2;
+	uint64_t                start_ms;   // Unix time
+} replay_header_t;
+
+typedef struct replay_record {
+	uint32_t                time_ms;    // since the capture began
+	uint16_t                length;
+} replay_record_t;
+
+typedef struct replay_writer replay_writer_t;
+
+replay_writer_t *replay_writer_new(const char *path, uint16_t room);
+// Closes the capture, deleting it if nothing was written.
+void replay_writer_destroy(replay_writer_t **ppwriter);
+
+// Timestamps with the monotonic clock and flushes about once a second.
+void replay_write(replay_writer_t *writer, const uint8_t *datagram, size_t length);
+
+typedef struct replay_reader replay_reader_t;
+
+replay_reader_t *replay_reader_new(const char *path);
+void replay_reader_destroy(replay_reader_t **ppreader);
+
+const replay_header_t *replay_reader_header(replay_reader_t *reader);
+// Returns false at the end of the capture or on a truncated record.
+// datagram_out holds REPLAY_DATAGRAM_MAX bytes.
+bool replay_reader_next(replay_reader_t *reader, replay_record_t *record_out, uint8_t *datagram_out);
+
+#endif
@@ -41,14 +41,13 @@ extern sprites_t						sprites;
 
 
 #define STAR_LAYERS		3
-#define STARS_PER_LAYER	256
 #define DEBRIS_PER_LAYER 256
 #define STAR_LAYER_SIZE	4096
 
 #define TILE_SIZE		32
 
-extern xivec3							star_layers[STAR_LAYERS][STARS_PER_LAYER];
-
+// Starts decoding the game's textures in the background.
+void sprites_prefetch(void);
 void sprites_init(void);
 void sprites_playfield_render(xpl_context_t *self, xmat4 *ortho);
 void sprites_ui_render(xpl_context_t *self, xmat4 *ortho);
@@ -0,0 +1,30 @@
+//
+//  starfield.h
+//  app
+//
+//  Created by Justin Bowes on 2013-07-28.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_starfield_h
+#define app_starfield_h
+
+#include "xpl_sprite.h"
+
+// The parallax starfield is an endless grid of tiles per layer. Each tile's stars
+// come from an RNG seeded by the layer and tile coordinates, so only the tiles
+// under the camera are ever generated or drawn, and a tile looks the same every
+// time it comes back into view.
+
+#define STARFIELD_TILE_SIZE		512
+#define STARS_PER_TILE			40
+// Tiles kept per layer, on each axis. A view has to stay narrower than this many
+// tiles for its tiles not to evict each other.
+#define STARFIELD_CACHE_SPAN	16
+
+void starfield_init(int seed);
+
+// Draws every star layer, back to front, as instances of the given sprite.
+void starfield_draw(xpl_sprite_t *star_sprite);
+
+#endif
@@ -0,0 +1,36 @@
+//
+//  ui_sprites.h
+//  app
+//
+//  Generated by resource_processor.rb from ui.json. Do not edit.
+//
+
+#ifndef app_ui_sprites_h
+#define app_ui_sprites_h
+
+#define SPRITE_UI_SIGNATURE 0xe38e469du
+
+enum ui_sprite {
+	SPRITE_UI_COIN = 0,
+	SPRITE_UI_FIRE_BUTTON_DARK = 1,
+	SPRITE_UI_FIRE_BUTTON_LIT = 2,
+	SPRITE_UI_KEY_LEFT = 3,
+	SPRITE_UI_KEY_RIGHT = 4,
+	SPRITE_UI_KEY_THRUST = 5,
+	SPRITE_UI_PANEL_BACKGROUND = 6,
+	SPRITE_UI_THRUST_STICK = 7,
+	SPRITE_UI_THRUST_STICK_PEN = 8,
+	SPRITE_UI_TILE_GRID = 9,
+	SPRITE_UI_TILE_SOLID = 10,
+	SPRITE_UI_WEAPON_0 = 11,
+	SPRITE_UI_WEAPON_1 = 12,
+	SPRITE_UI_WEAPON_2 = 13,
+	SPRITE_UI_WEAPON_3 = 14,
+	SPRITE_UI_WEAPON_4 = 15,
+	SPRITE_UI_WEAPON_5 = 16,
+	SPRITE_UI_WEAPON_6 = 17,
+	SPRITE_UI_WEAPON_7 = 18,
+	SPRITE_UI_COUNT = 19
+};
+
+#endif
@@ -9,6 +9,9 @@
 #ifndef ld26_util_h
 #define ld26_util_h
 
+#include "xpl_color.h"
+#include "xpl_rand.h"
+
 #include "game/game.h"
 
 XPLINLINE bool position_in_bounds(position_t position, int fudge, position_t min, position_t max) {
@@ -41,6 +44,15 @@ XPLINLINE void position_mod(position_t *pos) {
 	pos->py = pos->py % PLAYFIELD_MAX;
 }
 
+XPLINLINE xvec4 color_variant(uint32_t color, float variance) {
+	xvec4 max = RGBA_F(color);
+	xvec4 min = xvec4_scale(max, 1.0 - variance);
+	return xvec4_set(xpl_frand_range(min.r, max.r),
+					 xpl_frand_range(min.g, max.g),
+					 xpl_frand_range(min.b, max.b),
+					 xpl_frand_range(min.a, max.a));
+}
+
 const char *random_word(const char *key_prefix);
 
 #endif
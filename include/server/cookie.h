@@ -0,0 +1,34 @@
+//
+//  cookie.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-06.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_cookie_h
+#define app_cookie_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "net/udpnet.h"
+
+// Challenge cookies: a keyed digest of the address, its nonce and the time, so
+// a server can tell a returning hello or watch from a spoofed one without
+// having stored anything for the first. A cookie is good for one to two
+// COOKIE_LIFETIMEs; zero means none.
+
+#define COOKIE_LIFETIME         30.0
+
+typedef struct cookie_jar {
+	uint8_t                 secret[16];
+} cookie_jar_t;
+
+// Keys the jar from /dev/urandom, or the clock without it.
+void cookie_jar_init(cookie_jar_t *jar);
+
+uint32_t cookie_make(const cookie_jar_t *jar, const UDPNET_ADDRESS *source, uint16_t nonce, double now);
+bool cookie_check(const cookie_jar_t *jar, const UDPNET_ADDRESS *source, uint16_t nonce, uint32_t cookie, double now);
+
+#endif
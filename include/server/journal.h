@@ -0,0 +1,139 @@
+//
+//  journal.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-01.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_journal_h
+#define app_journal_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game/game.h"
+#include "game/packet.h"
+
+// The server's event journal: a directory of segment files, each a header
+// followed by records. A record is an 8-byte header and a fixed payload for
+// its type (chat text is the one variable payload). Fields are in host byte
+// order; the segment header says which.
+//
+// Segments are sealed when they reach a size or age, optionally gzipped on a
+// background thread, and the oldest are deleted past a retention count.
+
+#define JOURNAL_MAGIC           "UPJL"
+#define JOURNAL_VERSION         2
+#define JOURNAL_BYTE_ORDER      0x0102
+#define JOURNAL_EXTENSION       ".xjl"
+#define JOURNAL_PAYLOAD_MAX     255
+
+typedef enum journal_event_type {
+	je_join = 1,
+	je_delete,
+	je_full,
+	je_hello,
+	je_chat,
+	je_damage,
+	je_send_drop,
+	je_roster,          // a client connected when the segment opened
+	je_type_count
+} journal_event_type_t;
+
+typedef enum journal_delete_reason {
+	jdr_drop,
+	jdr_timeout,
+	jdr_leave           // said hello to another room
+} journal_delete_reason_t;
+
+typedef struct journal_segment_header {
+	char                    magic[4];
+	uint16_t                version;
+	uint16_t                byte_order;
+	uint32_t                sequence;
+	uint32_t                reserved;
+	uint64_t                start_ms;   // Unix time
+} journal_segment_header_t;
+
+typedef struct journal_record {
+	uint32_t                time_ms;    // since the segment started
+	uint16_t                client_id;
+	uint8_t                 type;
+	uint8_t                 length;     // of the payload that follows
+} journal_record_t;
+
+typedef struct journal_join {
+	uint16_t                port;
+	uint16_t                room;
+	char                    address[20];
+} journal_join_t;
+
+typedef struct journal_delete {
+	uint8_t                 reason;
+} journal_delete_t;
+
+typedef struct journal_hello {
+	uint16_t                nonce;
+	char                    name[NAME_SIZE];
+} journal_hello_t;
+
+typedef struct journal_damage {
+	uint16_t                origin;
+	uint16_t                projectile_id;
+	uint8_t                 amount;
+	uint8_t                 flags;
+} journal_damage_t;
+
+typedef struct journal_send_drop {
+	uint16_t                size;
+} journal_send_drop_t;
+
+typedef struct journal_roster {
+	uint16_t                room;
+	char                    name[NAME_SIZE];
+} journal_roster_t;
+
+typedef struct journal journal_t;
+
+typedef void (*journal_segment_function)(journal_t *journal, void *data);
+
+typedef struct journal_config {
+	const char              *directory;
+	const char              *prefix;            // segment names are <prefix>-<date>-<time>-<sequence>.xjl
+	size_t                  max_segment_bytes;
+	double                  max_segment_seconds;
+	int                     keep_segments;      // sealed segments to keep; 0 keeps them all
+	bool                    compress;           // gzip sealed segments
+
+	// Called after a new segment is opened, to restate whatever a reader of
+	// that segment alone would need (je_roster).
+	journal_segment_function segment_opened;
+	void                    *segment_opened_data;
+} journal_config_t;
+
+journal_t *journal_new(const journal_config_t *config);
+void journal_destroy(journal_t **ppjournal);
+
+void journal_write(journal_t *journal, journal_event_type_t type, uint16_t client_id, const void *payload, size_t length);
+
+// Seals the segment when it's too old and flushes once a second. Call it
+// from the server loop even when nothing is happening.
+void journal_tick(journal_t *journal);
+
+const char *journal_event_name(journal_event_type_t type);
+journal_event_type_t journal_event_type(const char *name);
+
+// Reads plain or gzipped segments.
+typedef struct journal_reader journal_reader_t;
+
+journal_reader_t *journal_reader_new(const char *path);
+void journal_reader_destroy(journal_reader_t **ppreader);
+
+const journal_segment_header_t *journal_reader_header(journal_reader_t *reader);
+// Returns false at the end of the segment or on a truncated record. payload_out
+// holds JOURNAL_PAYLOAD_MAX + 1 bytes and is zero-terminated.
+bool journal_reader_next(journal_reader_t *reader, journal_record_t *record_out, uint8_t *payload_out);
+
+#endif
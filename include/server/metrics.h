@@ -0,0 +1,75 @@
+//
+//  metrics.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-02.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_metrics_h
+#define app_metrics_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xpl_platform.h"
+
+// Counters, gauges and fixed-bucket histograms, updated with relaxed atomics
+// so they can be read from the exporter thread while the server runs. Metrics
+// are static structs registered once; series of one family (same name,
+// different labels) are registered one after another.
+
+#define METRICS_BUCKETS_MAX     16
+
+typedef enum metric_type {
+	mt_counter,
+	mt_gauge,
+	mt_histogram
+} metric_type_t;
+
+typedef struct metric {
+	const char              *name;
+	const char              *help;
+	metric_type_t           type;
+	const char              *labels;        // `type="chat"`, or NULL
+	const double            *bounds;        // histogram bucket upper bounds, ascending
+	size_t                  bound_count;
+
+	uint64_t                value;          // counter count, or gauge double bits
+	uint64_t                buckets[METRICS_BUCKETS_MAX + 1];   // the last is +Inf
+	uint64_t                count;
+	uint64_t                sum;            // double bits
+
+	struct metric           *next;
+} metric_t;
+
+void metrics_register(metric_t *metric);
+
+XPLINLINE void metrics_add(metric_t *metric, uint64_t amount) {
+	__atomic_fetch_add(&metric->value, amount, __ATOMIC_RELAXED);
+}
+
+XPLINLINE void metrics_inc(metric_t *metric) {
+	metrics_add(metric, 1);
+}
+
+XPLINLINE void metrics_set(metric_t *metric, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	__atomic_store_n(&metric->value, bits, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(metric_t *metric, double value);
+
+// Prometheus text exposition format, version 0.0.4.
+void metrics_write(FILE *out);
+
+// Serves the metrics over HTTP from a background thread. A number listens on
+// that TCP port on the loopback interface; anything else is a UNIX socket path.
+bool metrics_listen(const char *address);
+void metrics_shutdown(void);
+
+#endif
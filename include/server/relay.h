@@ -0,0 +1,41 @@
+//
+//  relay.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-06.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_relay_h
+#define app_relay_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "net/udpnet.h"
+
+// Fans matches out to spectators so the game server only ever sees one watcher
+// per room. Spectators, and further relays, send pt_watch here just as they
+// would to a game server. The relay watches each room that has viewers from
+// its own upstream socket and passes on what it gets, held back by a delay.
+// It keeps no game state: the game server restates each room every keyframe.
+
+typedef struct relay_config {
+	int                     socket;             // where spectators watch from
+	const char              *upstream_host;     // a game server or another relay
+	int                     upstream_port;
+	double                  delay;              // seconds everything is held back
+	int                     max_watchers;       // across all rooms
+	double                  timeout;            // seconds of silence before a watcher is dropped
+} relay_config_t;
+
+typedef struct relay relay_t;
+
+relay_t *relay_new(const relay_config_t *config);
+void relay_destroy(relay_t **pprelay);
+
+// Both are called from the receiving thread only.
+void relay_dispatch(relay_t *relay, const UDPNET_ADDRESS *source, uint8_t *buffer, size_t length);
+void relay_tick(relay_t *relay);
+
+#endif
@@ -0,0 +1,46 @@
+//
+//  room.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-03.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_room_h
+#define app_room_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "net/udpnet.h"
+#include "server/journal.h"
+
+// Many matches (rooms) served from one socket. The receiving thread decodes
+// each datagram and routes it by source address to the room named in that
+// address's last hello. Every room lives on one worker thread, which owns the
+// room's client table and sends its broadcasts; a new room goes to the worker
+// with the fewest clients.
+
+typedef struct room_host_config {
+	int                     socket;
+	int                     workers;
+	int                     max_rooms;
+	int                     max_room_clients;
+	int                     max_room_watchers;  // spectators or relays, fed coalesced updates
+	double                  timeout;            // seconds of silence before a client is dropped
+	const char              *motd;              // file sent after the welcome line
+	const journal_config_t  *journal;           // NULL to run without one
+	const char              *replay_directory;  // records every room's broadcasts; NULL not to
+} room_host_config_t;
+
+typedef struct room_host room_host_t;
+
+room_host_t *room_host_new(const room_host_config_t *config);
+void room_host_destroy(room_host_t **pphost);
+
+// Both are called from the receiving thread only.
+void room_host_dispatch(room_host_t *host, const UDPNET_ADDRESS *source, uint8_t *buffer, size_t length);
+void room_host_tick(room_host_t *host);
+
+#endif
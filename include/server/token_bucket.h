@@ -0,0 +1,44 @@
+//
+//  token_bucket.h
+//  app
+//
+//  Created by Justin Bowes on 2013-08-04.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#ifndef app_token_bucket_h
+#define app_token_bucket_h
+
+#include <stdbool.h>
+
+#include "xpl_platform.h"
+
+// A bucket holds up to burst tokens and refills at rate tokens a second;
+// each packet takes one. Rate and burst live with the caller so a table of
+// limits can be shared by every bucket of a kind.
+
+typedef struct token_bucket_limit {
+	double                  rate;
+	double                  burst;
+} token_bucket_limit_t;
+
+typedef struct token_bucket {
+	double                  tokens;
+	double                  last_time;
+} token_bucket_t;
+
+XPLINLINE void token_bucket_init(token_bucket_t *bucket, const token_bucket_limit_t *limit, double now) {
+	bucket->tokens = limit->burst;
+	bucket->last_time = now;
+}
+
+XPLINLINE bool token_bucket_take(token_bucket_t *bucket, const token_bucket_limit_t *limit, double now) {
+	double tokens = bucket->tokens + (now - bucket->last_time) * limit->rate;
+	bucket->tokens = tokens < limit->burst ? tokens : limit->burst;
+	bucket->last_time = now;
+	if (bucket->tokens < 1.0) return false;
+	bucket->tokens -= 1.0;
+	return true;
+}
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ * packet_bench_main.c - Packet encoding and loopback relay benchmarks
+ * usage: packet_bench [-i iterations] [-f fuzz cases] [-c clients] [-r rounds]
+ *                     [-w workers] [-p relay port] [-s seed]
+ *
+ * Three parts, run in order:
+ *  - codec: packet_encode, packet_decode_header and packet_decode per packet
+ *    type, timed over the same randomly filled packets each run. Reports
+ *    ns per call and MB/s of encoded packets.
+ *  - fuzz: random packets of every type must survive encode, decode and
+ *    encode again byte for byte. Truncated packets must fail
+ *    packet_decode_header. Random and mutated bytes must not crash the
+ *    decoder, and anything packet_decode_header passes must decode.
+ *  - relay: clients on loopback sockets join one room of a room_host_t,
+ *    cookie challenge and all, then each send a player packet per round.
+ *    Everything reaching the host's socket goes through room_host_dispatch,
+ *    so routing, token buckets, the worker queues and broadcast_buffer are
+ *    all on the path. Reports dispatch cost per datagram, how long each
+ *    round took to reach every client, and anything lost.
+ * Exits with failure if the fuzz finds a mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xpl.h"
+
+#include "game/game.h"
+#include "game/packet.h"
+
+#include "net/udpnet.h"
+#include "server/room.h"
+
+#define CODEC_PACKETS       256         // distinct packets cycled through per type
+#define RELAY_CLIENTS_MAX   256
+#define RELAY_ROOM          1
+#define RELAY_DATAGRAM_MAX  1024        // joining clients get snapshots this big
+#define RELAY_JOIN_WAIT     2.0         // seconds for every client to be welcomed
+#define RELAY_WAIT          0.1         // seconds to wait for a round's datagrams
+#define RELAY_ROUND_INTERVAL (1.0 / 60.0) // within the host's player packet limit
+#define RELAY_TIMEOUT       10.0
+
+// Results land here so the compiler can't drop the work.
+static volatile size_t sink;
+
+static unsigned long fuzz_failures;
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-i iterations] [-f fuzz cases] [-c clients] [-r rounds] [-w workers] [-p relay port] [-s seed]\n", program);
+	exit(EXIT_FAILURE);
+}
+
+// xorshift32, so every run sees the same packets for a seed.
+static uint32_t rng_state;
+
+static uint32_t rng_next(void) {
+	uint32_t x = rng_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return rng_state = x;
+}
+
+static void rng_fill(void *bytes, size_t size) {
+	uint8_t *p = bytes;
+	for (size_t i = 0; i < size; ++i) p[i] = (uint8_t)rng_next();
+}
+
+static void packet_randomize(packet_t *packet, uint8_t type) {
+	memset(packet, 0, sizeof(*packet));
+	packet->seq = rng_next();
+	packet->type = type;
+	switch (type) {
+		case pt_hello:
+		case pt_goodbye:
+			packet->hello.client_id = (uint16_t)rng_next();
+			packet->hello.nonce = (uint16_t)rng_next();
+			packet->hello.room = (uint16_t)rng_next();
+			packet->hello.cookie = rng_next();
+			rng_fill(packet->hello.name, NAME_SIZE);
+			break;
+
+		case pt_player:
+			packet->player.position.px = (uint16_t)rng_next();
+			packet->player.position.py = (uint16_t)rng_next();
+			packet->player.velocity.dx = (int16_t)rng_next();
+			packet->player.velocity.dy = (int16_t)rng_next();
+			packet->player.score = rng_next();
+			packet->player.orientation = (uint8_t)rng_next();
+			packet->player.health = (uint8_t)rng_next();
+			packet->player.is_thrust = rng_next() & 1;
+			break;
+
+		case pt_projectile:
+			packet->projectile.pid = (uint16_t)rng_next();
+			packet->projectile.position.px = (uint16_t)rng_next();
+			packet->projectile.position.py = (uint16_t)rng_next();
+			packet->projectile.velocity.dx = (int16_t)rng_next();
+			packet->projectile.velocity.dy = (int16_t)rng_next();
+			packet->projectile.orientation = (uint8_t)rng_next();
+			packet->projectile.health = (uint8_t)rng_next();
+			packet->projectile.type = (uint8_t)rng_next();
+			break;
+
+		case pt_damage:
+			packet->damage.player_id = (uint16_t)rng_next();
+			packet->damage.projectile_id = (uint16_t)rng_next();
+			packet->damage.amount = (uint8_t)rng_next();
+			packet->damage.flags = (uint8_t)rng_next();
+			break;
+
+		case pt_chat:
+			rng_fill(packet->chat, CHAT_MAX);
+			break;
+
+		case pt_watch:
+			packet->watch.room = (uint16_t)rng_next();
+			packet->watch.nonce = (uint16_t)rng_next();
+			packet->watch.cookie = rng_next();
+			break;
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Codec
+
+static void bench_codec(long iterations) {
+	static packet_t packets[CODEC_PACKETS];
+	static uint8_t encoded[CODEC_PACKETS][PACKET_SIZE_MAX];
+
+	printf("codec: %ld calls per type\n", iterations);
+	printf("  %-10s %5s %12s %12s %12s %10s\n", "type", "bytes", "encode ns", "header ns", "decode ns", "decode MB/s");
+	for (uint8_t type = 0; type < PACKET_TYPE_COUNT; ++type) {
+		for (int i = 0; i < CODEC_PACKETS; ++i) {
+			packet_randomize(&packets[i], type);
+			packet_encode(&packets[i], (uint16_t)i, encoded[i]);
+		}
+		size_t size = packet_size(type);
+
+		uint8_t buffer[PACKET_SIZE_MAX];
+		size_t total = 0;
+		double start = xpl_get_time();
+		for (long i = 0; i < iterations; ++i) {
+			total += packet_encode(&packets[i % CODEC_PACKETS], (uint16_t)i, buffer);
+		}
+		double encode_time = xpl_get_time() - start;
+
+		packet_header_t header;
+		size_t passed = 0;
+		start = xpl_get_time();
+		for (long i = 0; i < iterations; ++i) {
+			passed += packet_decode_header(&header, encoded[i % CODEC_PACKETS], size);
+		}
+		double header_time = xpl_get_time() - start;
+
+		packet_t packet;
+		uint16_t client_source;
+		size_t decoded = 0;
+		start = xpl_get_time();
+		for (long i = 0; i < iterations; ++i) {
+			decoded += packet_decode(&packet, &client_source, encoded[i % CODEC_PACKETS]);
+		}
+		double decode_time = xpl_get_time() - start;
+		sink = total + passed + decoded + packet.seq;
+
+		printf("  %-10s %5lu %12.1f %12.1f %12.1f %10.1f\n", packet_type_name(type), (unsigned long)size,
+			   encode_time * 1e9 / iterations, header_time * 1e9 / iterations, decode_time * 1e9 / iterations,
+			   decode_time > 0.0 ? size * iterations / decode_time / 1e6 : 0.0);
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Fuzz
+
+static void fuzz_fail(const char *what, uint8_t type, long index) {
+	if (fuzz_failures++ < 10) {
+		fprintf(stderr, "fuzz: %s (type %s, case %ld)\n", what, packet_type_name(type), index);
+	}
+}
+
+static void fuzz_round_trip(long index) {
+	uint8_t type = (uint8_t)(rng_next() % PACKET_TYPE_COUNT);
+	uint16_t client_id = (uint16_t)rng_next();
+	packet_t packet;
+	packet_randomize(&packet, type);
+
+	uint8_t first[PACKET_SIZE_MAX], second[PACKET_SIZE_MAX];
+	size_t size = packet_encode(&packet, client_id, first);
+	if (size != packet_size(type)) {
+		fuzz_fail("encoded size differs from packet_size", type, index);
+		return;
+	}
+
+	packet_header_t header;
+	if (! packet_decode_header(&header, first, size) || header.type != type ||
+		header.seq != packet.seq || header.client_source != client_id) {
+		fuzz_fail("header didn't decode to what was encoded", type, index);
+		return;
+	}
+	size_t short_length = rng_next() % size;
+	if (packet_decode_header(&header, first, short_length)) {
+		fuzz_fail("truncated packet passed the header check", type, index);
+	}
+
+	packet_t decoded;
+	uint16_t client_source;
+	if (! packet_decode(&decoded, &client_source, first) || decoded.type != type ||
+		decoded.seq != packet.seq || client_source != client_id) {
+		fuzz_fail("packet didn't decode to what was encoded", type, index);
+		return;
+	}
+	if (packet_encode(&decoded, client_source, second) != size || memcmp(first, second, size) != 0) {
+		fuzz_fail("re-encoding a decoded packet changed it", type, index);
+	}
+
+	// Flip a few bytes: anything the header check passes must decode.
+	int flips = 1 + rng_next() % 4;
+	for (int i = 0; i < flips; ++i) first[rng_next() % size] ^= (uint8_t)(1 + rng_next() % 255);
+	if (packet_decode_header(&header, first, size) && ! packet_decode(&decoded, &client_source, first)) {
+		fuzz_fail("mutated packet passed the header check but didn't decode", header.type, index);
+	}
+}
+
+// Mostly garbage, with the magic and version kept half the time so the type
+// and length checks see use.
+static void fuzz_garbage(long index, const uint8_t *valid) {
+	uint8_t buffer[PACKET_SIZE_MAX];
+	rng_fill(buffer, sizeof(buffer));
+	if (rng_next() & 1) memcpy(buffer, valid, 3);
+	size_t length = rng_next() % (sizeof(buffer) + 1);
+
+	packet_header_t header;
+	packet_t packet;
+	uint16_t client_source;
+	if (packet_decode_header(&header, buffer, length) && ! packet_decode(&packet, &client_source, buffer)) {
+		fuzz_fail("garbage passed the header check but didn't decode", header.type, index);
+	}
+}
+
+static void bench_fuzz(long cases) {
+	packet_t packet;
+	packet_randomize(&packet, pt_player);
+	uint8_t valid[PACKET_SIZE_MAX];
+	packet_encode(&packet, 1, valid);
+
+	double start = xpl_get_time();
+	for (long i = 0; i < cases; ++i) {
+		fuzz_round_trip(i);
+		fuzz_garbage(i, valid);
+	}
+	double elapsed = xpl_get_time() - start;
+	printf("fuzz:  %ld round trips and %ld garbage packets in %.2f s, %lu failures\n",
+		   cases, cases, elapsed, fuzz_failures);
+}
+
+// ------------------------------------------------------------------------------
+// Relay
+
+typedef struct relay_client {
+	int                     socket;
+	uint16_t                nonce;
+	uint16_t                client_id;      // the room's, once welcomed
+	uint32_t                seq;
+} relay_client_t;
+
+static bool relay_client_send(relay_client_t *client, packet_t *packet, int port) {
+	uint8_t buffer[PACKET_SIZE_MAX];
+	packet->seq = ++client->seq;
+	size_t size = packet_encode(packet, client->client_id, buffer);
+	return udp_send(client->socket, buffer, (int)size, "127.0.0.1", port) == 0;
+}
+
+static void relay_client_hello(relay_client_t *client, uint32_t cookie, int port) {
+	packet_t packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.type = pt_hello;
+	packet.hello.nonce = client->nonce;
+	packet.hello.room = RELAY_ROOM;
+	packet.hello.cookie = cookie;
+	snprintf(packet.hello.name, NAME_SIZE, "bench %u", client->nonce);
+	relay_client_send(client, &packet, port);
+}
+
+// Hands everything waiting on the host's socket to room_host_dispatch, as
+// the server's receive loop does. Returns how many datagrams there were.
+static long relay_pump(room_host_t *host, int sock, double *dispatch_time) {
+	uint8_t buffer[PACKET_SIZE_MAX];
+	UDPNET_ADDRESS source;
+	long dispatched = 0;
+	int n;
+	while ((n = udp_receive(sock, buffer, sizeof(buffer), &source)) > 0) {
+		double start = xpl_get_time();
+		room_host_dispatch(host, &source, buffer, (size_t)n);
+		if (dispatch_time) *dispatch_time += xpl_get_time() - start;
+		++dispatched;
+	}
+	return dispatched;
+}
+
+// Each client joins as the game does: a hello, the host's challenge, the
+// hello again with its cookie, then the welcome with the client id.
+static int relay_join(room_host_t *host, int sock, int port, relay_client_t *clients, int count) {
+	for (int c = 0; c < count; ++c) relay_client_hello(&clients[c], 0, port);
+
+	int joined = 0;
+	double deadline = xpl_get_time() + RELAY_JOIN_WAIT;
+	while (joined < count && xpl_get_time() < deadline) {
+		relay_pump(host, sock, NULL);
+		for (int c = 0; c < count; ++c) {
+			uint8_t buffer[RELAY_DATAGRAM_MAX];
+			UDPNET_ADDRESS source;
+			int n;
+			while ((n = udp_receive(clients[c].socket, buffer, sizeof(buffer), &source)) > 0) {
+				packet_header_t header;
+				packet_t packet;
+				uint16_t client_source;
+				if (! packet_decode_header(&header, buffer, (size_t)n) || header.type != pt_hello ||
+					! packet_decode(&packet, &client_source, buffer) || packet.hello.nonce != clients[c].nonce) continue;
+				if (client_source == 0 && packet.hello.cookie) {
+					relay_client_hello(&clients[c], packet.hello.cookie, port);
+				} else if (client_source && ! clients[c].client_id) {
+					clients[c].client_id = client_source;
+					++joined;
+				}
+			}
+		}
+	}
+	return joined;
+}
+
+// Counts the player packets that reached a client.
+static long relay_receive(relay_client_t *client) {
+	uint8_t buffer[RELAY_DATAGRAM_MAX];
+	UDPNET_ADDRESS source;
+	long received = 0;
+	int n;
+	while ((n = udp_receive(client->socket, buffer, sizeof(buffer), &source)) > 0) {
+		packet_header_t header;
+		if (packet_decode_header(&header, buffer, (size_t)n) && header.type == pt_player) ++received;
+	}
+	return received;
+}
+
+static void bench_relay(int clients, long rounds, int workers, int port) {
+	int sock = udp_create_endpoint(port);
+	if (sock < 0) {
+		fprintf(stderr, "relay: couldn't bind port %d\n", port);
+		return;
+	}
+	room_host_config_t config = {
+		.socket = sock,
+		.workers = workers,
+		.max_rooms = 1,
+		.max_room_clients = clients,
+		.max_room_watchers = 0,
+		.timeout = RELAY_TIMEOUT,
+		.motd = "",
+		.journal = NULL,
+		.replay_directory = NULL
+	};
+	room_host_t *host = room_host_new(&config);
+	if (! host) {
+		fprintf(stderr, "relay: couldn't start the room host\n");
+		udp_close_endpoint(sock);
+		return;
+	}
+
+	relay_client_t relay_clients[RELAY_CLIENTS_MAX];
+	memset(relay_clients, 0, sizeof(relay_clients));
+	for (int c = 0; c < clients; ++c) {
+		relay_clients[c].socket = udp_create_endpoint(0);
+		relay_clients[c].nonce = (uint16_t)(c + 1);
+		if (relay_clients[c].socket < 0) {
+			fprintf(stderr, "relay: couldn't open client socket %d\n", c);
+			clients = c;
+			break;
+		}
+	}
+	if (relay_join(host, sock, port, relay_clients, clients) != clients) {
+		fprintf(stderr, "relay: not every client was welcomed\n");
+		rounds = 0;
+	}
+	// Let the joins' snapshots and notices settle before counting.
+	double settle = xpl_get_time() + RELAY_WAIT;
+	while (xpl_get_time() < settle) {
+		relay_pump(host, sock, NULL);
+		for (int c = 0; c < clients; ++c) relay_receive(&relay_clients[c]);
+	}
+
+	// broadcast_buffer sends to the whole room, the sender included.
+	long per_round = (long)clients * clients;
+	unsigned long sent = 0, dispatched = 0, delivered = 0, expected = 0;
+	double dispatch_time = 0.0, fan_out_time = 0.0, worst_fan_out = 0.0;
+	double start = xpl_get_time();
+	for (long round = 0; round < rounds; ++round) {
+		double wait = start + round * RELAY_ROUND_INTERVAL - xpl_get_time();
+		if (wait > 0.0) usleep((useconds_t)(wait * 1e6));
+
+		for (int c = 0; c < clients; ++c) {
+			packet_t packet;
+			packet_randomize(&packet, pt_player);
+			if (relay_client_send(&relay_clients[c], &packet, port)) ++sent;
+		}
+
+		long pending = per_round;
+		double round_start = xpl_get_time();
+		double deadline = round_start + RELAY_WAIT;
+		while (pending > 0 && xpl_get_time() < deadline) {
+			dispatched += relay_pump(host, sock, &dispatch_time);
+			for (int c = 0; c < clients; ++c) pending -= relay_receive(&relay_clients[c]);
+		}
+		double fan_out = xpl_get_time() - round_start;
+		fan_out_time += fan_out;
+		worst_fan_out = xmax(worst_fan_out, fan_out);
+		delivered += per_round - xmax(pending, 0);
+		expected += per_round;
+
+		room_host_tick(host);
+	}
+	double elapsed = xpl_get_time() - start;
+
+	printf("relay: %d clients in one room on %d workers, %ld rounds in %.2f s\n", clients, workers, rounds, elapsed);
+	printf("  in:   %lu of %lu datagrams, %.0f ns each in room_host_dispatch\n",
+		   dispatched, sent, dispatched ? dispatch_time * 1e9 / dispatched : 0.0);
+	printf("  out:  %.3f ms a round to reach every client (worst %.3f ms), %.0f datagrams a second\n",
+		   rounds ? fan_out_time * 1e3 / rounds : 0.0, worst_fan_out * 1e3,
+		   fan_out_time > 0.0 ? delivered / fan_out_time : 0.0);
+	printf("  lost: %lu of %lu expected at the clients\n", expected - delivered, expected);
+
+	room_host_destroy(&host);
+	for (int c = 0; c < clients; ++c) udp_close_endpoint(relay_clients[c].socket);
+	udp_close_endpoint(sock);
+}
+
+// ------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+	long iterations = 2000000;
+	long fuzz_cases = 200000;
+	int clients = 32;
+	long rounds = 300;
+	int workers = 2;
+	int port = 47111;
+	uint32_t seed = 0x5eed1234;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:f:c:r:w:p:s:")) != -1) {
+		switch (opt) {
+			case 'i': iterations = atol(optarg); break;
+			case 'f': fuzz_cases = atol(optarg); break;
+			case 'c': clients = atoi(optarg); break;
+			case 'r': rounds = atol(optarg); break;
+			case 'w': workers = atoi(optarg); break;
+			case 'p': port = atoi(optarg); break;
+			case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind != argc || iterations < 1 || fuzz_cases < 0 || clients < 2 ||
+		clients > RELAY_CLIENTS_MAX || rounds < 0 || workers < 1 || port <= 0 || ! seed) {
+		usage(argv[0]);
+	}
+
+	xpl_init_timer();
+	udp_socket_init();
+	rng_state = seed;
+
+	bench_codec(iterations);
+	bench_fuzz(fuzz_cases);
+	if (rounds) bench_relay(clients, rounds, workers, port);
+
+	udp_socket_exit();
+	return fuzz_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+/*
+ * render_bench_main.c - Headless playfield render path
+ * usage: render_bench [frames] [resource root]
+ *
+ * Runs the sprite half of context_game's render (sprites_playfield_render and
+ * sprites_ui_render) against the recording GL backend, over a scripted match:
+ * the same players, projectiles and particles every run, moving the same way.
+ * Reports CPU submission time and what reached GL per frame. The resource
+ * root is a directory laid out like dist (resources/bitmaps, resources/shaders).
+ * Names and text particles need FreeType and aren't drawn.
+ */
+#include "xpl_gl.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xpl.h"
+#include "xpl_context.h"
+#include "xpl_gl_record.h"
+#include "xpl_shader.h"
+#include "xpl_vfs.h"
+
+#include "game/camera.h"
+#include "game/game.h"
+#include "game/sprites.h"
+#include "game/starfield.h"
+
+#define DEFAULT_FRAMES          600
+#define SCREEN_WIDTH            1024
+#define SCREEN_HEIGHT           768
+#define BENCH_PLAYERS           32
+#define BENCH_PROJECTILES       1024
+#define BENCH_PARTICLES         2048
+#define BENCH_SEED              1
+
+// context_game owns these in the client.
+game_t game;
+
+static unsigned int lcg(unsigned int *seed) {
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed;
+}
+
+static void match_init(void) {
+	unsigned int seed = BENCH_SEED;
+	memset(&game, 0, sizeof(game));
+	game.indicators_on = true;
+
+	for (int i = 0; i < BENCH_PLAYERS; ++i) {
+		game.player_connected[i] = true;
+		game.player_local[i].visible = true;
+		game.player[i].position.px = lcg(&seed) % PLAYFIELD_MAX;
+		game.player[i].position.py = lcg(&seed) % PLAYFIELD_MAX;
+		game.player[i].velocity.dx = (int16_t)(lcg(&seed) % 512) - 256;
+		game.player[i].velocity.dy = (int16_t)(lcg(&seed) % 512) - 256;
+		game.player[i].health = 255;
+		game.player[i].score = lcg(&seed) % 1000;
+	}
+
+	for (int i = 0; i < BENCH_PROJECTILES; ++i) {
+		game.projectile[i].health = 1;
+		game.projectile[i].type = 0;
+		game.projectile[i].velocity.dx = (int16_t)(lcg(&seed) % 2048) - 1024;
+		game.projectile[i].velocity.dy = (int16_t)(lcg(&seed) % 2048) - 1024;
+		game.projectile_local[i].color = xvec4_set(1.f, 0.8f, 0.2f, 1.f);
+	}
+
+	for (int i = 0; i < BENCH_PARTICLES; ++i) {
+		game.particle[i].size = 2.f + (float)(lcg(&seed) % 6);
+		game.particle[i].color = xvec4_set(1.f, 0.5f, 0.f, 0.8f);
+		game.particle[i].velocity = xvec2_set((float)(lcg(&seed) % 200) - 100.f, (float)(lcg(&seed) % 200) - 100.f);
+	}
+	for (int i = BENCH_PARTICLES; i < MAX_PARTICLES; ++i) {
+		game.particle[i].life = -1.f;
+	}
+}
+
+// Everything is a pure function of the frame, so any frame can be rendered alone.
+static void match_step(int frame) {
+	const float t = (float)frame / 60.f;
+
+	// The local player flies a slow loop; the rest drift and wrap.
+	game.player[0].position.px = (uint16_t)(PLAYFIELD_MAX / 2 + cosf(t * 0.5f) * 1200.f);
+	game.player[0].position.py = (uint16_t)(PLAYFIELD_MAX / 2 + sinf(t * 0.5f) * 1200.f);
+	game.player[0].orientation = (uint8_t)(frame * 2);
+	for (int i = 1; i < BENCH_PLAYERS; ++i) {
+		game.player[i].position.px = (uint16_t)((game.player[i].position.px + game.player[i].velocity.dx / 64) % PLAYFIELD_MAX);
+		game.player[i].position.py = (uint16_t)((game.player[i].position.py + game.player[i].velocity.dy / 64) % PLAYFIELD_MAX);
+		game.player[i].orientation = (uint8_t)(i * 8 + frame);
+	}
+
+	// Projectiles stream out of the players around the camera.
+	for (int i = 0; i < BENCH_PROJECTILES; ++i) {
+		const player_t *owner = &game.player[i % BENCH_PLAYERS];
+		const int age = (frame + i * 7) % 90;
+		game.projectile[i].position.px = (uint16_t)((owner->position.px + game.projectile[i].velocity.dx * age / 128) % PLAYFIELD_MAX);
+		game.projectile[i].position.py = (uint16_t)((owner->position.py + game.projectile[i].velocity.dy * age / 128) % PLAYFIELD_MAX);
+		game.projectile[i].orientation = (uint8_t)(age * 3);
+	}
+
+	// Exhaust and debris trail the local player.
+	for (int i = 0; i < BENCH_PARTICLES; ++i) {
+		const float age = (float)((frame + i) % 60) / 60.f;
+		game.particle[i].life = 1.f - age;
+		game.particle[i].position.px = (uint16_t)(game.player[0].position.px + game.particle[i].velocity.x * age * 4.f);
+		game.particle[i].position.py = (uint16_t)(game.player[0].position.py + game.particle[i].velocity.y * age * 4.f);
+		game.particle[i].orientation = age * 6.28f;
+	}
+
+	game.fire_cooldown = frame % 32;
+	game.active_weapon = (frame / 120) % 4;
+
+	camera_calculate_center(&game.player[0].position, 0, 0);
+}
+
+// As game_render does for the sprite layers.
+static void render(xpl_context_t *self) {
+	float width = (self->size.width <= 800 ? 800 : self->size.width);
+	float height = ((float)self->size.height / self->size.width) * width;
+	xmat4 ortho;
+	xmat4_ortho(0.f, width, 0.f, height, -1.f, 1.f, &ortho);
+
+	glClearColor(0.f, 0.f, 0.f, 1.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glEnable(GL_BLEND);
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(camera.dc.x, camera.dc.y, camera.dc.width, camera.dc.height);
+	sprites_playfield_render(self, &ortho);
+	glDisable(GL_SCISSOR_TEST);
+
+	xmat4_ortho(0.f, self->size.width, 0.f, self->size.height, -1.f, 1.f, &ortho);
+	sprites_ui_render(self, &ortho);
+}
+
+int main(int argc, char *argv[]) {
+	int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+	if (frames <= 0) frames = DEFAULT_FRAMES;
+	if (argc > 2 && chdir(argv[2]) != 0) {
+		fprintf(stderr, "Couldn't change to resource root %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	if (! xpl_gl_record_install()) return EXIT_FAILURE;
+	xpl_init_timer();
+	xpl_vfs_init();
+
+	xpl_context_t context;
+	memset(&context, 0, sizeof(context));
+	context.size = xivec2_set(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+	// Same layout as game_init.
+	camera.dc = xirect_set(0, 0, context.size.width, context.size.height);
+	camera.dc.y += (TILE_SIZE + 40);
+	camera.dc.height -= (TILE_SIZE + 40);
+	camera.draw_area = camera.dc;
+
+	double load_start = xpl_get_time();
+	xpl_shaders_init("shaders/", ".glsl");
+	srand(BENCH_SEED);
+	sprites_init();
+	starfield_init(BENCH_SEED); // sprites_init seeds it from the clock
+	match_init();
+	double load_time = xpl_get_time() - load_start;
+
+	xpl_gl_record_stats_t load;
+	xpl_gl_record_totals(&load, NULL);
+
+	match_step(0);
+	render(&context); // warm up caches and buffers
+
+	xpl_gl_record_stats_t frame_stats, run, peak;
+	memset(&run, 0, sizeof(run));
+	memset(&peak, 0, sizeof(peak));
+	double submit_time = 0.0, worst_submit = 0.0;
+	for (int f = 0; f < frames; ++f) {
+		match_step(f);
+
+		xpl_gl_record_frame_begin();
+		double start = xpl_get_time();
+		render(&context);
+		double elapsed = xpl_get_time() - start;
+		xpl_gl_record_frame_end(&frame_stats);
+
+		submit_time += elapsed;
+		worst_submit = xmax(worst_submit, elapsed);
+		xpl_gl_record_stats_add(&run, &frame_stats);
+		peak.draw_calls = xmax(peak.draw_calls, frame_stats.draw_calls);
+		peak.buffer_upload_bytes = xmax(peak.buffer_upload_bytes, frame_stats.buffer_upload_bytes);
+	}
+
+	printf("load: %.1f ms, %lu shader compiles, %lu texture uploads (%.1f KB)\n",
+		   load_time * 1e3, (unsigned long)load.shader_compiles, (unsigned long)load.texture_uploads,
+		   load.texture_upload_bytes / 1024.0);
+	printf("%d frames at %dx%d, %d players, %d projectiles, %d particles\n",
+		   frames, SCREEN_WIDTH, SCREEN_HEIGHT, BENCH_PLAYERS, BENCH_PROJECTILES, BENCH_PARTICLES);
+	printf("submit: %8.3f ms/frame (worst %.3f ms)\n", submit_time * 1e3 / frames, worst_submit * 1e3);
+	printf("draws:  %8.1f /frame (peak %lu, %.1f instanced), %.0f vertices, %.0f instances\n",
+		   (double)run.draw_calls / frames, (unsigned long)peak.draw_calls,
+		   (double)run.instanced_draw_calls / frames,
+		   (double)run.vertices / frames, (double)run.instances / frames);
+	printf("state:  %8.1f changes/frame, %.1f redundant binds, %.1f program binds, %.1f texture binds, %.1f uniforms\n",
+		   (double)run.state_changes / frames, (double)run.redundant_binds / frames,
+		   (double)run.program_binds / frames, (double)run.texture_binds / frames,
+		   (double)run.uniform_updates / frames);
+	printf("upload: %8.1f KB/frame in %.1f calls (peak %.1f KB), %.1f MB/s at 60 fps\n",
+		   run.buffer_upload_bytes / 1024.0 / frames, (double)run.buffer_uploads / frames,
+		   peak.buffer_upload_bytes / 1024.0, run.buffer_upload_bytes * 60.0 / frames / (1024.0 * 1024.0));
+
+	xpl_shaders_shutdown();
+	xpl_vfs_shutdown();
+	return EXIT_SUCCESS;
+}
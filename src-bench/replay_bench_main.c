@@ -0,0 +1,150 @@
+/*
+ * replay_bench_main.c - Headless replay playback
+ * usage: replay_bench [-f] <replay>
+ *
+ * Plays a recorded match back a jiffy at a time, at 1x or (with -f) as fast
+ * as it will go. Each datagram goes through packet_decode and
+ * match_packet_apply, then ships and projectiles move and age through the
+ * match calls game_engine makes. Reports decode and step cost per frame.
+ * Audio, particles and drawing are left out; render_bench covers drawing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xpl.h"
+
+#include "game/game.h"
+#include "game/match.h"
+#include "game/packet.h"
+#include "game/replay.h"
+
+#define JIFFY               (1.0 / 60.0)
+
+// context_game owns this in the client.
+game_t game;
+
+static unsigned long packet_counts[PACKET_TYPE_COUNT];
+static unsigned long decode_failures;
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-f] <replay>\n", program);
+	exit(EXIT_FAILURE);
+}
+
+static void datagram_apply(uint8_t *buffer, size_t length) {
+	size_t offset = 0;
+	while (offset < length) {
+		packet_header_t header;
+		uint16_t client_id;
+		packet_t packet;
+		if (! packet_decode_header(&header, buffer + offset, length - offset) ||
+			! packet_decode(&packet, &client_id, buffer + offset)) {
+			++decode_failures;
+			return;
+		}
+		++packet_counts[header.type];
+		match_packet_apply(client_id, &packet);
+		offset += packet_size(header.type);
+	}
+}
+
+// One jiffy of game_engine, less what only concerns the local player.
+static void match_step(void) {
+	for (int i = 0; i < MAX_PROJECTILES; ++i) {
+		if (! game.projectile[i].health) continue;
+		match_projectile_move(i, 1.0);
+		match_projectile_age(i);
+	}
+	for (int i = 1; i < MAX_PLAYERS; ++i) {
+		if (game.player_connected[i]) match_player_move(i, 1.0);
+	}
+}
+
+static void match_count(int *players, int *projectiles) {
+	*players = 0;
+	*projectiles = 0;
+	for (int i = 1; i < MAX_PLAYERS; ++i) {
+		if (game.player_connected[i]) ++*players;
+	}
+	for (int i = 0; i < MAX_PROJECTILES; ++i) {
+		if (game.projectile[i].health) ++*projectiles;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	bool fast = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "f")) != -1) {
+		switch (opt) {
+			case 'f': fast = true; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1) usage(argv[0]);
+
+	xpl_init_timer();
+	replay_reader_t *reader = replay_reader_new(argv[optind]);
+	if (! reader) return EXIT_FAILURE;
+	memset(&game, 0, sizeof(game));
+	// Stands in for whoever made the capture, as in a connected client.
+	game.player_connected[0] = true;
+
+	replay_record_t record;
+	uint8_t datagram[REPLAY_DATAGRAM_MAX];
+	unsigned long datagrams = 0;
+	bool more = replay_reader_next(reader, &record, datagram);
+
+	long frames = 0;
+	int peak_players = 0, peak_projectiles = 0;
+	double decode_time = 0.0, step_time = 0.0, worst_frame = 0.0;
+	double start = xpl_get_time();
+	while (more) {
+		double frame_end_ms = (frames + 1) * JIFFY * 1000.0;
+
+		double frame_start = xpl_get_time();
+		while (more && record.time_ms <= frame_end_ms) {
+			datagram_apply(datagram, record.length);
+			++datagrams;
+			more = replay_reader_next(reader, &record, datagram);
+		}
+		double decoded = xpl_get_time();
+		match_step();
+		double stepped = xpl_get_time();
+
+		decode_time += decoded - frame_start;
+		step_time += stepped - decoded;
+		worst_frame = xmax(worst_frame, stepped - frame_start);
+		++frames;
+
+		int players, projectiles;
+		match_count(&players, &projectiles);
+		peak_players = xmax(peak_players, players);
+		peak_projectiles = xmax(peak_projectiles, projectiles);
+
+		if (! fast) {
+			double wait = start + frames * JIFFY - xpl_get_time();
+			if (wait > 0.0) usleep((useconds_t)(wait * 1e6));
+		}
+	}
+	double wall_time = xpl_get_time() - start;
+
+	unsigned long packets = 0;
+	for (int t = 0; t < PACKET_TYPE_COUNT; ++t) packets += packet_counts[t];
+	if (! frames) frames = 1;
+
+	printf("replay: room %u, %.1f s in %ld frames, %lu datagrams, %lu packets (%lu didn't decode)\n",
+		   replay_reader_header(reader)->room, frames * JIFFY, frames, datagrams, packets, decode_failures);
+	printf("packets:");
+	for (int t = 0; t < PACKET_TYPE_COUNT; ++t) printf(" %s %lu", packet_type_name(t), packet_counts[t]);
+	printf("\n");
+	printf("peak:   %d players, %d projectiles\n", peak_players, peak_projectiles);
+	printf("decode: %8.3f us/frame, %.0f ns/packet\n",
+		   decode_time * 1e6 / frames, packets ? decode_time * 1e9 / packets : 0.0);
+	printf("step:   %8.3f us/frame (worst frame %.3f us)\n", step_time * 1e6 / frames, worst_frame * 1e6);
+	printf("wall:   %.2f s (%.1fx)\n", wall_time, wall_time > 0.0 ? frames * JIFFY / wall_time : 0.0);
+
+	replay_reader_destroy(&reader);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+/*
+ * sprite_bench_main.c - Headless sprite queue throughput
+ * usage: sprite_bench [frames] [resource root]
+ *
+ * Queues a frame shaped like the playfield (starfield, particles and
+ * projectiles across a few textures and blend modes), then times sorting
+ * and vertex emission, and packing the same sprites as instances for the
+ * instanced path. No GL context is needed.
+ *
+ * First it checks xpl_sprite_instance_expand, which the instanced shader and
+ * the ES2 fallback follow, against what xpl_sprite_draw_transformed queues for
+ * the same sprites, and exits non-zero if they differ. The check runs the
+ * sprite batch on the recording GL backend, so it needs a resource root laid
+ * out like dist (resources/bitmaps, resources/shaders).
+ */
+#include "xpl_gl.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "xpl.h"
+#include "xpl_color.h"
+#include "xpl_gl_record.h"
+#include "xpl_shader.h"
+#include "xpl_sprite.h"
+#include "xpl_sprite_queue.h"
+#include "xpl_sprite_instance.h"
+#include "xpl_vfs.h"
+
+#include "game/game.h"
+
+// About what the playfield shows; game/sprites.h and game/starfield.h need GL.
+#define STAR_LAYERS         3
+#define STARS_PER_LAYER     256
+#define DEFAULT_FRAMES      200
+
+#define CHECK_TEXTURE       "playfield.png"
+#define CHECK_SPRITES       4096
+#define CHECK_SEED          1
+// emit_quad and the expansion round differently; a thousandth of a pixel or UV is plenty.
+#define CHECK_TOLERANCE     1e-3f
+
+static const int BLEND_PREMULT[] = { 1, 2, 3, 4 };
+static const int BLEND_ADD[] = { 5, 6, 7, 8 };
+
+static void queue_frame(xpl_sprite_queue_t *queue, const xmat4 *ortho, unsigned int seed) {
+	static const xvec4 white = {{ 1.f, 1.f, 1.f, 1.f }};
+	xpl_sprite_queue_clear(queue);
+
+	// Stars, particles and projectiles interleave the way the game submits them.
+	for (int i = 0; i < STAR_LAYERS * STARS_PER_LAYER + MAX_PARTICLES + MAX_PROJECTILES; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		uint32_t texture = 1 + (seed >> 28) % 3;
+		const int *blend = (seed >> 20) & 1 ? BLEND_ADD : BLEND_PREMULT;
+
+		xpl_sprite_quad_t *quad = xpl_sprite_queue_add(queue, texture, blend, ortho);
+		quad->pos = xvec2_set((float)(seed & 0x3ff), (float)((seed >> 10) & 0x3ff));
+		quad->origin = xvec2_set(4.f, 4.f);
+		quad->size = xvec2_set(8.f, 8.f);
+		quad->scale = xvec2_set(1.f, 1.f);
+		quad->rot_radians = (seed & 0x100) ? (float)(seed & 0xff) * 0.0245f : 0.f;
+		quad->color = white;
+		quad->region = xrect_set(0.f, 0.f, 0.25f, 0.25f);
+	}
+}
+
+static void pack_frame(xpl_sprite_instances_t *instances, unsigned int seed) {
+	static const xvec4 white = {{ 1.f, 1.f, 1.f, 1.f }};
+	xpl_sprite_instances_clear(instances);
+
+	for (int i = 0; i < STAR_LAYERS * STARS_PER_LAYER + MAX_PARTICLES + MAX_PROJECTILES; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+
+		xpl_sprite_instance_t *instance = xpl_sprite_instances_add(instances);
+		instance->center = xvec2_set((float)(seed & 0x3ff) + 4.f, (float)((seed >> 10) & 0x3ff) + 4.f);
+		instance->size = 8.f;
+		instance->rotation = (seed & 0x100) ? (float)(seed & 0xff) * 0.0245f : 0.f;
+		instance->color = xpl_sprite_instance_pack_color(white);
+	}
+}
+
+static int vertex_matches(const xpl_sprite_vertex_t *a, const xpl_sprite_vertex_t *b) {
+	return (fabsf(a->x - b->x) <= CHECK_TOLERANCE && fabsf(a->y - b->y) <= CHECK_TOLERANCE &&
+			fabsf(a->u - b->u) <= CHECK_TOLERANCE && fabsf(a->v - b->v) <= CHECK_TOLERANCE &&
+			fabsf(a->color.r - b->color.r) <= CHECK_TOLERANCE && fabsf(a->color.g - b->color.g) <= CHECK_TOLERANCE &&
+			fabsf(a->color.b - b->color.b) <= CHECK_TOLERANCE && fabsf(a->color.a - b->color.a) <= CHECK_TOLERANCE);
+}
+
+// Draws a seeded instance stream through the ordinary sprite path, one centred quad per
+// instance, and compares the queued vertices with the expanded instances.
+static int check_instance_expand(void) {
+	static const xrect full = {{ 0.f, 0.f, 1.f, 1.f }};
+
+	xpl_sprite_batch_t *batch = xpl_sprite_batch_new();
+	xpl_sprite_t *sprite = xpl_sprite_new(batch, CHECK_TEXTURE, NULL);
+	xpl_sprite_instances_t *instances = xpl_sprite_instances_new();
+
+	unsigned int seed = CHECK_SEED;
+	for (int i = 0; i < CHECK_SPRITES; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		xpl_sprite_instance_t *instance = xpl_sprite_instances_add(instances);
+		instance->center = xvec2_set((float)(seed & 0x3ff), (float)((seed >> 10) & 0x3ff));
+		instance->size = 1.f + (float)((seed >> 20) & 0x3f);
+		instance->rotation = (seed & 0x100) ? (float)(seed & 0xff) * 0.0245f : 0.f;
+		instance->color = RGBA(seed >> 24, (seed >> 16) & 0xff, (seed >> 8) & 0xff, 0x80 | (seed & 0x7f));
+	}
+
+	xpl_sprite_batch_begin(batch);
+	for (size_t i = 0; i < instances->count; ++i) {
+		const xpl_sprite_instance_t *instance = &instances->instances[i];
+		const float half = instance->size * 0.5f;
+		xvec4 color = xpl_sprite_instance_unpack_color(instance->color);
+		xpl_sprite_draw_transformed(sprite, instance->center.x - half, instance->center.y - half, half, half,
+									instance->size, instance->size, 1.f, 1.f, instance->rotation, &color);
+	}
+	xpl_sprite_batch_end(batch);
+
+	// One texture, blend and matrix, so the queue keeps the order they were drawn in.
+	const xpl_sprite_queue_t *queue = xpl_sprite_batch_get_queue(batch);
+	int ok = (queue->count == instances->count);
+	if (! ok) printf("check: queued %lu sprites for %lu instances\n", (unsigned long)queue->count, (unsigned long)instances->count);
+	for (size_t i = 0; ok && i < instances->count; ++i) {
+		xpl_sprite_vertex_t expanded[4];
+		xpl_sprite_instance_expand(&instances->instances[i], full, expanded);
+		for (int c = 0; c < 4; ++c) {
+			const xpl_sprite_vertex_t *drawn = &queue->vertices[i * 4 + c];
+			if (vertex_matches(drawn, &expanded[c])) continue;
+			printf("check: instance %lu corner %d expands to (%f, %f) uv (%f, %f), drawn at (%f, %f) uv (%f, %f)\n",
+				   (unsigned long)i, c, expanded[c].x, expanded[c].y, expanded[c].u, expanded[c].v,
+				   drawn->x, drawn->y, drawn->u, drawn->v);
+			ok = 0;
+			break;
+		}
+	}
+	if (ok) printf("check: %lu instances expand to the quads xpl_sprite_draw queues\n", (unsigned long)instances->count);
+
+	xpl_sprite_instances_destroy(&instances);
+	xpl_sprite_destroy(&sprite);
+	xpl_sprite_batch_destroy(&batch);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+	if (frames <= 0) frames = DEFAULT_FRAMES;
+	if (argc > 2 && chdir(argv[2]) != 0) {
+		fprintf(stderr, "Couldn't change to resource root %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	if (! xpl_gl_record_install()) return EXIT_FAILURE;
+	xpl_init_timer();
+	xpl_vfs_init();
+	xpl_shaders_init("shaders/", ".glsl");
+	if (! check_instance_expand()) return EXIT_FAILURE;
+
+	xmat4 ortho;
+	xmat4_ortho(0.f, 1024.f, 0.f, 1024.f, -1.f, 1.f, &ortho);
+
+	xpl_sprite_queue_t *queue = xpl_sprite_queue_new();
+	queue_frame(queue, &ortho, 1);
+	xpl_sprite_queue_build(queue); // warm up
+
+	xpl_sprite_instances_t *instances = xpl_sprite_instances_new();
+	pack_frame(instances, 1);
+
+	double queue_time = 0.0, build_time = 0.0, pack_time = 0.0;
+	size_t quads = 0, runs = 0;
+	for (int f = 0; f < frames; ++f) {
+		double start = xpl_get_time();
+		queue_frame(queue, &ortho, (unsigned int)f);
+		double queued = xpl_get_time();
+		xpl_sprite_queue_build(queue);
+		double built = xpl_get_time();
+		pack_frame(instances, (unsigned int)f);
+		double packed = xpl_get_time();
+
+		queue_time += queued - start;
+		build_time += built - queued;
+		pack_time += packed - built;
+		quads += queue->count;
+		runs += queue->run_count;
+	}
+
+	printf("%d frames, %lu sprites/frame, %.1f runs/frame\n", frames,
+		   (unsigned long)(quads / frames), (double)runs / frames);
+	printf("queue: %8.2f ns/sprite\n", queue_time * 1e9 / quads);
+	printf("build: %8.2f ns/sprite (sort + emit)\n", build_time * 1e9 / quads);
+	printf("total: %8.2f Msprites/s\n", quads / (queue_time + build_time) / 1e6);
+	printf("instanced: %4.2f ns/sprite (pack only, %lu bytes vs %lu)\n", pack_time * 1e9 / quads,
+		   (unsigned long)sizeof(xpl_sprite_instance_t), (unsigned long)(4 * sizeof(xpl_sprite_vertex_t)));
+
+	xpl_sprite_instances_destroy(&instances);
+	xpl_sprite_queue_destroy(&queue);
+	return EXIT_SUCCESS;
+}
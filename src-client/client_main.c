@@ -8,6 +8,9 @@
 #include "xpl_input.h"
 #include "xpl_app.h"
 #include "xpl_thread.h"
+#include "xpl_task.h"
+#include "xpl_loader.h"
+#include "xpl_texture.h"
 #include "xpl_engine_info.h"
 #include "xpl_text_buffer.h"
 #include "xpl_vec.h"
@@ -19,6 +22,9 @@
 #include "context/context_logo.h"
 #include "context/context_game.h"
 
+#define TASK_WORKERS            2
+#define LOADER_FRAME_BUDGET     0.004               // s
+
 static int frame_counter = 0;
 static xpl_context_t *context = NULL;
 static void *context_data;
@@ -64,8 +70,10 @@ static void parse_args(xpl_app_t *app) {
 }
 
 static void init(xpl_app_t *app) {
-    // xpl_threads_init(4, NULL);
+    xpl_threads_init(TASK_WORKERS, NULL);
 	xpl_init_timer();
+	xpl_tasks_init(TASK_WORKERS);
+	xpl_loader_init();
 	xpl_input_init();
 	xpl_shaders_init("shaders/", ".glsl");
 	audio_startup();
@@ -87,7 +95,10 @@ static void destroy(xpl_app_t *app) {
     }
     
 	audio_shutdown();
-    // xpl_threads_shutdown();
+	xpl_texture_prefetch_purge();
+	xpl_loader_shutdown();
+	xpl_tasks_shutdown();
+    xpl_threads_shutdown();
     xpl_shaders_shutdown();
 }
 
@@ -136,6 +147,8 @@ static void main_loop(xpl_app_t *app) {
 
 		// Once per frame regardless of the frame rate.
 		audio_update();
+		xpl_loader_poll(LOADER_FRAME_BUDGET);
+		xpl_shaders_reload_changed();
 
 		while (app->execution_info->remaining_time_to_process >= app->engine_info->timestep) {
 			xpl_context_t *next_context = context->functions.handoff(context, context_data);
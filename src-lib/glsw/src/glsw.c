@@ -362,6 +362,49 @@ void glswClearError(void) {
     gc->ErrorMessage = 0;
 }
 
+static void __glsw__RemoveWhere(glswList** ppList, bstring key, int prefixMatch)
+{
+    while (*ppList)
+    {
+        glswList* pNode = *ppList;
+        if (prefixMatch ? binstr(pNode->Key, 0, key) == 0 : biseq(pNode->Key, key) == 1)
+        {
+            *ppList = pNode->Next;
+            pNode->Next = 0;
+            __glsw__FreeList(pNode);
+        }
+        else
+        {
+            ppList = &pNode->Next;
+        }
+    }
+}
+
+int glswForgetEffect(const char* effectName)
+{
+    glswContext* gc = __glsw__Context;
+    bstring name;
+    bstring sectionPrefix;
+
+    if (!gc)
+    {
+        return 0;
+    }
+
+    // The next glswGetShader for this effect reads the file again.
+    name = bfromcstr(effectName);
+    sectionPrefix = bstrcpy(name);
+    bconchar(sectionPrefix, '.');
+
+    __glsw__RemoveWhere(&gc->LoadedEffects, name, 0);
+    __glsw__RemoveWhere(&gc->ShaderMap, sectionPrefix, 1);
+
+    bdestroy(sectionPrefix);
+    bdestroy(name);
+
+    return 1;
+}
+
 int glswAddDirectiveToken(const char* token, const char* directive)
 {
     glswContext* gc = __glsw__Context;
@@ -28,6 +28,33 @@ void main()
 }
 
 
+//------------------- InstancedVertex.GL32 -------------------------
+// One quad per instance; xpl_sprite_instance_expand is the CPU equivalent.
+
+in vec2 			corner;     // 0..1, in UV space
+in vec4 			instance;   // center.xy, size, rotation
+in vec4 			color;      // RGBA8, normalized
+
+uniform mat4 		mvp;
+uniform vec4 		region;     // UV x, y, width, height
+
+out vec4			vcolor;
+out vec2			vuv;
+out vec2            vscreen_uv;
+
+void main()
+{
+    vec2 offset = (corner - 0.5) * instance.z;
+    float c = cos(instance.w);
+    float s = sin(instance.w);
+    vec2 position = instance.xy + vec2(c * offset.x - s * offset.y, s * offset.x + c * offset.y);
+    vec4 transformed_position = mvp * vec4(position, 0.0, 1.0);
+    gl_Position = transformed_position;
+    vcolor = color;
+    vuv = region.xy + corner * region.zw;
+    vscreen_uv = transformed_position.xy / transformed_position.w + 1.0 * 0.5;
+}
+
 //------------------- Fragment.GL32 -------------------------------
 
 uniform sampler2D 	tex;
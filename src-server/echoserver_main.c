@@ -1,6 +1,17 @@
 /*
  * udpserver.c - A simple UDP echo server
- * usage: udpserver <port>
+ * usage: udpserver [-m metrics port or socket path] [-w workers] [-r max rooms]
+ *                  [-p max players per room] [-s max watchers] [-R replay directory]
+ *                  [-u upstream host:port [-d delay]] <port> [journal directory]
+ *
+ * Clients name a room in their hello; each room is a separate match. Rooms
+ * are spread over the worker threads, which default to one per CPU. With -R,
+ * everything broadcast in a room is recorded to a replay there.
+ *
+ * Spectators send pt_watch instead of hello and are fed coalesced updates;
+ * -s caps them per room. With -u the server is a relay instead: it watches
+ * rooms upstream for its own spectators, -d seconds behind, and -s caps them
+ * in total. Relays can watch relays.
  */
 #ifndef WIN32
 #include <assert.h>
@@ -10,43 +21,47 @@
 #include <stdarg.h>
 #include <string.h>
 #include <netdb.h>
+#include <poll.h>
+#include <signal.h>
 #include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include "uthash.h"
-
 #include "xpl.h"
 #include "xpl_log.h"
-#include "xpl_hash.h"
 
 #include "game/game.h"
 #include "game/packet.h"
 
 #include "net/udpnet.h"
 
+#include "server/journal.h"
+#include "server/metrics.h"
+#include "server/relay.h"
+#include "server/room.h"
+
 #define BUFSIZE 1024
 
 #define TIMEOUT 5.0
 
-typedef struct client_info {
-	int					id;
-	UDPNET_ADDRESS				remote_addr;
-	uint32_t				seq;
-	double					last_packet_time;
-	player_id_t				player_id;
-	bool					drop;
-	UT_hash_handle				hh;
-} client_info_t;
+#define POLL_MS						10
+#define MAX_ROOMS					256
+#define MAX_ROOM_WATCHERS			16
+#define MAX_RELAY_WATCHERS			4096
+
+#define JOURNAL_DIRECTORY			"journal"
+#define JOURNAL_SEGMENT_BYTES		(64 * 1024 * 1024)
+#define JOURNAL_SEGMENT_SECONDS		3600.0
+#define JOURNAL_KEEP_SEGMENTS		336			/* two weeks of hourly segments */
 
-static client_info_t 	*clients 		= NULL;
-static int 		client_count 		= 0;
-static uint16_t 	client_uid_counter 	= 1;
 static int 		sock			= 0;
 static const char 	*motd 			= "motd.txt";
-static double		uptime			= 0.0;
+static volatile sig_atomic_t running		= 1;
+static volatile sig_atomic_t dump_metrics	= 0;
+
+static metric_t		uptime_gauge		= { "up_uptime_seconds", "Seconds since the server started.", mt_gauge };
 
 /*
  * error - wrapper for perror
@@ -56,137 +71,74 @@ static void exit_error(char *msg) {
 	exit(1);
 }
 
-static void log_event(const char *type, client_info_t *client_info, const char *format, ...) {
-	char timebuf[32];
-	char buffer[1024];
-	uint16_t cid = client_info ? client_info->player_id.client_id : 0;
-	const char *cname = client_info ? client_info->player_id.name : "";
-    	time_t now = time(0);
-	va_list args;
-
-	va_start(args, format);
-	vsnprintf(buffer, 1024, format, args);
-	va_end(args);
-    	strftime(timebuf, 32, "%Y-%m-%d %H:%M:%S.000", localtime(&now));
-	LOG_INFO("%s [%s] client_id=[%u,\"%s\"] data=[%s]", timebuf, type, cid, cname, buffer);
-}
-
-static void pointcast_buffer(uint8_t *buf, int size, client_info_t *client) {
-	int ret = udp_send(sock, buf, size, client->remote_addr.address, client->remote_addr.port);
-	if (ret) {
-		log_event("send_drop", client, "size=%d", size);
-		client->drop = true;
-	}
-}
-
-static void pointcast_packet(uint16_t subject, packet_t *packet, client_info_t *client) {
-	uint8_t buf[1024];
-	size_t size = packet_encode(packet, subject, buf);
-	pointcast_buffer(buf, (int)size, client);
-}
-
-static void broadcast_buffer(uint8_t *buf, int size) {
-	client_info_t *dest, *tmp;
-	HASH_ITER(hh, clients, dest, tmp) {
-		pointcast_buffer(buf, size, dest);
-	}
-}
-
-
-static void broadcast_packet(uint16_t subject, packet_t *packet) {
-	uint8_t buf[1024];
-	size_t size = packet_encode(packet, subject, buf);
-	broadcast_buffer(buf, (int)size);
-}
-
-static void client_send_motd(client_info_t *client) {
-
-	packet_t packet;
-	packet.type = pt_chat;
-
-	char stat_message[CHAT_MAX] = { 0 };
-	snprintf(stat_message, CHAT_MAX, "Welcome to UltraPew! %d users, uptime %.2f h", client_count, uptime / 3600.0);
-	strncpy(packet.chat, stat_message, CHAT_MAX);
-	pointcast_packet(0, &packet, client);
-
-	size_t bytes_read = 0;
-
-	char file_message[CHAT_MAX] = { 0 };
-	FILE *file = fopen(motd, "r");
-	if (file) {
-		bytes_read = fread(file_message, 1, CHAT_MAX - 1, file);
-		fclose(file);
-	}
-	if (bytes_read) strncpy(packet.chat, file_message, CHAT_MAX);
-	pointcast_packet(0, &packet, client);
-
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-m metrics port or socket path] [-w workers] [-r max rooms] [-p max players per room] [-s max watchers] [-R replay directory] [-u upstream host:port [-d delay]] <port> [journal directory]\n", program);
+	exit(1);
 }
 
-static client_info_t *get_client(UDPNET_ADDRESS *remote_addr) {
-	client_info_t *client;
-	int hash = xpl_hashs(remote_addr->address, XPL_HASH_INIT);
-	hash = xpl_hashi(remote_addr->port, hash);
-	HASH_FIND_INT(clients, &hash, client);
-	
-	if (! client) {
-		client = xpl_calloc_type(client_info_t);
-		client->id = hash;
-		client->remote_addr = *remote_addr;
-		client->player_id.client_id = client_uid_counter++;
-		++client_count;
-		log_event("join", client, "ip=\"%s\",port=%d", remote_addr->address, remote_addr->port);
-		HASH_ADD_INT(clients, id, client);
-	}
-	
-	return client;
+static void stop_running(int sig) {
+	running = 0;
 }
 
-static void delete_client(client_info_t *client, const char *reason) {
-	log_event("delete", client, "reason=\"%s\"", reason);
-	packet_t bye;
-	memset(&bye, 0, sizeof(bye));
-	bye.type = pt_goodbye;
-	bye.goodbye = client->player_id;
-	broadcast_packet(client->player_id.client_id, &bye);
-
-	HASH_DEL(clients, client);
-
-	--client_count;	
-
-	xpl_free(client);
+static void request_metrics_dump(int sig) {
+	dump_metrics = 1;
 }
 
-static void purge_clients() {
-	double time = xpl_get_time();
-	client_info_t *dest, *tmp;
-	HASH_ITER(hh, clients, dest, tmp) {
-		
-		if (dest->drop) {
-			delete_client(dest, "drop");
-		}
-		
-		if (time - dest->last_packet_time > TIMEOUT) {
-			delete_client(dest, "timeout");
-		}
-	}
-}
+static room_host_t *host_start(int sock, int portno, int workers, int max_rooms, int max_room_clients,
+							   int max_room_watchers, const char *journal_directory, const char *replay_directory);
 
 int main(int argc, char **argv) {
 	uint8_t buf[BUFSIZE];				/* message buf */
 	int n;							/* message byte size */
 	
 	xpl_init_timer();
+	xpl_log_set_timestamps(true);
+	xpl_log_async_start();
 
 	double initial_time = xpl_get_time();
 	
 	/*
 	 * check command line arguments
 	 */
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s <port>\n", argv[0]);
-		exit(1);
+	const char *metrics_address = NULL;
+	const char *replay_directory = NULL;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int workers = cpus > 0 ? (int)cpus : 1;
+	int max_rooms = MAX_ROOMS;
+	int max_room_clients = MAX_PLAYERS;
+	int max_watchers = -1;
+	char *upstream_host = NULL;
+	int upstream_port = 0;
+	double delay = 0.0;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:w:r:p:s:R:u:d:")) != -1) {
+		switch (opt) {
+			case 'm': metrics_address = optarg; break;
+			case 'w': workers = atoi(optarg); break;
+			case 'r': max_rooms = atoi(optarg); break;
+			case 'p': max_room_clients = atoi(optarg); break;
+			case 's': max_watchers = atoi(optarg); break;
+			case 'R': replay_directory = optarg; break;
+			case 'u': {
+				upstream_host = optarg;
+				char *colon = strrchr(optarg, ':');
+				if (! colon) usage(argv[0]);
+				*colon = '\0';
+				upstream_port = atoi(colon + 1);
+				break;
+			}
+			case 'd': delay = atof(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (argc - optind < 1 || argc - optind > 2 || workers < 1 || max_rooms < 1 ||
+		max_room_clients < 1 || max_room_clients > MAX_PLAYERS || delay < 0.0 ||
+		(upstream_host && upstream_port <= 0)) {
+		usage(argv[0]);
 	}
-	int portno = atoi(argv[1]);
+	if (max_watchers < 0) max_watchers = upstream_host ? MAX_RELAY_WATCHERS : MAX_ROOM_WATCHERS;
+	int portno = atoi(argv[optind]);
+	const char *journal_directory = (argc - optind > 1) ? argv[optind + 1] : JOURNAL_DIRECTORY;
 	
 	/* setsockopt: Handy debugging trick that lets
 	 * us rerun the server immediately after we kill it;
@@ -206,10 +158,54 @@ int main(int argc, char **argv) {
 	}
 	
 	LOG_INFO("Socket bound on port %d", portno);
-	
-	while (1) {
-		memset(buf, 0, 1024);
-		purge_clients();
+
+	metrics_register(&uptime_gauge);
+
+	signal(SIGINT, stop_running);
+	signal(SIGTERM, stop_running);
+	signal(SIGUSR1, request_metrics_dump);
+
+	/*
+	 * a relay has no rooms of its own, journal or replays
+	 */
+	relay_t *relay = NULL;
+	room_host_t *host = NULL;
+	if (upstream_host) {
+		relay_config_t relay_config = {
+			.socket = sock,
+			.upstream_host = upstream_host,
+			.upstream_port = upstream_port,
+			.delay = delay,
+			.max_watchers = max_watchers,
+			.timeout = TIMEOUT
+		};
+		relay = relay_new(&relay_config);
+		if (! relay) {
+			exit_error("Couldn't start the relay");
+		}
+	} else {
+		host = host_start(sock, portno, workers, max_rooms, max_room_clients, max_watchers,
+						  journal_directory, replay_directory);
+	}
+
+	// The relay and rooms register their metrics without a lock, so only
+	// start serving the list once it's complete.
+	if (metrics_address) metrics_listen(metrics_address);
+
+	struct pollfd pfd = { sock, POLLIN, 0 };
+	while (running) {
+		if (relay) {
+			relay_tick(relay);
+		} else {
+			room_host_tick(host);
+		}
+
+		metrics_set(&uptime_gauge, xpl_get_time() - initial_time);
+		if (dump_metrics) {
+			dump_metrics = 0;
+			metrics_write(stdout);
+			fflush(stdout);
+		}
 		
 		UDPNET_ADDRESS src;
 		n = udp_receive(sock, buf, BUFSIZE, &src);
@@ -218,84 +214,56 @@ int main(int argc, char **argv) {
 			int e = udp_error();
 			if (e == EWOULDBLOCK ||
 				e == EAGAIN) {
-				xpl_sleep_seconds(0.01);
+				poll(&pfd, 1, POLL_MS);
 				continue;
 			}
 			exit_error("Error code from socket on receive");
 		}
 		
 		LOG_DEBUG("Received packet");
-		
-		client_info_t *client_info = get_client(&src);
 
-		uint16_t client_source;
-		packet_t packet;
-		if (! packet_decode(&packet, &client_source, buf)) {
-			LOG_WARN("Malformed packet, dropping");
-			continue;
-		}
-		
-		if (packet.seq <= client_info->seq) {
-			LOG_DEBUG("Dropping old packet %d", packet.seq);
-			continue;
+		if (relay) {
+			relay_dispatch(relay, &src, buf, (size_t)n);
+		} else {
+			room_host_dispatch(host, &src, buf, (size_t)n);
 		}
-		client_info->seq = packet.seq;
-		
-		if (packet.type == pt_hello) {
-			
-			if (client_count > 127) {
-				
-				client_info_t temp_client;
-				memset(&temp_client, 0, sizeof(temp_client));
-				temp_client.remote_addr = src;
-				
-				packet_t full_packet;
-				full_packet.type = pt_chat;
-				strncpy(full_packet.chat, "Server is full", CHAT_MAX);
-				
-				pointcast_packet(0, &packet, &temp_client);
-		
-				log_event("full", NULL, "");
-				
-				continue;
-			}
-			
-			if (packet.hello.nonce && client_source == 0) {
-				client_source = client_info->player_id.client_id;
-				log_event("hello", client_info, "nonce=%u", packet.hello.nonce);
-				packet.hello.client_id = client_info->player_id.client_id;
-				pointcast_packet(client_source, &packet, client_info);
-				client_send_motd(client_info);
-				assert(client_source != 0);
-			}
-			strncpy(client_info->player_id.name, packet.hello.name, NAME_SIZE);
-			// Overwrite the nonce so it's not shared
-			packet.hello.nonce = 0;
-		}
-		
-		if (packet.type == pt_chat) {
-			packet.chat[63] = '\0';
-			log_event("chat", client_info, "message=\"%s\"", packet.chat);
-		}
-		
-		if (packet.type == pt_damage) {
-			log_event("damage", client_info, "damage=%u,origin=%u,flags=%u",
-					  packet.damage.amount,
-					  packet.damage.player_id,
-					  packet.damage.flags);
-		}
-		
-		if (client_source != client_info->player_id.client_id) {
-			LOG_WARN("Packet client_id mismatch (claim %u, have %u); kicking packet",
-					 client_source, client_info->player_id.client_id);
-		}
-		
-		double time = xpl_get_time();
-		uptime = time - initial_time;
-		client_info->last_packet_time = time;
-		
-		broadcast_packet(client_source, &packet);
-		
 	}
+
+	LOG_INFO("Shutting down");
+	metrics_shutdown();
+	relay_destroy(&relay);
+	room_host_destroy(&host);
+	udp_close_endpoint(sock);
+	return 0;
+}
+
+static room_host_t *host_start(int sock, int portno, int workers, int max_rooms, int max_room_clients,
+							   int max_room_watchers, const char *journal_directory, const char *replay_directory) {
+	char journal_prefix[32];
+	snprintf(journal_prefix, sizeof(journal_prefix), "events-%d", portno);
+	journal_config_t journal_config = {
+		.directory = journal_directory,
+		.prefix = journal_prefix,
+		.max_segment_bytes = JOURNAL_SEGMENT_BYTES,
+		.max_segment_seconds = JOURNAL_SEGMENT_SECONDS,
+		.keep_segments = JOURNAL_KEEP_SEGMENTS,
+		.compress = true
+	};
+	room_host_config_t host_config = {
+		.socket = sock,
+		.workers = workers,
+		.max_rooms = max_rooms,
+		.max_room_clients = max_room_clients,
+		.max_room_watchers = max_room_watchers,
+		.timeout = TIMEOUT,
+		.motd = motd,
+		.journal = &journal_config,
+		.replay_directory = replay_directory
+	};
+	room_host_t *host = room_host_new(&host_config);
+	if (! host) {
+		exit_error("Couldn't start the room workers");
+	}
+	return host;
 }
 #endif
@@ -0,0 +1,227 @@
+/*
+ * journal_tool.c - Reads the server's event journal
+ * usage: journal_tool [-j] [-t type[,type...]] [-c client_id] [-r room] [-s since] [-u until] segment...
+ *
+ * Prints each record as a line of text, or as a line of JSON with -j. Segments
+ * may be plain or gzipped; give them in order (a shell glob of the journal
+ * directory sorts that way). -s and -u take Unix times in seconds. -r keeps the
+ * records of clients in one room, as of their last join or roster record.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cJSON.h"
+
+#include "xpl.h"
+#include "xpl_log.h"
+
+#include "server/journal.h"
+
+typedef struct filter {
+	bool					json;
+	bool					types[je_type_count];
+	bool					any_type;
+	int						client_id;		/* -1 for any */
+	int						room;			/* -1 for any */
+	uint64_t				since_ms;
+	uint64_t				until_ms;
+} filter_t;
+
+/* Names by client id, from hello and roster records; rooms from join and roster. */
+static char names[UINT16_MAX + 1][NAME_SIZE + 1];
+static uint16_t rooms[UINT16_MAX + 1];
+
+static const char *delete_reasons[] = { "drop", "timeout", "leave" };
+
+static const char *delete_reason_name(uint8_t reason) {
+	return reason < sizeof(delete_reasons) / sizeof(delete_reasons[0]) ? delete_reasons[reason] : "unknown";
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-j] [-t type[,type...]] [-c client_id] [-r room] [-s since] [-u until] segment...\n", program);
+	fprintf(stderr, "types: join delete full hello chat damage send_drop roster\n");
+	exit(1);
+}
+
+static bool parse_types(filter_t *filter, char *list) {
+	for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		journal_event_type_t type = journal_event_type(name);
+		if (! type) {
+			fprintf(stderr, "Unknown event type %s\n", name);
+			return false;
+		}
+		filter->types[type] = true;
+	}
+	filter->any_type = false;
+	return true;
+}
+
+static void print_text(uint64_t time_ms, const journal_record_t *record, const uint8_t *payload) {
+	char stamp[32];
+	time_t seconds = (time_t)(time_ms / 1000);
+	struct tm tm;
+	localtime_r(&seconds, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+
+	printf("%s.%03u [%s] client_id=[%u,\"%s\"] data=[", stamp, (unsigned int)(time_ms % 1000),
+		   journal_event_name(record->type), record->client_id, names[record->client_id]);
+
+	switch (record->type) {
+		case je_join: {
+			const journal_join_t *event = (const journal_join_t *)payload;
+			printf("ip=\"%.*s\",port=%u,room=%u", (int)sizeof(event->address), event->address, event->port, event->room);
+			break;
+		}
+		case je_delete: {
+			const journal_delete_t *event = (const journal_delete_t *)payload;
+			printf("reason=\"%s\"", delete_reason_name(event->reason));
+			break;
+		}
+		case je_hello: {
+			const journal_hello_t *event = (const journal_hello_t *)payload;
+			printf("nonce=%u", event->nonce);
+			break;
+		}
+		case je_chat:
+			printf("message=\"%s\"", (const char *)payload);
+			break;
+		case je_damage: {
+			const journal_damage_t *event = (const journal_damage_t *)payload;
+			printf("damage=%u,origin=%u,flags=%u", event->amount, event->origin, event->flags);
+			break;
+		}
+		case je_send_drop: {
+			const journal_send_drop_t *event = (const journal_send_drop_t *)payload;
+			printf("size=%u", event->size);
+			break;
+		}
+		case je_roster: {
+			const journal_roster_t *event = (const journal_roster_t *)payload;
+			printf("room=%u", event->room);
+			break;
+		}
+	}
+	printf("]\n");
+}
+
+static void print_json(uint64_t time_ms, const journal_record_t *record, const uint8_t *payload) {
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "time_ms", (double)time_ms);
+	cJSON_AddStringToObject(root, "type", journal_event_name(record->type));
+	cJSON_AddNumberToObject(root, "client_id", record->client_id);
+	cJSON_AddStringToObject(root, "name", names[record->client_id]);
+
+	switch (record->type) {
+		case je_join: {
+			const journal_join_t *event = (const journal_join_t *)payload;
+			char address[sizeof(event->address) + 1] = { 0 };
+			memcpy(address, event->address, sizeof(event->address));
+			cJSON_AddStringToObject(root, "ip", address);
+			cJSON_AddNumberToObject(root, "port", event->port);
+			cJSON_AddNumberToObject(root, "room", event->room);
+			break;
+		}
+		case je_delete: {
+			const journal_delete_t *event = (const journal_delete_t *)payload;
+			cJSON_AddStringToObject(root, "reason", delete_reason_name(event->reason));
+			break;
+		}
+		case je_hello: {
+			const journal_hello_t *event = (const journal_hello_t *)payload;
+			cJSON_AddNumberToObject(root, "nonce", event->nonce);
+			break;
+		}
+		case je_chat:
+			cJSON_AddStringToObject(root, "message", (const char *)payload);
+			break;
+		case je_damage: {
+			const journal_damage_t *event = (const journal_damage_t *)payload;
+			cJSON_AddNumberToObject(root, "damage", event->amount);
+			cJSON_AddNumberToObject(root, "origin", event->origin);
+			cJSON_AddNumberToObject(root, "projectile_id", event->projectile_id);
+			cJSON_AddNumberToObject(root, "flags", event->flags);
+			break;
+		}
+		case je_send_drop: {
+			const journal_send_drop_t *event = (const journal_send_drop_t *)payload;
+			cJSON_AddNumberToObject(root, "size", event->size);
+			break;
+		}
+		case je_roster: {
+			const journal_roster_t *event = (const journal_roster_t *)payload;
+			cJSON_AddNumberToObject(root, "room", event->room);
+			break;
+		}
+	}
+
+	char *line = cJSON_PrintUnformatted(root);
+	puts(line);
+	free(line);
+	cJSON_Delete(root);
+}
+
+static bool read_segment(const char *path, const filter_t *filter) {
+	journal_reader_t *reader = journal_reader_new(path);
+	if (! reader) return false;
+
+	uint64_t start_ms = journal_reader_header(reader)->start_ms;
+	journal_record_t record;
+	uint8_t payload[JOURNAL_PAYLOAD_MAX + 1];
+	while (journal_reader_next(reader, &record, payload)) {
+		if (record.type == je_hello || record.type == je_roster) {
+			const char *name = (record.type == je_hello)
+				? ((const journal_hello_t *)payload)->name
+				: ((const journal_roster_t *)payload)->name;
+			memcpy(names[record.client_id], name, NAME_SIZE);
+		}
+		if (record.type == je_join) rooms[record.client_id] = ((const journal_join_t *)payload)->room;
+		if (record.type == je_roster) rooms[record.client_id] = ((const journal_roster_t *)payload)->room;
+
+		uint64_t time_ms = start_ms + record.time_ms;
+		if (! filter->any_type && (record.type >= je_type_count || ! filter->types[record.type])) continue;
+		if (filter->client_id >= 0 && record.client_id != filter->client_id) continue;
+		if (filter->room >= 0 && rooms[record.client_id] != filter->room) continue;
+		if (time_ms < filter->since_ms || time_ms >= filter->until_ms) continue;
+
+		if (filter->json) {
+			print_json(time_ms, &record, payload);
+		} else {
+			print_text(time_ms, &record, payload);
+		}
+	}
+
+	journal_reader_destroy(&reader);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	filter_t filter;
+	memset(&filter, 0, sizeof(filter));
+	filter.any_type = true;
+	filter.client_id = -1;
+	filter.room = -1;
+	filter.until_ms = UINT64_MAX;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "jt:c:r:s:u:")) != -1) {
+		switch (opt) {
+			case 'j': filter.json = true; break;
+			case 't': if (! parse_types(&filter, optarg)) usage(argv[0]); break;
+			case 'c': filter.client_id = atoi(optarg); break;
+			case 'r': filter.room = atoi(optarg); break;
+			case 's': filter.since_ms = strtoull(optarg, NULL, 10) * 1000; break;
+			case 'u': filter.until_ms = strtoull(optarg, NULL, 10) * 1000; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc) usage(argv[0]);
+
+	int failures = 0;
+	for (int i = optind; i < argc; ++i) {
+		if (! read_segment(argv[i], &filter)) ++failures;
+	}
+	return failures ? 1 : 0;
+}
@@ -286,6 +286,7 @@ static void main_loop(xpl_app_t *app) {
     
 	while(glfwGetWindowParam(GLFW_OPENED) && ! should_exit) {
 		glfwGetWindowSize(&app->execution_info->screen_size.x, &app->execution_info->screen_size.y);
+		xpl_shaders_reload_changed();
 		render(app->execution_info);
         glfwSwapBuffers();
     }
@@ -20,6 +20,7 @@
 #include "xpl_rc.h"
 #include "xpl_l10n.h"
 #include "xpl_app_params.h"
+#include "xpl_vfs.h"
 
 #if defined(XPL_PLATFORM_OSX)
 #include <OpenGL/OpenGL.h>
@@ -173,6 +174,7 @@ int xpl_start_app(xpl_app_t *app) {
         app->display_params = display_params;
 #endif
         
+        xpl_vfs_init();
         xpl_l10n_set_fallback_locale("en");
         xpl_l10n_load_saved_locale();
 
@@ -202,6 +204,7 @@ int xpl_start_app(xpl_app_t *app) {
 
     } while (defaults || app->restart);
 
+    xpl_vfs_shutdown();
     xpl_app_destroy(&app);
     
     return 0;
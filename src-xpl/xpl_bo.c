@@ -135,3 +135,26 @@ void xpl_bo_update(xpl_bo_t *self, size_t update_offset, const void *data, size_
     buffer_mark_dirty(self);
 	xpl_dynamic_buffer_update(self->client_data, update_offset, data, data_len);
 }
+
+void xpl_bo_stream(xpl_bo_t *self, const void *data, size_t data_len) {
+    if (! self->bo_id) {
+        glGenBuffers(1, &self->bo_id);
+    }
+
+    // Grow geometrically so a frame that's a little bigger than the last doesn't reallocate.
+    if (data_len > self->server_memory_size) {
+        size_t size = self->server_memory_size ? self->server_memory_size : 4096;
+        while (size < data_len) size *= 2;
+        self->server_memory_size = size;
+    }
+
+    glBindBuffer(self->target, self->bo_id);
+    glBufferData(self->target, self->server_memory_size, NULL, self->usage);
+    if (data_len) {
+        glBufferSubData(self->target, 0, data_len, data);
+    }
+    GL_DEBUG();
+    glBindBuffer(self->target, GL_NONE);
+
+    self->dirty_state = xpl_bods_clean;
+}
@@ -1,182 +1,52 @@
 #include <math.h>
 #include <wchar.h>
+#include <stddef.h>
 #include <string.h>
 
-#include "uthash.h"
-
 #include "xpl.h"
 #include "xpl_gl.h"
 #include "xpl_memory.h"
 #include "xpl_text_cache.h"
 #include "xpl_vao.h"
 #include "xpl_bo.h"
-#include "xpl_hash.h"
 #include "xpl_command_render.h"
 #include "xpl_imui.h"
+#include "xpl_imui_geometry.h"
 #include "xpl_color.h"
 
-#undef DISABLE_CACHES
-
-static const float PI = 3.14159264;
-static const int HASH_RAWPOLY = 1;
-static const int HASH_RECT = 2;
-static const int HASH_ROUNDED_RECT = 3;
-static const int HASH_LINE = 4;
-// static const int HASH_FONT = 5;
-static const int HASH_TRI = 6;
+#define FRAME_ARENA_CHUNK_SIZE (64 * 1024)
 
 static struct xpl_text_cache *g_text_cache;
 
 // ---------------------------------------------------------------------
 
-typedef struct _geometry_table_entry {
-	int key;
-	xpl_vao_t *vao;
-	xpl_bo_t *vertex_bo;
-	xpl_bo_t *color_bo;
-	size_t vertices;
-    
-	UT_hash_handle hh;
-    
-} _geometry_table_entry_t;
-
-static _geometry_table_entry_t *geometry_table_entry_new(int key) {
-    
-	_geometry_table_entry_t *entry = xpl_alloc_type(_geometry_table_entry_t);
-#    ifndef DISABLE_CACHES
-	LOG_DEBUG("New geometry table entry: %d", key);
-#    endif
-	entry->key = key;
-	entry->vao = xpl_vao_new();
-	entry->vertex_bo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-	entry->color_bo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    
-	return entry;
-}
-
-static void geometry_table_entry_destroy(_geometry_table_entry_t **ppbuffer) {
-	assert(ppbuffer);
-    
-	_geometry_table_entry_t *entry = *ppbuffer;
-	assert(entry);
-    
-	if (entry->vao)
-		xpl_vao_destroy(&entry->vao);
-	if (entry->vertex_bo)
-		xpl_bo_destroy(&entry->vertex_bo);
-	if (entry->color_bo)
-		xpl_bo_destroy(&entry->color_bo);
-    
-	xpl_free(entry);
-    
-	*ppbuffer = NULL;
-}
-
-// ---------------------------------------------------------------------
-
-typedef struct _geometry_table {
-	_geometry_table_entry_t *entries;	// uthash
-    
-} _geometry_table_t;
-
-_geometry_table_t * geometry_table_new() {
-	_geometry_table_t *table = xpl_alloc_type(_geometry_table_t);
-	table->entries = NULL;
-    
-	return table;
-}
-
-static void geometry_table_destroy(_geometry_table_t **pptable) {
-	assert(pptable);
-    
-	_geometry_table_t *table = *pptable;
-	assert(table);
-    
-	_geometry_table_entry_t *buf, *tmp;
-    
-	HASH_ITER(hh, table->entries, buf, tmp)
-	{
-		HASH_DEL(table->entries, buf);
-		geometry_table_entry_destroy(&buf);
-	}
-    
-	xpl_free(table);
-    
-	*pptable = NULL;
-    
-}
-// ---------------------------------------------------------------------
-
-typedef struct _geometry_cache {
-	_geometry_table_t *last_frame;	// uthash
-	_geometry_table_t *this_frame;	// uthash
-    
-} _geometry_cache_t;
-
-static _geometry_cache_t *geometry_cache_new() {
-	_geometry_cache_t *cache = xpl_alloc_type(_geometry_cache_t);
-	cache->last_frame = geometry_table_new();
-	cache->this_frame = geometry_table_new();
-	return cache;
-}
-
-static void geometry_cache_destroy(_geometry_cache_t **ppcache) {
-	assert(ppcache);
-    
-	_geometry_cache_t *cache = *ppcache;
-	assert(cache);
-    
-	if (cache->last_frame)
-		geometry_table_destroy(&cache->last_frame);
-	if (cache->this_frame)
-		geometry_table_destroy(&cache->this_frame);
-    
-	xpl_free(cache);
-    
-	*ppcache = NULL;
-}
-
-// ---------------------------------------------------------------------
-static _geometry_cache_t *g_geom_cache;
-
-static _geometry_table_entry_t * geometry_cache_get(int hashkey) {
-#    ifdef DISABLE_CACHES
-	return NULL;
-#    endif
-	_geometry_table_entry_t *entry;
-	HASH_FIND_INT(g_geom_cache->this_frame->entries, &hashkey, entry);
-	if (entry != NULL ) {
-		LOG_WARN("Duplicate fetch for %d this frame", hashkey);
-		return entry;
-	}
-    
-	HASH_FIND_INT(g_geom_cache->last_frame->entries, &hashkey, entry);
-	if (entry == NULL )
-		return NULL ;
-    
-	// transfer to this frame table
-	HASH_DEL(g_geom_cache->last_frame->entries, entry);
-	HASH_ADD_INT(g_geom_cache->this_frame->entries, key, entry);
-    
-	return entry;
-}
-
-static void geometry_cache(_geometry_table_entry_t *geom) {
-	assert(geom);
-	HASH_ADD_INT(g_geom_cache->this_frame->entries, key, geom);
-}
-
-static void geometry_cache_advance_frame(void) {
-	_geometry_table_entry_t *entry, *tmp;
-    
-	HASH_ITER(hh, g_geom_cache->last_frame->entries, entry, tmp)
-	{
-		HASH_DEL(g_geom_cache->last_frame->entries, entry);
-		geometry_table_entry_destroy(&entry);
+// All of a frame's UI triangles go into g_geometry, which is uploaded once to a
+// single streaming buffer. Draws are only issued where text (a different shader)
+// or a scissor change interrupts the shapes. The vertices are staged in
+// g_frame_arena, which gives them back at the start of the next frame.
+
+typedef struct _stream_batch {
+	size_t end;                     // vertex count when the batch was cut
+	size_t command;                 // index of the command that cut it
+} _stream_batch_t;
+
+static xpl_arena_t *g_frame_arena = NULL;
+static xpl_imui_geometry_t *g_geometry = NULL;
+static xpl_bo_t *g_stream_bo = NULL;
+static xpl_vao_t *g_stream_vao = NULL;
+
+static _stream_batch_t *g_batches = NULL;
+static size_t g_batch_count = 0;
+static size_t g_batch_capacity = 0;
+
+static void stream_batch_cut(size_t command) {
+	if (g_batch_count == g_batch_capacity) {
+		g_batch_capacity = g_batch_capacity ? g_batch_capacity * 2 : 64;
+		g_batches = xpl_realloc(g_batches, g_batch_capacity * sizeof(_stream_batch_t));
 	}
-	_geometry_table_t *swap = g_geom_cache->last_frame;
-	g_geom_cache->last_frame = g_geom_cache->this_frame;
-	g_geom_cache->this_frame = swap;
+	g_batches[g_batch_count].end = g_geometry->count;
+	g_batches[g_batch_count].command = command;
+	g_batch_count++;
 }
 
 // ---------------------------------------------------------------------
@@ -186,16 +56,16 @@ static int g_ui_state_set = 0;
 XPLINLINE void imui_render_state_set(void) {
 	if (g_ui_state_set)
 		return;
-    
+
 	// LOG_DEBUG("Setting UI render state");
 	glDepthMask(GL_FALSE);
 	glEnable(GL_BLEND);
 	glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
 	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
 	glUseProgram(g_ui_shader->id);
-    
+
     GL_DEBUG();
-    
+
 	g_ui_state_set = TRUE;
 }
 
@@ -205,316 +75,96 @@ XPLINLINE void imui_render_state_clear(void) {
 	glEnable(GL_BLEND);
 	glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
 	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
-    
+
 	if (!g_ui_state_set)
 		return;
-    
+
 	glUseProgram(0);
-    
+
     GL_DEBUG();
-    
+
 	g_ui_state_set = FALSE;
 }
 
-XPLINLINE void draw_geom(xmat4 *mvp, _geometry_table_entry_t *geom) {
+static void draw_stream(xmat4 *vp, size_t start, size_t end) {
+	if (end <= start)
+		return;
+
 	imui_render_state_set();
-	glUniformMatrix4fv(xpl_shader_get_uniform(g_ui_shader, "mvp"), 1, GL_FALSE, &mvp->data[0]);
-	xpl_vao_program_draw_arrays(geom->vao, g_ui_shader, GL_TRIANGLES, 0,
-                                (GLsizei) geom->vertices);
+	glUniformMatrix4fv(xpl_shader_get_uniform(g_ui_shader, "mvp"), 1, GL_FALSE, &vp->data[0]);
+	xpl_vao_program_draw_arrays(g_stream_vao, g_ui_shader, GL_TRIANGLES, (GLint) start,
+                                (GLsizei) (end - start));
 }
 
 // ---------------------------------------------------------------------
 
-#define TEMP_COORD_COUNT 1000
-static xvec2 s_temp_normals[TEMP_COORD_COUNT];
-static xvec2 s_temp_coords[TEMP_COORD_COUNT];
-
-inline uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	return (r) | (g << 8) | (b << 16) | (a << 24);
-}
-
-static _geometry_table_entry_t *geometry_cache_polygon(int key, xvec2 *coords,
-                                                       size_t num_coords, float blend_r, uint32_t color) {
-	_geometry_table_entry_t *geom = geometry_table_entry_new(key);
-    
-	size_t last_coord = num_coords - 1;
-    
-	// j is a trailing iterator
-	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
-		const xvec2 *v0 = &coords[j];
-		const xvec2 *v1 = &coords[i];
-		xvec2 diff = xvec2_set(v1->x - v0->x, v1->y - v0->y);
-		float dist = sqrtf(diff.x * diff.x + diff.y * diff.y);
-		if (dist > 0) {
-			// normalize
-			dist = 1.0f / dist;
-			diff.x *= dist;
-			diff.y *= dist;
-		}
-		s_temp_normals[j] = xvec2_set(diff.y, -diff.x);
-	}
-    
-	// j trails
-	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
-		const xvec2 *dlx0 = &s_temp_normals[j];
-		const xvec2 *dlx1 = &s_temp_normals[i];
-		xvec2 dm = xvec2_set(dlx0->x + dlx1->x * 0.5f,
-                             dlx0->y + dlx1->y * 0.5f);
-		float dmr2 = dm.x * dm.x + dm.y * dm.y;
-		if (dmr2 > 0.000001f) {
-			float scale = 1.0f / dmr2;
-			if (scale > 10.0f)
-				scale = 10.0f;
-			dm = xvec2_set(dm.x * scale, dm.y * scale);
-		}
-		s_temp_coords[i] = xvec2_set(coords[i].x + dm.x * blend_r,
-                                     coords[i].y + dm.y * blend_r);
-	}
-    
-	uint32_t color_transparent = RGBA(color & 0xff,
-                                      (color >> 8) & 0xff,
-                                      (color >> 16) & 0xff,
-                                      0);
-    
-	size_t vertices = num_coords * 6 + (num_coords - 2) * 3;
-	xvec2 *v = xpl_alloc(vertices * sizeof (xvec2));
-	uint32_t *c = xpl_alloc(vertices * sizeof (uint32_t));
-	int k = 0;
-    
-	// edge
-	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
-		v[k] = coords[i];
-		c[k++] = color;
-        
-		v[k] = coords[j];
-		c[k++] = color;
-        
-		v[k] = s_temp_coords[j];
-		c[k++] = color_transparent;
-        
-		// t2
-        
-		v[k] = s_temp_coords[j];
-		c[k++] = color_transparent;
-        
-		v[k] = s_temp_coords[i];
-		c[k++] = color_transparent;
-        
-		v[k] = coords[i];
-		c[k++] = color;
-	}
-    
-	// interior
-	for (size_t i = 2; i < num_coords; ++i) {
-		v[k] = coords[0];
-		c[k++] = color;
-        
-		v[k] = coords[i - 1];
-		c[k++] = color;
-        
-		v[k] = coords[i];
-		c[k++] = color;
-	}
-	assert(vertices == k);
-	geom->vertices = k;
-    
-	// Create BOs from data
-	xpl_bo_append(geom->vertex_bo, &v[0], k * sizeof(xvec2));
-	xpl_bo_commit(geom->vertex_bo);
-	xpl_bo_append(geom->color_bo, &c[0], k * sizeof(uint32_t));
-	xpl_bo_commit(geom->color_bo);
-    
-	xpl_free(v);
-	xpl_free(c);
-    
-	xpl_vao_define_vertex_attrib(geom->vao, "position", geom->vertex_bo, 2,
-                                 GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
-	xpl_vao_define_vertex_attrib(geom->vao, "color", geom->color_bo, 4,
-                                 GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint32_t), 0);
-    
-	geometry_cache(geom);
-	return geom;
-}
-
-static void draw_polygon(xmat4 *mvp, xvec2 *coords, size_t num_coords,
-                         float blend_r, uint32_t color) {
-	// cache pass
-	int hash = XPL_HASH_INIT;
-	hash = xpl_hashi(HASH_RAWPOLY, hash);
-	for (size_t i = 0; i < num_coords; ++i) {
-		hash = xpl_hashf(coords[i].x, hash);
-		hash = xpl_hashf(coords[i].y, hash);
-	}
-	hash = xpl_hashi((int)num_coords, hash);
-	hash = xpl_hashf(blend_r, hash);
-	hash = xpl_hashi(color, hash);
-    
-	_geometry_table_entry_t *geom = geometry_cache_get(hash);
-	if (!geom) {
-		geom = geometry_cache_polygon(hash, coords, num_coords, blend_r, color);
-	}
-	draw_geom(mvp, geom);
-}
+static void tessellate_command(xpl_imui_geometry_t *geometry, xpl_render_cmd_t *cmd,
+                               const float scale, const float blend_amount) {
+	xpl_imui_geometry_set_transform(geometry, &cmd->matrix);
 
-static void draw_rect(xmat4 *mvp, xrect rect, float blend_r, uint32_t color) {
-	// cache pass
-	int hash = XPL_HASH_INIT;
-	hash = xpl_hashi(HASH_RECT, hash);
-	hash = xpl_hashf(rect.origin.x, hash);
-	hash = xpl_hashf(rect.origin.y, hash);
-	hash = xpl_hashf(rect.size.width, hash);
-	hash = xpl_hashf(rect.size.height, hash);
-	hash = xpl_hashf(blend_r, hash);
-	hash = xpl_hashi(color, hash);
-    
-	_geometry_table_entry_t *geom = geometry_cache_get(hash);
-	if (!geom) {
-		xvec2 verts[4];
-		verts[0] = xvec2_set(rect.x + 0.5f, rect.y + 0.5f);
-		verts[1] = xvec2_set(rect.x + rect.width - 0.5f, rect.y + 0.5f);
-		verts[2] = xvec2_set(rect.x + rect.width - 0.5f,
-                             rect.y + rect.height - 0.5f);
-		verts[3] = xvec2_set(rect.x + 0.5f, rect.y + rect.height - 0.5f);
-		geom = geometry_cache_polygon(hash, verts, 4, blend_r, color);
-	}
-	draw_geom(mvp, geom);
-}
-
-static const int CIRCLE_VERTS = 8 * 4;
-
-static xvec2 *init_circle_verts() {
-	xvec2 *verts = xpl_alloc(CIRCLE_VERTS * sizeof (xvec2));
-	for (size_t i = 0; i < CIRCLE_VERTS; ++i) {
-		float a = ((float) i) / ((float) CIRCLE_VERTS) * PI * 2;
-		verts[i] = xvec2_set(cosf(a), sinf(a));
-	}
-	return verts;
-    
-}
-
-static xvec2 *g_circle_verts = NULL;
-
-static void draw_rounded_rect(xmat4 *mvp, xrect rect, float corner_r,
-                              float blend_r, uint32_t color) {
-	// cache
-	int hash = XPL_HASH_INIT;
-	hash = xpl_hashi(HASH_ROUNDED_RECT, hash);
-	hash = xpl_hashf(rect.origin.x, hash);
-	hash = xpl_hashf(rect.origin.y, hash);
-	hash = xpl_hashf(rect.size.width, hash);
-	hash = xpl_hashf(rect.size.height, hash);
-	hash = xpl_hashf(corner_r, hash);
-	hash = xpl_hashf(blend_r, hash);
-	hash = xpl_hashi(color, hash);
-    
-	_geometry_table_entry_t *geom = geometry_cache_get(hash);
-	if (!geom) {
-		const unsigned n = CIRCLE_VERTS / 4; // quarter circle
-		xvec2 verts[(n + 1) * 4];
-		const xvec2 *cverts = g_circle_verts;
-		int k = 0;
-        
-		// top right?
-		for (size_t i = 0; i <= n; ++i) {
-			verts[k] = xvec2_set(
-                                 rect.origin.x + rect.size.width - corner_r + cverts[i].x * corner_r,
-                                 rect.origin.y + rect.size.height - corner_r + cverts[i].y * corner_r);
-			k++;
-		}
-        
-		for (size_t i = n; i <= 2 * n; ++i) {
-			verts[k] = xvec2_set(rect.origin.x + corner_r + cverts[i].x * corner_r,
-                                 rect.origin.y + rect.size.height - corner_r + cverts[i].y * corner_r);
-			k++;
-		}
-        
-		for (size_t i = 2 * n; i <= 3 * n; ++i) {
-			verts[k] = xvec2_set(rect.origin.x + corner_r + cverts[i].x * corner_r,
-                                 rect.origin.y + corner_r + cverts[i].y * corner_r);
-			k++;
-		}
-        
-		for (size_t i = 3 * n; i < 4 * n; ++i) {
-			verts[k] = xvec2_set(
-                                 rect.origin.x + rect.size.width - corner_r + cverts[i].x * corner_r,
-                                 rect.origin.y + corner_r + cverts[i].y * corner_r);
-			k++;
-		}
-		verts[k++] = xvec2_set(
-                               rect.origin.x + rect.size.width - corner_r + cverts[0].x * corner_r,
-                               rect.origin.y + corner_r + cverts[0].y * corner_r);
-		assert(k == (n + 1) * 4);
-        
-		geom = geometry_cache_polygon(hash, verts, k, blend_r, color);
-	}
-	draw_geom(mvp, geom);
-}
+	switch (cmd->type) {
+        case XPL_RENDER_CMD_RECT:
+            if (cmd->shape.radius == 0.0f) {
+                xpl_imui_geometry_rect(geometry, xrect_scale(cmd->shape.area, scale),
+                                       blend_amount, cmd->shape.color);
+            } else {
+                xpl_imui_geometry_rounded_rect(geometry, xrect_scale(cmd->shape.area, scale),
+                                               cmd->shape.radius * scale, blend_amount,
+                                               cmd->shape.color);
+            }
+            break;
 
-static void draw_line(xmat4 *mvp, xvec4 line, float width, float blend_r,
-                      uint32_t color) {
-	// cache
-	int hash = XPL_HASH_INIT;
-	hash = xpl_hashi(HASH_LINE, hash);
-	hash = xpl_hashf(line.origin.x, hash);
-	hash = xpl_hashf(line.origin.y, hash);
-	hash = xpl_hashf(line.dest.x, hash);
-	hash = xpl_hashf(line.dest.y, hash);
-	hash = xpl_hashf(width, hash);
-	hash = xpl_hashf(blend_r, hash);
-	hash = xpl_hashi(color, hash);
-    
-	_geometry_table_entry_t *geom = geometry_cache_get(hash);
-	if (!geom) {
-        
-		xvec2 vec = xvec2_set(line.dest.x - line.origin.x, line.dest.y - line.origin.y);
-		float d = sqrtf(vec.x * vec.x + vec.y * vec.y);
-		if (d > 0.00001f) {
-			d = 1.0f / d;
-			vec.x *= d;
-			vec.y *= d;
-		}
-        
-		xvec2 normal = xvec2_set(-vec.y, vec.x);
-		xvec2 verts[4];
-        
-		width -= blend_r;
-		width *= 0.5f;
-		if (width < 0.01f)
-			width = 0.01f;
-        
-		vec.x *= width;
-		vec.y *= width;
-		normal.x *= width;
-		normal.y *= width;
-        
-		verts[0] = xvec2_set(line.origin.x - vec.x - normal.x,
-							 line.origin.y - vec.y - normal.y);
-		verts[1] = xvec2_set(line.origin.x - vec.x + normal.x,
-							 line.origin.y - vec.y + normal.y);
-		verts[2] = xvec2_set(line.dest.x + vec.x + normal.x,
-							 line.dest.y + vec.y + normal.y);
-		verts[3] = xvec2_set(line.dest.x + vec.x - normal.x,
-							 line.dest.y + vec.y - normal.y);
-        
-		geom = geometry_cache_polygon(hash, verts, 4, blend_r, color);
-	}
-	draw_geom(mvp, geom);
-    
-}
+        case XPL_RENDER_CMD_LINE:
+            xpl_imui_geometry_line(geometry, xvec4_scale(cmd->shape.line, scale),
+                                   cmd->shape.radius * scale, 1.0f, cmd->shape.color);
+            break;
 
-static void draw_triangle(xmat4 *mvp, xvec2 *verts, float blend_r,
-                          uint32_t color) {
-	int hash = XPL_HASH_INIT;
-	hash = xpl_hashi(HASH_TRI, hash);
-	for (size_t i = 0; i < 3; ++i) {
-		hash = xpl_hashf(verts[i].x, hash);
-		hash = xpl_hashf(verts[i].y, hash);
-	}
-	_geometry_table_entry_t *geom = geometry_cache_get(hash);
-	if (!geom) {
-		geom = geometry_cache_polygon(hash, verts, 3, blend_r, color);
+        case XPL_RENDER_CMD_TRIANGLE: {
+            xvec2 verts[3];
+            if (cmd->flags == 1) {
+                verts[0] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
+                                     cmd->shape.area.y * scale + 0.5f);
+
+                verts[1] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
+                                     cmd->shape.area.width * scale - 1.0f,
+                                     cmd->shape.area.y * scale + 0.5f +
+                                     cmd->shape.area.height * scale * 0.5f - 0.5f);
+
+                verts[2] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
+                                     cmd->shape.area.y * scale + 0.5f +
+                                     cmd->shape.area.height * scale - 1.0f);
+            } else if (cmd->flags == 2) {
+                verts[0] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
+                                     cmd->shape.area.y * scale + 0.5f +
+                                     cmd->shape.area.height * scale - 1.0f);
+
+                verts[1] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
+                                     cmd->shape.area.width * scale * 0.5f - 0.5f,
+                                     cmd->shape.area.y * scale + 0.5f);
+
+                verts[2] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
+                                     cmd->shape.area.width * scale - 1.0f,
+                                     cmd->shape.area.y * scale + 0.5f +
+                                     cmd->shape.area.height * scale - 1.0f);
+            } else {
+                break;
+            }
+            xpl_imui_geometry_triangle(geometry, verts, 1.0f, cmd->shape.color);
+            break;
+        }
+        case XPL_RENDER_CMD_POLYGON: {
+            for (size_t j = 0; j < cmd->polygon.points_len; ++j) {
+                cmd->polygon.points[j].x *= scale;
+                cmd->polygon.points[j].y *= scale;
+            }
+            xpl_imui_geometry_polygon(geometry, cmd->polygon.points, cmd->polygon.points_len,
+                                      blend_amount, cmd->polygon.color);
+            break;
+        }
+        default:
+            LOG_ERROR("Unimplemented command: %d", cmd->type);
+            break;
 	}
-	draw_geom(mvp, geom);
 }
 
 static float text_get_length(xpl_font_t *font, const char *text,
@@ -642,81 +292,39 @@ static void draw_text(xmat4 *mvp, xvec2 position, xpl_markup_t *markup,
 
 static void imui_render_advance_frame() {
 	xpl_text_cache_advance_frame(g_text_cache);
-	geometry_cache_advance_frame();
 }
 
 void xpl_imui_render_draw(xivec2 *screen, xpl_render_cmd_t *commands,
                           size_t command_length, const float scale, const float blend_amount) {
 	glDisable(GL_SCISSOR_TEST);
-    
+
 	xmat4 mat_vp, *vp = &mat_vp;
 	xmat4_ortho(0, (float) screen->x, 0, (float) screen->y, -1.0f, 1.0f, vp);
-    
+
+	// Tessellate every shape up front, noting where text and scissor commands fall.
+	xpl_imui_geometry_clear(g_geometry);
+	xpl_arena_reset(g_frame_arena);
+	g_batch_count = 0;
 	for (size_t i = 0; i < command_length; ++i) {
-        
-		const xpl_render_cmd_t *cmd = &commands[i];
-		xmat4 mat_mvp, *mvp = &mat_mvp;
-		xmat4_multiply(vp, &cmd->matrix, mvp);
-        
+		xpl_render_cmd_t *cmd = &commands[i];
+		if (cmd->type == XPL_RENDER_CMD_TEXT || cmd->type == XPL_RENDER_CMD_SCISSOR) {
+			stream_batch_cut(i);
+		} else {
+			tessellate_command(g_geometry, cmd, scale, blend_amount);
+		}
+	}
+	xpl_bo_stream(g_stream_bo, xpl_imui_geometry_vertices(g_geometry), g_geometry->count * sizeof(xpl_imui_vertex_t));
+
+	size_t drawn = 0;
+	for (size_t b = 0; b < g_batch_count; ++b) {
+		draw_stream(vp, drawn, g_batches[b].end);
+		drawn = g_batches[b].end;
+
+		const xpl_render_cmd_t *cmd = &commands[g_batches[b].command];
 		switch (cmd->type) {
-                
-            case XPL_RENDER_CMD_RECT:
-                if (cmd->shape.radius == 0.0f) {
-                    draw_rect(mvp, xrect_scale(cmd->shape.area, scale),
-                              blend_amount, cmd->shape.color);
-                } else {
-                    draw_rounded_rect(mvp, xrect_scale(cmd->shape.area, scale),
-                                      cmd->shape.radius * scale, blend_amount,
-                                      cmd->shape.color);
-                }
-                break;
-                
-            case XPL_RENDER_CMD_LINE:
-                draw_line(mvp, xvec4_scale(cmd->shape.line, scale),
-                          cmd->shape.radius * scale, 1.0f, cmd->shape.color);
-                break;
-                
-            case XPL_RENDER_CMD_TRIANGLE: {
-                xvec2 verts[3];
-                if (cmd->flags == 1) {
-                    verts[0] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
-                                         cmd->shape.area.y * scale + 0.5f);
-                    
-                    verts[1] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
-                                         cmd->shape.area.width * scale - 1.0f,
-                                         cmd->shape.area.y * scale + 0.5f +
-                                         cmd->shape.area.height * scale * 0.5f - 0.5f);
-                    
-                    verts[2] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
-                                         cmd->shape.area.y * scale + 0.5f +
-                                         cmd->shape.area.height * scale - 1.0f);
-                } else if (cmd->flags == 2) {
-                    verts[0] = xvec2_set(cmd->shape.area.x * scale + 0.5f,
-                                         cmd->shape.area.y * scale + 0.5f +
-                                         cmd->shape.area.height * scale - 1.0f);
-                    
-                    verts[1] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
-                                         cmd->shape.area.width * scale * 0.5f - 0.5f,
-                                         cmd->shape.area.y * scale + 0.5f);
-                    
-                    verts[2] = xvec2_set(cmd->shape.area.x * scale + 0.5f +
-                                         cmd->shape.area.width * scale - 1.0f,
-                                         cmd->shape.area.y * scale + 0.5f +
-                                         cmd->shape.area.height * scale - 1.0f);
-                }
-                draw_triangle(mvp, verts, 1.0f, cmd->shape.color);
-                break;
-            }
-            case XPL_RENDER_CMD_POLYGON: {
-                for (size_t j = 0; j < cmd->polygon.points_len; ++j) {
-                    cmd->polygon.points[j].x *= scale;
-                    cmd->polygon.points[j].y *= scale;
-                }
-                draw_polygon(mvp, cmd->polygon.points, cmd->polygon.points_len,
-                             blend_amount, cmd->polygon.color);
-                break;
-            }
             case XPL_RENDER_CMD_TEXT: {
+                xmat4 mat_mvp, *mvp = &mat_mvp;
+                xmat4_multiply(vp, &cmd->matrix, mvp);
                 xpl_markup_t *markup = cmd->text.markup;
                 draw_text(mvp, xvec2_scale(cmd->text.position, scale), markup,
                           cmd->text.text, cmd->text.align);
@@ -734,10 +342,11 @@ void xpl_imui_render_draw(xivec2 *screen, xpl_render_cmd_t *commands,
                 }
                 break;
             default:
-                LOG_ERROR("Unimplemented command: %d", cmd->type);
                 break;
 		}
 	}
+	draw_stream(vp, drawn, g_geometry->count);
+
 	imui_render_state_clear();
 	imui_render_advance_frame();
 }
@@ -748,12 +357,18 @@ void xpl_imui_render_init() {
 	if (g_initialized)
 		return;
     
-	g_circle_verts = init_circle_verts();
-    
 	g_text_cache = xpl_text_cache_new(256);
     
-	g_circle_verts = init_circle_verts();
-	g_geom_cache = geometry_cache_new();
+	g_frame_arena = xpl_arena_new(FRAME_ARENA_CHUNK_SIZE);
+	g_geometry = xpl_imui_geometry_new(&g_frame_arena->allocator);
+	g_stream_bo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+	g_stream_vao = xpl_vao_new();
+	xpl_vao_define_vertex_attrib(g_stream_vao, "position", g_stream_bo, 2,
+                                 GL_FLOAT, GL_FALSE, sizeof(xpl_imui_vertex_t),
+                                 offsetof(xpl_imui_vertex_t, position));
+	xpl_vao_define_vertex_attrib(g_stream_vao, "color", g_stream_bo, 4,
+                                 GL_UNSIGNED_BYTE, GL_TRUE, sizeof(xpl_imui_vertex_t),
+                                 offsetof(xpl_imui_vertex_t, color));
     
 	g_ui_shader = xpl_shader_get("IMUI");
 	if (!g_ui_shader->linked) {
@@ -769,10 +384,15 @@ void xpl_imui_render_destroy() {
 	if (!g_initialized)
 		return;
     
-    xpl_free(g_circle_verts);
-    
 	xpl_text_cache_destroy(&g_text_cache);
-	geometry_cache_destroy(&g_geom_cache);
+    
+	xpl_vao_destroy(&g_stream_vao);
+	xpl_bo_destroy(&g_stream_bo);
+	xpl_imui_geometry_destroy(&g_geometry);
+	xpl_arena_destroy(&g_frame_arena);
+	if (g_batches) xpl_free(g_batches);
+	g_batches = NULL;
+	g_batch_count = g_batch_capacity = 0;
     
 	xpl_shader_release(&g_ui_shader);
     
@@ -783,8 +403,9 @@ void xpl_imui_render_destroy() {
 void xpl_render_cmd_content_reset(xpl_render_cmd_t *cmd) {
 	switch (cmd->type) {
         case XPL_RENDER_CMD_TEXT:
-            xpl_free(cmd->text.markup);
-            free(cmd->text.text); // strdup allocated
+            // The queue's arena takes these back all at once.
+            cmd->text.markup = NULL;
+            cmd->text.text = NULL;
             break;
         case XPL_RENDER_CMD_POLYGON:
             xpl_free(cmd->polygon.points);
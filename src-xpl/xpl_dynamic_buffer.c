@@ -13,41 +13,90 @@
 #include "xpl_memory.h"
 #include "xpl_dynamic_buffer.h"
 
-#define CHUNK_SIZE 4096
+#define MIN_CAPACITY 64
 
 xpl_dynamic_buffer_t *xpl_dynamic_buffer_new(void) {
     xpl_dynamic_buffer_t *buf = xpl_calloc_type(xpl_dynamic_buffer_t);
     return buf;
 }
 
+xpl_dynamic_buffer_t *xpl_dynamic_buffer_new_with_allocator(const xpl_allocator_t *allocator) {
+    xpl_dynamic_buffer_t *buf = xpl_dynamic_buffer_new();
+    buf->allocator = allocator;
+    return buf;
+}
+
 void xpl_dynamic_buffer_destroy(xpl_dynamic_buffer_t **ppbuffer) {
     xpl_dynamic_buffer_t *buf = *ppbuffer;
     
-    if (buf->capacity) {
-        xpl_free(buf->content);
-    }
+    xpl_dynamic_buffer_release(buf);
     
     xpl_free(buf);
     *ppbuffer = NULL;
 }
 
+static void set_capacity(xpl_dynamic_buffer_t *self, size_t capacity) {
+    const xpl_allocator_t *allocator = self->allocator;
+    if (! allocator) {
+        self->content = xpl_realloc(self->content, capacity);
+    } else {
+        unsigned char *content = allocator->alloc(allocator->context, capacity);
+        if (self->content) {
+            memcpy(content, self->content, self->length);
+            if (allocator->free) allocator->free(allocator->context, self->content);
+        }
+        self->content = content;
+    }
+    self->capacity = capacity;
+}
+
+void xpl_dynamic_buffer_reserve(xpl_dynamic_buffer_t *self, size_t capacity) {
+    assert(self);
+    
+    if (capacity <= self->capacity) return;
+    set_capacity(self, capacity);
+}
+
+// Doubling keeps a run of appends to amortized constant time per byte.
+static void grow_to_fit(xpl_dynamic_buffer_t *self, size_t required) {
+    if (required <= self->capacity) return;
+    
+    size_t capacity = xmax(self->capacity * 2, (size_t)MIN_CAPACITY);
+    while (capacity < required) capacity *= 2;
+    set_capacity(self, capacity);
+}
+
+void xpl_dynamic_buffer_release(xpl_dynamic_buffer_t *self) {
+    assert(self);
+    
+    if (self->content) {
+        if (! self->allocator) {
+            xpl_free(self->content);
+        } else if (self->allocator->free) {
+            self->allocator->free(self->allocator->context, self->content);
+        }
+    }
+    self->content = NULL;
+    self->capacity = 0;
+    self->length = 0;
+    xpl_dynamic_buffer_mark_clean(self);
+}
+
 void xpl_dynamic_buffer_alloc(xpl_dynamic_buffer_t *self, size_t data_len, int as_data) {
     assert(self);
     
     if (!data_len) return;
 	
-	size_t alloc_size;
-    if (self->content) {
-		alloc_size = (self->capacity + data_len + CHUNK_SIZE) / CHUNK_SIZE * CHUNK_SIZE;
-        self->content = xpl_realloc(self->content, alloc_size);
+    if (! self->content) {
+        // Callers that size the buffer up front (files, atlases) get exactly what they asked for.
+        xpl_dynamic_buffer_reserve(self, self->length + data_len);
     } else {
-		alloc_size = data_len;
-        self->content = xpl_alloc(data_len);
+        grow_to_fit(self, self->length + data_len);
     }
-    memset(self->content + self->length, 0, alloc_size - self->length);
     
-    self->capacity = alloc_size;
     if (as_data) {
+        memset(self->content + self->length, 0, data_len);
+        self->dirty_range_min = xmin(self->dirty_range_min, self->length);
     	self->length += data_len;
     	self->dirty_range_max = xmax(self->dirty_range_max, self->length);
     }
@@ -59,9 +108,7 @@ void xpl_dynamic_buffer_append(xpl_dynamic_buffer_t *self, const unsigned char *
     
     if (! data_len) return;
     
-    if (self->length + data_len > self->capacity) {
-    	xpl_dynamic_buffer_alloc(self, self->length + data_len - self->capacity, FALSE);
-    }
+    grow_to_fit(self, self->length + data_len);
     memmove(self->content + self->length,
             data,
             data_len);
@@ -86,9 +133,7 @@ void xpl_dynamic_buffer_insert(xpl_dynamic_buffer_t *self, size_t insert_offset,
     
     // Otherwise, it's a three stage copy
     size_t newlen = self->length + data_len;
-    if (newlen > self->capacity) {
-    	self->content = xpl_realloc(self->content, newlen);
-    }
+    grow_to_fit(self, newlen);
     
     // Now we have the original copy with room for the insertion
     // Move the final chunk forward by data_len
@@ -110,14 +155,13 @@ void xpl_dynamic_buffer_insert(xpl_dynamic_buffer_t *self, size_t insert_offset,
 void xpl_dynamic_buffer_delete(xpl_dynamic_buffer_t *self, size_t delete_offset, size_t data_len) {
     
     assert(self);
-    assert(delete_offset + data_len <= self->capacity);
+    assert(delete_offset + data_len <= self->length);
     
     if (! data_len) return;
     
-    memmove(self->content, self->content, delete_offset);
     memmove(self->content + delete_offset,
             self->content + delete_offset + data_len,
-            self->length - data_len);
+            self->length - delete_offset - data_len);
     
     self->dirty_range_max = xmax(self->dirty_range_max, self->length);
     self->length -= data_len;
@@ -40,7 +40,7 @@ void xpl_log_times(xpl_engine_execution_info_t *execution_info,
 	size_t retain_sample_count = execution_info->retain_execution_sample_count;
 	xpl_execution_stats_t *head = execution_info->execution_stats, *it = NULL, *tmp = NULL;
 
-	xpl_execution_stats_t *new_node = xpl_alloc_type(xpl_execution_stats_t);
+	xpl_execution_stats_t *new_node = xpl_pool_alloc_type(execution_info->execution_stats_pool, xpl_execution_stats_t);
 	new_node->all_time = all_time;
 	new_node->engine_time = engine_time;
 	new_node->interpolation_time = interpolation_time;
@@ -64,7 +64,7 @@ void xpl_log_times(xpl_engine_execution_info_t *execution_info,
     if (count > retain_sample_count && head) {
         DL_FOREACH_SAFE(head, it, tmp) {
             DL_DELETE(head, it);
-            xpl_free(it);
+            xpl_pool_free(execution_info->execution_stats_pool, it);
             count--;
             if (count <= retain_sample_count) break;
         }
@@ -127,16 +127,15 @@ xpl_engine_execution_info_t *xpl_engine_execution_info_new() {
 
 	execution_info->execution_stats = NULL;
 	execution_info->retain_execution_sample_count = 5;
+	execution_info->execution_stats_pool = xpl_pool_new_type(xpl_execution_stats_t, execution_info->retain_execution_sample_count + 1);
 
 	return execution_info;
 }
 
 void xpl_engine_execution_info_destroy(
 									   xpl_engine_execution_info_t **execution_info) {
-	xpl_execution_stats_t *stats = (*execution_info)->execution_stats;
-	while (stats != NULL ) {
-		DL_DELETE(stats, stats);
-	}
+	// The pool owns the nodes.
+	xpl_pool_destroy(&(*execution_info)->execution_stats_pool);
 
 	xpl_free(*execution_info);
 	*execution_info = NULL;
@@ -11,67 +11,288 @@
 
 #include "xpl_es.h"
 
-typedef struct es_component {
-	xpl_entity          eid;
+// Chunks are sized to stay cache friendly; each archetype fits as many rows as it can.
+#define ES_CHUNK_BYTES              (16 * 1024)
+#define ES_COLUMN_ALIGN             16
+#define ES_ARCHETYPES_INITIAL       16
+#define ES_RECORDS_INITIAL          256
+#define ES_NO_SLOT                  UINT32_MAX
+#define ES_GENERATION_MASK          ((1u << (32 - XPL_ENTITY_INDEX_BITS)) - 1)
+
+typedef struct es_type {
 	xpl_type_id         type_id;
-	void                *data;
-
-	UT_hash_handle      hh_main_by_ptr;
-	UT_hash_handle      hh_entity_by_type_id;
-	UT_hash_handle      hh_type_id_by_eid;
-} es_component_t;
-
-typedef struct es_component_by_type_id {
-	xpl_type_id         type_id;
-	es_component_t      *by_eid_table;
+	size_t              size;
+	xpl_component_destructor destructor;
 	UT_hash_handle      hh;
-} es_component_by_type_id_t;
-
-typedef struct es_components {
-	es_component_t      *by_ptr_table;
-	es_component_by_type_id_t *by_type_id_table;
-} es_components_t;
+} es_type_t;
+
+// A chunk holds rows_per_chunk entity handles followed by one column per type.
+// Rows are packed: every chunk but the last is full.
+typedef struct es_archetype {
+	xpl_type_id         *type_ids;          // sorted; the hash key
+	es_type_t           **types;
+	size_t              *offsets;           // of each column in a chunk
+	size_t              type_count;
+
+	size_t              rows_per_chunk;
+	size_t              chunk_bytes;
+	uint8_t             **chunks;
+	size_t              chunk_count;
+	size_t              chunk_capacity;
+	size_t              count;
 
-typedef struct es_entity {
-	xpl_entity          id;
-	es_component_t      *component_table;
 	UT_hash_handle      hh;
-} es_entity_t;
+} es_archetype_t;
 
-typedef struct es_entities {
-	xpl_entity          next_id;
-	es_entity_t         *entity_table;
-} es_entities_t;
-
-typedef struct es_allocator {
-    xpl_type_id         type_id;
-    xpl_component_allocator allocator;
-    xpl_component_destructor destructor;
-    UT_hash_handle      hh;
-} es_allocator_t;
+typedef struct es_record {
+	es_archetype_t      *archetype;         // NULL while the slot is free
+	size_t              row;
+	uint32_t            generation;
+	uint32_t            next_free;
+} es_record_t;
 
 struct xpl_es_context {
-	es_components_t     *components;
-	es_entities_t       *entities;
-    es_allocator_t      *allocators;
+	es_record_t         *records;
+	uint32_t            record_count;
+	uint32_t            record_capacity;
+	uint32_t            free_head;
+
+	es_type_t           *types;
+
+	es_archetype_t      *archetype_table;
+	es_archetype_t      **archetypes;       // in order of creation; [0] has no components
+	size_t              archetype_count;
+	size_t              archetype_capacity;
 };
 
-static void entity_destroy(xpl_es_t *context, es_entity_t *entity) {
-	es_component_t *component, *tmp;
-	HASH_ITER(hh_entity_by_type_id, entity->component_table, component, tmp) {
-		xpl_entity_component_destroy(context, entity->id, component->data);
+XPLINLINE size_t align_column(size_t offset) {
+	return (offset + ES_COLUMN_ALIGN - 1) & ~(size_t)(ES_COLUMN_ALIGN - 1);
+}
+
+XPLINLINE uint8_t *row_chunk(const es_archetype_t *archetype, size_t row) {
+	return archetype->chunks[row / archetype->rows_per_chunk];
+}
+
+XPLINLINE xpl_entity *row_entity(const es_archetype_t *archetype, size_t row) {
+	return (xpl_entity *)row_chunk(archetype, row) + row % archetype->rows_per_chunk;
+}
+
+XPLINLINE void *row_component(const es_archetype_t *archetype, size_t row, size_t column) {
+	return row_chunk(archetype, row) + archetype->offsets[column]
+		+ (row % archetype->rows_per_chunk) * archetype->types[column]->size;
+}
+
+static int archetype_column(const es_archetype_t *archetype, xpl_type_id type_id, size_t *column_out) {
+	size_t lo = 0, hi = archetype->type_count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (archetype->type_ids[mid] < type_id) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo < archetype->type_count && archetype->type_ids[lo] == type_id) {
+		if (column_out) *column_out = lo;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static es_type_t *type_get(xpl_es_t *context, xpl_type_id type_id) {
+	es_type_t *type;
+	HASH_FIND_INT(context->types, &type_id, type);
+	return type;
+}
+
+static es_type_t *type_register(xpl_es_t *context, xpl_type_id type_id, size_t size) {
+	es_type_t *type = type_get(context, type_id);
+	if (! type) {
+		type = xpl_calloc_type(es_type_t);
+		type->type_id = type_id;
+		type->size = size;
+		HASH_ADD_INT(context->types, type_id, type);
+	}
+	// A destructor may have been registered before any component gave the size.
+	if (type->size == SIZE_MAX) type->size = size;
+	if (type->size != size) {
+		LOG_ERROR("Component type %u registered with size %zu, now %zu", type_id, type->size, size);
+		assert(0);
+	}
+	return type;
+}
+
+static es_archetype_t *archetype_new(xpl_es_t *context, const xpl_type_id *type_ids, size_t type_count) {
+	es_archetype_t *archetype = xpl_calloc_type(es_archetype_t);
+	archetype->type_count = type_count;
+	archetype->type_ids = xpl_alloc((type_count + 1) * sizeof(xpl_type_id));
+	archetype->types = xpl_alloc((type_count + 1) * sizeof(es_type_t *));
+	archetype->offsets = xpl_alloc((type_count + 1) * sizeof(size_t));
+
+	size_t row_bytes = sizeof(xpl_entity);
+	for (size_t i = 0; i < type_count; ++i) {
+		archetype->type_ids[i] = type_ids[i];
+		archetype->types[i] = type_get(context, type_ids[i]);
+		assert(archetype->types[i]);
+		row_bytes += archetype->types[i]->size;
+	}
+
+	size_t padding = (type_count + 1) * ES_COLUMN_ALIGN;
+	archetype->rows_per_chunk = ES_CHUNK_BYTES > padding + row_bytes ? (ES_CHUNK_BYTES - padding) / row_bytes : 1;
+
+	size_t offset = align_column(archetype->rows_per_chunk * sizeof(xpl_entity));
+	for (size_t i = 0; i < type_count; ++i) {
+		archetype->offsets[i] = offset;
+		offset = align_column(offset + archetype->rows_per_chunk * archetype->types[i]->size);
+	}
+	archetype->chunk_bytes = offset;
+
+	if (type_count) {
+		HASH_ADD_KEYPTR(hh, context->archetype_table, archetype->type_ids, type_count * sizeof(xpl_type_id), archetype);
+	}
+
+	if (context->archetype_count == context->archetype_capacity) {
+		context->archetype_capacity *= 2;
+		context->archetypes = xpl_realloc(context->archetypes, context->archetype_capacity * sizeof(es_archetype_t *));
+	}
+	context->archetypes[context->archetype_count++] = archetype;
+
+	return archetype;
+}
+
+static void archetype_destroy(es_archetype_t *archetype) {
+	for (size_t i = 0; i < archetype->chunk_count; ++i) {
+		xpl_free(archetype->chunks[i]);
+	}
+	xpl_free(archetype->chunks);
+	xpl_free(archetype->offsets);
+	xpl_free(archetype->types);
+	xpl_free(archetype->type_ids);
+	xpl_free(archetype);
+}
+
+static es_archetype_t *archetype_get(xpl_es_t *context, const xpl_type_id *type_ids, size_t type_count) {
+	if (! type_count) return context->archetypes[0];
+
+	es_archetype_t *archetype;
+	HASH_FIND(hh, context->archetype_table, type_ids, type_count * sizeof(xpl_type_id), archetype);
+	if (! archetype) {
+		archetype = archetype_new(context, type_ids, type_count);
+	}
+	return archetype;
+}
+
+static size_t archetype_push_row(es_archetype_t *archetype, xpl_entity entity) {
+	if (archetype->count == archetype->chunk_count * archetype->rows_per_chunk) {
+		if (archetype->chunk_count == archetype->chunk_capacity) {
+			archetype->chunk_capacity = archetype->chunk_capacity ? archetype->chunk_capacity * 2 : 4;
+			archetype->chunks = xpl_realloc(archetype->chunks, archetype->chunk_capacity * sizeof(uint8_t *));
+		}
+		archetype->chunks[archetype->chunk_count++] = xpl_alloc(archetype->chunk_bytes);
+	}
+
+	size_t row = archetype->count++;
+	*row_entity(archetype, row) = entity;
+	return row;
+}
+
+// Fills the hole with the last row, and updates that entity's record.
+static void archetype_remove_row(xpl_es_t *context, es_archetype_t *archetype, size_t row) {
+	assert(row < archetype->count);
+	size_t last = --archetype->count;
+	if (row != last) {
+		xpl_entity moved = *row_entity(archetype, last);
+		*row_entity(archetype, row) = moved;
+		for (size_t i = 0; i < archetype->type_count; ++i) {
+			memcpy(row_component(archetype, row, i), row_component(archetype, last, i), archetype->types[i]->size);
+		}
+		context->records[xpl_entity_index(moved)].row = row;
+	}
+
+	// Keep one empty chunk around so an entity bouncing over a chunk boundary doesn't thrash.
+	while (archetype->chunk_count > 1 &&
+		   archetype->count + 2 * archetype->rows_per_chunk <= archetype->chunk_count * archetype->rows_per_chunk) {
+		xpl_free(archetype->chunks[--archetype->chunk_count]);
+	}
+}
+
+static void row_destruct(const es_archetype_t *archetype, size_t row) {
+	for (size_t i = 0; i < archetype->type_count; ++i) {
+		if (archetype->types[i]->destructor) {
+			archetype->types[i]->destructor(row_component(archetype, row, i));
+		}
+	}
+}
+
+static es_record_t *record_get(xpl_es_t *context, xpl_entity entity) {
+	uint32_t index = xpl_entity_index(entity);
+	if (index >= context->record_count) return NULL;
+
+	es_record_t *record = &context->records[index];
+	if (! record->archetype || record->generation != xpl_entity_generation(entity)) return NULL;
+	return record;
+}
+
+static xpl_entity record_acquire(xpl_es_t *context) {
+	uint32_t index;
+	if (context->free_head != ES_NO_SLOT) {
+		index = context->free_head;
+		context->free_head = context->records[index].next_free;
+	} else {
+		assert(context->record_count <= XPL_ENTITY_INDEX_MASK);
+		if (context->record_count == context->record_capacity) {
+			context->record_capacity *= 2;
+			context->records = xpl_realloc(context->records, context->record_capacity * sizeof(es_record_t));
+		}
+		index = context->record_count++;
+		context->records[index].generation = 1;
 	}
 
-	HASH_DEL(context->entities->entity_table, entity);
-    xpl_free(entity);
+	es_record_t *record = &context->records[index];
+	record->next_free = ES_NO_SLOT;
+	return index | (record->generation << XPL_ENTITY_INDEX_BITS);
+}
+
+static void record_release(xpl_es_t *context, xpl_entity entity) {
+	uint32_t index = xpl_entity_index(entity);
+	es_record_t *record = &context->records[index];
+	record->archetype = NULL;
+	// Generation 0 never occurs, so no live handle can equal XPL_ENTITY_NONE.
+	record->generation = (record->generation + 1) & ES_GENERATION_MASK;
+	if (! record->generation) record->generation = 1;
+	record->next_free = context->free_head;
+	context->free_head = index;
+}
+
+// Moves an entity's row to another archetype. Columns the destination doesn't have
+// are dropped; ones the source doesn't have are zeroed.
+static void entity_move(xpl_es_t *context, xpl_entity entity, es_record_t *record, es_archetype_t *dest) {
+	es_archetype_t *source = record->archetype;
+	size_t source_row = record->row;
+	size_t dest_row = archetype_push_row(dest, entity);
+
+	for (size_t i = 0; i < dest->type_count; ++i) {
+		size_t column;
+		void *dest_component = row_component(dest, dest_row, i);
+		if (archetype_column(source, dest->type_ids[i], &column)) {
+			memcpy(dest_component, row_component(source, source_row, column), dest->types[i]->size);
+		} else {
+			memset(dest_component, 0, dest->types[i]->size);
+		}
+	}
+
+	archetype_remove_row(context, source, source_row);
+	record->archetype = dest;
+	record->row = dest_row;
 }
 
 xpl_es_t *xpl_es_new() {
 	xpl_es_t *context = xpl_calloc_type(xpl_es_t);
 
-	context->entities = xpl_calloc_type(es_entities_t);
-	context->entities->next_id = XPL_ENTITY_NONE + 1;
-	context->components = xpl_calloc_type(es_components_t);
+	context->record_capacity = ES_RECORDS_INITIAL;
+	context->records = xpl_alloc(context->record_capacity * sizeof(es_record_t));
+	context->free_head = ES_NO_SLOT;
+
+	context->archetype_capacity = ES_ARCHETYPES_INITIAL;
+	context->archetypes = xpl_alloc(context->archetype_capacity * sizeof(es_archetype_t *));
+	archetype_new(context, NULL, 0);
 
 	return context;
 }
@@ -81,28 +302,23 @@ void xpl_es_destroy(xpl_es_t **ppcontext) {
 	xpl_es_t *context = *ppcontext;
 	assert(context);
 
-	es_entity_t *entity, *etmp;
-	HASH_ITER(hh, context->entities->entity_table, entity, etmp) {
-		entity_destroy(context, entity);
+	HASH_CLEAR(hh, context->archetype_table);
+	for (size_t i = 0; i < context->archetype_count; ++i) {
+		es_archetype_t *archetype = context->archetypes[i];
+		for (size_t row = 0; row < archetype->count; ++row) {
+			row_destruct(archetype, row);
+		}
+		archetype_destroy(archetype);
 	}
+	xpl_free(context->archetypes);
 
-	// We don't purge the type_id table when its lists are empty for performance,
-	// so we have to do it now.
-	es_component_by_type_id_t *by_type_id, *tmp;
-	HASH_ITER(hh, context->components->by_type_id_table, by_type_id, tmp) {
-		HASH_DEL(context->components->by_type_id_table, by_type_id);
-		assert(by_type_id->by_eid_table == NULL);
-		xpl_free(by_type_id);
+	es_type_t *type, *tmp;
+	HASH_ITER(hh, context->types, type, tmp) {
+		HASH_DEL(context->types, type);
+		xpl_free(type);
 	}
 
-    es_allocator_t *allocator, *atmp;
-    HASH_ITER(hh, context->allocators, allocator, atmp) {
-        HASH_DEL(context->allocators, allocator);
-        xpl_free(allocator);
-    }
-    
-	xpl_free(context->entities);
-	xpl_free(context->components);
+	xpl_free(context->records);
 	xpl_free(context);
 
 	*ppcontext = NULL;
@@ -110,177 +326,131 @@ void xpl_es_destroy(xpl_es_t **ppcontext) {
 
 xpl_entity xpl_entity_new(xpl_es_t *context) {
 	assert(context);
-	xpl_entity eid = context->entities->next_id++;
-	es_entity_t *entity = xpl_alloc_type(es_entity_t);
-	entity->id = eid;
-	entity->component_table = NULL;
-	HASH_ADD_INT(context->entities->entity_table, id, entity);
+	xpl_entity eid = record_acquire(context);
+	es_record_t *record = &context->records[xpl_entity_index(eid)];
+	record->archetype = context->archetypes[0];
+	record->row = archetype_push_row(record->archetype, eid);
 
 	return eid;
 }
 
 void xpl_entity_destroy(xpl_es_t *context, xpl_entity entity) {
 	assert(context);
-	es_entity_t *entry;
-	HASH_FIND_INT(context->entities->entity_table, &entity, entry);
-	assert(entry);
-	entity_destroy(context, entry);
+	es_record_t *record = record_get(context, entity);
+	assert(record);
+
+	row_destruct(record->archetype, record->row);
+	archetype_remove_row(context, record->archetype, record->row);
+	record_release(context, entity);
 }
 
-xpl_entity xpl_entity_transfer(xpl_es_t *source, xpl_entity source_entity, xpl_es_t *dest) {
-    xpl_entity destination_entity = xpl_entity_new(dest);
-    
-    es_entity_t *entity;
-    HASH_FIND_INT(source->entities->entity_table, &source_entity, entity);
-    assert(entity);
-    es_component_t *component, *tmp;
-    HASH_ITER(hh_entity_by_type_id, entity->component_table, component, tmp) {
-        void *data = component->data;
-        const xpl_type_id type_id = component->type_id;
-        xpl_component_remove_type_id(source, source_entity, data, type_id);
-        xpl_component_assign_type_id(dest, destination_entity, data, type_id);
-    }
-    xpl_entity_destroy(source, source_entity);
-    
-    return destination_entity;
-}
-
-void *xpl_component_assign_type_id(xpl_es_t *context, const xpl_entity entity, void *component, const xpl_type_id type_id) {
-    if (xpl_entity_component_with_type_id(context, entity, type_id)) {
-    	LOG_ERROR("Duplicate component assignment to %u!", entity);
-    	assert(0);
-    }
-    
+int xpl_entity_alive(xpl_es_t *context, xpl_entity entity) {
 	assert(context);
-	es_component_t *esc = xpl_alloc_type(es_component_t);
-	esc->eid = entity;
-	esc->data = component;
-	esc->type_id = type_id;
-
-	HASH_ADD(hh_main_by_ptr, context->components->by_ptr_table, data, sizeof(void *), esc);
-
-	es_component_by_type_id_t *by_type_id;
-	HASH_FIND_INT(context->components->by_type_id_table, &type_id, by_type_id);
-	if (! by_type_id) {
-		by_type_id = xpl_alloc_type(es_component_by_type_id_t);
-		by_type_id->type_id = type_id;
-		by_type_id->by_eid_table = NULL;
-		HASH_ADD_INT(context->components->by_type_id_table, type_id, by_type_id);
+	return record_get(context, entity) != NULL;
+}
+
+xpl_entity xpl_entity_transfer(xpl_es_t *source, xpl_entity source_entity, xpl_es_t *dest) {
+	es_record_t *record = record_get(source, source_entity);
+	assert(record);
+	es_archetype_t *source_archetype = record->archetype;
+	size_t source_row = record->row;
+
+	for (size_t i = 0; i < source_archetype->type_count; ++i) {
+		const es_type_t *source_type = source_archetype->types[i];
+		es_type_t *dest_type = type_register(dest, source_type->type_id, source_type->size);
+		if (! dest_type->destructor) dest_type->destructor = source_type->destructor;
 	}
-	HASH_ADD(hh_type_id_by_eid, by_type_id->by_eid_table, eid, sizeof(xpl_entity), esc);
 
-	es_entity_t *ee;
-	HASH_FIND_INT(context->entities->entity_table, &entity, ee);
-	assert(ee);
-    HASH_ADD(hh_entity_by_type_id, ee->component_table, type_id, sizeof(type_id), esc);
+	xpl_entity destination_entity = xpl_entity_new(dest);
+	es_record_t *dest_record = &dest->records[xpl_entity_index(destination_entity)];
+	es_archetype_t *dest_archetype = archetype_get(dest, source_archetype->type_ids, source_archetype->type_count);
+	archetype_remove_row(dest, dest_record->archetype, dest_record->row);
+	dest_record->archetype = dest_archetype;
+	dest_record->row = archetype_push_row(dest_archetype, destination_entity);
+
+	for (size_t i = 0; i < dest_archetype->type_count; ++i) {
+		memcpy(row_component(dest_archetype, dest_record->row, i),
+			   row_component(source_archetype, source_row, i),
+			   dest_archetype->types[i]->size);
+	}
 
-	return component;
+	archetype_remove_row(source, source_archetype, source_row);
+	record_release(source, source_entity);
+
+	return destination_entity;
 }
 
-void *xpl_component_remove_type_id(xpl_es_t *context, const xpl_entity entity, void *component, const xpl_type_id type_id) {
+void xpl_component_destructor_for_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_destructor destructor) {
 	assert(context);
-    assert(type_id);
-	es_component_t *esc;
-	HASH_FIND(hh_main_by_ptr, context->components->by_ptr_table, &component, sizeof(void *), esc);
-	assert(esc);
-	HASH_DELETE(hh_main_by_ptr, context->components->by_ptr_table, esc);
-
-	es_component_by_type_id_t *by_type_id;
-	HASH_FIND_INT(context->components->by_type_id_table, &type_id, by_type_id);
-	assert(by_type_id);
-	HASH_DELETE(hh_type_id_by_eid, by_type_id->by_eid_table, esc);
-
-	es_entity_t *ee;
-	HASH_FIND_INT(context->entities->entity_table, &esc->eid, ee);
-	assert(ee);
-	HASH_DELETE(hh_entity_by_type_id, ee->component_table, esc);
-    
-    xpl_free(esc);
-
-	return component;
-}
-
-void xpl_component_allocator_for_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_allocator allocator, xpl_component_destructor destructor) {
-    assert(context);
-    
-    es_allocator_t *entry;
-    HASH_FIND_INT(context->allocators, &type_id, entry);
-    if (! entry) {
-        entry = xpl_calloc_type(es_allocator_t);
-        entry->type_id = type_id;
-        HASH_ADD_INT(context->allocators, type_id, entry);
-    }
-    entry->allocator = allocator;
-    entry->destructor = destructor;
-}
-
-static void *component_create_with_type_id(xpl_es_t *context, const xpl_type_id type_id, size_t size) {
-    assert(context);
-    es_allocator_t *allocator;
-    HASH_FIND_INT(context->allocators, &type_id, allocator);
-    if (allocator) return allocator->allocator();
-    
-    return xpl_calloc(size);
-}
-
-void xpl_component_destroy_with_type_id(xpl_es_t *context, void *component, const xpl_type_id type_id) {
-    assert(component);
-    
-	// This looks dangerous. We actually do the free FIRST so that any
-	// last second eid lookups in registered destructors will work.  THEN
-	// we destroy the association with the entity, after the component
-	// is dead and gone.
-    es_allocator_t *allocator;
-    HASH_FIND_INT(context->allocators, &type_id, allocator);
-    if (allocator) {
-        allocator->destructor(component);
-    } else {
-        xpl_free(component);
-    }
-	
-	es_component_t *esc;
-    HASH_FIND(hh_main_by_ptr, context->components->by_ptr_table, &component, sizeof(void *), esc);
-    if (esc) {
-        // Not necessary for the component to be registered.
-        // The ES allocates the component and allows it to be detached, so it must
-        // allow destroy after detach.
-        xpl_component_remove_type_id(context, esc->eid, esc->data, esc->type_id);
-    }
-    
 
+	es_type_t *type = type_get(context, type_id);
+	if (! type) {
+		type = xpl_calloc_type(es_type_t);
+		type->type_id = type_id;
+		type->size = SIZE_MAX;
+		HASH_ADD_INT(context->types, type_id, type);
+	}
+	type->destructor = destructor;
 }
 
 void * xpl_component_new_with_type_id(xpl_es_t *context, xpl_entity entity, const xpl_type_id type_id, const size_t size) {
-    void *component = component_create_with_type_id(context, type_id, size);
-    xpl_component_assign_type_id(context, entity, component, type_id);
-    return component;
-}
+	assert(context);
+	es_record_t *record = record_get(context, entity);
+	assert(record);
 
-void xpl_entity_component_destroy(xpl_es_t *context, xpl_entity entity, void *component_data) {
-    const xpl_type_id type_id = xpl_component_type_id(context, component_data);
-    xpl_component_destroy_with_type_id(context, xpl_component_remove_type_id(context, entity, component_data, type_id), type_id);
-}
+	type_register(context, type_id, size);
+
+	es_archetype_t *source = record->archetype;
+	size_t column;
+	if (archetype_column(source, type_id, &column)) {
+		LOG_ERROR("Duplicate component assignment to %u!", entity);
+		assert(0);
+		return row_component(source, record->row, column);
+	}
+
+	xpl_type_id type_ids[source->type_count + 1];
+	size_t count = 0;
+	for (size_t i = 0; i < source->type_count && source->type_ids[i] < type_id; ++i) {
+		type_ids[count++] = source->type_ids[i];
+	}
+	type_ids[count++] = type_id;
+	for (size_t i = count - 1; i < source->type_count; ++i) {
+		type_ids[count++] = source->type_ids[i];
+	}
 
-xpl_entity xpl_entity_with_component(xpl_es_t *context, const void *component) {
-    assert(context);
-    assert(component);
-    es_component_t *esc;
-    HASH_FIND(hh_main_by_ptr, context->components->by_ptr_table, &component, sizeof(void *), esc);
-    return esc ? esc->eid : XPL_ENTITY_NONE;
+	es_archetype_t *dest = archetype_get(context, type_ids, count);
+	entity_move(context, entity, record, dest);
+
+	archetype_column(dest, type_id, &column);
+	return row_component(dest, record->row, column);
 }
 
-xpl_type_id xpl_component_type_id(xpl_es_t *context, const void *component) {
+void xpl_component_remove_type_id(xpl_es_t *context, const xpl_entity entity, const xpl_type_id type_id) {
 	assert(context);
-	assert(component);
-	es_component_t *esc;
-	HASH_FIND(hh_main_by_ptr, context->components->by_ptr_table, &component, sizeof(void *), esc);
-	return esc ? esc->type_id : 0;
+	es_record_t *record = record_get(context, entity);
+	assert(record);
+
+	es_archetype_t *source = record->archetype;
+	size_t column;
+	if (! archetype_column(source, type_id, &column)) return;
+
+	if (source->types[column]->destructor) {
+		source->types[column]->destructor(row_component(source, record->row, column));
+	}
+
+	xpl_type_id type_ids[source->type_count];
+	size_t count = 0;
+	for (size_t i = 0; i < source->type_count; ++i) {
+		if (i != column) type_ids[count++] = source->type_ids[i];
+	}
+
+	entity_move(context, entity, record, archetype_get(context, type_ids, count));
 }
 
 xpl_component_result_set_t *xpl_component_result_set_new() {
     size_t max_size = 2;
 	xpl_component_result_set_t *set = xpl_alloc_type(xpl_component_result_set_t);
-	set->result = xpl_alloc((max_size) * sizeof(xpl_component_result_t));
+	set->result = xpl_alloc((max_size + 1) * sizeof(xpl_component_result_t));
 	set->max_size = max_size;
 	set->size = 0;
 	return set;
@@ -292,29 +462,35 @@ void xpl_component_result_set_destroy(xpl_component_result_set_t **ppset) {
 	assert(set);
 
 	xpl_free(set->result);
+	xpl_free(set);
 
 	*ppset = NULL;
 }
 
 size_t xpl_components_with_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_component_result_set_t *results) {
     assert(results);
-	assert(results->max_size > 0);
 	results->size = 0;
 
-	es_component_by_type_id_t *by_type_id;
-	HASH_FIND_INT(context->components->by_type_id_table, &type_id, by_type_id);
-	if (by_type_id) {
-		es_component_t *esc, *tmp;
-		HASH_ITER(hh_type_id_by_eid, by_type_id->by_eid_table, esc, tmp) {
-			size_t index = results->size++;
-			results->result[index].eid = esc->eid;
-			results->result[index].component = esc->data;
-
-			// Resize in case of imminent overflow
-			if (results->size == results->max_size) {
-				results->max_size *= 1.75 + 1;
-				results->result = xpl_realloc(results->result, (1 + results->max_size) * sizeof(xpl_component_result_t));
-			}
+	xpl_es_query_t query;
+	xpl_es_query_init(&query, context, 1, &type_id);
+
+	// Size the set once; the archetype counts are exact.
+	size_t total = 0;
+	for (size_t i = 0; i < context->archetype_count; ++i) {
+		if (archetype_column(context->archetypes[i], type_id, NULL)) total += context->archetypes[i]->count;
+	}
+	if (total > results->max_size) {
+		results->max_size = total;
+		results->result = xpl_realloc(results->result, (results->max_size + 1) * sizeof(xpl_component_result_t));
+	}
+
+	const size_t size = type_get(context, type_id) ? type_get(context, type_id)->size : 0;
+	while (xpl_es_query_next(&query)) {
+		uint8_t *component = query.components[0];
+		for (size_t i = 0; i < query.count; ++i) {
+			results->result[results->size].eid = query.entities[i];
+			results->result[results->size].component = component + i * size;
+			results->size++;
 		}
 	}
 
@@ -326,30 +502,24 @@ size_t xpl_components_with_type_id(xpl_es_t *context, const xpl_type_id type_id,
 }
 
 void * xpl_component_with_type_id(xpl_es_t *context, const xpl_type_id type_id, xpl_entity *entity_out) {
-    es_component_by_type_id_t *by_type_id;
-    HASH_FIND_INT(context->components->by_type_id_table, &type_id, by_type_id);
-    if (by_type_id) {
-        es_component_t *esc, *tmp;
-        HASH_ITER(hh_type_id_by_eid, by_type_id->by_eid_table, esc, tmp) {
-        	if (entity_out) *entity_out = esc->eid;
-            return esc->data;
-        }
-    }
+	xpl_es_query_t query;
+	xpl_es_query_init(&query, context, 1, &type_id);
+	if (xpl_es_query_next(&query)) {
+		if (entity_out) *entity_out = query.entities[0];
+		return query.components[0];
+	}
 
-    if (entity_out) *entity_out = XPL_ENTITY_NONE;
-    return NULL;    
+	if (entity_out) *entity_out = XPL_ENTITY_NONE;
+	return NULL;
 }
 
 void * xpl_entity_component_with_type_id(xpl_es_t *context, xpl_entity entity, const xpl_type_id type_id) {
-	es_entity_t *ee;
-	HASH_FIND_INT(context->entities->entity_table, &entity, ee);
-	if (! ee) {
-		assert(ee); // Entity doesn't exist
-	}
+	es_record_t *record = record_get(context, entity);
+	assert(record); // Entity doesn't exist
+	if (! record) return NULL;
 
-	es_component_t *ec;
-    HASH_FIND(hh_entity_by_type_id, ee->component_table, &type_id, sizeof(type_id), ec);
-	return ec ? ec->data : NULL;
+	size_t column;
+	return archetype_column(record->archetype, type_id, &column) ? row_component(record->archetype, record->row, column) : NULL;
 }
 
 xpl_entity xpl_only_entity_with_component_type_id(xpl_es_t *context, const xpl_type_id type_id) {
@@ -358,3 +528,47 @@ xpl_entity xpl_only_entity_with_component_type_id(xpl_es_t *context, const xpl_t
     return e;
 }
 
+void xpl_es_query_init(xpl_es_query_t *query, xpl_es_t *context, const size_t type_count, const xpl_type_id *type_ids) {
+	assert(query);
+	assert(context);
+	assert(type_count <= XPL_ES_QUERY_MAX);
+
+	memset(query, 0, sizeof(xpl_es_query_t));
+	query->es = context;
+	query->type_count = type_count;
+	memcpy(query->type_ids, type_ids, type_count * sizeof(xpl_type_id));
+}
+
+int xpl_es_query_next(xpl_es_query_t *query) {
+	xpl_es_t *context = query->es;
+
+	while (query->archetype < context->archetype_count) {
+		const es_archetype_t *archetype = context->archetypes[query->archetype];
+
+		int match = TRUE;
+		if (query->chunk == 0) {
+			for (size_t i = 0; match && i < query->type_count; ++i) {
+				match = archetype_column(archetype, query->type_ids[i], &query->columns[i]);
+			}
+		}
+
+		size_t first = query->chunk * archetype->rows_per_chunk;
+		if (! match || first >= archetype->count) {
+			query->archetype++;
+			query->chunk = 0;
+			continue;
+		}
+
+		uint8_t *chunk = archetype->chunks[query->chunk++];
+		query->count = xmin(archetype->rows_per_chunk, archetype->count - first);
+		query->entities = (const xpl_entity *)chunk;
+		for (size_t i = 0; i < query->type_count; ++i) {
+			query->components[i] = chunk + archetype->offsets[query->columns[i]];
+		}
+		return TRUE;
+	}
+
+	query->count = 0;
+	query->entities = NULL;
+	return FALSE;
+}
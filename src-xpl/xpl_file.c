@@ -6,6 +6,7 @@
 //  Copyright (c) 2013 Informi Software Inc. All rights reserved.
 //
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -15,6 +16,13 @@
 #include "xpl_file.h"
 #include "xpl_platform.h"
 
+#if !defined(XPL_PLATFORM_WINDOWS)
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
 const char *xpl_file_extension(const char *filename) {
 	char *e = strrchr(filename, '.');
 	if (e == NULL) e = "";
@@ -40,6 +48,68 @@ void xpl_file_get_contents(const char *filename, xpl_dynamic_buffer_t *buffer) {
 	fclose(file);
 }
 
+xpl_file_mapping_t *xpl_file_map(const char *filename) {
+	xpl_file_mapping_t *mapping = xpl_calloc_type(xpl_file_mapping_t);
+#if defined(XPL_PLATFORM_WINDOWS)
+	FILE *file = fopen(filename, "rb");
+	if (! file) {
+		xpl_free(mapping);
+		return NULL;
+	}
+	fclose(file);
+	mapping->buffer = xpl_dynamic_buffer_new();
+	xpl_file_get_contents(filename, mapping->buffer);
+	mapping->content = mapping->buffer->content;
+	mapping->length = mapping->buffer->length;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		xpl_free(mapping);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		xpl_free(mapping);
+		return NULL;
+	}
+	void *content = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping holds its own reference
+	if (content == MAP_FAILED) {
+		LOG_ERROR("Couldn't map file %s", filename);
+		xpl_free(mapping);
+		return NULL;
+	}
+	mapping->content = content;
+	mapping->length = (size_t)st.st_size;
+#endif
+	return mapping;
+}
+
+xpl_file_mapping_t *xpl_file_mapping_slice(const xpl_file_mapping_t *source, size_t offset, size_t length) {
+	assert(offset + length <= source->length);
+	xpl_file_mapping_t *mapping = xpl_calloc_type(xpl_file_mapping_t);
+	mapping->content = source->content + offset;
+	mapping->length = length;
+	mapping->source = source;
+	return mapping;
+}
+
+void xpl_file_unmap(xpl_file_mapping_t **ppmapping) {
+	xpl_file_mapping_t *mapping = *ppmapping;
+	if (mapping->source) {
+		// Slices don't own their content
+	} else if (mapping->buffer) {
+		xpl_dynamic_buffer_destroy(&mapping->buffer);
+	} else {
+#if !defined(XPL_PLATFORM_WINDOWS)
+		munmap((void *)mapping->content, mapping->length);
+#endif
+	}
+	xpl_free(mapping);
+	*ppmapping = NULL;
+}
+
 // Clean-room reimpl of GNU-like basename for Windows
 #define INCLUDES_DRIVE(path)	((((path)[0] >= 'a' && (path)[0] <= 'z') || \
 								  ((path)[0] >= 'A' && (path)[0] <= 'Z')) && (path)[1] == ':')
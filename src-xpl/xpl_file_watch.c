@@ -0,0 +1,224 @@
+//
+//  xpl_file_watch.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-29.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "uthash.h"
+
+#include "xpl.h"
+#include "xpl_memory.h"
+#include "xpl_log.h"
+#include "xpl_file.h"
+#include "xpl_file_watch.h"
+
+#if defined(__linux__)
+#	define XPL_FILE_WATCH_INOTIFY 1
+#	include <errno.h>
+#	include <unistd.h>
+#	include <sys/inotify.h>
+#endif
+
+typedef struct watched_file {
+	char                    filename[PATH_MAX];
+	time_t                  mtime;
+	off_t                   size;
+	int                     changed;
+	void                    *data;
+	UT_hash_handle          hh;
+} watched_file_t;
+
+#if XPL_FILE_WATCH_INOTIFY
+typedef struct watched_dir {
+	int                     wd;
+	char                    dirname[PATH_MAX];
+	UT_hash_handle          hh;
+} watched_dir_t;
+#endif
+
+struct xpl_file_watch {
+	watched_file_t          *files;
+#if XPL_FILE_WATCH_INOTIFY
+	int                     fd;
+	watched_dir_t           *dirs;
+#endif
+};
+
+static void file_stat(watched_file_t *file) {
+	struct stat st;
+	if (stat(file->filename, &st) == 0) {
+		file->mtime = st.st_mtime;
+		file->size = st.st_size;
+	} else {
+		file->mtime = 0;
+		file->size = -1;
+	}
+}
+
+xpl_file_watch_t *xpl_file_watch_new(void) {
+	xpl_file_watch_t *watch = xpl_calloc_type(xpl_file_watch_t);
+#if XPL_FILE_WATCH_INOTIFY
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0) {
+		LOG_WARN("inotify unavailable, polling modification times instead");
+	}
+#endif
+	return watch;
+}
+
+void xpl_file_watch_destroy(xpl_file_watch_t **ppwatch) {
+	assert(ppwatch);
+	xpl_file_watch_t *watch = *ppwatch;
+	assert(watch);
+
+	watched_file_t *file, *ftmp;
+	HASH_ITER(hh, watch->files, file, ftmp) {
+		HASH_DEL(watch->files, file);
+		xpl_free(file);
+	}
+
+#if XPL_FILE_WATCH_INOTIFY
+	watched_dir_t *dir, *dtmp;
+	HASH_ITER(hh, watch->dirs, dir, dtmp) {
+		HASH_DEL(watch->dirs, dir);
+		xpl_free(dir);
+	}
+	if (watch->fd >= 0) close(watch->fd);
+#endif
+
+	xpl_free(watch);
+	*ppwatch = NULL;
+}
+
+#if XPL_FILE_WATCH_INOTIFY
+// Splits at the last separator; a bare name is in ".". Returns the file's name.
+static const char *split_path(const char *filename, char *dirname) {
+	const char *separator = strrchr(filename, XPL_PATH_SEPARATOR);
+	if (! separator) {
+		strcpy(dirname, ".");
+		return filename;
+	}
+	size_t length = xmin((size_t)(separator - filename), PATH_MAX - 1);
+	memcpy(dirname, filename, length);
+	dirname[length] = '\0';
+	return separator + 1;
+}
+
+static int watch_dir(xpl_file_watch_t *self, const char *filename) {
+	char dirname[PATH_MAX];
+	split_path(filename, dirname);
+
+	watched_dir_t *dir, *tmp;
+	HASH_ITER(hh, self->dirs, dir, tmp) {
+		if (! strcmp(dir->dirname, dirname)) return TRUE;
+	}
+
+	int wd = inotify_add_watch(self->fd, dirname, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0) {
+		LOG_WARN("Couldn't watch %s: %s", dirname, strerror(errno));
+		return FALSE;
+	}
+
+	HASH_FIND_INT(self->dirs, &wd, dir);
+	if (! dir) {
+		dir = xpl_calloc_type(watched_dir_t);
+		dir->wd = wd;
+		strcpy(dir->dirname, dirname);
+		HASH_ADD_INT(self->dirs, wd, dir);
+	}
+	return TRUE;
+}
+
+static void read_events(xpl_file_watch_t *self) {
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+	while ((length = read(self->fd, buffer, sizeof(buffer))) > 0) {
+		for (char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			const struct inotify_event *event = (const struct inotify_event *)p;
+			if (! event->len) continue;
+
+			watched_dir_t *dir;
+			HASH_FIND_INT(self->dirs, &event->wd, dir);
+			if (! dir) continue;
+
+			// A path too long to have been watched can't match anything.
+			char filename[PATH_MAX];
+			int filename_length = snprintf(filename, PATH_MAX, "%s%c%s", dir->dirname, XPL_PATH_SEPARATOR, event->name);
+			if (filename_length < 0 || filename_length >= PATH_MAX) continue;
+			watched_file_t *file;
+			HASH_FIND_STR(self->files, filename, file);
+			if (file) file->changed = TRUE;
+		}
+	}
+}
+#endif
+
+int xpl_file_watch_add(xpl_file_watch_t *self, const char *filename, void *data) {
+	assert(self);
+	assert(filename);
+
+	char normalized[PATH_MAX];
+#if XPL_FILE_WATCH_INOTIFY
+	// Events name files relative to the directory, so the key has to match that form.
+	char dirname[PATH_MAX];
+	const char *basename = split_path(filename, dirname);
+	int normalized_length = snprintf(normalized, PATH_MAX, "%s%c%s", dirname, XPL_PATH_SEPARATOR, basename);
+	if (normalized_length < 0 || normalized_length >= PATH_MAX) {
+		LOG_WARN("Couldn't watch %s: path too long", filename);
+		return FALSE;
+	}
+#else
+	strncpy(normalized, filename, PATH_MAX - 1);
+	normalized[PATH_MAX - 1] = '\0';
+#endif
+
+	watched_file_t *file;
+	HASH_FIND_STR(self->files, normalized, file);
+	if (file) return TRUE;
+
+	file = xpl_calloc_type(watched_file_t);
+	strcpy(file->filename, normalized);
+	file->data = data;
+	file_stat(file);
+	HASH_ADD_STR(self->files, filename, file);
+
+#if XPL_FILE_WATCH_INOTIFY
+	if (self->fd >= 0) return watch_dir(self, normalized);
+#endif
+	return TRUE;
+}
+
+size_t xpl_file_watch_poll(xpl_file_watch_t *self, xpl_file_watch_func changed, void *context) {
+	assert(self);
+
+	watched_file_t *file, *tmp;
+#if XPL_FILE_WATCH_INOTIFY
+	if (self->fd >= 0) {
+		read_events(self);
+	} else
+#endif
+	{
+		HASH_ITER(hh, self->files, file, tmp) {
+			time_t mtime = file->mtime;
+			off_t size = file->size;
+			file_stat(file);
+			if (file->mtime != mtime || file->size != size) file->changed = TRUE;
+		}
+	}
+
+	size_t count = 0;
+	HASH_ITER(hh, self->files, file, tmp) {
+		if (! file->changed) continue;
+		file->changed = FALSE;
+		changed(file->filename, file->data, context);
+		++count;
+	}
+	return count;
+}
@@ -28,6 +28,7 @@
 #include "xpl_memory.h"
 #include "xpl_font.h"
 #include "xpl_platform.h"
+#include "xpl_vfs.h"
 #include "xpl_hash.h" // for windows max
 #define LOG_FT_ERROR(error) LOG_ERROR("FT_Error (0x%02x)", error)
 
@@ -42,19 +43,15 @@ typedef struct xpl_kerning {
     
 } xpl_kerning_t;
 
-static int resource_name_for_font_name(char *resource_name, const char *font_name, const char *extension, size_t length) {
-	char *font_path = (char *)xpl_alloc(length * sizeof (char));
-	sprintf(font_path, "fonts/%s.%s", font_name, extension);
-    
-	int result = xpl_resolve_resource(resource_name, font_path, length);
-	xpl_free(font_path);
-	return result;
+static xpl_file_mapping_t *font_map_resource(char *resource_name, const char *font_name, const char *extension, size_t length) {
+	snprintf(resource_name, length, "fonts/%s.%s", font_name, extension);
+	return xpl_vfs_map(resource_name);
 }
 
-static int font_load_face(FT_Library *library, const char *filename, const float size,
+static int font_load_face(FT_Library *library, const xpl_file_mapping_t *source, const float size,
                           FT_Face *face) {
 	assert(library);
-	assert(filename);
+	assert(source);
 	assert(size);
     
 	FT_Matrix matrix = { (int) ((1.0 / HRES) * 0x10000L),
@@ -69,7 +66,8 @@ static int font_load_face(FT_Library *library, const char *filename, const float
 		return FALSE;
 	}
     
-	error = FT_New_Face(*library, filename, 0, face);
+	// The font keeps its source mapped, so faces can share it instead of reopening the file.
+	error = FT_New_Memory_Face(*library, source->content, (FT_Long)source->length, 0, face);
 	if (error) {
 		LOG_FT_ERROR(error);
 		FT_Done_FreeType(*library);
@@ -166,7 +164,7 @@ void font_generate_kerning(xpl_font_t *self) {
 	FT_Face face;
 	FT_Vector kerning;
     
-	if (!font_load_face(&library, self->filename, self->size, &face)) {
+	if (!font_load_face(&library, self->source, self->size, &face)) {
         
 		LOG_ERROR(
                   "Couldn't generate kerning for %s %f", self->filename, self->size);
@@ -221,11 +219,11 @@ xpl_font_t *xpl_font_new(xpl_texture_atlas_t *atlas, const char *name,
 	assert(size);
     
 	char resource_name[PATH_MAX];
-	if (! resource_name_for_font_name(&resource_name[0], name, "ttf", PATH_MAX)) {
-		if (! resource_name_for_font_name(&resource_name[0], name, "otf", PATH_MAX)) {
-			LOG_ERROR("Couldn't create requested font: %s %f", name, size);
-			return NULL;
-		}
+	xpl_file_mapping_t *source = font_map_resource(&resource_name[0], name, "ttf", PATH_MAX);
+	if (! source) source = font_map_resource(&resource_name[0], name, "otf", PATH_MAX);
+	if (! source) {
+		LOG_ERROR("Couldn't create requested font: %s %f", name, size);
+		return NULL;
 	}
     
 	xpl_font_t *self = xpl_alloc_type(xpl_font_t);
@@ -237,6 +235,7 @@ xpl_font_t *xpl_font_new(xpl_texture_atlas_t *atlas, const char *name,
 	self->descender = 0.0f;
 	self->name = strdup(name);
 	self->filename = strdup(resource_name);
+	self->source = source;
 	self->size = size;
 	self->outline_type = xfo_none;
 	self->outline_thickness = 0.0f;
@@ -256,7 +255,7 @@ xpl_font_t *xpl_font_new(xpl_texture_atlas_t *atlas, const char *name,
 	FT_Library library;
 	FT_Face face;
     
-	if (!font_load_face(&library, self->filename, self->size * EXTRA_PRECISION,
+	if (!font_load_face(&library, self->source, self->size * EXTRA_PRECISION,
                         &face))
 		return self;
     
@@ -289,6 +288,7 @@ void xpl_font_destroy(xpl_font_t **ppfont) {
 	assert(font);
     
 	free(font->filename); // Allocated using strdup
+	xpl_file_unmap(&font->source);
 	free(font->name); // Allocated using strdup
     
 	xpl_glyph_t *elem, *tmp;
@@ -392,7 +392,7 @@ size_t xpl_font_load_glyphs(xpl_font_t *self, const wchar_t *charcodes) {
     
 	FT_Library library;
 	FT_Face face;
-	if (!font_load_face(&library, self->filename, self->size, &face)) {
+	if (!font_load_face(&library, self->source, self->size, &face)) {
 		return charcount; // We missed all of them.
 	}
     
@@ -0,0 +1,411 @@
+//
+//  xpl_gl_record.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-30.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include "xpl_gl.h"
+
+#include <string.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+#include "xpl_gl_record.h"
+
+#define RECORD_TEXTURE_UNITS	16
+#define RECORD_MAX_ATTRIBS		16
+
+static xpl_gl_record_stats_t s_current;
+static xpl_gl_record_stats_t s_totals;
+static size_t s_frames = 0;
+
+void xpl_gl_record_stats_add(xpl_gl_record_stats_t *sum, const xpl_gl_record_stats_t *stats) {
+	sum->draw_calls += stats->draw_calls;
+	sum->instanced_draw_calls += stats->instanced_draw_calls;
+	sum->vertices += stats->vertices;
+	sum->instances += stats->instances;
+	sum->state_changes += stats->state_changes;
+	sum->redundant_binds += stats->redundant_binds;
+	sum->program_binds += stats->program_binds;
+	sum->texture_binds += stats->texture_binds;
+	sum->uniform_updates += stats->uniform_updates;
+	sum->buffer_uploads += stats->buffer_uploads;
+	sum->buffer_upload_bytes += stats->buffer_upload_bytes;
+	sum->texture_uploads += stats->texture_uploads;
+	sum->texture_upload_bytes += stats->texture_upload_bytes;
+	sum->shader_compiles += stats->shader_compiles;
+}
+
+void xpl_gl_record_frame_begin(void) {
+	xpl_gl_record_stats_add(&s_totals, &s_current);
+	memset(&s_current, 0, sizeof(s_current));
+}
+
+void xpl_gl_record_frame_end(xpl_gl_record_stats_t *frame_out) {
+	if (frame_out) *frame_out = s_current;
+	xpl_gl_record_stats_add(&s_totals, &s_current);
+	memset(&s_current, 0, sizeof(s_current));
+	++s_frames;
+}
+
+void xpl_gl_record_totals(xpl_gl_record_stats_t *totals_out, size_t *frames_out) {
+	*totals_out = s_totals;
+	xpl_gl_record_stats_add(totals_out, &s_current);
+	if (frames_out) *frames_out = s_frames;
+}
+
+#if defined(XPL_PLATFORM_OSX) || defined(XPL_PLATFORM_IOS)
+
+int xpl_gl_record_install(void) {
+	LOG_WARN("GL is linked directly on this platform; can't record");
+	return FALSE;
+}
+
+#else
+
+// Just enough bound state to spot redundant binds and answer queries.
+static struct {
+	GLuint                      next_name;
+	GLuint                      program;
+	GLuint                      vertex_array;
+	GLuint                      array_buffer;
+	GLuint                      element_array_buffer;
+	GLuint                      framebuffer;
+	GLenum                      active_texture;
+	GLuint                      textures[RECORD_TEXTURE_UNITS];
+	GLint                       unpack_alignment;
+	GLint                       viewport[4];
+} s_gl;
+
+static GLuint record_name(void) {
+	return ++s_gl.next_name;
+}
+
+static void record_names(GLsizei n, GLuint *names) {
+	for (GLsizei i = 0; i < n; ++i) names[i] = record_name();
+}
+
+static void record_bind(GLuint *bound, GLuint name) {
+	++s_current.state_changes;
+	if (*bound == name) ++s_current.redundant_binds;
+	*bound = name;
+}
+
+static size_t pixel_size(GLenum format, GLenum type) {
+	size_t components;
+	switch (format) {
+		case GL_RED:
+		case GL_DEPTH_COMPONENT:	components = 1; break;
+		case GL_RG:					components = 2; break;
+		case GL_RGB:
+		case GL_BGR:				components = 3; break;
+		default:					components = 4; break;
+	}
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:				return components;
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:			return components * 2;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_5_5_5_1:	return 2;
+		default:					return components * 4;
+	}
+}
+
+static void record_texture_upload(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels) {
+	++s_current.texture_uploads;
+	if (pixels) s_current.texture_upload_bytes += (size_t)width * height * depth * pixel_size(format, type);
+}
+
+// Objects
+
+static void APIENTRY record_GenBuffers(GLsizei n, GLuint *buffers) { record_names(n, buffers); }
+static void APIENTRY record_GenFramebuffers(GLsizei n, GLuint *framebuffers) { record_names(n, framebuffers); }
+static void APIENTRY record_GenTextures(GLsizei n, GLuint *textures) { record_names(n, textures); }
+static void APIENTRY record_GenVertexArrays(GLsizei n, GLuint *arrays) { record_names(n, arrays); }
+static GLuint APIENTRY record_CreateProgram(void) { return record_name(); }
+static GLuint APIENTRY record_CreateShader(GLenum type) { return record_name(); }
+static void APIENTRY record_DeleteBuffers(GLsizei n, const GLuint *buffers) { }
+static void APIENTRY record_DeleteFramebuffers(GLsizei n, const GLuint *framebuffers) { }
+static void APIENTRY record_DeleteTextures(GLsizei n, const GLuint *textures) { }
+static void APIENTRY record_DeleteVertexArrays(GLsizei n, const GLuint *arrays) { }
+static void APIENTRY record_DeleteProgram(GLuint program) { }
+static void APIENTRY record_DeleteShader(GLuint shader) { }
+
+// Shaders
+
+static void APIENTRY record_ShaderSource(GLuint shader, GLsizei count, const GLchar* const *string, const GLint *length) { }
+static void APIENTRY record_CompileShader(GLuint shader) { ++s_current.shader_compiles; }
+static void APIENTRY record_AttachShader(GLuint program, GLuint shader) { }
+static void APIENTRY record_LinkProgram(GLuint program) { }
+static void APIENTRY record_BindFragDataLocation(GLuint program, GLuint color, const GLchar *name) { }
+
+static void APIENTRY record_GetShaderiv(GLuint shader, GLenum pname, GLint *params) {
+	*params = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0;
+}
+
+static void APIENTRY record_GetProgramiv(GLuint program, GLenum pname, GLint *params) {
+	*params = (pname == GL_LINK_STATUS || pname == GL_VALIDATE_STATUS) ? GL_TRUE : 0;
+}
+
+static void APIENTRY record_GetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	if (length) *length = 0;
+	if (bufSize > 0) infoLog[0] = '\0';
+}
+
+static void APIENTRY record_GetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	if (length) *length = 0;
+	if (bufSize > 0) infoLog[0] = '\0';
+}
+
+static GLint APIENTRY record_GetAttribLocation(GLuint program, const GLchar *name) { return 0; }
+static GLint APIENTRY record_GetUniformLocation(GLuint program, const GLchar *name) { return 0; }
+
+// Binding and state
+
+static void APIENTRY record_UseProgram(GLuint program) {
+	++s_current.program_binds;
+	record_bind(&s_gl.program, program);
+}
+
+static void APIENTRY record_BindVertexArray(GLuint array) { record_bind(&s_gl.vertex_array, array); }
+static void APIENTRY record_BindFramebuffer(GLenum target, GLuint framebuffer) { record_bind(&s_gl.framebuffer, framebuffer); }
+
+static void APIENTRY record_BindBuffer(GLenum target, GLuint buffer) {
+	if (target == GL_ELEMENT_ARRAY_BUFFER) {
+		record_bind(&s_gl.element_array_buffer, buffer);
+	} else {
+		record_bind(&s_gl.array_buffer, buffer);
+	}
+}
+
+static void APIENTRY record_ActiveTexture(GLenum texture) {
+	++s_current.state_changes;
+	s_gl.active_texture = texture;
+}
+
+static void APIENTRY record_BindTexture(GLenum target, GLuint texture) {
+	++s_current.texture_binds;
+	size_t unit = (s_gl.active_texture - GL_TEXTURE0) % RECORD_TEXTURE_UNITS;
+	record_bind(&s_gl.textures[unit], texture);
+}
+
+static void APIENTRY record_Enable(GLenum cap) { ++s_current.state_changes; }
+static void APIENTRY record_Disable(GLenum cap) { ++s_current.state_changes; }
+static void APIENTRY record_BlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha) { ++s_current.state_changes; }
+static void APIENTRY record_BlendFunc(GLenum sfactor, GLenum dfactor) { ++s_current.state_changes; }
+static void APIENTRY record_BlendFuncSeparate(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha) { ++s_current.state_changes; }
+static void APIENTRY record_DepthFunc(GLenum func) { ++s_current.state_changes; }
+static void APIENTRY record_DepthMask(GLboolean flag) { ++s_current.state_changes; }
+static void APIENTRY record_DrawBuffer(GLenum mode) { ++s_current.state_changes; }
+static void APIENTRY record_ReadBuffer(GLenum mode) { ++s_current.state_changes; }
+static void APIENTRY record_Scissor(GLint x, GLint y, GLsizei width, GLsizei height) { ++s_current.state_changes; }
+static void APIENTRY record_ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { ++s_current.state_changes; }
+static void APIENTRY record_EnableVertexAttribArray(GLuint index) { ++s_current.state_changes; }
+static void APIENTRY record_DisableVertexAttribArray(GLuint index) { ++s_current.state_changes; }
+static void APIENTRY record_VertexAttribDivisor(GLuint index, GLuint divisor) { ++s_current.state_changes; }
+static void APIENTRY record_VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer) { ++s_current.state_changes; }
+static void APIENTRY record_TexParameteri(GLenum target, GLenum pname, GLint param) { ++s_current.state_changes; }
+
+static void APIENTRY record_Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	++s_current.state_changes;
+	s_gl.viewport[0] = x;
+	s_gl.viewport[1] = y;
+	s_gl.viewport[2] = width;
+	s_gl.viewport[3] = height;
+}
+
+static void APIENTRY record_PixelStorei(GLenum pname, GLint param) {
+	++s_current.state_changes;
+	if (pname == GL_UNPACK_ALIGNMENT) s_gl.unpack_alignment = param;
+}
+
+static void APIENTRY record_Uniform1f(GLint location, GLfloat v0) { ++s_current.uniform_updates; }
+static void APIENTRY record_Uniform1i(GLint location, GLint v0) { ++s_current.uniform_updates; }
+static void APIENTRY record_Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) { ++s_current.uniform_updates; }
+static void APIENTRY record_Uniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) { ++s_current.uniform_updates; }
+static void APIENTRY record_Uniform4fv(GLint location, GLsizei count, const GLfloat *value) { ++s_current.uniform_updates; }
+static void APIENTRY record_UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { ++s_current.uniform_updates; }
+
+// Uploads
+
+static void APIENTRY record_BufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+	++s_current.buffer_uploads;
+	if (data) s_current.buffer_upload_bytes += (size_t)size;
+}
+
+static void APIENTRY record_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
+	++s_current.buffer_uploads;
+	s_current.buffer_upload_bytes += (size_t)size;
+}
+
+static void APIENTRY record_TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {
+	record_texture_upload(width, height, 1, format, type, pixels);
+}
+
+static void APIENTRY record_TexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {
+	record_texture_upload(width, height, depth, format, type, pixels);
+}
+
+static void APIENTRY record_TexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels) {
+	record_texture_upload(width, height, depth, format, type, pixels);
+}
+
+static void APIENTRY record_GenerateMipmap(GLenum target) { }
+static void APIENTRY record_FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) { }
+static GLenum APIENTRY record_CheckFramebufferStatus(GLenum target) { return GL_FRAMEBUFFER_COMPLETE; }
+
+// Drawing
+
+static void APIENTRY record_Clear(GLbitfield mask) { }
+
+static void APIENTRY record_DrawArrays(GLenum mode, GLint first, GLsizei count) {
+	++s_current.draw_calls;
+	s_current.vertices += (size_t)count;
+	++s_current.instances;
+}
+
+static void APIENTRY record_DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei primcount) {
+	++s_current.draw_calls;
+	++s_current.instanced_draw_calls;
+	s_current.vertices += (size_t)count;
+	s_current.instances += (size_t)primcount;
+}
+
+static void APIENTRY record_DrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
+	++s_current.draw_calls;
+	s_current.vertices += (size_t)count;
+	++s_current.instances;
+}
+
+static void APIENTRY record_ReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels) {
+	memset(pixels, 0, (size_t)width * height * pixel_size(format, type));
+}
+
+// Queries
+
+static GLenum APIENTRY record_GetError(void) { return GL_NO_ERROR; }
+
+static void APIENTRY record_GetIntegerv(GLenum pname, GLint *params) {
+	switch (pname) {
+		case GL_MAJOR_VERSION:			*params = 3; break;
+		case GL_MINOR_VERSION:			*params = 2; break;
+		case GL_MAX_TEXTURE_SIZE:		*params = 8192; break;
+		case GL_MAX_VERTEX_ATTRIBS:		*params = RECORD_MAX_ATTRIBS; break;
+		case GL_UNPACK_ALIGNMENT:		*params = s_gl.unpack_alignment; break;
+		case GL_CURRENT_PROGRAM:		*params = (GLint)s_gl.program; break;
+		case GL_VIEWPORT:				memcpy(params, s_gl.viewport, sizeof(s_gl.viewport)); break;
+		default:						*params = 0; break;
+	}
+}
+
+static const GLubyte * APIENTRY record_GetString(GLenum name) {
+	switch (name) {
+		case GL_VENDOR:						return (const GLubyte *)"Informi";
+		case GL_RENDERER:					return (const GLubyte *)"xpl_gl_record";
+		case GL_VERSION:					return (const GLubyte *)"3.2 xpl_gl_record";
+		case GL_SHADING_LANGUAGE_VERSION:	return (const GLubyte *)"1.50";
+		default:							return (const GLubyte *)"";
+	}
+}
+
+static const GLubyte * APIENTRY record_GetStringi(GLenum name, GLuint index) {
+	return (const GLubyte *)"";
+}
+
+int xpl_gl_record_install(void) {
+	memset(&s_gl, 0, sizeof(s_gl));
+	s_gl.active_texture = GL_TEXTURE0;
+	s_gl.unpack_alignment = 4;
+
+#define RECORD(name) gl3w##name = record_##name
+	RECORD(GenBuffers);
+	RECORD(GenFramebuffers);
+	RECORD(GenTextures);
+	RECORD(GenVertexArrays);
+	RECORD(CreateProgram);
+	RECORD(CreateShader);
+	RECORD(DeleteBuffers);
+	RECORD(DeleteFramebuffers);
+	RECORD(DeleteTextures);
+	RECORD(DeleteVertexArrays);
+	RECORD(DeleteProgram);
+	RECORD(DeleteShader);
+
+	RECORD(ShaderSource);
+	RECORD(CompileShader);
+	RECORD(AttachShader);
+	RECORD(LinkProgram);
+	RECORD(BindFragDataLocation);
+	RECORD(GetShaderiv);
+	RECORD(GetProgramiv);
+	RECORD(GetShaderInfoLog);
+	RECORD(GetProgramInfoLog);
+	RECORD(GetAttribLocation);
+	RECORD(GetUniformLocation);
+
+	RECORD(UseProgram);
+	RECORD(BindVertexArray);
+	RECORD(BindFramebuffer);
+	RECORD(BindBuffer);
+	RECORD(ActiveTexture);
+	RECORD(BindTexture);
+	RECORD(Enable);
+	RECORD(Disable);
+	RECORD(BlendEquationSeparate);
+	RECORD(BlendFunc);
+	RECORD(BlendFuncSeparate);
+	RECORD(DepthFunc);
+	RECORD(DepthMask);
+	RECORD(DrawBuffer);
+	RECORD(ReadBuffer);
+	RECORD(Scissor);
+	RECORD(ClearColor);
+	RECORD(EnableVertexAttribArray);
+	RECORD(DisableVertexAttribArray);
+	RECORD(VertexAttribDivisor);
+	RECORD(VertexAttribPointer);
+	RECORD(TexParameteri);
+	RECORD(Viewport);
+	RECORD(PixelStorei);
+	RECORD(Uniform1f);
+	RECORD(Uniform1i);
+	RECORD(Uniform3f);
+	RECORD(Uniform4f);
+	RECORD(Uniform4fv);
+	RECORD(UniformMatrix4fv);
+
+	RECORD(BufferData);
+	RECORD(BufferSubData);
+	RECORD(TexImage2D);
+	RECORD(TexImage3D);
+	RECORD(TexSubImage3D);
+	RECORD(GenerateMipmap);
+	RECORD(FramebufferTexture2D);
+	RECORD(CheckFramebufferStatus);
+
+	RECORD(Clear);
+	RECORD(DrawArrays);
+	RECORD(DrawArraysInstanced);
+	RECORD(DrawElements);
+	RECORD(ReadPixels);
+
+	RECORD(GetError);
+	RECORD(GetIntegerv);
+	RECORD(GetString);
+	RECORD(GetStringi);
+#undef RECORD
+
+	memset(&s_current, 0, sizeof(s_current));
+	memset(&s_totals, 0, sizeof(s_totals));
+	s_frames = 0;
+
+	LOG_INFO("Recording GL calls; nothing will be drawn");
+	return TRUE;
+}
+
+#endif
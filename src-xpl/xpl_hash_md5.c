@@ -231,9 +231,7 @@ static void md5_characterize(xpl_md5_context_t *self) {
 
 // MD5 initialization. Begins an MD5 operation, writing a new context.
 
-xpl_md5_context_t *xpl_md5_new() {
-	xpl_md5_context_t *context = xpl_alloc_type(xpl_md5_context_t);
-
+void xpl_md5_init(xpl_md5_context_t *context) {
 	context->finished = 0;
 
 	context->count[0] = 0;
@@ -247,7 +245,11 @@ xpl_md5_context_t *xpl_md5_new() {
 
 	memset(& context->digest_raw, 0, sizeof (context->digest_raw));
 	memset(& context->digest_chars, 0, sizeof (context->digest_chars));
+}
 
+xpl_md5_context_t *xpl_md5_new() {
+	xpl_md5_context_t *context = xpl_alloc_type(xpl_md5_context_t);
+	xpl_md5_init(context);
 	return context;
 }
 
@@ -27,6 +27,7 @@
 #include "xpl_imui.h"
 
 #define SCROLL_STACK_MAX 10
+#define RQ_ARENA_CHUNK_SIZE (64 * 1024)
 
 typedef struct context_scroll {
 	control_id id;
@@ -56,6 +57,7 @@ struct xpl_imui_context {
 	struct {
 		struct xpl_render_cmd 	queue[MAX_QUEUE_SIZE];
 		size_t					length;
+		xpl_arena_t				*arena;			// command contents, reset with the queue
 	} rq;
 
 	struct {
@@ -185,13 +187,14 @@ static void gfx_add_text(xvec2 pos, const char *text, xpl_markup_t *markup, int
 	xpl_render_cmd_t *cmd = &(g_context->rq.queue[g_context->rq.length++]);
 	cmd->type = XPL_RENDER_CMD_TEXT;
 	cmd->flags = 0;
-	cmd->text.markup = xpl_markup_new();
+	cmd->text.markup = xpl_arena_alloc_type(g_context->rq.arena, xpl_markup_t);
+	xpl_markup_clear(cmd->text.markup);
 	xpl_markup_set(cmd->text.markup, markup->family, markup->size,
 				markup->bold, markup->italic,
 				markup->foreground_color, markup->background_color);
 	cmd->text.position = pos;
 	cmd->text.align = align;
-	cmd->text.text = strdup(text);
+	cmd->text.text = xpl_arena_strdup(g_context->rq.arena, text);
 }
 
 // ---------------------------------------------------------------------------
@@ -210,6 +213,7 @@ struct xpl_imui_context *xpl_imui_context_new(xpl_imui_theme_t *theme) {
 
 	context->bounds.ref = xivec2_set(1280.0f, 720.0f);
 	context->rq.length = 0;
+	context->rq.arena = xpl_arena_new(RQ_ARENA_CHUNK_SIZE);
 
 	context->mouse.scroll.scale = 4.0f;
 	context->controls.widget_area = xrect_set(0.0f, 0.0f, 100.0f, 0.0f);
@@ -236,6 +240,10 @@ void xpl_imui_context_destroy(struct xpl_imui_context **ppcontext) {
 	xpl_imui_context_t *context = *ppcontext;
 	assert(context);
 
+	for (size_t i = 0; i < context->rq.length; ++i) {
+		xpl_render_cmd_content_reset(&context->rq.queue[i]);
+	}
+	xpl_arena_destroy(&context->rq.arena);
 	xpl_free(context);
     
     --context_count;
@@ -677,6 +685,7 @@ void xpl_imui_context_begin(xpl_imui_context_t *context, xpl_engine_execution_in
 		xpl_render_cmd_content_reset(& g_context->rq.queue[i]);
 	}
 	g_context->rq.length = 0;
+	xpl_arena_reset(g_context->rq.arena);
 
 
 }
@@ -0,0 +1,259 @@
+//
+//  xpl_imui_geometry.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-25.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "xpl.h"
+#include "xpl_memory.h"
+#include "xpl_color.h"
+#include "xpl_imui_geometry.h"
+
+#define GEOMETRY_INITIAL_CAPACITY   4096
+#define CIRCLE_VERTS                (8 * 4)
+
+static const float PI = 3.14159264;
+
+static xvec2 s_circle_verts[CIRCLE_VERTS];
+static bool s_circle_verts_ready = false;
+
+static void init_circle_verts(void) {
+	if (s_circle_verts_ready) return;
+	for (size_t i = 0; i < CIRCLE_VERTS; ++i) {
+		float a = ((float) i) / ((float) CIRCLE_VERTS) * PI * 2;
+		s_circle_verts[i] = xvec2_set(cosf(a), sinf(a));
+	}
+	s_circle_verts_ready = true;
+}
+
+xpl_imui_geometry_t *xpl_imui_geometry_new(const xpl_allocator_t *allocator) {
+	init_circle_verts();
+
+	xpl_imui_geometry_t *geometry = xpl_calloc_type(xpl_imui_geometry_t);
+	geometry->buffer = xpl_dynamic_buffer_new_with_allocator(allocator);
+	geometry->reserve_bytes = GEOMETRY_INITIAL_CAPACITY * sizeof(xpl_imui_vertex_t);
+	return geometry;
+}
+
+void xpl_imui_geometry_destroy(xpl_imui_geometry_t **ppgeometry) {
+	assert(ppgeometry);
+
+	xpl_imui_geometry_t *geometry = *ppgeometry;
+	assert(geometry);
+
+	xpl_dynamic_buffer_destroy(&geometry->buffer);
+	if (geometry->scratch) xpl_free(geometry->scratch);
+	xpl_free(geometry);
+
+	*ppgeometry = NULL;
+}
+
+void xpl_imui_geometry_clear(xpl_imui_geometry_t *self) {
+	if (self->buffer->allocator) {
+		self->reserve_bytes = xmax(self->reserve_bytes, self->buffer->capacity);
+		xpl_dynamic_buffer_release(self->buffer);
+	} else {
+		xpl_dynamic_buffer_clear(self->buffer);
+	}
+	self->count = 0;
+	self->has_transform = false;
+}
+
+void xpl_imui_geometry_set_transform(xpl_imui_geometry_t *self, const xmat4 *transform) {
+	xmat4 identity;
+	xmat4_identity(&identity);
+	if (! transform || ! memcmp(transform->data, identity.data, sizeof(identity.data))) {
+		self->has_transform = false;
+		return;
+	}
+	self->transform = *transform;
+	self->has_transform = true;
+}
+
+// Returns room for count more vertices, which the caller must fill.
+static xpl_imui_vertex_t *geometry_reserve(xpl_imui_geometry_t *self, size_t count) {
+	xpl_dynamic_buffer_reserve(self->buffer, self->reserve_bytes);
+	xpl_dynamic_buffer_alloc(self->buffer, count * sizeof(xpl_imui_vertex_t), TRUE);
+	xpl_imui_vertex_t *result = xpl_imui_geometry_vertices(self) + self->count;
+	self->count += count;
+	return result;
+}
+
+static void geometry_apply_transform(xpl_imui_geometry_t *self, xpl_imui_vertex_t *v, size_t count) {
+	if (! self->has_transform) return;
+
+	// UI transforms are 2D, so only the affine part in the XY plane matters.
+	const float *m = self->transform.data;
+	for (size_t i = 0; i < count; ++i) {
+		float x = v[i].position.x, y = v[i].position.y;
+		v[i].position.x = m[0] * x + m[4] * y + m[12];
+		v[i].position.y = m[1] * x + m[5] * y + m[13];
+	}
+}
+
+XPLINLINE void put_vertex(xpl_imui_vertex_t *v, size_t *k, xvec2 position, uint32_t color) {
+	v[*k].position = position;
+	v[*k].color = color;
+	(*k)++;
+}
+
+void xpl_imui_geometry_polygon(xpl_imui_geometry_t *self, const xvec2 *coords, size_t num_coords, float blend_r, uint32_t color) {
+	if (num_coords < 3) return;
+
+	if (self->scratch_capacity < num_coords * 2) {
+		self->scratch_capacity = num_coords * 2;
+		self->scratch = xpl_realloc(self->scratch, self->scratch_capacity * sizeof(xvec2));
+	}
+	xvec2 *normals = &self->scratch[0];
+	xvec2 *outer = &self->scratch[num_coords];
+
+	size_t last_coord = num_coords - 1;
+
+	// j is a trailing iterator
+	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
+		const xvec2 *v0 = &coords[j];
+		const xvec2 *v1 = &coords[i];
+		xvec2 diff = xvec2_set(v1->x - v0->x, v1->y - v0->y);
+		float dist = sqrtf(diff.x * diff.x + diff.y * diff.y);
+		if (dist > 0) {
+			// normalize
+			dist = 1.0f / dist;
+			diff.x *= dist;
+			diff.y *= dist;
+		}
+		normals[j] = xvec2_set(diff.y, -diff.x);
+	}
+
+	// j trails
+	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
+		const xvec2 *dlx0 = &normals[j];
+		const xvec2 *dlx1 = &normals[i];
+		xvec2 dm = xvec2_set(dlx0->x + dlx1->x * 0.5f,
+							 dlx0->y + dlx1->y * 0.5f);
+		float dmr2 = dm.x * dm.x + dm.y * dm.y;
+		if (dmr2 > 0.000001f) {
+			float scale = 1.0f / dmr2;
+			if (scale > 10.0f)
+				scale = 10.0f;
+			dm = xvec2_set(dm.x * scale, dm.y * scale);
+		}
+		outer[i] = xvec2_set(coords[i].x + dm.x * blend_r,
+							 coords[i].y + dm.y * blend_r);
+	}
+
+	uint32_t color_transparent = RGBA(color & 0xff,
+									  (color >> 8) & 0xff,
+									  (color >> 16) & 0xff,
+									  0);
+
+	size_t vertices = num_coords * 6 + (num_coords - 2) * 3;
+	xpl_imui_vertex_t *v = geometry_reserve(self, vertices);
+	size_t k = 0;
+
+	// edge
+	for (size_t i = 0, j = last_coord; i < num_coords; j = i++) {
+		put_vertex(v, &k, coords[i], color);
+		put_vertex(v, &k, coords[j], color);
+		put_vertex(v, &k, outer[j], color_transparent);
+
+		put_vertex(v, &k, outer[j], color_transparent);
+		put_vertex(v, &k, outer[i], color_transparent);
+		put_vertex(v, &k, coords[i], color);
+	}
+
+	// interior
+	for (size_t i = 2; i < num_coords; ++i) {
+		put_vertex(v, &k, coords[0], color);
+		put_vertex(v, &k, coords[i - 1], color);
+		put_vertex(v, &k, coords[i], color);
+	}
+	assert(vertices == k);
+
+	geometry_apply_transform(self, v, k);
+}
+
+void xpl_imui_geometry_rect(xpl_imui_geometry_t *self, xrect rect, float blend_r, uint32_t color) {
+	xvec2 verts[4];
+	verts[0] = xvec2_set(rect.x + 0.5f, rect.y + 0.5f);
+	verts[1] = xvec2_set(rect.x + rect.width - 0.5f, rect.y + 0.5f);
+	verts[2] = xvec2_set(rect.x + rect.width - 0.5f,
+						 rect.y + rect.height - 0.5f);
+	verts[3] = xvec2_set(rect.x + 0.5f, rect.y + rect.height - 0.5f);
+	xpl_imui_geometry_polygon(self, verts, 4, blend_r, color);
+}
+
+void xpl_imui_geometry_rounded_rect(xpl_imui_geometry_t *self, xrect rect, float corner_r, float blend_r, uint32_t color) {
+	const unsigned n = CIRCLE_VERTS / 4; // quarter circle
+	xvec2 verts[(n + 1) * 4];
+	const xvec2 *cverts = s_circle_verts;
+	size_t k = 0;
+
+	// top right?
+	for (size_t i = 0; i <= n; ++i) {
+		verts[k++] = xvec2_set(rect.origin.x + rect.size.width - corner_r + cverts[i].x * corner_r,
+							   rect.origin.y + rect.size.height - corner_r + cverts[i].y * corner_r);
+	}
+
+	for (size_t i = n; i <= 2 * n; ++i) {
+		verts[k++] = xvec2_set(rect.origin.x + corner_r + cverts[i].x * corner_r,
+							   rect.origin.y + rect.size.height - corner_r + cverts[i].y * corner_r);
+	}
+
+	for (size_t i = 2 * n; i <= 3 * n; ++i) {
+		verts[k++] = xvec2_set(rect.origin.x + corner_r + cverts[i].x * corner_r,
+							   rect.origin.y + corner_r + cverts[i].y * corner_r);
+	}
+
+	for (size_t i = 3 * n; i < 4 * n; ++i) {
+		verts[k++] = xvec2_set(rect.origin.x + rect.size.width - corner_r + cverts[i].x * corner_r,
+							   rect.origin.y + corner_r + cverts[i].y * corner_r);
+	}
+	verts[k++] = xvec2_set(rect.origin.x + rect.size.width - corner_r + cverts[0].x * corner_r,
+						   rect.origin.y + corner_r + cverts[0].y * corner_r);
+	assert(k == (n + 1) * 4);
+
+	xpl_imui_geometry_polygon(self, verts, k, blend_r, color);
+}
+
+void xpl_imui_geometry_line(xpl_imui_geometry_t *self, xvec4 line, float width, float blend_r, uint32_t color) {
+	xvec2 vec = xvec2_set(line.dest.x - line.origin.x, line.dest.y - line.origin.y);
+	float d = sqrtf(vec.x * vec.x + vec.y * vec.y);
+	if (d > 0.00001f) {
+		d = 1.0f / d;
+		vec.x *= d;
+		vec.y *= d;
+	}
+
+	xvec2 normal = xvec2_set(-vec.y, vec.x);
+	xvec2 verts[4];
+
+	width -= blend_r;
+	width *= 0.5f;
+	if (width < 0.01f)
+		width = 0.01f;
+
+	vec.x *= width;
+	vec.y *= width;
+	normal.x *= width;
+	normal.y *= width;
+
+	verts[0] = xvec2_set(line.origin.x - vec.x - normal.x,
+						 line.origin.y - vec.y - normal.y);
+	verts[1] = xvec2_set(line.origin.x - vec.x + normal.x,
+						 line.origin.y - vec.y + normal.y);
+	verts[2] = xvec2_set(line.dest.x + vec.x + normal.x,
+						 line.dest.y + vec.y + normal.y);
+	verts[3] = xvec2_set(line.dest.x + vec.x - normal.x,
+						 line.dest.y + vec.y - normal.y);
+
+	xpl_imui_geometry_polygon(self, verts, 4, blend_r, color);
+}
+
+void xpl_imui_geometry_triangle(xpl_imui_geometry_t *self, const xvec2 *verts, float blend_r, uint32_t color) {
+	xpl_imui_geometry_polygon(self, verts, 3, blend_r, color);
+}
@@ -21,6 +21,7 @@ xpl_instanced_geom_t *xpl_instanced_geom_new(void) {
 	
 	geom->vao = xpl_vao_new();
 	geom->vbo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+	geom->instance_vbo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
 	geom->ibo = xpl_bo_new(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 	geom->ubo = xpl_bo_new(GL_UNIFORM_BUFFER, GL_STATIC_READ);
 	
@@ -33,6 +34,7 @@ void xpl_instanced_geom_destroy(xpl_instanced_geom_t **ppgeom) {
 	assert(geom);
 	xpl_vao_destroy(&geom->vao);
 	xpl_bo_destroy(&geom->vbo);
+	xpl_bo_destroy(&geom->instance_vbo);
 	xpl_bo_destroy(&geom->ibo);
 	xpl_bo_destroy(&geom->ubo);
 	
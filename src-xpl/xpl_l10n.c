@@ -9,18 +9,40 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
 #include <assert.h>
 
 #include "minIni.h"
 #include "uthash.h"
 
 #include "xpl.h"
+#include "xpl_file.h"
 #include "xpl_l10n.h"
+#include "xpl_vfs.h"
 
 #define LOCALE_MAX 10
 
 #define L10N_KEYLEN 128
 
+// Compiled by build/scripts/l10n_table_update.rb; see there for the layout.
+#define L10N_TABLE_RESOURCE "l10n.xlt"
+#define L10N_TABLE_MAGIC "XLT1"
+#define L10N_FAMILY_SUFFIX "_#"
+
+typedef struct l10n_table_header {
+	char magic[4];
+	uint32_t entry_count;
+	uint32_t bucket_count;
+	uint32_t pool_size;
+} l10n_table_header_t;
+
+typedef struct l10n_table_entry {
+	uint32_t key_offset;
+	uint32_t value_offset;
+	uint32_t count;
+} l10n_table_entry_t;
+
 typedef struct l10n_entry {
     char key[L10N_KEYLEN];
     char *mbs_value;
@@ -38,6 +60,98 @@ static char locale[LOCALE_MAX] = { 0 };
 static char fallback_locale[LOCALE_MAX] = { 0 };
 static l10n_entry_t *l10n_table = NULL;
 
+static bool compiled_table_loaded = false;
+static xpl_file_mapping_t *compiled_table_mapping = NULL;
+static const l10n_table_header_t *compiled_table = NULL;
+static const int32_t *compiled_table_displacements = NULL;
+static const l10n_table_entry_t *compiled_table_entries = NULL;
+static const char *compiled_table_pool = NULL;
+
+static uint32_t l10n_hash(const char *s, uint32_t seed) {
+	uint32_t h = 2166136261u ^ seed;
+	for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+		h ^= *p;
+		h *= 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+static bool compiled_table_validate(const xpl_file_mapping_t *mapping) {
+	const l10n_table_header_t *header = (const l10n_table_header_t *)mapping->content;
+	if (mapping->length < sizeof(l10n_table_header_t)) return false;
+	if (memcmp(header->magic, L10N_TABLE_MAGIC, sizeof(header->magic))) return false;
+	if (! header->entry_count || ! header->bucket_count) return false;
+	
+	size_t pool_offset = sizeof(l10n_table_header_t) +
+		header->bucket_count * sizeof(int32_t) +
+		header->entry_count * sizeof(l10n_table_entry_t);
+	if (pool_offset + header->pool_size != mapping->length) return false;
+	
+	const char *pool = (const char *)mapping->content + pool_offset;
+	if (! header->pool_size || pool[header->pool_size - 1] != '\0') return false;
+	
+	const l10n_table_entry_t *entries = (const l10n_table_entry_t *)(mapping->content +
+		sizeof(l10n_table_header_t) + header->bucket_count * sizeof(int32_t));
+	for (uint32_t i = 0; i < header->entry_count; ++i) {
+		if (entries[i].key_offset >= header->pool_size) return false;
+		if (entries[i].value_offset >= header->pool_size) return false;
+	}
+	return true;
+}
+
+static void compiled_table_load(void) {
+	if (compiled_table_loaded) return;
+	compiled_table_loaded = true;
+	
+	compiled_table_mapping = xpl_vfs_map(L10N_TABLE_RESOURCE);
+	if (! compiled_table_mapping) {
+		LOG_DEBUG("No compiled l10n table; using INI lookup");
+		return;
+	}
+	if (! compiled_table_validate(compiled_table_mapping)) {
+		LOG_WARN("Compiled l10n table %s is invalid; using INI lookup", L10N_TABLE_RESOURCE);
+		xpl_file_unmap(&compiled_table_mapping);
+		return;
+	}
+	
+	const unsigned char *content = compiled_table_mapping->content;
+	compiled_table = (const l10n_table_header_t *)content;
+	content += sizeof(l10n_table_header_t);
+	compiled_table_displacements = (const int32_t *)content;
+	content += compiled_table->bucket_count * sizeof(int32_t);
+	compiled_table_entries = (const l10n_table_entry_t *)content;
+	content += compiled_table->entry_count * sizeof(l10n_table_entry_t);
+	compiled_table_pool = (const char *)content;
+	
+	LOG_DEBUG("Compiled l10n table %s: %u entries", table_file, compiled_table->entry_count);
+}
+
+static const l10n_table_entry_t *compiled_table_find(const char *locale_key) {
+	uint32_t bucket = l10n_hash(locale_key, 0) % compiled_table->bucket_count;
+	int32_t displacement = compiled_table_displacements[bucket];
+	uint32_t slot = (displacement < 0 ?
+					 (uint32_t)(-displacement - 1) :
+					 l10n_hash(locale_key, (uint32_t)displacement) % compiled_table->entry_count);
+	if (slot >= compiled_table->entry_count) return NULL;
+	
+	const l10n_table_entry_t *entry = &compiled_table_entries[slot];
+	if (strcmp(compiled_table_pool + entry->key_offset, locale_key)) return NULL;
+	return entry;
+}
+
+// Table keys are lowercase, since minIni matches INI keys case-insensitively.
+static void compiled_table_key(char *locale_key, const char *loc, const char *key, const char *suffix) {
+	snprintf(locale_key, L10N_KEYLEN, "%s:%s%s", loc ? loc : "", key, suffix);
+	for (char *p = locale_key; *p; ++p) {
+		*p = tolower((unsigned char)*p);
+	}
+}
+
 static void clear_l10n_table(void) {
     l10n_entry_t *el, *tmp;
     HASH_ITER(hh, l10n_table, el, tmp) {
@@ -50,6 +164,7 @@ static void clear_l10n_table(void) {
 void xpl_l10n_set_locale(const char *set_locale) {
     strncpy(locale, set_locale, LOCALE_MAX);
     clear_l10n_table();
+    compiled_table_load();
     
     const char *localization_pref_resource = "l10n_prefs.ini";
     char localization_file[PATH_MAX];
@@ -70,6 +185,7 @@ void xpl_l10n_load_saved_locale() {
 void xpl_l10n_set_fallback_locale(const char *set_locale) {
     strncpy(fallback_locale, set_locale, LOCALE_MAX);
     clear_l10n_table();
+    compiled_table_load();
 }
 
 static char * unescape(const char *input) {
@@ -129,10 +245,18 @@ static char * unescape(const char *input) {
 	return output;
 }
 
-static bool l10n_lookup(const char *loc, const char *key, char **l10n_out) {
+static bool l10n_lookup(const char *loc, const char *key, const char **l10n_out) {
     *l10n_out = NULL;
     
     char locale_key[L10N_KEYLEN];
+    if (compiled_table) {
+        compiled_table_key(locale_key, loc, key, "");
+        const l10n_table_entry_t *entry = compiled_table_find(locale_key);
+        if (! entry) return false;
+        *l10n_out = compiled_table_pool + entry->value_offset;
+        return (**l10n_out != '\0');
+    }
+    
     snprintf(locale_key, L10N_KEYLEN, "%s:%s", loc, key);
     
     l10n_entry_t *result;
@@ -194,7 +318,7 @@ static bool l10n_lookup(const char *loc, const char *key, char **l10n_out) {
 
 const char * xpl_l10n_get(const char *key) {
     assert(fallback_locale[0]);
-    char *value = NULL;
+    const char *value = NULL;
     if (! l10n_lookup(locale, key, &value)) {
         if (! l10n_lookup(fallback_locale, key, &value)) {
             return key;
@@ -202,3 +326,30 @@ const char * xpl_l10n_get(const char *key) {
     }
     return value;
 }
+
+static int family_count_probe(const char *key_prefix) {
+	int count = 0;
+	char key[L10N_KEYLEN];
+	while (1) {
+		snprintf(key, L10N_KEYLEN, "%s_%d", key_prefix, count);
+		if (! xl_exists(key)) break;
+		count++;
+	}
+	return count;
+}
+
+static int compiled_family_count(const char *loc, const char *key_prefix) {
+	char locale_key[L10N_KEYLEN];
+	compiled_table_key(locale_key, loc, key_prefix, L10N_FAMILY_SUFFIX);
+	const l10n_table_entry_t *entry = compiled_table_find(locale_key);
+	return entry ? (int)entry->count : 0;
+}
+
+// Lookups fall back key by key, so a family spans whichever locale has more of it.
+int xpl_l10n_family_count(const char *key_prefix) {
+	if (! compiled_table) return family_count_probe(key_prefix);
+	
+	int count = compiled_family_count(locale, key_prefix);
+	int fallback_count = compiled_family_count(fallback_locale, key_prefix);
+	return count > fallback_count ? count : fallback_count;
+}
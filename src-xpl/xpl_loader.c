@@ -0,0 +1,153 @@
+//
+//  xpl_loader.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-23.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <string.h>
+
+#include "xpl.h"
+#include "xpl_thread.h"
+#include "xpl_task.h"
+#include "xpl_vfs.h"
+#include "xpl_loader.h"
+
+#ifdef XPL_PLATFORM_WINDOWS
+#include <windows.h>
+#define loader_load(ptr)            (*(ptr))
+#define loader_cas(ptr, old, new)   (InterlockedCompareExchangePointer((PVOID volatile *)(ptr), (new), (old)) == (old))
+#define loader_exchange(ptr, value) InterlockedExchangePointer((PVOID volatile *)(ptr), (value))
+#else
+#define loader_load(ptr)            __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define loader_cas(ptr, old, new)   __atomic_compare_exchange_n((ptr), &(old), (new), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#define loader_exchange(ptr, value) __atomic_exchange_n((ptr), (value), __ATOMIC_ACQUIRE)
+#endif
+
+typedef struct loader_job {
+	char                        *resource;
+	xpl_loader_decode_func      decode;
+	xpl_loader_complete_func    complete;
+	void                        *context;
+	void                        *result;
+
+	struct loader_job           *next;
+} loader_job_t;
+
+// Decoded jobs, pushed by the workers without locking and taken all at once by the
+// primary thread, so there's no ABA hazard.
+static loader_job_t *completed = NULL;
+
+// Primary thread only.
+static loader_job_t *backlog = NULL;
+static size_t pending = 0;
+
+static void completed_push(loader_job_t *job) {
+	loader_job_t *head;
+	do {
+		head = loader_load(&completed);
+		job->next = head;
+	} while (! loader_cas(&completed, head, job));
+}
+
+// Returns the completed jobs in the order they finished.
+static loader_job_t *completed_take(void) {
+	loader_job_t *list = (loader_job_t *)loader_exchange(&completed, NULL);
+
+	loader_job_t *reversed = NULL;
+	while (list) {
+		loader_job_t *next = list->next;
+		list->next = reversed;
+		reversed = list;
+		list = next;
+	}
+	return reversed;
+}
+
+static void job_decode(loader_job_t *job) {
+	xpl_file_mapping_t *mapping = xpl_vfs_map(job->resource);
+	if (! mapping) {
+		LOG_WARN("Couldn't load resource %s", job->resource);
+		return;
+	}
+	job->result = job->decode(job->resource, mapping, job->context);
+	xpl_file_unmap(&mapping);
+}
+
+static void job_complete(loader_job_t *job) {
+	job->complete(job->resource, job->result, job->context);
+	free(job->resource); // strdup
+	xpl_free(job);
+	pending--;
+}
+
+static void job_task(void *data) {
+	loader_job_t *job = (loader_job_t *)data;
+	job_decode(job);
+	completed_push(job);
+}
+
+void xpl_loader_init(void) {
+	assert(xpl_thread_is_primary());
+	if (! xpl_tasks_initialized() || ! xpl_tasks_worker_count()) {
+		LOG_DEBUG("No task workers; loading synchronously");
+	}
+}
+
+void xpl_loader_shutdown(void) {
+	xpl_loader_finish();
+}
+
+void xpl_loader_request(const char *resource, xpl_loader_decode_func decode, xpl_loader_complete_func complete, void *context) {
+	assert(decode);
+	assert(complete);
+
+	loader_job_t *job = xpl_calloc_type(loader_job_t);
+	job->resource = strdup(resource);
+	job->decode = decode;
+	job->complete = complete;
+	job->context = context;
+	pending++;
+
+	if (! xpl_tasks_initialized() || ! xpl_tasks_worker_count()) {
+		job_decode(job);
+		job_complete(job);
+		return;
+	}
+	xpl_task_t *task = xpl_task_run(job_task, job);
+	xpl_task_release(&task);
+}
+
+size_t xpl_loader_pending(void) {
+	return pending;
+}
+
+size_t xpl_loader_poll(double budget) {
+	if (! pending) return 0;
+
+	loader_job_t *taken = completed_take();
+	if (taken) {
+		loader_job_t **tail = &backlog;
+		while (*tail) tail = &(*tail)->next;
+		*tail = taken;
+	}
+
+	double start = budget > 0.0 ? xpl_get_time() : 0.0;
+	size_t count = 0;
+	while (backlog) {
+		loader_job_t *job = backlog;
+		backlog = job->next;
+		job_complete(job);
+		count++;
+		if (budget > 0.0 && xpl_get_time() - start >= budget) break;
+	}
+	return count;
+}
+
+void xpl_loader_finish(void) {
+	while (pending) {
+		if (! xpl_loader_poll(0.0)) xpl_thread_yield();
+	}
+}
@@ -1,2 +1,627 @@
+//
+//  xpl_log.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-31.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
 #include "xpl.h"
 #include "xpl_log.h"
+
+// Each thread that logs gets its own ring, so producers never contend: the
+// calling thread copies the format pointer and raw arguments in, and the drain
+// thread formats and writes them in batches. Strings are copied, since they
+// rarely outlive the call.
+
+#define LOG_RING_SIZE           (256 * 1024)    // bytes per thread, power of two
+#define LOG_RING_MASK           (LOG_RING_SIZE - 1)
+#define LOG_STRING_MAX          512
+#define LOG_BATCH_SIZE          (32 * 1024)
+#define LOG_DRAIN_INTERVAL_NS   1000000
+
+#define LOG_RECORD_PAD          1   // skip to the start of the ring
+#define LOG_RECORD_TEXT         2   // already formatted; the argument is the message
+
+#define LOG_ARG_INVALID         -1
+
+#define LOG_LIMIT_NONE          0
+#define LOG_LIMIT_STAR          0xffff
+
+// gcc, clang and mingw all provide the __atomic builtins.
+#define log_load(ptr)               __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define log_load_relaxed(ptr)       __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define log_store(ptr, value)       __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define log_store_relaxed(ptr, v)   __atomic_store_n((ptr), (v), __ATOMIC_RELAXED)
+#define log_cas(ptr, old, new)      __atomic_compare_exchange_n((ptr), &(old), (new), false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+
+enum log_arg_kind {
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_INTMAX,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,
+	LOG_ARG_POINTER,
+	LOG_ARG_STRING
+};
+
+typedef struct log_record {
+	uint32_t                size;       // including this header, multiple of 8
+	uint32_t                flags;
+	const xpl_log_site_t    *site;
+	const char              *format;
+	FILE                    *stream;
+	uint64_t                time_ms;
+} log_record_t;
+
+typedef struct log_ring {
+	unsigned char           buffer[LOG_RING_SIZE];
+	uint64_t                head;       // written by the owning thread
+	uint64_t                dropped;    // ditto
+	char                    pad[64];
+	uint64_t                tail;       // written by the drain thread
+	uint64_t                reported_dropped;
+	int                     owned;
+	struct log_ring         *next;
+} log_ring_t;
+
+typedef struct log_batch {
+	FILE                    *stream;
+	size_t                  length;
+	char                    data[LOG_BATCH_SIZE];
+} log_batch_t;
+
+static bool s_timestamps = false;
+static int s_async = 0;
+static int s_running = 0;
+static pthread_t s_drain_thread;
+static pthread_key_t s_ring_key;
+static bool s_ring_key_created = false;
+static log_ring_t *s_rings = NULL;
+static uint64_t s_coarse_ms = 0;
+static uint64_t s_dropped_total = 0;
+
+static __thread log_ring_t *t_ring = NULL;
+
+static xpl_log_site_t s_drop_site = { XPL_COLOR_txtrst XPL_COLOR_bldylw, "warn", __FILE__, "drain_ring", __LINE__ };
+
+static uint64_t log_clock_ms(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
+
+static FILE *log_stream(FILE *stream) {
+	return stream ? stream : stdout;
+}
+
+// ------------------------------------------------------------------------------
+// Format parsing
+
+// Walks one conversion after the '%'. Returns the end of the conversion and
+// appends what it consumes to the signature, or returns NULL for conversions
+// that can't be captured (%n, wide strings, unknown).
+static const char *parse_conversion(const char *p, xpl_log_signature_t *signature) {
+	uint16_t limit = LOG_LIMIT_NONE;
+
+	while (*p && strchr("-+ #0'", *p)) ++p;
+
+	if (*p == '*') {
+		if (signature->arg_count >= XPL_LOG_ARG_MAX) return NULL;
+		signature->kinds[signature->arg_count++] = LOG_ARG_INT;
+		++p;
+	} else {
+		while (*p >= '0' && *p <= '9') ++p;
+	}
+
+	if (*p == '.') {
+		++p;
+		if (*p == '*') {
+			if (signature->arg_count >= XPL_LOG_ARG_MAX) return NULL;
+			signature->kinds[signature->arg_count++] = LOG_ARG_INT;
+			limit = LOG_LIMIT_STAR;
+			++p;
+		} else {
+			unsigned int precision = 0;
+			while (*p >= '0' && *p <= '9') {
+				precision = precision * 10 + (unsigned int)(*p++ - '0');
+				if (precision > LOG_STRING_MAX) precision = LOG_STRING_MAX;
+			}
+			limit = (uint16_t)xmax(precision, 1); // keep "%.0s" distinct from no precision
+		}
+	}
+
+	int length = 0; // 'H' hh, 'h', 'l', 'L' ll, 'D' long double, 'j', 'z', 't'
+	switch (*p) {
+		case 'h': length = (p[1] == 'h') ? 'H' : 'h'; p += (p[1] == 'h') ? 2 : 1; break;
+		case 'l': length = (p[1] == 'l') ? 'L' : 'l'; p += (p[1] == 'l') ? 2 : 1; break;
+		case 'q': length = 'L'; ++p; break;
+		case 'L': length = 'D'; ++p; break;
+		case 'j':
+		case 'z':
+		case 't': length = *p++; break;
+	}
+
+	if (signature->arg_count >= XPL_LOG_ARG_MAX) return NULL;
+	unsigned char *kind = &signature->kinds[signature->arg_count];
+	signature->limits[signature->arg_count] = LOG_LIMIT_NONE;
+
+	switch (*p) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+			switch (length) {
+				case 'l': *kind = LOG_ARG_LONG; break;
+				case 'L': *kind = LOG_ARG_LLONG; break;
+				case 'z': *kind = LOG_ARG_SIZE; break;
+				case 't': *kind = LOG_ARG_PTRDIFF; break;
+				case 'j': *kind = LOG_ARG_INTMAX; break;
+				default:  *kind = LOG_ARG_INT; break;
+			}
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			*kind = (length == 'D') ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+			break;
+		case 'p':
+			*kind = LOG_ARG_POINTER;
+			break;
+		case 's':
+			if (length) return NULL;
+			*kind = LOG_ARG_STRING;
+			signature->limits[signature->arg_count] = limit;
+			break;
+		default:
+			return NULL;
+	}
+	++signature->arg_count;
+	return p + 1;
+}
+
+static bool parse_format(const char *format, xpl_log_signature_t *signature) {
+	signature->arg_count = 0;
+	for (const char *p = format; *p; ) {
+		if (*p++ != '%') continue;
+		if (*p == '%') {
+			++p;
+			continue;
+		}
+		p = parse_conversion(p, signature);
+		if (! p) return false;
+	}
+	return true;
+}
+
+// Parses once per call site. A site whose format changes from call to call
+// (a variable format) is parsed every time instead.
+static const xpl_log_signature_t *site_signature(xpl_log_site_t *site, const char *format, xpl_log_signature_t *scratch) {
+	if (log_load(&site->state) == 2 && site->format == format) {
+		return site->signature.arg_count == LOG_ARG_INVALID ? NULL : &site->signature;
+	}
+
+	bool ok = parse_format(format, scratch);
+	if (! ok) scratch->arg_count = LOG_ARG_INVALID;
+	int expected = 0;
+	if (log_cas(&site->state, expected, 1)) {
+		site->format = format;
+		site->signature = *scratch;
+		log_store(&site->state, 2);
+	}
+	return ok ? scratch : NULL;
+}
+
+// ------------------------------------------------------------------------------
+// Capture
+
+static size_t align8(size_t size) {
+	return (size + 7) & ~(size_t)7;
+}
+
+// Copies the arguments after the header into record. Returns the record size,
+// or 0 if they don't fit.
+static size_t capture_args(unsigned char *record, size_t capacity, const xpl_log_signature_t *signature, va_list args) {
+	size_t offset = sizeof(log_record_t);
+	int star = -1;
+	for (int i = 0; i < signature->arg_count; ++i) {
+		if (offset + 16 > capacity) return 0;
+		unsigned char *slot = record + offset;
+		switch (signature->kinds[i]) {
+			case LOG_ARG_INT:		{ int64_t v = va_arg(args, int); memcpy(slot, &v, 8); star = (int)v; offset += 8; break; }
+			case LOG_ARG_LONG:		{ int64_t v = va_arg(args, long); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_LLONG:		{ int64_t v = va_arg(args, long long); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_SIZE:		{ uint64_t v = va_arg(args, size_t); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_PTRDIFF:	{ int64_t v = va_arg(args, ptrdiff_t); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_INTMAX:	{ int64_t v = va_arg(args, intmax_t); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_DOUBLE:	{ double v = va_arg(args, double); memcpy(slot, &v, 8); offset += 8; break; }
+			case LOG_ARG_LDOUBLE:	{ long double v = va_arg(args, long double); memcpy(slot, &v, sizeof(v)); offset += align8(sizeof(v)); break; }
+			case LOG_ARG_POINTER:	{ void *v = va_arg(args, void *); memcpy(slot, &v, sizeof(v)); offset += 8; break; }
+			case LOG_ARG_STRING: {
+				const char *s = va_arg(args, const char *);
+				size_t limit = LOG_STRING_MAX;
+				if (signature->limits[i] == LOG_LIMIT_STAR) {
+					if (star >= 0) limit = xmin((size_t)star, limit);
+				} else if (signature->limits[i] != LOG_LIMIT_NONE) {
+					limit = signature->limits[i];
+				}
+				if (! s) s = "(null)";
+				uint32_t length = (uint32_t)strnlen(s, limit);
+				if (offset + 8 + length + 1 > capacity) return 0;
+				memcpy(slot, &length, sizeof(length));
+				memcpy(slot + 8, s, length);
+				slot[8 + length] = '\0';
+				offset += 8 + align8(length + 1);
+				break;
+			}
+		}
+	}
+	return offset;
+}
+
+static void ring_release(void *data) {
+	log_ring_t *ring = data;
+	log_store(&ring->owned, 0);
+}
+
+static log_ring_t *ring_acquire(void) {
+	// Take over a ring left by a thread that has exited.
+	for (log_ring_t *ring = log_load(&s_rings); ring; ring = ring->next) {
+		int expected = 0;
+		if (log_cas(&ring->owned, expected, 1)) {
+			pthread_setspecific(s_ring_key, ring);
+			return ring;
+		}
+	}
+
+	// Written through here rather than calloc'd, so the first lap around the
+	// ring doesn't take page faults on the logging thread.
+	log_ring_t *ring = malloc(sizeof(log_ring_t));
+	if (! ring) return NULL;
+	memset(ring, 0, sizeof(log_ring_t));
+	ring->owned = 1;
+	log_ring_t *head = log_load_relaxed(&s_rings);
+	do {
+		ring->next = head;
+	} while (! log_cas(&s_rings, head, ring));
+	pthread_setspecific(s_ring_key, ring);
+	return ring;
+}
+
+static void ring_push(log_ring_t *ring, const unsigned char *record, size_t size) {
+	uint64_t head = ring->head;
+	uint64_t tail = log_load(&ring->tail);
+	size_t offset = head & LOG_RING_MASK;
+	size_t contiguous = LOG_RING_SIZE - offset;
+	size_t needed = size <= contiguous ? size : contiguous + size;
+
+	if (head - tail + needed > LOG_RING_SIZE) {
+		log_store_relaxed(&ring->dropped, ring->dropped + 1);
+		return;
+	}
+
+	if (size > contiguous) {
+		log_record_t pad = { (uint32_t)contiguous, LOG_RECORD_PAD };
+		memcpy(ring->buffer + offset, &pad, sizeof(uint32_t) * 2);
+		head += contiguous;
+		offset = 0;
+	}
+	memcpy(ring->buffer + offset, record, size);
+	log_store(&ring->head, head + size);
+}
+
+// ------------------------------------------------------------------------------
+// Formatting
+
+static size_t format_timestamp(char *out, size_t length, uint64_t time_ms) {
+	static __thread time_t cached_second = -1;
+	static __thread char cached[24];
+
+	time_t second = (time_t)(time_ms / 1000);
+	if (second != cached_second) {
+		struct tm tm;
+		localtime_r(&second, &tm);
+		strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &tm);
+		cached_second = second;
+	}
+	int written = snprintf(out, length, "%s.%03u ", cached, (unsigned int)(time_ms % 1000));
+	return written < 0 ? 0 : xmin((size_t)written, length - 1);
+}
+
+// The conversion is re-emitted with any '*' replaced by the value captured for it.
+static size_t format_args(char *out, size_t length, const char *format, const unsigned char *args) {
+	size_t used = 0;
+	const char *p = format;
+	while (*p && used + 1 < length) {
+		if (*p != '%') {
+			out[used++] = *p++;
+			continue;
+		}
+		if (p[1] == '%') {
+			out[used++] = '%';
+			p += 2;
+			continue;
+		}
+
+		char spec[48];
+		size_t spec_length = 0;
+		spec[spec_length++] = *p++;
+		while (*p && ! strchr("diouxXceEfFgGaApsn", *p) && spec_length < sizeof(spec) - 16) {
+			if (*p == '*') {
+				int64_t v;
+				memcpy(&v, args, 8);
+				args += 8;
+				bool precision = spec[spec_length - 1] == '.';
+				if (precision && v < 0) {
+					--spec_length; // negative precision is no precision
+				} else {
+					spec_length += (size_t)snprintf(spec + spec_length, sizeof(spec) - spec_length, "%d", (int)v);
+				}
+				++p;
+			} else {
+				spec[spec_length++] = *p++;
+			}
+		}
+		if (! *p) break;
+		char conversion = *p++;
+		spec[spec_length++] = conversion;
+		spec[spec_length] = '\0';
+
+		char *dest = out + used;
+		size_t remaining = length - used;
+		int written = 0;
+		bool is_long = strstr(spec, "l") != NULL, is_ldouble = strchr(spec, 'L') != NULL;
+		switch (conversion) {
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+				if (is_ldouble) {
+					long double v;
+					memcpy(&v, args, sizeof(v));
+					args += align8(sizeof(v));
+					written = snprintf(dest, remaining, spec, v);
+				} else {
+					double v;
+					memcpy(&v, args, 8);
+					args += 8;
+					written = snprintf(dest, remaining, spec, v);
+				}
+				break;
+			case 'p': {
+				void *v;
+				memcpy(&v, args, sizeof(v));
+				args += 8;
+				written = snprintf(dest, remaining, spec, v);
+				break;
+			}
+			case 's': {
+				uint32_t string_length;
+				memcpy(&string_length, args, sizeof(string_length));
+				written = snprintf(dest, remaining, spec, (const char *)args + 8);
+				args += 8 + align8(string_length + 1);
+				break;
+			}
+			default: {
+				int64_t v;
+				memcpy(&v, args, 8);
+				args += 8;
+				// The spec still carries its length modifier, so pass the width it names.
+				if (strchr(spec, 'z')) written = snprintf(dest, remaining, spec, (size_t)v);
+				else if (strchr(spec, 't')) written = snprintf(dest, remaining, spec, (ptrdiff_t)v);
+				else if (strchr(spec, 'j')) written = snprintf(dest, remaining, spec, (intmax_t)v);
+				else if (strstr(spec, "ll") || strchr(spec, 'q')) written = snprintf(dest, remaining, spec, (long long)v);
+				else if (is_long) written = snprintf(dest, remaining, spec, (long)v);
+				else written = snprintf(dest, remaining, spec, (int)v);
+				break;
+			}
+		}
+		if (written > 0) used += xmin((size_t)written, remaining - 1);
+	}
+	out[used] = '\0';
+	return used;
+}
+
+static const char *log_basename(const char *file) {
+	const char *slash = strrchr(file, '/');
+	const char *backslash = strrchr(file, '\\');
+	if (backslash > slash) slash = backslash;
+	return slash ? slash + 1 : file;
+}
+
+static size_t format_line(char *out, size_t length, const xpl_log_site_t *site, uint64_t time_ms, const char *message) {
+	size_t used = s_timestamps ? format_timestamp(out, length, time_ms) : 0;
+	int written = snprintf(out + used, length - used, "[%s%s%s]\t %s %s:%d %s\n",
+						   site->color, site->level, XPL_COLOR_txtrst,
+						   log_basename(site->file), site->func, site->line, message);
+	if (written < 0) return used;
+	used += xmin((size_t)written, length - used - 1);
+	if (out[used - 1] != '\n') out[used - 1] = '\n'; // truncated
+	return used;
+}
+
+// ------------------------------------------------------------------------------
+// Drain
+
+static void batch_flush(log_batch_t *batch) {
+	if (! batch->length) return;
+	fwrite(batch->data, 1, batch->length, batch->stream);
+	fflush(batch->stream);
+	batch->length = 0;
+}
+
+static void batch_append(log_batch_t *batch, const char *line, size_t length) {
+	if (batch->length + length > LOG_BATCH_SIZE) batch_flush(batch);
+	memcpy(batch->data + batch->length, line, length);
+	batch->length += length;
+}
+
+static log_batch_t *batch_for(log_batch_t *batches, FILE *stream) {
+	return (stream == batches[0].stream) ? &batches[0] : &batches[1];
+}
+
+static size_t drain_ring(log_ring_t *ring, log_batch_t *batches) {
+	size_t count = 0;
+	uint64_t tail = ring->tail;
+	uint64_t head = log_load(&ring->head);
+	char message[XPL_LOG_LINE_MAX];
+	char line[XPL_LOG_LINE_MAX + 256];
+
+	while (tail != head) {
+		const log_record_t *record = (const log_record_t *)(ring->buffer + (tail & LOG_RING_MASK));
+		if (! (record->flags & LOG_RECORD_PAD)) {
+			const unsigned char *args = (const unsigned char *)(record + 1);
+			const char *text = (const char *)args + 8;
+			if (! (record->flags & LOG_RECORD_TEXT)) {
+				format_args(message, sizeof(message), record->format, args);
+				text = message;
+			}
+			size_t length = format_line(line, sizeof(line), record->site, record->time_ms, text);
+
+			FILE *stream = log_stream(record->stream);
+			log_batch_t *batch = batch_for(batches, stream);
+			if (batch->stream != stream) {
+				// Neither stdout nor stderr; write it straight through.
+				fwrite(line, 1, length, stream);
+			} else {
+				batch_append(batch, line, length);
+			}
+			++count;
+		}
+		tail += record->size;
+	}
+	log_store(&ring->tail, tail);
+
+	uint64_t dropped = log_load_relaxed(&ring->dropped);
+	if (dropped != ring->reported_dropped) {
+		__atomic_fetch_add(&s_dropped_total, dropped - ring->reported_dropped, __ATOMIC_RELAXED);
+		snprintf(message, sizeof(message), "dropped %llu log lines, ring full", (unsigned long long)(dropped - ring->reported_dropped));
+		size_t length = format_line(line, sizeof(line), &s_drop_site, log_load_relaxed(&s_coarse_ms), message);
+		batch_append(&batches[1], line, length);
+		ring->reported_dropped = dropped;
+	}
+	return count;
+}
+
+static size_t drain_all(log_batch_t *batches) {
+	size_t count = 0;
+	for (log_ring_t *ring = log_load(&s_rings); ring; ring = ring->next) {
+		count += drain_ring(ring, batches);
+	}
+	batch_flush(&batches[0]);
+	batch_flush(&batches[1]);
+	return count;
+}
+
+static void *drain_main(void *data) {
+	static log_batch_t batches[2];
+	batches[0].stream = stdout;
+	batches[1].stream = stderr;
+
+	while (log_load(&s_running)) {
+		log_store_relaxed(&s_coarse_ms, log_clock_ms());
+		if (! drain_all(batches)) {
+			struct timespec interval = { 0, LOG_DRAIN_INTERVAL_NS };
+			nanosleep(&interval, NULL);
+		}
+	}
+	drain_all(batches);
+	return NULL;
+}
+
+// ------------------------------------------------------------------------------
+// Public
+
+void xpl_log_set_timestamps(bool enabled) {
+	s_timestamps = enabled;
+}
+
+uint64_t xpl_log_dropped(void) {
+	return __atomic_load_n(&s_dropped_total, __ATOMIC_RELAXED);
+}
+
+void xpl_log_async_start(void) {
+	if (log_load(&s_async)) return;
+
+	if (! s_ring_key_created) {
+		pthread_key_create(&s_ring_key, ring_release);
+		s_ring_key_created = true;
+		atexit(xpl_log_async_stop);
+	}
+	log_store(&s_coarse_ms, log_clock_ms());
+	log_store(&s_running, 1);
+	if (pthread_create(&s_drain_thread, NULL, drain_main, NULL) != 0) {
+		log_store(&s_running, 0);
+		LOG_WARN("Couldn't start the log drain thread; logging synchronously");
+		return;
+	}
+	log_store(&s_async, 1);
+}
+
+void xpl_log_async_stop(void) {
+	if (! log_load(&s_async)) return;
+	log_store(&s_async, 0);
+	log_store(&s_running, 0);
+	pthread_join(s_drain_thread, NULL);
+}
+
+static void log_write_sync(const xpl_log_site_t *site, FILE *stream, const char *format, va_list args) {
+	char message[XPL_LOG_LINE_MAX];
+	char line[XPL_LOG_LINE_MAX + 256];
+	vsnprintf(message, sizeof(message), format, args);
+	size_t length = format_line(line, sizeof(line), site, log_clock_ms(), message);
+	stream = log_stream(stream);
+	fwrite(line, 1, length, stream);
+	fflush(stream);
+}
+
+void xpl_log_write(xpl_log_site_t *site, FILE *stream, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+
+	log_ring_t *ring = NULL;
+	if (log_load_relaxed(&s_async)) {
+		ring = t_ring;
+		if (! ring) ring = t_ring = ring_acquire();
+	}
+	if (! ring) {
+		log_write_sync(site, stream, format, args);
+		va_end(args);
+		return;
+	}
+
+	union {
+		log_record_t header;
+		unsigned char bytes[XPL_LOG_LINE_MAX];
+	} record;
+	record.header.flags = 0;
+	record.header.site = site;
+	record.header.format = format;
+	record.header.stream = stream;
+	record.header.time_ms = log_load_relaxed(&s_coarse_ms);
+
+	xpl_log_signature_t scratch;
+	const xpl_log_signature_t *signature = site_signature(site, format, &scratch);
+	size_t size = signature ? capture_args(record.bytes, sizeof(record.bytes), signature, args) : 0;
+	va_end(args);
+
+	if (! size) {
+		// Couldn't capture the arguments (%n, wide strings, too many or too
+		// long), so format here and queue the text.
+		va_start(args, format);
+		char *text = (char *)record.bytes + sizeof(log_record_t) + 8;
+		size_t capacity = sizeof(record.bytes) - sizeof(log_record_t) - 8;
+		int written = vsnprintf(text, capacity, format, args);
+		va_end(args);
+		size_t length = written < 0 ? 0 : xmin((size_t)written, capacity - 1);
+		record.header.flags = LOG_RECORD_TEXT;
+		size = sizeof(log_record_t) + 8 + align8(length + 1);
+	}
+
+	record.header.size = (uint32_t)size;
+	ring_push(ring, record.bytes, size);
+}
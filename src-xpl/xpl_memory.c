@@ -8,15 +8,19 @@
 #ifndef XPL_MEMORY_H
 #define XPL_MEMORY_H
 
+#include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "uthash.h"
 
+#include "xpl.h"
 #include "xpl_log.h"
 #include "xpl_memory.h"
 #include "xpl_platform.h"
 
-#if XPL_MEMORY_TRACKING_ALLOCATOR != 0
+#if XPL_MEMORY_TRACKING_ALLOCATOR == 1
 
 // allocation info struct.
 typedef struct xpl_allocation {
@@ -124,8 +128,286 @@ void *xpl_realloc(void *ptr, size_t newsize) {
 
     return allocation_info->handle;
 }
+
+#elif XPL_MEMORY_TRACKING_ALLOCATOR == 2
+
+#define SITES_MAX       1024
+
+// Sits in front of every block; 16 bytes keeps the block's alignment.
+typedef struct xpl_allocation_header {
+    uint32_t    site;
+    uint32_t    reserved;
+    uint64_t    bytes;
+} xpl_allocation_header_t;
+
+typedef struct xpl_allocation_site {
+    uint64_t    key;            // 0 while the slot is free
+    const char  *file;
+    int         line;
+    uint64_t    calls;
+    int64_t     live_bytes;
+    int64_t     live_blocks;
+} xpl_allocation_site_t;
+
+// Counters are updated atomically, since loader and task threads allocate too.
+static xpl_allocation_site_t sites[SITES_MAX];
+
+static uint32_t site_index(const char *file, int line) {
+    uint64_t key = ((uint64_t)(uintptr_t)file * 31 + (uint64_t)line) | 1;
+    uint32_t index = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 54) & (SITES_MAX - 1);
+    for (size_t probe = 0; probe < SITES_MAX; ++probe, index = (index + 1) & (SITES_MAX - 1)) {
+        uint64_t existing = __atomic_load_n(&sites[index].key, __ATOMIC_ACQUIRE);
+        if (existing == key) return index;
+        if (existing == 0) {
+            uint64_t expected = 0;
+            if (__atomic_compare_exchange_n(&sites[index].key, &expected, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                sites[index].file = file;
+                sites[index].line = line;
+                return index;
+            }
+            if (expected == key) return index;
+        }
+    }
+    // Full: lump the rest in with whatever slot we started at.
+    return index;
+}
+
+static void site_add(uint32_t site, int64_t bytes, int64_t blocks) {
+    __atomic_fetch_add(&sites[site].live_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sites[site].live_blocks, blocks, __ATOMIC_RELAXED);
+}
+
+void *xpl_alloc_at(size_t size, const char *file, int line) {
+    xpl_allocation_header_t *header = malloc(sizeof(xpl_allocation_header_t) + size);
+    if (header == NULL) {
+        LOG_ERROR("malloc failed for %lu bytes at %s:%d", (unsigned long)size, file, line);
+        abort();
+    }
+    header->site = site_index(file, line);
+    header->bytes = size;
+    __atomic_fetch_add(&sites[header->site].calls, 1, __ATOMIC_RELAXED);
+    site_add(header->site, (int64_t)size, 1);
+    return header + 1;
+}
+
+void *xpl_calloc_at(size_t size, const char *file, int line) {
+    void *result = xpl_alloc_at(size, file, line);
+    memset(result, 0, size);
+    return result;
+}
+
+void xpl_free_at(void *ptr) {
+    if (ptr == NULL) return;
+    xpl_allocation_header_t *header = (xpl_allocation_header_t *)ptr - 1;
+    site_add(header->site, -(int64_t)header->bytes, -1);
+    free(header);
+}
+
+void *xpl_realloc_at(void *ptr, size_t size, const char *file, int line) {
+    if (ptr == NULL) return xpl_alloc_at(size, file, line);
+    if (size == 0) {
+        xpl_free_at(ptr);
+        return NULL;
+    }
+
+    xpl_allocation_header_t *header = (xpl_allocation_header_t *)ptr - 1;
+    site_add(header->site, -(int64_t)header->bytes, -1);
+    header = realloc(header, sizeof(xpl_allocation_header_t) + size);
+    if (header == NULL) {
+        LOG_ERROR("realloc failed for %lu bytes at %s:%d", (unsigned long)size, file, line);
+        abort();
+    }
+    // The block now belongs to the site that resized it.
+    header->site = site_index(file, line);
+    header->bytes = size;
+    __atomic_fetch_add(&sites[header->site].calls, 1, __ATOMIC_RELAXED);
+    site_add(header->site, (int64_t)size, 1);
+    return header + 1;
+}
+
+static int site_compare_live_bytes(const void *a, const void *b) {
+    int64_t la = (*(const xpl_allocation_site_t **)a)->live_bytes;
+    int64_t lb = (*(const xpl_allocation_site_t **)b)->live_bytes;
+    return (la < lb) - (la > lb);
+}
+
+void xpl_memory_log_sites(size_t count) {
+    xpl_allocation_site_t *sorted[SITES_MAX];
+    size_t used = 0;
+    for (size_t i = 0; i < SITES_MAX; ++i) {
+        if (__atomic_load_n(&sites[i].key, __ATOMIC_ACQUIRE)) sorted[used++] = &sites[i];
+    }
+    qsort(sorted, used, sizeof(sorted[0]), site_compare_live_bytes);
+
+    LOG_INFO("Allocation sites by live bytes (%lu sites):", (unsigned long)used);
+    for (size_t i = 0; i < xmin(count, used); ++i) {
+        const xpl_allocation_site_t *site = sorted[i];
+        LOG_INFO("%10lld bytes %6lld blocks %10llu calls  %s:%d",
+                 (long long)site->live_bytes, (long long)site->live_blocks,
+                 (unsigned long long)site->calls, site->file, site->line);
+    }
+}
+
 #endif
 
+// ----------- arenas -----------
+
+#define ARENA_ALIGN     16
+
+struct xpl_arena_chunk {
+    struct xpl_arena_chunk  *next;
+    size_t                  size;
+    unsigned char           *data;      // aligned, within this allocation
+};
+
+static xpl_arena_chunk_t *arena_chunk_new(size_t size, xpl_arena_chunk_t *next) {
+    xpl_arena_chunk_t *chunk = xpl_alloc(sizeof(xpl_arena_chunk_t) + size + ARENA_ALIGN);
+    uintptr_t data = ((uintptr_t)(chunk + 1) + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+    chunk->data = (unsigned char *)data;
+    chunk->size = size;
+    chunk->next = next;
+    return chunk;
+}
+
+static void arena_free_chunks(xpl_arena_t *arena) {
+    xpl_arena_chunk_t *chunk = arena->chunks;
+    while (chunk) {
+        xpl_arena_chunk_t *next = chunk->next;
+        xpl_free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
+
+static void *arena_allocator_alloc(void *context, size_t size) {
+    return xpl_arena_alloc((xpl_arena_t *)context, size);
+}
+
+xpl_arena_t *xpl_arena_new(size_t chunk_size) {
+    xpl_arena_t *arena = xpl_calloc_type(xpl_arena_t);
+    arena->chunk_size = chunk_size;
+    arena->chunks = arena_chunk_new(chunk_size, NULL);
+    arena->allocator.alloc = arena_allocator_alloc;
+    arena->allocator.free = NULL;
+    arena->allocator.context = arena;
+    return arena;
+}
+
+void xpl_arena_destroy(xpl_arena_t **pparena) {
+    assert(pparena);
+    xpl_arena_t *arena = *pparena;
+    assert(arena);
+
+    arena_free_chunks(arena);
+    xpl_free(arena);
+    *pparena = NULL;
+}
+
+void *xpl_arena_alloc(xpl_arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena->frame_bytes += size;
+
+    if (arena->used + size > arena->chunks->size) {
+        arena->chunks = arena_chunk_new(xmax(arena->chunk_size, size), arena->chunks);
+        arena->used = 0;
+    }
+    void *result = arena->chunks->data + arena->used;
+    arena->used += size;
+    return result;
+}
+
+void *xpl_arena_calloc(xpl_arena_t *arena, size_t size) {
+    void *result = xpl_arena_alloc(arena, size);
+    memset(result, 0, size);
+    return result;
+}
+
+char *xpl_arena_strdup(xpl_arena_t *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *result = xpl_arena_alloc(arena, len);
+    memcpy(result, str, len);
+    return result;
+}
+
+void xpl_arena_reset(xpl_arena_t *arena) {
+    if (arena->chunks->next) {
+        size_t size = xmax(arena->chunk_size, arena->frame_bytes);
+        arena_free_chunks(arena);
+        arena->chunks = arena_chunk_new(size, NULL);
+    }
+    arena->used = 0;
+    arena->frame_bytes = 0;
+}
+
+// ----------- pools -----------
+
+#define POOL_ALIGN      16
+
+// Each block starts with a link to the next, padded so objects stay aligned.
+#define POOL_BLOCK_HEADER   POOL_ALIGN
+
+xpl_pool_t *xpl_pool_new(size_t object_size, size_t objects_per_block) {
+    assert(objects_per_block);
+    xpl_pool_t *pool = xpl_calloc_type(xpl_pool_t);
+    // Free objects hold the free list link.
+    object_size = xmax(object_size, sizeof(void *));
+    pool->object_size = (object_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->objects_per_block = objects_per_block;
+    return pool;
+}
+
+void xpl_pool_destroy(xpl_pool_t **pppool) {
+    assert(pppool);
+    xpl_pool_t *pool = *pppool;
+    assert(pool);
+
+    void *block = pool->blocks;
+    while (block) {
+        void *next = *(void **)block;
+        xpl_free(block);
+        block = next;
+    }
+    xpl_free(pool);
+    *pppool = NULL;
+}
+
+static void pool_add_block(xpl_pool_t *pool) {
+    unsigned char *block = xpl_alloc(POOL_BLOCK_HEADER + pool->object_size * pool->objects_per_block);
+    *(void **)block = pool->blocks;
+    pool->blocks = block;
+
+    // Thread the new objects onto the free list in address order.
+    unsigned char *objects = block + POOL_BLOCK_HEADER;
+    for (size_t i = pool->objects_per_block; i-- > 0; ) {
+        void *object = objects + i * pool->object_size;
+        *(void **)object = pool->free_list;
+        pool->free_list = object;
+    }
+}
+
+void *xpl_pool_alloc(xpl_pool_t *pool) {
+    if (! pool->free_list) pool_add_block(pool);
+
+    void *result = pool->free_list;
+    pool->free_list = *(void **)result;
+    pool->live++;
+    return result;
+}
+
+void *xpl_pool_calloc(xpl_pool_t *pool) {
+    void *result = xpl_pool_alloc(pool);
+    memset(result, 0, pool->object_size);
+    return result;
+}
+
+void xpl_pool_free(xpl_pool_t *pool, void *ptr) {
+    if (! ptr) return;
+    assert(pool->live);
+    *(void **)ptr = pool->free_list;
+    pool->free_list = ptr;
+    pool->live--;
+}
+
 xpl_memory_comparison_result_t xpl_memory_compare(void *m1, void *m2, const size_t compare_bytes) {
     xpl_memory_comparison_result_t result;
 
@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <sys/stat.h>
 
 #include "utlist.h"
 
@@ -21,8 +23,13 @@
 
 #define INVERT_Z            1
 #define CW_WINDING_ORDER    0
-#define OBJ_FILE_LINE_SIZE  1024
-#define WHITESPACE          " \t\n\r"
+#define FACE_MAX_CORNERS    64
+#define WF_ARRAY_INITIAL    256
+#define WF_SLOTS_INITIAL    1024
+
+#define XMODEL_MAGIC        0x4c444d58 // "XMDL"
+#define XMODEL_VERSION      1
+#define XMODEL_EXTENSION    ".xmodel"
 
 xpl_model_material_t *xpl_model_material_new(void) {
 	xpl_model_material_t *material = xpl_alloc_type(xpl_model_material_t);
@@ -52,6 +59,7 @@ xpl_model_material_t *xpl_model_material_new(void) {
 	material->glossiness = 98.0f;
 
 	material->name[0] = '\0';
+	material->texture_name[0] = '\0';
 	material->texture = NULL;
 
 	material->prev = NULL;
@@ -63,56 +71,14 @@ xpl_model_material_t *xpl_model_material_new(void) {
 void xpl_model_material_destroy(xpl_model_material_t **ppmaterial) {
 	xpl_model_material_t *material = *ppmaterial;
 
-	xpl_texture_destroy(&material->texture);
+	if (material->texture) xpl_texture_destroy(&material->texture);
 
 	xpl_free(material);
 	*ppmaterial = NULL;
 }
 
-xpl_model_face_t *xpl_model_face_new(void) {
-	xpl_model_face_t *face = xpl_alloc_type(xpl_model_face_t);
-
-	face->vertex_count = 0;
-
-	face->prev = NULL;
-	face->next = NULL;
-
-	return face;
-}
-
-void xpl_model_face_destroy(xpl_model_face_t **ppface) {
-	xpl_model_face_t *face = *ppface;
-
-	xpl_free(face);
-
-	*ppface = NULL;
-}
-
-static const UT_icd vec3_icd = { sizeof (xvec3), NULL, NULL, NULL };
-
 xpl_model_t *xpl_model_new(void) {
-	xpl_model_t *model = xpl_alloc_type(xpl_model_t);
-
-	model->materials = NULL;
-	model->material_count = 0;
-
-	model->faces = NULL;
-	model->face_count = 0;
-	model->face_vertex_count = 0;
-
-	utarray_new(model->vertices, &vec3_icd);
-	model->vertex_count = 0;
-
-	utarray_new(model->normals, &vec3_icd);
-	model->normal_count = 0;
-
-	utarray_new(model->texcoords, &vec3_icd);
-	model->texcoord_count = 0;
-
-	model->vao = NULL;
-	model->vbo = NULL;
-	model->shader = NULL;
-
+	xpl_model_t *model = xpl_calloc_type(xpl_model_t);
 	return model;
 }
 
@@ -126,17 +92,13 @@ void xpl_model_destroy(xpl_model_t **ppmodel) {
 		xpl_model_material_destroy(&material);
 	}
 
-	xpl_model_face_t *face;
-	while (model->faces) {
-		face = model->faces;
-		model->faces = face->next;
-		xpl_model_face_destroy(&face);
+	if (model->cache) {
+		xpl_file_unmap(&model->cache);
+	} else {
+		xpl_free((void *)model->vertices);
+		xpl_free((void *)model->indices);
 	}
 
-	utarray_free(model->vertices);
-	utarray_free(model->normals);
-	utarray_free(model->texcoords);
-
 	if (model->vao) xpl_vao_destroy(&model->vao);
 	if (model->vbo) xpl_bo_destroy(&model->vbo);
 
@@ -144,121 +106,347 @@ void xpl_model_destroy(xpl_model_t **ppmodel) {
 	*ppmodel = NULL;
 }
 
-XPLINLINE int strequal(const char *s1, const char *s2) {
-	return (strcmp(s1, s2) == 0);
+static void material_set_texture(xpl_model_material_t *material, const char *texture_name) {
+	strncpy(material->texture_name, texture_name, MATERIAL_NAME_SIZE - 1);
+	material->texture_name[MATERIAL_NAME_SIZE - 1] = '\0';
+	material->texture = xpl_texture_new();
+	xpl_texture_load(material->texture, material->texture_name, true);
 }
 
-XPLINLINE int strcontains(const char *haystack, const char *needle) {
-	return (strstr(haystack, needle) != NULL);
+// Everything scans in place over a mapped file; nothing is copied or terminated.
+typedef struct wf_cursor {
+	const char              *p;
+	const char              *end;
+	int                     line_number;
+} wf_cursor_t;
+
+static const double s_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+XPLINLINE int wf_is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+XPLINLINE int wf_is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+XPLINLINE void wf_skip_space(wf_cursor_t *c) {
+	while (c->p < c->end && wf_is_space(*c->p)) ++c->p;
+}
+
+static void wf_next_line(wf_cursor_t *c) {
+	const char *newline = memchr(c->p, '\n', (size_t)(c->end - c->p));
+	c->p = newline ? newline + 1 : c->end;
+	++c->line_number;
+}
+
+// The next run of non-whitespace on this line.
+static size_t wf_token(wf_cursor_t *c, const char **token) {
+	wf_skip_space(c);
+	*token = c->p;
+	while (c->p < c->end && ! wf_is_space(*c->p) && *c->p != '\n') ++c->p;
+	return (size_t)(c->p - *token);
 }
 
-static void wf_parse_vector(xvec3 *vector) {
-	char *pch;
-	pch = strtok(NULL, WHITESPACE);
-	if (pch) {
-		vector->x = atof(pch);
-		pch = strtok(NULL, WHITESPACE);
-		if (pch) {
-			vector->y = atof(pch);
-			pch = strtok(NULL, WHITESPACE);
-			if (pch) {
-#                if INVERT_Z==1
-				vector->z = -atof(pch);
-#                else
-				vector->z = atof(pch);
-#                endif
-			} else {
-				vector->z = 0.0f;
+XPLINLINE int wf_token_is(const char *token, size_t length, const char *keyword) {
+	return strlen(keyword) == length && memcmp(token, keyword, length) == 0;
+}
+
+static void wf_token_copy(wf_cursor_t *c, char *out, size_t out_size) {
+	const char *token;
+	size_t length = wf_token(c, &token);
+	length = xmin(length, out_size - 1);
+	memcpy(out, token, length);
+	out[length] = '\0';
+}
+
+// Decimal and exponent forms. Up to 19 significant digits are kept, which is far
+// more than a float needs.
+static int wf_scan_float(wf_cursor_t *c, float *out) {
+	wf_skip_space(c);
+	const char *p = c->p;
+	int negative = FALSE;
+	if (p < c->end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; p < c->end && wf_is_digit(*p); ++p, ++digits) {
+		if (mantissa < 1000000000000000000ull) mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+		else ++exponent;
+	}
+	if (p < c->end && *p == '.') {
+		for (++p; p < c->end && wf_is_digit(*p); ++p, ++digits) {
+			if (mantissa < 1000000000000000000ull) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				--exponent;
 			}
-		} else {
-			vector->y = 0.0f;
-			vector->z = 0.0f;
 		}
-	} else {
-		vector->x = 0.0f;
-		vector->y = 0.0f;
-		vector->z = 0.0f;
 	}
+	if (! digits) return FALSE;
+
+	if (p < c->end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		int exponent_negative = FALSE;
+		if (q < c->end && (*q == '-' || *q == '+')) exponent_negative = (*q++ == '-');
+		if (q < c->end && wf_is_digit(*q)) {
+			int e = 0;
+			for (; q < c->end && wf_is_digit(*q); ++q) {
+				if (e < 10000) e = e * 10 + (*q - '0');
+			}
+			exponent += exponent_negative ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0) {
+		value = -exponent <= 22 ? value / s_pow10[-exponent] : value * pow(10.0, exponent);
+	} else if (exponent > 0) {
+		value = exponent <= 22 ? value * s_pow10[exponent] : value * pow(10.0, exponent);
+	}
+
+	*out = (float)(negative ? -value : value);
+	c->p = p;
+	return TRUE;
+}
+
+// Doesn't skip leading space, so that it can scan inside a face corner.
+static int wf_scan_int(wf_cursor_t *c, int *out) {
+	const char *p = c->p;
+	int negative = FALSE;
+	if (p < c->end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	if (p >= c->end || ! wf_is_digit(*p)) return FALSE;
+
+	int value = 0;
+	for (; p < c->end && wf_is_digit(*p); ++p) {
+		if (value < INT_MAX / 10) value = value * 10 + (*p - '0');
+	}
+
+	*out = negative ? -value : value;
+	c->p = p;
+	return TRUE;
 }
 
-static void wf_add_vector(UT_array *vertices, int *vertex_count) {
+// Missing trailing components are zero. Returns how many were present.
+static int wf_scan_xyz(wf_cursor_t *c, xvec3 *vector) {
+	vector->x = vector->y = vector->z = 0.0f;
+	int count = 0;
+	while (count < 3 && wf_scan_float(c, &vector->data[count])) ++count;
+	return count;
+}
+
+// Geometry only; colours go through wf_scan_xyz as they are.
+static xvec3 wf_scan_vector(wf_cursor_t *c) {
 	xvec3 vector;
-	wf_parse_vector(&vector);
-	utarray_push_back(vertices, &vector);
-	++(*vertex_count);
+#	if INVERT_Z==1
+	if (wf_scan_xyz(c, &vector) == 3) vector.z = -vector.z;
+#	else
+	wf_scan_xyz(c, &vector);
+#	endif
+	return vector;
 }
 
-static int wf_parse_vertex_index(int *vertex_indices, int *texture_indices, int *normal_indices) {
-	char *temp;
-	char *token;
-	int vertex_count = 0;
+static float wf_scan_scalar(wf_cursor_t *c, float fallback) {
+	float value;
+	return wf_scan_float(c, &value) ? value : fallback;
+}
 
-	while ((token = strtok(NULL, WHITESPACE))) {
-		if (texture_indices) texture_indices[vertex_count] = 0;
-		if (normal_indices) normal_indices[vertex_count] = 0;
+typedef struct wf_vectors {
+	xvec3                   *items;
+	uint32_t                count;
+	uint32_t                capacity;
+} wf_vectors_t;
+
+// A unique vertex is a distinct position/texcoord/normal/material combination.
+typedef struct wf_key {
+	int32_t                 position;
+	int32_t                 texcoord;
+	int32_t                 normal;
+	int32_t                 material;
+} wf_key_t;
+
+typedef struct wf_parser {
+	xpl_model_t             *model;
+	const char              *resource;
+
+	wf_vectors_t            positions;
+	wf_vectors_t            normals;
+	wf_vectors_t            texcoords;
+
+	xpl_model_vertex_t      *vertices;
+	wf_key_t                *keys;          // parallel to vertices
+	uint32_t                vertex_count;
+	uint32_t                vertex_capacity;
+
+	uint16_t                *indices;
+	uint32_t                index_count;
+	uint32_t                index_capacity;
+
+	// Open addressing over keys; each slot is a vertex index + 1, or 0 when empty.
+	uint32_t                *slots;
+	uint32_t                slot_mask;
+
+	int                     current_material;
+	int                     default_material;
+} wf_parser_t;
+
+static void wf_vectors_push(wf_vectors_t *vectors, xvec3 vector) {
+	if (vectors->count == vectors->capacity) {
+		vectors->capacity = vectors->capacity ? vectors->capacity * 2 : WF_ARRAY_INITIAL;
+		vectors->items = xpl_realloc(vectors->items, vectors->capacity * sizeof(xvec3));
+	}
+	vectors->items[vectors->count++] = vector;
+}
 
-		vertex_indices[vertex_count] = atoi(token);
+XPLINLINE uint32_t wf_key_hash(const wf_key_t *key) {
+	uint32_t hash = (uint32_t)key->position * 2654435761u;
+	hash = (hash ^ (uint32_t)key->texcoord) * 2246822519u;
+	hash = (hash ^ (uint32_t)key->normal) * 3266489917u;
+	hash = (hash ^ (uint32_t)key->material) * 668265263u;
+	return hash ^ (hash >> 15);
+}
 
-		if (strcontains(token, "//")) {                 // normal only
-			temp = strchr(token, '/');
-			++temp;
-			normal_indices[vertex_count] = atoi(++temp);
-		} else if (strcontains(token, "/")) {           // not just a vertex
+static void wf_slots_grow(wf_parser_t *parser) {
+	uint32_t slot_count = parser->slots ? (parser->slot_mask + 1) * 2 : WF_SLOTS_INITIAL;
+	xpl_free(parser->slots);
+	parser->slots = xpl_calloc(slot_count * sizeof(uint32_t));
+	parser->slot_mask = slot_count - 1;
 
-			// First is texture.
-			temp = strchr(token, '/');
-			texture_indices[vertex_count] = atoi(++temp);
+	for (uint32_t i = 0; i < parser->vertex_count; ++i) {
+		uint32_t slot = wf_key_hash(&parser->keys[i]) & parser->slot_mask;
+		while (parser->slots[slot]) slot = (slot + 1) & parser->slot_mask;
+		parser->slots[slot] = i + 1;
+	}
+}
 
-			// If another exists, it's normal.
-			if (strcontains(temp, "/")) {
-				temp = strchr(temp, '/');
-				normal_indices[vertex_count] = atoi(++temp);
-			}
+static int wf_default_material(wf_parser_t *parser) {
+	if (parser->default_material < 0) {
+		// Can't do the _new call in the macro; it's evaluated more than once
+		xpl_model_material_t *material = xpl_model_material_new();
+		DL_APPEND(parser->model->materials, material);
+		parser->default_material = parser->model->material_count++;
+	}
+	return parser->default_material;
+}
+
+static int wf_vertex(wf_parser_t *parser, const wf_key_t *key, uint16_t *index_out) {
+	if (! parser->slots || (parser->vertex_count + 1) * 2 > parser->slot_mask + 1) {
+		wf_slots_grow(parser);
+	}
+
+	uint32_t slot = wf_key_hash(key) & parser->slot_mask;
+	while (parser->slots[slot]) {
+		uint32_t index = parser->slots[slot] - 1;
+		if (! memcmp(&parser->keys[index], key, sizeof(wf_key_t))) {
+			*index_out = (uint16_t)index;
+			return TRUE;
 		}
+		slot = (slot + 1) & parser->slot_mask;
+	}
 
-		++vertex_count;
+	// Models draw with 16-bit indices.
+	if (parser->vertex_count > UINT16_MAX) {
+		LOG_ERROR("Model %s has more than %u unique vertices", parser->resource, UINT16_MAX + 1);
+		return FALSE;
+	}
+
+	if (parser->vertex_count == parser->vertex_capacity) {
+		parser->vertex_capacity = parser->vertex_capacity ? parser->vertex_capacity * 2 : WF_ARRAY_INITIAL;
+		parser->vertices = xpl_realloc(parser->vertices, parser->vertex_capacity * sizeof(xpl_model_vertex_t));
+		parser->keys = xpl_realloc(parser->keys, parser->vertex_capacity * sizeof(wf_key_t));
 	}
 
-	return vertex_count;
+	static const xvec3 zero = {{ 0.0f, 0.0f, 0.0f }};
+	uint32_t index = parser->vertex_count++;
+	xpl_model_vertex_t *vertex = &parser->vertices[index];
+	vertex->position = parser->positions.items[key->position];
+	vertex->texcoord = key->texcoord >= 0 ? parser->texcoords.items[key->texcoord] : zero;
+	vertex->normal = key->normal >= 0 ? parser->normals.items[key->normal] : zero;
+	vertex->material_index = key->material;
+	parser->keys[index] = *key;
+	parser->slots[slot] = index + 1;
+
+	*index_out = (uint16_t)index;
+	return TRUE;
 }
 
-// Apparently wavefront indices are 0-based.
+static void wf_push_index(wf_parser_t *parser, uint16_t index) {
+	if (parser->index_count == parser->index_capacity) {
+		parser->index_capacity = parser->index_capacity ? parser->index_capacity * 2 : WF_ARRAY_INITIAL;
+		parser->indices = xpl_realloc(parser->indices, parser->index_capacity * sizeof(uint16_t));
+	}
+	parser->indices[parser->index_count++] = index;
+}
 
-static int wf_convert_index(int item_count, int index) {
-	// If this asserts, the file may be invalid or empty.
-	assert(index > 0); // I don't see this documented
-	return index - 1;  // 1 based to 0 based
+// OBJ indices are 1-based, or negative to count back from the latest element.
+// Returns -1 for an index that's absent (0) or out of range.
+static int wf_resolve_index(int index, uint32_t count) {
+	if (index > 0 && (uint32_t)index <= count) return index - 1;
+	if (index < 0 && (uint32_t)-index <= count) return (int)count + index;
+	return -1;
 }
 
-static void wf_convert_indices(int item_count, int index_count, int *indices) {
-	for (int i = 0; i < index_count; ++i) {
-		indices[i] = wf_convert_index(item_count, indices[i]);
+// Corners are v, v/vt, v//vn or v/vt/vn.
+static int wf_scan_corner(wf_cursor_t *c, int corner[3]) {
+	corner[0] = corner[1] = corner[2] = 0;
+	wf_skip_space(c);
+	if (! wf_scan_int(c, &corner[0])) return FALSE;
+	if (c->p < c->end && *c->p == '/') {
+		++c->p;
+		wf_scan_int(c, &corner[1]);
+		if (c->p < c->end && *c->p == '/') {
+			++c->p;
+			wf_scan_int(c, &corner[2]);
+		}
 	}
+	return TRUE;
 }
 
-static void wf_parse_face(xpl_model_t *model, int current_material) {
-	xpl_model_face_t *face = xpl_model_face_new();
+// Faces are triangulated as fans.
+static int wf_parse_face(wf_parser_t *parser, wf_cursor_t *c) {
+	uint16_t indices[FACE_MAX_CORNERS];
+	int corner_count = 0;
+	int corner[3];
 
-	face->vertex_count = wf_parse_vertex_index(face->vertex_indices,
-											face->texture_indices,
-											face->normal_indices);
-	wf_convert_indices(model->vertex_count,
-						face->vertex_count,
-						face->vertex_indices);
-	wf_convert_indices(model->normal_count,
-						face->vertex_count,
-						face->normal_indices);
-	wf_convert_indices(model->texcoord_count,
-						face->vertex_count,
-						face->texture_indices);
+	if (parser->current_material < 0) {
+		parser->current_material = wf_default_material(parser);
+	}
 
-	face->material_index = current_material;
+	while (wf_scan_corner(c, corner)) {
+		if (corner_count == FACE_MAX_CORNERS) {
+			LOG_WARN("Face with more than %d corners in %s at line %d", FACE_MAX_CORNERS, parser->resource, c->line_number);
+			return TRUE;
+		}
 
-	DL_APPEND(model->faces, face);
-	++model->face_count;
-	model->face_vertex_count += face->vertex_count;
+		wf_key_t key;
+		key.position = wf_resolve_index(corner[0], parser->positions.count);
+		key.texcoord = corner[1] ? wf_resolve_index(corner[1], parser->texcoords.count) : -1;
+		key.normal = corner[2] ? wf_resolve_index(corner[2], parser->normals.count) : -1;
+		key.material = parser->current_material;
+		if (key.position < 0 || (corner[1] && key.texcoord < 0) || (corner[2] && key.normal < 0)) {
+			LOG_WARN("Face index out of range in %s at line %d", parser->resource, c->line_number);
+			return TRUE;
+		}
 
+		if (! wf_vertex(parser, &key, &indices[corner_count++])) return FALSE;
+	}
 
+	for (int i = 1; i + 1 < corner_count; ++i) {
+#		if CW_WINDING_ORDER==1
+		wf_push_index(parser, indices[0]);
+		wf_push_index(parser, indices[i]);
+		wf_push_index(parser, indices[i + 1]);
+#		else
+		// OBJ files seem to have CW winding order
+		wf_push_index(parser, indices[0]);
+		wf_push_index(parser, indices[i + 1]);
+		wf_push_index(parser, indices[i]);
+#		endif
+	}
+	return TRUE;
 }
 
 static int wf_find_material(xpl_model_t *model, const char *material_name) {
@@ -266,152 +454,375 @@ static int wf_find_material(xpl_model_t *model, const char *material_name) {
 	int index = 0;
 
 	DL_FOREACH(model->materials, el) {
-		if (strequal(el->name, material_name)) return index;
+		if (! strcmp(el->name, material_name)) return index;
 		++index;
 	}
 	return -1;
 }
 
 static void wf_add_material_lib(xpl_model_t *model, const char *resource) {
-
-	int line_number = 0;
-	char *current_token = NULL;
-	char current_line[OBJ_FILE_LINE_SIZE];
-	int material_open = FALSE;
-	xpl_model_material_t *current_material = NULL;
-
-	FILE *mtl_file_stream = fopen(resource, "r");
-	if (!mtl_file_stream) {
+	xpl_file_mapping_t *mapping = xpl_file_map(resource);
+	if (! mapping) {
 		LOG_ERROR("Couldn't open file %s", resource);
 		return;
 	}
 
-	while (fgets(current_line, OBJ_FILE_LINE_SIZE, mtl_file_stream)) {
-		++line_number;
-		current_token = strtok(current_line, WHITESPACE);
+	wf_cursor_t cursor = { (const char *)mapping->content, (const char *)mapping->content + mapping->length, 1 };
+	wf_cursor_t *c = &cursor;
+	xpl_model_material_t *current_material = NULL;
+
+	for (; c->p < c->end; wf_next_line(c)) {
+		const char *token;
+		size_t length = wf_token(c, &token);
 
 		// Skip blank lines and comments.
-		if ((current_token == NULL) || (current_token[0] == '#')) continue;
+		if (! length || token[0] == '#') continue;
 
-		if (strequal(current_token, "newmtl")) {                                // start new material
-			material_open = TRUE;
+		if (wf_token_is(token, length, "newmtl")) {                             // start new material
 			current_material = xpl_model_material_new();
-			char *material_name = strtok(NULL, " \t");
-			strncpy(current_material->name, material_name, MATERIAL_NAME_SIZE);
+			wf_token_copy(c, current_material->name, MATERIAL_NAME_SIZE);
 			DL_APPEND(model->materials, current_material);
 			++(model->material_count);
 
-		} else if (material_open && strequal(current_token, "Ka")) {            // ambient
-			wf_parse_vector(&current_material->ambient);
+		} else if (! current_material) {
+			LOG_WARN("Command outside a material in %s at line %i", resource, c->line_number);
+
+		} else if (wf_token_is(token, length, "Ka")) {                          // ambient
+			wf_scan_xyz(c, &current_material->ambient);
 
-		} else if (material_open && strequal(current_token, "Kd")) {            // diffuse
-			wf_parse_vector(&current_material->diffuse);
+		} else if (wf_token_is(token, length, "Kd")) {                          // diffuse
+			wf_scan_xyz(c, &current_material->diffuse);
 
-		} else if (material_open && strequal(current_token, "Ks")) {            // specular
-			wf_parse_vector(&current_material->specular);
+		} else if (wf_token_is(token, length, "Ks")) {                          // specular
+			wf_scan_xyz(c, &current_material->specular);
 
-		} else if (material_open && strequal(current_token, "Ns")) {            // shininess
-			current_material->shininess = atof(strtok(NULL, WHITESPACE));
+		} else if (wf_token_is(token, length, "Ns")) {                          // shininess
+			current_material->shininess = wf_scan_scalar(c, current_material->shininess);
 
-		} else if (material_open && strequal(current_token, "d")) {             // opacity
-			current_material->opacity = atof(strtok(NULL, WHITESPACE));
+		} else if (wf_token_is(token, length, "d")) {                           // opacity
+			current_material->opacity = wf_scan_scalar(c, current_material->opacity);
 
-		} else if (material_open && strequal(current_token, "r")) {             // reflectiveness
-			current_material->reflectiveness = atof(strtok(NULL, WHITESPACE));
+		} else if (wf_token_is(token, length, "r")) {                           // reflectiveness
+			current_material->reflectiveness = wf_scan_scalar(c, current_material->reflectiveness);
 
-		} else if (material_open && strequal(current_token, "sharpness")) {     // glossiness?!
-			current_material->glossiness = atof(strtok(NULL, WHITESPACE));
+		} else if (wf_token_is(token, length, "sharpness")) {                   // glossiness?!
+			current_material->glossiness = wf_scan_scalar(c, current_material->glossiness);
 
-		} else if (material_open && strequal(current_token, "Ni")) {            // refract index
-			current_material->refraction_index = atof(strtok(NULL, WHITESPACE));
+		} else if (wf_token_is(token, length, "Ni")) {                          // refract index
+			current_material->refraction_index = wf_scan_scalar(c, current_material->refraction_index);
 
-		} else if (material_open && strequal(current_token, "illum")) {
+		} else if (wf_token_is(token, length, "illum")) {
 			LOG_WARN("Illumination not handled");
 
-		} else if (material_open && strequal(current_token, "map_Ka")) {
-			char *filename = strtok(NULL, WHITESPACE);
-			char tex_resource_name[PATH_MAX];
-			xpl_resolve_resource(tex_resource_name, filename, PATH_MAX);
-			current_material->texture = xpl_texture_new();
-			xpl_texture_load(current_material->texture, tex_resource_name, true);
+		} else if (wf_token_is(token, length, "map_Ka")) {
+			char texture_name[MATERIAL_NAME_SIZE];
+			wf_token_copy(c, texture_name, MATERIAL_NAME_SIZE);
+			material_set_texture(current_material, texture_name);
 
 		} else {
-			LOG_WARN("Unknown command '%s' in material file %s at line %i:\n\t%s",
-					current_token, resource, line_number, current_line);
+			LOG_WARN("Unknown command '%.*s' in material file %s at line %i",
+					 (int)length, token, resource, c->line_number);
 		}
 	}
 
+	xpl_file_unmap(&mapping);
 }
 
-int xpl_model_load_obj(xpl_model_t *model, const char *resource) {
-
-	int current_material = -1;
-	char *current_token = NULL;
-	char current_line[OBJ_FILE_LINE_SIZE];
-	int line_number = 0;
-
-	char filename[PATH_MAX];
-	char resource_path[PATH_MAX];
-	snprintf(resource_path, PATH_MAX, "models/%s", resource);
-	xpl_resolve_resource(filename, resource_path, PATH_MAX);
+static int wf_parse(xpl_model_t *model, const xpl_file_mapping_t *source, const char *resource) {
+	wf_parser_t parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.model = model;
+	parser.resource = resource;
+	parser.current_material = -1;
+	parser.default_material = -1;
 
-	FILE *obj_file_stream = fopen(filename, "r");
-	if (!obj_file_stream) {
-		LOG_ERROR("Couldn't open file %s", filename);
-		return FALSE;
-	}
+	wf_cursor_t cursor = { (const char *)source->content, (const char *)source->content + source->length, 1 };
+	wf_cursor_t *c = &cursor;
+	int result = TRUE;
 
-	while (fgets(current_line, OBJ_FILE_LINE_SIZE, obj_file_stream)) {
-		++line_number;
-		current_token = strtok(current_line, WHITESPACE);
+	for (; result && c->p < c->end; wf_next_line(c)) {
+		const char *token;
+		size_t length = wf_token(c, &token);
 
 		// Skip blank lines and comments.
-		if ((current_token == NULL) || (current_token[0] == '#')) continue;
+		if (! length || token[0] == '#') continue;
 
-		if (strequal(current_token, "v")) {                 // vertex
-			wf_add_vector(model->vertices, &model->vertex_count);
+		if (wf_token_is(token, length, "v")) {                  // vertex
+			wf_vectors_push(&parser.positions, wf_scan_vector(c));
 
-		} else if (strequal(current_token, "vn")) {         // normal
-			wf_add_vector(model->normals, &model->normal_count);
+		} else if (wf_token_is(token, length, "vn")) {          // normal
+			wf_vectors_push(&parser.normals, wf_scan_vector(c));
 
-		} else if (strequal(current_token, "vt")) {         // texture
-			wf_add_vector(model->texcoords, &model->texcoord_count);
+		} else if (wf_token_is(token, length, "vt")) {          // texture
+			wf_vectors_push(&parser.texcoords, wf_scan_vector(c));
 
-		} else if (strequal(current_token, "f")) {          // face
-			wf_parse_face(model, current_material);
+		} else if (wf_token_is(token, length, "f")) {           // face
+			result = wf_parse_face(&parser, c);
 
-		} else if (strequal(current_token, "usemtl")) {
-			const char *material_name = strtok(NULL, WHITESPACE);
-			current_material = wf_find_material(model, material_name);
-			if (current_material < 0) {
+		} else if (wf_token_is(token, length, "usemtl")) {
+			char material_name[MATERIAL_NAME_SIZE];
+			wf_token_copy(c, material_name, MATERIAL_NAME_SIZE);
+			parser.current_material = wf_find_material(model, material_name);
+			if (parser.current_material < 0) {
 				LOG_WARN("Material named %s not found", material_name);
 			}
 
-		} else if (strequal(current_token, "mtllib")) {
-			char fname[PATH_MAX];
-			char rname[PATH_MAX];
-			xpl_resolve_resource(rname, fname, PATH_MAX);
-			wf_add_material_lib(model, rname);
+		} else if (wf_token_is(token, length, "mtllib")) {
+			char library_name[MATERIAL_NAME_SIZE];
+			char resource_path[PATH_MAX];
+			char filename[PATH_MAX];
+			wf_token_copy(c, library_name, MATERIAL_NAME_SIZE);
+			snprintf(resource_path, PATH_MAX, "models/%s", library_name);
+			xpl_resolve_resource(filename, resource_path, PATH_MAX);
+			wf_add_material_lib(model, filename);
 
-		} else if (strequal(current_token, "o")) {
-			LOG_DEBUG("Ignored: object name");
+		} else if (wf_token_is(token, length, "o") ||
+				   wf_token_is(token, length, "s") ||
+				   wf_token_is(token, length, "g")) {
+			// Ignored: object names, smoothing and groups
 
-		} else if (strequal(current_token, "s")) {
-			LOG_DEBUG("Ignored: smoothing");
+		} else {
+			LOG_WARN("Unknown command %.*s in %s at line %i",
+					 (int)length, token, resource, c->line_number);
+		}
+	}
 
-		} else if (strequal(current_token, "g")) {
-			LOG_DEBUG("Ignored: group");
+	xpl_free(parser.positions.items);
+	xpl_free(parser.normals.items);
+	xpl_free(parser.texcoords.items);
+	xpl_free(parser.keys);
+	xpl_free(parser.slots);
+
+	if (result) {
+		model->vertices = parser.vertices;
+		model->vertex_count = parser.vertex_count;
+		model->indices = parser.indices;
+		model->index_count = parser.index_count;
+	} else {
+		xpl_free(parser.vertices);
+		xpl_free(parser.indices);
+	}
+	return result;
+}
 
-		} else {
-			LOG_WARN("Unknown command %s in scene code at line %i:\n\t%s",
-					current_token, line_number, current_line);
+// Host layout; a cache from another build fails the magic or stride check and is rebuilt.
+typedef struct xmodel_header {
+	uint32_t                magic;
+	uint32_t                version;
+	uint32_t                vertex_stride;
+	uint32_t                material_count;
+	uint32_t                vertex_count;
+	uint32_t                index_count;
+	uint64_t                source_size;
+	int64_t                 source_mtime;
+	uint64_t                source_hash;
+} xmodel_header_t;
+
+typedef struct xmodel_material {
+	xvec3                   ambient;
+	xvec3                   diffuse;
+	xvec3                   specular;
+	xvec3                   emissive;
+	float                   reflectiveness;
+	float                   refractiveness;
+	float                   refraction_index;
+	float                   opacity;
+	float                   shininess;
+	float                   glossiness;
+	char                    name[MATERIAL_NAME_SIZE];
+	char                    texture_name[MATERIAL_NAME_SIZE];
+} xmodel_material_t;
+
+// FNV-1a.
+static uint64_t xmodel_source_hash(const xpl_file_mapping_t *source) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < source->length; ++i) {
+		hash = (hash ^ source->content[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+XPLINLINE size_t xmodel_vertices_offset(const xmodel_header_t *header) {
+	return sizeof(xmodel_header_t) + header->material_count * sizeof(xmodel_material_t);
+}
+
+XPLINLINE size_t xmodel_indices_offset(const xmodel_header_t *header) {
+	return xmodel_vertices_offset(header) + header->vertex_count * sizeof(xpl_model_vertex_t);
+}
+
+XPLINLINE size_t xmodel_length(const xmodel_header_t *header) {
+	return xmodel_indices_offset(header) + header->index_count * sizeof(uint16_t);
+}
 
+// The length check can't catch a stale or damaged body, and the draw path indexes
+// materials and vertices with what's in it.
+static int xmodel_body_valid(const xmodel_header_t *header, const unsigned char *content) {
+	const xmodel_material_t *records = (const xmodel_material_t *)(content + sizeof(xmodel_header_t));
+	for (uint32_t i = 0; i < header->material_count; ++i) {
+		if (! memchr(records[i].name, '\0', MATERIAL_NAME_SIZE)) return FALSE;
+		if (! memchr(records[i].texture_name, '\0', MATERIAL_NAME_SIZE)) return FALSE;
+	}
+
+	const xpl_model_vertex_t *vertices = (const xpl_model_vertex_t *)(content + xmodel_vertices_offset(header));
+	for (uint32_t i = 0; i < header->vertex_count; ++i) {
+		if (vertices[i].material_index < 0 || (uint32_t)vertices[i].material_index >= header->material_count) return FALSE;
+	}
+
+	const uint16_t *indices = (const uint16_t *)(content + xmodel_indices_offset(header));
+	for (uint32_t i = 0; i < header->index_count; ++i) {
+		if (indices[i] >= header->vertex_count) return FALSE;
+	}
+	return TRUE;
+}
+
+// Points the model at the cache if it's still good for the source. Maps the source
+// into *source_out if the check needed its content.
+static int xmodel_load(xpl_model_t *model, const char *cache_filename, const struct stat *source_stat,
+					   const char *filename, xpl_file_mapping_t **source_out) {
+	xpl_file_mapping_t *cache = xpl_file_map(cache_filename);
+	if (! cache) return FALSE;
+
+	const xmodel_header_t *header = (const xmodel_header_t *)cache->content;
+	if (cache->length < sizeof(xmodel_header_t) ||
+		header->magic != XMODEL_MAGIC ||
+		header->version != XMODEL_VERSION ||
+		header->vertex_stride != sizeof(xpl_model_vertex_t) ||
+		cache->length != xmodel_length(header) ||
+		header->source_size != (uint64_t)source_stat->st_size) {
+		xpl_file_unmap(&cache);
+		return FALSE;
+	}
+
+	if (header->source_mtime != (int64_t)source_stat->st_mtime) {
+		// Touched, but maybe not changed.
+		*source_out = xpl_file_map(filename);
+		if (! *source_out || xmodel_source_hash(*source_out) != header->source_hash) {
+			xpl_file_unmap(&cache);
+			return FALSE;
+		}
+	}
+
+	if (! xmodel_body_valid(header, cache->content)) {
+		LOG_WARN("Model cache %s is damaged; rebuilding it", cache_filename);
+		xpl_file_unmap(&cache);
+		return FALSE;
+	}
+
+	const xmodel_material_t *records = (const xmodel_material_t *)(cache->content + sizeof(xmodel_header_t));
+	for (uint32_t i = 0; i < header->material_count; ++i) {
+		xpl_model_material_t *material = xpl_model_material_new();
+		material->ambient = records[i].ambient;
+		material->diffuse = records[i].diffuse;
+		material->specular = records[i].specular;
+		material->emissive = records[i].emissive;
+		material->reflectiveness = records[i].reflectiveness;
+		material->refractiveness = records[i].refractiveness;
+		material->refraction_index = records[i].refraction_index;
+		material->opacity = records[i].opacity;
+		material->shininess = records[i].shininess;
+		material->glossiness = records[i].glossiness;
+		memcpy(material->name, records[i].name, MATERIAL_NAME_SIZE);
+		if (records[i].texture_name[0]) material_set_texture(material, records[i].texture_name);
+		DL_APPEND(model->materials, material);
+		++model->material_count;
+	}
+
+	model->vertices = (const xpl_model_vertex_t *)(cache->content + xmodel_vertices_offset(header));
+	model->vertex_count = header->vertex_count;
+	model->indices = (const uint16_t *)(cache->content + xmodel_indices_offset(header));
+	model->index_count = header->index_count;
+	model->cache = cache;
+	return TRUE;
+}
+
+// Written beside the source and renamed into place, so a reader never sees half a cache.
+// Failing to write it isn't an error.
+static void xmodel_write(const xpl_model_t *model, const char *cache_filename, const struct stat *source_stat,
+						 const xpl_file_mapping_t *source) {
+	xmodel_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = XMODEL_MAGIC;
+	header.version = XMODEL_VERSION;
+	header.vertex_stride = sizeof(xpl_model_vertex_t);
+	header.material_count = (uint32_t)model->material_count;
+	header.vertex_count = model->vertex_count;
+	header.index_count = model->index_count;
+	header.source_size = (uint64_t)source_stat->st_size;
+	header.source_mtime = (int64_t)source_stat->st_mtime;
+	header.source_hash = xmodel_source_hash(source);
+
+	char temp_filename[PATH_MAX];
+	snprintf(temp_filename, PATH_MAX, "%s.tmp", cache_filename);
+	FILE *file = fopen(temp_filename, "wb");
+	if (! file) {
+		LOG_DEBUG("Couldn't write model cache %s", cache_filename);
+		return;
+	}
+
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	const xpl_model_material_t *material;
+	DL_FOREACH(model->materials, material) {
+		xmodel_material_t record;
+		memset(&record, 0, sizeof(record));
+		record.ambient = material->ambient;
+		record.diffuse = material->diffuse;
+		record.specular = material->specular;
+		record.emissive = material->emissive;
+		record.reflectiveness = material->reflectiveness;
+		record.refractiveness = material->refractiveness;
+		record.refraction_index = material->refraction_index;
+		record.opacity = material->opacity;
+		record.shininess = material->shininess;
+		record.glossiness = material->glossiness;
+		memcpy(record.name, material->name, MATERIAL_NAME_SIZE);
+		memcpy(record.texture_name, material->texture_name, MATERIAL_NAME_SIZE);
+		ok = ok && fwrite(&record, sizeof(record), 1, file) == 1;
+	}
+
+	ok = ok && fwrite(model->vertices, sizeof(xpl_model_vertex_t), model->vertex_count, file) == model->vertex_count;
+	ok = ok && fwrite(model->indices, sizeof(uint16_t), model->index_count, file) == model->index_count;
+	ok = (fclose(file) == 0) && ok;
+
+	if (! ok || rename(temp_filename, cache_filename) != 0) {
+		LOG_WARN("Couldn't write model cache %s", cache_filename);
+		remove(temp_filename);
+	}
+}
+
+int xpl_model_load_obj(xpl_model_t *model, const char *resource) {
+	char filename[PATH_MAX];
+	char resource_path[PATH_MAX];
+	snprintf(resource_path, PATH_MAX, "models/%s", resource);
+	xpl_resolve_resource(filename, resource_path, PATH_MAX);
+
+	struct stat source_stat;
+	if (stat(filename, &source_stat) != 0) {
+		LOG_ERROR("Couldn't open file %s", filename);
+		return FALSE;
+	}
+
+	char cache_filename[PATH_MAX];
+	snprintf(cache_filename, PATH_MAX, "%s" XMODEL_EXTENSION, filename);
+
+	xpl_file_mapping_t *source = NULL;
+	int result = xmodel_load(model, cache_filename, &source_stat, filename, &source);
+	if (! result) {
+		if (! source) source = xpl_file_map(filename);
+		if (! source) {
+			LOG_ERROR("Couldn't open file %s", filename);
+			return FALSE;
 		}
 
+		result = wf_parse(model, source, resource);
+		if (result) xmodel_write(model, cache_filename, &source_stat, source);
+	} else if (source) {
+		// Only the mtime changed; record the new one so the next load skips the hash.
+		xmodel_write(model, cache_filename, &source_stat, source);
 	}
 
-	fclose(obj_file_stream);
-	return 1;
+	if (source) xpl_file_unmap(&source);
+	return result;
 }
 
 xpl_model_t *xpl_model_load_from_wavefront(const char *wavefront_resource_name) {
@@ -459,88 +870,62 @@ void xpl_model_build_vao(xpl_model_t *model) {
 	xpl_bo_t *vbo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
 	xpl_bo_t *ibo = xpl_bo_new(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 
-	size_t index_bytes = model->face_vertex_count * sizeof (GLushort);
-	size_t vertex_bytes = model->face_vertex_count * sizeof (_mvertex_t);
-	GLushort *indices = (GLushort *)xpl_alloc(index_bytes);
+	size_t index_bytes = model->index_count * sizeof (GLushort);
+	size_t vertex_bytes = model->vertex_count * sizeof (_mvertex_t);
 	_mvertex_t *vertices = (_mvertex_t *)xpl_alloc(vertex_bytes);
-	// GLushort indices[model->face_vertex_count];
-	//_mvertex_t vertices[model->face_vertex_count];
-
-	size_t vertex_index = 0, index_index = 0;
-	xpl_model_face_t *face;
-	xpl_model_material_t *material;
-
-	// Add a default material.
-	material = xpl_model_material_new();
-	// Can't do the _new call in the macro; it's evaluated more than once
-	DL_APPEND(model->materials, material);
-	model->material_count++;
 
-	DL_FOREACH(model->faces, face) {
-		// If no material was assigned, use the last (default) material.
-		if (face->material_index < 0) {
-			face->material_index = model->material_count - 1;
-		}
-		material = (model->materials) + face->material_index;
+	const xpl_model_material_t **materials = xpl_alloc((model->material_count + 1) * sizeof(xpl_model_material_t *));
+	const xpl_model_material_t *material;
+	int material_index = 0;
+	DL_FOREACH(model->materials, material) {
+		materials[material_index++] = material;
+	}
 
-#        if CW_WINDING_ORDER==1
-		// OBJ files seem to have CW winding order
-		for (int face_vertex_index = 0; face_vertex_index < face->vertex_count; ++face_vertex_index) {
-#        else
-		for (int face_vertex_index = face->vertex_count - 1; face_vertex_index >= 0; --face_vertex_index) {
-#            endif
-			size_t vertex_offset = face->vertex_indices[face_vertex_index];
-			size_t normal_offset = face->normal_indices[face_vertex_index];
-			size_t texcoord_offset = face->texture_indices[face_vertex_index];
-
-			xvec3 *vertex;
-
-			vertex = (xvec3 *)utarray_eltptr(model->vertices, vertex_offset);
-			vertices[vertex_index].position = *vertex;
-
-			vertex = (xvec3 *)utarray_eltptr(model->normals, normal_offset);
-			vertices[vertex_index].normal = *vertex;
-
-			vertex = (xvec3 *)utarray_eltptr(model->texcoords, texcoord_offset);
-			vertices[vertex_index].texture = *vertex;
-
-			vertices[vertex_index].tex_index = face->material_index;
-
-			vertices[vertex_index].ambient.r = material->ambient.r;
-			vertices[vertex_index].ambient.g = material->ambient.g;
-			vertices[vertex_index].ambient.b = material->ambient.b;
-			vertices[vertex_index].ambient.a = material->opacity;
-
-			vertices[vertex_index].diffuse.r = material->diffuse.r;
-			vertices[vertex_index].diffuse.g = material->diffuse.g;
-			vertices[vertex_index].diffuse.b = material->diffuse.b;
-			vertices[vertex_index].diffuse.a = material->opacity;
-
-			vertices[vertex_index].specular.r = material->specular.r;
-			vertices[vertex_index].specular.g = material->specular.g;
-			vertices[vertex_index].specular.b = material->specular.b;
-			vertices[vertex_index].specular.a = material->opacity;
-
-			vertices[vertex_index].emissive.r = material->emissive.r;
-			vertices[vertex_index].emissive.g = material->emissive.g;
-			vertices[vertex_index].emissive.b = material->emissive.b;
-			vertices[vertex_index].emissive.a = material->opacity;
-
-			vertices[vertex_index].reflectiveness = material->reflectiveness;
-			vertices[vertex_index].refractiveness = material->refractiveness;
-			vertices[vertex_index].refraction_index = material->refraction_index;
-			vertices[vertex_index].shininess = material->shininess;
-			vertices[vertex_index].glossiness = material->glossiness;
-
-			indices[index_index++] = (GLushort)vertex_index;
-			vertex_index++;
-		}
+	// Vertices are already unique; each just picks up its material's properties.
+	for (size_t vertex_index = 0; vertex_index < model->vertex_count; ++vertex_index) {
+		const xpl_model_vertex_t *source = &model->vertices[vertex_index];
+		assert(source->material_index >= 0 && source->material_index < model->material_count);
+		material = materials[source->material_index];
+
+		vertices[vertex_index].position = source->position;
+		vertices[vertex_index].normal = source->normal;
+		vertices[vertex_index].texture = source->texcoord;
+
+		vertices[vertex_index].tex_index = source->material_index;
+
+		vertices[vertex_index].ambient.r = material->ambient.r;
+		vertices[vertex_index].ambient.g = material->ambient.g;
+		vertices[vertex_index].ambient.b = material->ambient.b;
+		vertices[vertex_index].ambient.a = material->opacity;
+
+		vertices[vertex_index].diffuse.r = material->diffuse.r;
+		vertices[vertex_index].diffuse.g = material->diffuse.g;
+		vertices[vertex_index].diffuse.b = material->diffuse.b;
+		vertices[vertex_index].diffuse.a = material->opacity;
+
+		vertices[vertex_index].specular.r = material->specular.r;
+		vertices[vertex_index].specular.g = material->specular.g;
+		vertices[vertex_index].specular.b = material->specular.b;
+		vertices[vertex_index].specular.a = material->opacity;
+
+		vertices[vertex_index].emissive.r = material->emissive.r;
+		vertices[vertex_index].emissive.g = material->emissive.g;
+		vertices[vertex_index].emissive.b = material->emissive.b;
+		vertices[vertex_index].emissive.a = material->opacity;
+
+		vertices[vertex_index].reflectiveness = material->reflectiveness;
+		vertices[vertex_index].refractiveness = material->refractiveness;
+		vertices[vertex_index].refraction_index = material->refraction_index;
+		vertices[vertex_index].shininess = material->shininess;
+		vertices[vertex_index].glossiness = material->glossiness;
 	}
+	xpl_free(materials);
 
 	xpl_bo_append(vbo, vertices, vertex_bytes);
 	xpl_bo_commit(vbo);
-	xpl_bo_append(ibo, indices, index_bytes);
+	xpl_bo_append(ibo, model->indices, index_bytes);
 	xpl_bo_commit(ibo);
+	xpl_free(vertices);
 
 	xpl_vao_t *vao = xpl_vao_new();
 	xpl_vao_set_index_buffer(vao, 0, ibo);
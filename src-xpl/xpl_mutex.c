@@ -101,3 +101,85 @@ bool xpl_mutex_leave(xpl_mutex_t *self) {
     return result;
 }
 
+
+// ----------------------------------------------------------------------------
+
+#ifdef XPL_PLATFORM_WINDOWS
+typedef CONDITION_VARIABLE  condition_t;
+#else
+#include <errno.h>
+#include <sys/time.h>
+typedef pthread_cond_t      condition_t;
+#endif
+
+struct xpl_condition {
+    condition_t condition;
+};
+
+xpl_condition_t *xpl_condition_new() {
+    xpl_condition_t *self = xpl_calloc_type(xpl_condition_t);
+#ifdef XPL_PLATFORM_WINDOWS
+    InitializeConditionVariable(&self->condition);
+#else
+    if (pthread_cond_init(&self->condition, NULL) != 0) {
+        xpl_free(self);
+        return NULL;
+    }
+#endif
+    return self;
+}
+
+void xpl_condition_destroy(xpl_condition_t **ppcondition) {
+    assert(ppcondition);
+    xpl_condition_t *self = *ppcondition;
+    assert(self);
+    
+#ifndef XPL_PLATFORM_WINDOWS
+    pthread_cond_destroy(&self->condition);
+#endif
+    
+    xpl_free(self);
+    *ppcondition = NULL;
+}
+
+bool xpl_condition_wait(xpl_condition_t *self, xpl_mutex_t *mutex, int timeout) {
+    assert(self);
+    assert(mutex && mutex->valid);
+    
+#ifdef XPL_PLATFORM_WINDOWS
+    return SleepConditionVariableCS(&self->condition, &mutex->mutex, timeout < 0 ? INFINITE : (DWORD)timeout) != 0;
+#else
+    if (timeout < 0) {
+        return pthread_cond_wait(&self->condition, mutex->mutex) == 0;
+    }
+    
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + timeout / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000L + (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(&self->condition, mutex->mutex, &deadline) != ETIMEDOUT;
+#endif
+}
+
+void xpl_condition_signal(xpl_condition_t *self) {
+    assert(self);
+#ifdef XPL_PLATFORM_WINDOWS
+    WakeConditionVariable(&self->condition);
+#else
+    pthread_cond_signal(&self->condition);
+#endif
+}
+
+void xpl_condition_broadcast(xpl_condition_t *self) {
+    assert(self);
+#ifdef XPL_PLATFORM_WINDOWS
+    WakeAllConditionVariable(&self->condition);
+#else
+    pthread_cond_broadcast(&self->condition);
+#endif
+}
@@ -14,6 +14,7 @@
 #include "xpl.h"
 #include "xpl_memory.h"
 #include "xpl_rc.h"
+#include "xpl_vfs.h"
 
 #define PATH_SEP '/'
 #define OS_SEP XPL_PATH_SEPARATOR
@@ -515,6 +516,33 @@ int xpl_resource_exists(const char *resource_path) {
 }
 
 int xpl_resolve_resource(char *path_out, const char *path_in, size_t length) {
+    // The read-only resource paths are indexed once; only the data path is probed.
+    switch (xpl_vfs_locate(path_in)) {
+        case XPL_VFS_APP_RESOURCE:
+            xpl_resource_path(&path_out[0], path_in, length);
+            return TRUE;
+
+        case XPL_VFS_LIBRARY_RESOURCE:
+            xpl_library_resource_path(&path_out[0], path_in, length);
+            return TRUE;
+
+        case XPL_VFS_DEV_RESOURCE:
+            xpl_dev_resource_path(&path_out[0], path_in, length);
+            return TRUE;
+
+        case XPL_VFS_PACK:
+            // Packed resources have no path of their own; use xpl_vfs_map.
+            xpl_resource_path(&path_out[0], path_in, length);
+            return FALSE;
+
+        case XPL_VFS_NOT_FOUND:
+            xpl_data_resource_path(&path_out[0], path_in, length);
+            return xpl_resource_exists(&path_out[0]);
+
+        case XPL_VFS_UNINDEXED:
+            break;
+    }
+
     xpl_resource_path(&path_out[0], path_in, length);
     if (xpl_resource_exists(&path_out[0])) return TRUE;
 
@@ -17,6 +17,8 @@
 
 #include "xpl.h"
 #include "xpl_gl_debug.h"
+#include "xpl_file.h"
+#include "xpl_file_watch.h"
 #include "xpl_memory.h"
 #include "xpl_platform.h"
 #include "xpl_shader.h"
@@ -24,6 +26,12 @@
 
 #define SHADER_CACHE_SIZE 200
 
+#define SHADER_SOURCE_CACHE_FILE ".xpl_shader_cache"
+#define SHADER_SOURCE_CACHE_MAGIC 0x43585348
+#define SHADER_SOURCE_CACHE_VERSION 1
+#define SHADER_SOURCE_KEY_MAX (SHADER_NAME_MAX + 32)
+#define SHADER_HASH_INIT 14695981039346656037ull
+
 typedef struct shader_table_entry {
 	char            name[SHADER_NAME_MAX];
 	xpl_shader_t    *shader;
@@ -56,15 +64,49 @@ typedef struct xpl_uniform_info {
 
 typedef struct xpl_shader_node {
 	GLuint                  shader_handle;
+	GLenum                  shader_type;
+	char                    effect_key[SHADER_NAME_MAX];
+	uint64_t                source_hash;
 	struct xpl_shader_node  *prev;
 	struct xpl_shader_node  *next;
 } xpl_shader_node_t;
 
+// An effect file on disk, hashed lazily so unchanged includes cost one read.
+typedef struct shader_file {
+	char            effect_name[SHADER_NAME_MAX];
+	char            path[PATH_MAX];
+	uint64_t        content_hash;
+	bool            hashed;
+
+	UT_hash_handle  hh;
+} shader_file_t;
+
+// A fully expanded source, keyed like glsw keys plus the version and platform
+// tokens. It's reused while the directives and every file it pulled in hash the same.
+typedef struct shader_source {
+	char            key[SHADER_SOURCE_KEY_MAX];
+	uint64_t        directives_hash;
+	uint64_t        hash;
+	char            *source;
+	size_t          dependency_count;
+	char            (*dependencies)[SHADER_NAME_MAX];
+	uint64_t        *dependency_hashes;
+	bool            verified;
+
+	UT_hash_handle  hh;
+} shader_source_t;
+
 // ---------------- private global shader hash table --------------------
 static shader_table_entry_t *s_shader_table = NULL;
 static char s_version_suffix[8] = { 0 }; // Glue this onto effect key names, e.g. GL32
 static char s_shader_suffix[PATH_MAX] = { 0 };
 static char s_shader_prefix[PATH_MAX] = { 0 };
+static shader_file_t *s_shader_files = NULL;
+static shader_source_t *s_shader_sources = NULL;
+static bool s_shader_sources_dirty = false;
+static uint64_t s_directives_hash = SHADER_HASH_INIT;
+static xpl_file_watch_t *s_shader_watch = NULL;
+static bool s_shader_reload_pending = false;
 // ----------------------------------------------------------------------
 
 xpl_shader_t *xpl_shader_new(const char *name) {
@@ -205,39 +247,288 @@ static bstring source_for_effect_key_internal(const char *effect_key, const char
     return bresult;
 }
 
-static char *alloc_source_for_effect_key(const char *effect_key, struct bstrList *included_keys, const char **error) {
-    bstring result = source_for_effect_key_internal(effect_key, error, included_keys, 0, 0);
-    
-    char *char_result = 0;
-    if (! *error) {
-        char_result = strdup((const char *)result->data);
-    }
+// FNV-1a.
+static uint64_t shader_hash_bytes(uint64_t hash, const void *data, size_t length) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
 
-    bdestroy(result);
-    result = NULL;
-    
-    return char_result;
+static void effect_name_for_key(char *effect_name, const char *effect_key) {
+	size_t length = strcspn(effect_key, ".");
+	length = xmin(length, SHADER_NAME_MAX - 1);
+	memcpy(effect_name, effect_key, length);
+	effect_name[length] = '\0';
 }
 
-GLuint xpl_shader_add(xpl_shader_t *shader, const GLenum shader_type, const char *effect_key) {
+static void shader_file_changed(const char *filename, void *data, void *context);
 
-    const char *error = NULL;
-    struct bstrList *included_keys = bstrListCreate();
-    char *source = alloc_source_for_effect_key(effect_key, included_keys, &error);
-    if (source == 0) {
-		LOG_ERROR("Couldn't load shader (type: %d, effect_key: %s): %s", shader_type, effect_key, error);
-		xpl_gl_breakpoint_func();
-		glswGetError();
-		glswClearError();
-		return GL_FALSE;
+static shader_file_t *shader_file_get(const char *effect_name) {
+	shader_file_t *file;
+	HASH_FIND_STR(s_shader_files, effect_name, file);
+	if (file) return file;
+
+	// The same search glsw makes, in the same order.
+	xpl_resolve_resource_opts_t resource_opts;
+	xpl_resource_resolve_opts(&resource_opts, s_shader_prefix);
+	for (size_t i = 0; i < 4; ++i) {
+		char path[PATH_MAX];
+		int path_length = snprintf(path, PATH_MAX, "%s%s%s", resource_opts.resource_paths[i], effect_name, s_shader_suffix);
+		if (path_length < 0 || path_length >= PATH_MAX || ! xpl_resource_exists(path)) continue;
+
+		file = xpl_calloc_type(shader_file_t);
+		strcpy(file->effect_name, effect_name);
+		strcpy(file->path, path);
+		HASH_ADD_STR(s_shader_files, effect_name, file);
+		if (s_shader_watch) xpl_file_watch_add(s_shader_watch, path, file);
+		return file;
+	}
+	return NULL;
+}
+
+static uint64_t shader_file_hash(shader_file_t *file) {
+	if (! file->hashed) {
+		xpl_file_mapping_t *mapping = xpl_file_map(file->path);
+		file->content_hash = mapping ? shader_hash_bytes(SHADER_HASH_INIT, mapping->content, mapping->length) : 0;
+		if (mapping) xpl_file_unmap(&mapping);
+		file->hashed = true;
+	}
+	return file->content_hash;
+}
+
+static shader_source_t *shader_source_new(const char *key, uint64_t directives_hash, const char *source, size_t length) {
+	shader_source_t *entry = xpl_calloc_type(shader_source_t);
+	strncpy(entry->key, key, SHADER_SOURCE_KEY_MAX - 1);
+	entry->directives_hash = directives_hash;
+	entry->source = xpl_alloc(length + 1);
+	memcpy(entry->source, source, length);
+	entry->source[length] = '\0';
+	entry->hash = shader_hash_bytes(SHADER_HASH_INIT, source, length);
+	HASH_ADD_STR(s_shader_sources, key, entry);
+	return entry;
+}
+
+static void shader_source_add_dependency(shader_source_t *entry, const char *effect_name, uint64_t content_hash) {
+	for (size_t i = 0; i < entry->dependency_count; ++i) {
+		if (! strcmp(entry->dependencies[i], effect_name)) return;
+	}
+	size_t count = ++entry->dependency_count;
+	entry->dependencies = xpl_realloc(entry->dependencies, count * sizeof(entry->dependencies[0]));
+	entry->dependency_hashes = xpl_realloc(entry->dependency_hashes, count * sizeof(uint64_t));
+	strncpy(entry->dependencies[count - 1], effect_name, SHADER_NAME_MAX - 1);
+	entry->dependencies[count - 1][SHADER_NAME_MAX - 1] = '\0';
+	entry->dependency_hashes[count - 1] = content_hash;
+}
+
+static bool shader_source_depends_on(const shader_source_t *entry, const char *effect_name) {
+	for (size_t i = 0; i < entry->dependency_count; ++i) {
+		if (! strcmp(entry->dependencies[i], effect_name)) return true;
+	}
+	return false;
+}
+
+static void shader_source_destroy(shader_source_t *entry) {
+	HASH_DEL(s_shader_sources, entry);
+	xpl_free(entry->source);
+	xpl_free(entry->dependencies);
+	xpl_free(entry->dependency_hashes);
+	xpl_free(entry);
+}
+
+// Each file is hashed at most once a session, however many sources include it.
+static bool shader_source_verify(shader_source_t *entry) {
+	if (entry->directives_hash != s_directives_hash) return false;
+	if (entry->verified) return true;
+
+	for (size_t i = 0; i < entry->dependency_count; ++i) {
+		shader_file_t *file = shader_file_get(entry->dependencies[i]);
+		if (! file || shader_file_hash(file) != entry->dependency_hashes[i]) return false;
+	}
+	entry->verified = true;
+	return true;
+}
+
+static shader_source_t *source_for_effect_key(const char *effect_key, const char **error) {
+	char key[SHADER_SOURCE_KEY_MAX];
+	snprintf(key, SHADER_SOURCE_KEY_MAX, "%s.%s.%s", effect_key, s_version_suffix, XPL_PLATFORM_STRING);
+
+	shader_source_t *entry;
+	HASH_FIND_STR(s_shader_sources, key, entry);
+	if (entry) {
+		if (shader_source_verify(entry)) return entry;
+		shader_source_destroy(entry);
+	}
+
+	struct bstrList *included_keys = bstrListCreate();
+	bstring result = source_for_effect_key_internal(effect_key, error, included_keys, 0, 0);
+	if (! *error) {
+		entry = shader_source_new(key, s_directives_hash, (const char *)result->data, (size_t)blength(result));
+		for (int i = 0; i < included_keys->qty; ++i) {
+			char effect_name[SHADER_NAME_MAX];
+			effect_name_for_key(effect_name, (const char *)included_keys->entry[i]->data);
+			shader_file_t *file = shader_file_get(effect_name);
+			shader_source_add_dependency(entry, effect_name, file ? shader_file_hash(file) : 0);
+		}
+		entry->verified = true;
+		s_shader_sources_dirty = true;
+	} else {
+		entry = NULL;
+	}
+
+	bdestroy(result);
+	bstrListDestroy(included_keys);
+	return entry;
+}
+
+// Host layout: magic, version, count, then per source its key, directives hash,
+// dependencies with their content hashes, and the source itself. Strings are
+// length-prefixed.
+typedef struct cache_cursor {
+	const unsigned char     *p;
+	const unsigned char     *end;
+} cache_cursor_t;
+
+static bool cache_read(cache_cursor_t *cursor, void *out, size_t length) {
+	if ((size_t)(cursor->end - cursor->p) < length) return false;
+	memcpy(out, cursor->p, length);
+	cursor->p += length;
+	return true;
+}
+
+static const char *cache_read_string(cache_cursor_t *cursor, uint32_t *length_out, uint32_t max_length) {
+	if (! cache_read(cursor, length_out, sizeof(uint32_t))) return NULL;
+	if (*length_out > max_length || (size_t)(cursor->end - cursor->p) < *length_out) return NULL;
+	const char *string = (const char *)cursor->p;
+	cursor->p += *length_out;
+	return string;
+}
+
+static void cache_write_string(FILE *file, const char *string, uint32_t length) {
+	fwrite(&length, sizeof(length), 1, file);
+	fwrite(string, 1, length, file);
+}
+
+static void shader_sources_load(void) {
+	xpl_resolve_resource_opts_t resource_opts;
+	xpl_resource_resolve_opts(&resource_opts, s_shader_prefix);
+
+	xpl_file_mapping_t *mapping = NULL;
+	for (size_t i = 0; i < 4 && ! mapping; ++i) {
+		char path[PATH_MAX];
+		int path_length = snprintf(path, PATH_MAX, "%s%s", resource_opts.resource_paths[i], SHADER_SOURCE_CACHE_FILE);
+		if (path_length < 0 || path_length >= PATH_MAX) continue;
+		if (xpl_resource_exists(path)) mapping = xpl_file_map(path);
+	}
+	if (! mapping) return;
+
+	cache_cursor_t cursor = { mapping->content, mapping->content + mapping->length };
+	uint32_t magic = 0, version = 0, count = 0;
+	if (! cache_read(&cursor, &magic, sizeof(magic)) || magic != SHADER_SOURCE_CACHE_MAGIC ||
+		! cache_read(&cursor, &version, sizeof(version)) || version != SHADER_SOURCE_CACHE_VERSION ||
+		! cache_read(&cursor, &count, sizeof(count))) {
+		xpl_file_unmap(&mapping);
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t key_length, dependency_count, source_length;
+		uint64_t directives_hash;
+		char key[SHADER_SOURCE_KEY_MAX];
+
+		const char *key_data = cache_read_string(&cursor, &key_length, SHADER_SOURCE_KEY_MAX - 1);
+		if (! key_data ||
+			! cache_read(&cursor, &directives_hash, sizeof(directives_hash)) ||
+			! cache_read(&cursor, &dependency_count, sizeof(dependency_count))) break;
+		memcpy(key, key_data, key_length);
+		key[key_length] = '\0';
+
+		// Dependencies come before the source, so hold on to where they start.
+		cache_cursor_t dependencies = cursor;
+		bool ok = true;
+		for (uint32_t j = 0; ok && j < dependency_count; ++j) {
+			uint32_t name_length;
+			uint64_t content_hash;
+			ok = cache_read_string(&cursor, &name_length, SHADER_NAME_MAX - 1) &&
+				 cache_read(&cursor, &content_hash, sizeof(content_hash));
+		}
+		const char *source = ok ? cache_read_string(&cursor, &source_length, UINT32_MAX) : NULL;
+		if (! source) break;
+
+		shader_source_t *entry;
+		HASH_FIND_STR(s_shader_sources, key, entry);
+		if (entry) continue;
+
+		entry = shader_source_new(key, directives_hash, source, source_length);
+		for (uint32_t j = 0; ok && j < dependency_count; ++j) {
+			uint32_t name_length;
+			uint64_t content_hash;
+			char effect_name[SHADER_NAME_MAX];
+			const char *name = cache_read_string(&dependencies, &name_length, SHADER_NAME_MAX - 1);
+			ok = name && cache_read(&dependencies, &content_hash, sizeof(content_hash));
+			if (! ok) break;
+			memcpy(effect_name, name, name_length);
+			effect_name[name_length] = '\0';
+			shader_source_add_dependency(entry, effect_name, content_hash);
+		}
+		if (! ok) {
+			shader_source_destroy(entry);
+			break;
+		}
+	}
+
+	LOG_DEBUG("Loaded %u cached shader sources", HASH_COUNT(s_shader_sources));
+	xpl_file_unmap(&mapping);
+}
+
+static void shader_sources_save(void) {
+	if (! s_shader_sources_dirty || ! s_shader_files) return;
+
+	// Beside the first shader file we found.
+	char path[PATH_MAX];
+	strcpy(path, s_shader_files->path);
+	char *separator = strrchr(path, '/');
+	if (! separator) separator = strrchr(path, '\\');
+	if (separator) separator[1] = '\0';
+	else path[0] = '\0';
+	strncat(path, SHADER_SOURCE_CACHE_FILE, PATH_MAX - strlen(path) - 1);
+
+	FILE *file = fopen(path, "wb");
+	if (! file) {
+		LOG_DEBUG("Couldn't write shader source cache %s", path);
+		return;
+	}
+
+	uint32_t header[3] = { SHADER_SOURCE_CACHE_MAGIC, SHADER_SOURCE_CACHE_VERSION, HASH_COUNT(s_shader_sources) };
+	fwrite(header, sizeof(header), 1, file);
+
+	shader_source_t *entry, *tmp;
+	HASH_ITER(hh, s_shader_sources, entry, tmp) {
+		cache_write_string(file, entry->key, (uint32_t)strlen(entry->key));
+		fwrite(&entry->directives_hash, sizeof(entry->directives_hash), 1, file);
+		uint32_t dependency_count = (uint32_t)entry->dependency_count;
+		fwrite(&dependency_count, sizeof(dependency_count), 1, file);
+		for (size_t i = 0; i < entry->dependency_count; ++i) {
+			cache_write_string(file, entry->dependencies[i], (uint32_t)strlen(entry->dependencies[i]));
+			fwrite(&entry->dependency_hashes[i], sizeof(uint64_t), 1, file);
+		}
+		cache_write_string(file, entry->source, (uint32_t)strlen(entry->source));
 	}
-    
-    // Parse source for #includes, which are also implemented as effect keys
 
+	if (fclose(file) != 0) {
+		LOG_WARN("Couldn't write shader source cache %s", path);
+		remove(path);
+		return;
+	}
+	s_shader_sources_dirty = false;
+}
+
+static GLuint shader_compile(const GLenum shader_type, const char *effect_key, const shader_source_t *source) {
 	GLuint shader_handle = glCreateShader(shader_type);
-	glShaderSource(shader_handle, 1, (const char **)&source, 0);
+	glShaderSource(shader_handle, 1, (const char **)&source->source, 0);
 	glCompileShader(shader_handle);
-    
+
 	GLint compile_status;
 	glGetShaderiv(shader_handle, GL_COMPILE_STATUS, &compile_status);
 
@@ -245,33 +536,48 @@ GLuint xpl_shader_add(xpl_shader_t *shader, const GLenum shader_type, const char
 		GLchar messages[1024];
 		glGetShaderInfoLog(shader_handle, sizeof (messages), 0, &messages[0]);
 		LOG_ERROR("Couldn't compile shader (type: %d, effect_key: %s): \n%s", shader_type, effect_key, messages);
-        LOG_DEBUG("Included keys:");
-        for (int i = 0; i < included_keys->qty; ++i) {
-            LOG_DEBUG("%d\t: %s", i, included_keys->entry[i]->data);
+        LOG_DEBUG("Included effects:");
+        for (size_t i = 0; i < source->dependency_count; ++i) {
+            LOG_DEBUG("%zu\t: %s", i, source->dependencies[i]);
         }
         xpl_gl_breakpoint_func();
-        LOG_DEBUG("\n%s", source);
+        LOG_DEBUG("\n%s", source->source);
         xpl_gl_breakpoint_func();
-	}
-    
-    // Clean up
-    free(source);    
-    bstrListDestroy(included_keys);
-    
-    if (compile_status == GL_FALSE) {
+
+        glDeleteShader(shader_handle);
         return GL_FALSE;
-    }
-    
+	}
+
+	return shader_handle;
+}
+
+GLuint xpl_shader_add(xpl_shader_t *shader, const GLenum shader_type, const char *effect_key) {
 
-	xpl_shader_node_t *node = xpl_alloc_type(xpl_shader_node_t);
+    const char *error = NULL;
+    const shader_source_t *source = source_for_effect_key(effect_key, &error);
+    if (! source) {
+		LOG_ERROR("Couldn't load shader (type: %d, effect_key: %s): %s", shader_type, effect_key, error);
+		xpl_gl_breakpoint_func();
+		glswGetError();
+		glswClearError();
+		return GL_FALSE;
+	}
+
+	GLuint shader_handle = shader_compile(shader_type, effect_key, source);
+	if (! shader_handle) {
+		return GL_FALSE;
+	}
+
+	xpl_shader_node_t *node = xpl_calloc_type(xpl_shader_node_t);
 	node->shader_handle = shader_handle;
-	node->prev = NULL;
-	node->next = NULL;
+	node->shader_type = shader_type;
+	strncpy(node->effect_key, effect_key, SHADER_NAME_MAX - 1);
+	node->source_hash = source->hash;
 	DL_APPEND(shader->shader_program_nodes, node);
 	LOG_TRACE("Added effect key %s to shader %s", effect_key, shader->name);
-    
+
     GL_DEBUG();
-    
+
     shader->linked = false;
 
 	return shader_handle;
@@ -493,6 +799,129 @@ xpl_shader_t *xpl_shader_get(const char *name) {
 	return shader;
 }
 
+static void shader_file_changed(const char *filename, void *data, void *context) {
+	shader_file_t *file = data;
+	LOG_INFO("Shader file %s changed", filename);
+	file->hashed = false;
+	glswForgetEffect(file->effect_name);
+
+	shader_source_t *entry, *tmp;
+	HASH_ITER(hh, s_shader_sources, entry, tmp) {
+		if (shader_source_depends_on(entry, file->effect_name)) {
+			shader_source_destroy(entry);
+			s_shader_sources_dirty = true;
+		}
+	}
+	s_shader_reload_pending = true;
+}
+
+static void shader_reset_tables(xpl_shader_t *shader) {
+	xpl_uniform_info_t *uniform, *uniform_tmp;
+	HASH_ITER(hh, shader->uniform_table, uniform, uniform_tmp) {
+		HASH_DEL(shader->uniform_table, uniform);
+		xpl_free(uniform);
+	}
+
+	shader_vao_info_t *vao_info, *vao_info_tmp;
+	HASH_ITER(hh, shader->vao_table, vao_info, vao_info_tmp) {
+		HASH_DEL(shader->vao_table, vao_info);
+		vao_info_destroy(&vao_info);
+	}
+}
+
+// Builds the replacement program beside the old one; the old one stays bound
+// to the shader if anything fails, so a typo doesn't take the screen down.
+static void shader_reload(xpl_shader_t *shader) {
+	const char *error = NULL;
+	bool changed = false;
+	xpl_shader_node_t *node;
+	DL_FOREACH(shader->shader_program_nodes, node) {
+		const shader_source_t *source = source_for_effect_key(node->effect_key, &error);
+		if (! source) {
+			LOG_ERROR("Couldn't reload %s in shader %s: %s", node->effect_key, shader->name, error);
+			glswClearError();
+			return;
+		}
+		if (source->hash != node->source_hash) changed = true;
+	}
+	if (! changed) return;
+
+	size_t node_count = 0;
+	DL_FOREACH(shader->shader_program_nodes, node) ++node_count;
+	GLuint handles[node_count];
+
+	GLuint program_handle = glCreateProgram();
+	size_t i = 0;
+	bool ok = true;
+	DL_FOREACH(shader->shader_program_nodes, node) {
+		const shader_source_t *source = source_for_effect_key(node->effect_key, &error);
+		handles[i] = (source->hash == node->source_hash) ? node->shader_handle : shader_compile(node->shader_type, node->effect_key, source);
+		if (! handles[i]) {
+			ok = false;
+			break;
+		}
+		glAttachShader(program_handle, handles[i++]);
+	}
+
+#ifndef XPL_GLES
+	for (GLuint color_number = 0; ok && color_number < 8; ++color_number) {
+		if (shader->frag_data_locations[color_number]) {
+			glBindFragDataLocation(program_handle, color_number, shader->frag_data_locations[color_number]);
+		}
+	}
+#endif
+
+	if (ok) {
+		glLinkProgram(program_handle);
+		GLint link_status;
+		glGetProgramiv(program_handle, GL_LINK_STATUS, &link_status);
+		if (link_status == GL_FALSE) {
+			GLchar messages[1024];
+			glGetProgramInfoLog(program_handle, sizeof (messages), 0, messages);
+			LOG_ERROR("Couldn't relink shader %s: \n%s", shader->name, messages);
+			ok = false;
+		}
+	}
+
+	size_t compiled = i;
+	i = 0;
+	DL_FOREACH(shader->shader_program_nodes, node) {
+		if (i >= compiled) break;
+		bool replaced = handles[i] != node->shader_handle;
+		if (ok && replaced) {
+			glDeleteShader(node->shader_handle);
+			node->shader_handle = handles[i];
+			node->source_hash = source_for_effect_key(node->effect_key, &error)->hash;
+		} else if (! ok && replaced) {
+			glDeleteShader(handles[i]);
+		}
+		++i;
+	}
+
+	if (! ok) {
+		glDeleteProgram(program_handle);
+		return;
+	}
+
+	glDeleteProgram(shader->id);
+	shader->id = program_handle;
+	shader_reset_tables(shader);
+	LOG_INFO("Reloaded shader %s", shader->name);
+	GL_DEBUG();
+}
+
+void xpl_shaders_reload_changed(void) {
+	if (! s_shader_watch) return;
+	xpl_file_watch_poll(s_shader_watch, shader_file_changed, NULL);
+	if (! s_shader_reload_pending) return;
+	s_shader_reload_pending = false;
+
+	shader_table_entry_t *entry, *tmp;
+	HASH_ITER(hh, s_shader_table, entry, tmp) {
+		if (entry->shader->linked) shader_reload(entry->shader);
+	}
+}
+
 int xpl_shaders_init(const char *path_prefix, const char *path_suffix) {
 	if (! glswInit()) {
 		LOG_ERROR("glswInit failed");
@@ -529,15 +958,20 @@ int xpl_shaders_init(const char *path_prefix, const char *path_suffix) {
 			(strcmp("", *k) == 0)) {
 			// Only include this on the root include
 			glswAddDirectiveToken("root", *l);
+			s_directives_hash = shader_hash_bytes(SHADER_HASH_INIT, *l, strlen(*l) + 1);
 			break;
 		}
 	}
 
+	s_shader_watch = xpl_file_watch_new();
+	shader_sources_load();
+
 	return TRUE;
 }
 
 void xpl_shaders_add_directive(const char *define) {
 	glswAddDirectiveToken("root", define);
+	s_directives_hash = shader_hash_bytes(s_directives_hash, define, strlen(define) + 1);
 }
 
 xpl_shader_t *xpl_shader_get_prepared(const char *name, const char *vs_name, const char *fs_name) {
@@ -564,4 +998,23 @@ void xpl_shaders_shutdown(void) {
 	}
 
 	HASH_CLEAR(hh, s_shader_table);
+
+	shader_sources_save();
+
+	shader_source_t *source, *source_tmp;
+	HASH_ITER(hh, s_shader_sources, source, source_tmp) {
+		shader_source_destroy(source);
+	}
+
+	shader_file_t *file, *file_tmp;
+	HASH_ITER(hh, s_shader_files, file, file_tmp) {
+		HASH_DEL(s_shader_files, file);
+		xpl_free(file);
+	}
+
+	if (s_shader_watch) xpl_file_watch_destroy(&s_shader_watch);
+	s_shader_reload_pending = false;
+	s_directives_hash = SHADER_HASH_INIT;
+
+	glswShutdown();
 }
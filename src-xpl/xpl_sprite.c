@@ -7,6 +7,7 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "utarray.h"
 #include "uthash.h"
@@ -21,19 +22,20 @@
 #include "xpl_color.h"
 #include "xpl_texture.h"
 #include "xpl_text_buffer.h"
+#include "xpl_sprite_queue.h"
+#include "xpl_sprite_instance.h"
+#include "xpl_instanced_geom.h"
 
 #include "xpl_sprite.h"
 
 #define MAX_TEXTURES 8
 
-typedef struct sprite_vertex {
-	float x;
-	float y;
-	float u;
-	float v;
-	xvec4 color;
-} sprite_vertex_t;
-static const size_t sprite_vertex_size = sizeof(sprite_vertex_t);
+// Unsigned short indices reach 65536 vertices, so larger frames upload and draw
+// in segments of this many quads.
+#define MAX_SEGMENT_QUADS 16384
+
+static const size_t sprite_vertex_size = sizeof(xpl_sprite_vertex_t);
+static const size_t sprite_instance_size = sizeof(xpl_sprite_instance_t);
 
 struct xpl_sprite {
 	struct xpl_sprite_batch         *batch;
@@ -42,25 +44,13 @@ struct xpl_sprite {
 	xrect                           region;
 };
 
-typedef struct sprite_vao {
-	xpl_vao_t                       *vao;
-	xpl_bo_t                        *vbo;
-	size_t                          vertices;
-	size_t                          quads;
-	size_t                          indexed_quads;
-} sprite_vao_t;
-
-typedef struct sprite_batch_command {
-	struct xpl_sprite               *sprite;
-	xvec2                           pos;
-	xvec2                           origin;
-	xvec2                           size;
-	xvec2                           scale;
-	float                           rot_radians;
-    xmat4                           matrix;
-    xvec4                           color;
-	int                             executed;
-} sprite_batch_command_t;
+// Instances that draw with the same state. The run's quads count instances,
+// and its matrix points at the copy here once the frame ends.
+struct instance_run {
+	xpl_sprite_run_t                run;
+	xmat4                           matrix;
+	xrect                           region;
+};
 
 struct xpl_sprite_batch {
 
@@ -83,24 +73,33 @@ struct xpl_sprite_batch {
 		int                         active_texture;
 		int                         bound_texture[MAX_TEXTURES];
         xvec4                       draw_color;
+		const xmat4                 *matrix;
 	} gl_state;
 
-	UT_array                        *commands;
-	UT_array                        *vaos;
+	// Every quad goes in the queue; at the end they're sorted by state and drawn
+	// from one streaming vertex buffer, a draw call per run of shared state.
+	xpl_sprite_queue_t              *queue;
+	xpl_vao_t                       *vao;
+	xpl_bo_t                        *vbo;
+	xpl_bo_t                        *ibo;
+	size_t                          indexed_quads;
 	xpl_shader_t                    *current_shader;
-	sprite_vao_t                    *current_vao;
 	int                             started;
 
-};
-
+	// Instanced sprites draw before the queue, in the order they were added.
+	xpl_sprite_instances_t          *instances;
+	struct instance_run             *instance_runs;
+	size_t                          instance_run_count;
+	size_t                          instance_run_capacity;
+#ifndef XPL_GLES
+	xpl_instanced_geom_t            *instanced;
+	xpl_shader_t                    *instanced_shader;
+#endif
 
-static void draw_command(xpl_sprite_batch_t *self, sprite_batch_command_t *cmd) {
-	// port from
-	// https://github.com/libgdx/libgdx/blob/master/gdx/src/com/badlogic/gdx/graphics/g2d/SpriteBatch.java
-	const xpl_sprite_t *sprite = cmd->sprite;
+};
 
-	sprite_vao_t *vao = self->current_vao;
 
+static void apply_run_state(xpl_sprite_batch_t *self, xpl_shader_t *sprite_shader, const xpl_sprite_run_t *run) {
 	if (self->gl_state.depth_mask || self->gl_state.unknown) {
 		self->gl_state.depth_mask = GL_FALSE;
 		glDepthMask(GL_FALSE);
@@ -111,15 +110,19 @@ static void draw_command(xpl_sprite_batch_t *self, sprite_batch_command_t *cmd)
         glDisable(GL_CULL_FACE);
     }
 
-	xpl_shader_t *sprite_shader = self->current_shader;
 	if (self->gl_state.active_shader != sprite_shader || self->gl_state.unknown) {
 		self->gl_state.active_shader = sprite_shader;
+		self->gl_state.matrix = NULL;
 		glUseProgram(sprite_shader->id);
-		glUniformMatrix4fv(xpl_shader_get_uniform(sprite_shader, "mvp"), 1, GL_FALSE, &cmd->matrix.data[0]);
 	}
 
-	if (self->gl_state.blend_funcs != sprite->blend_funcs || self->gl_state.unknown) {
-		const int *bf = self->gl_state.blend_funcs = sprite->blend_funcs;
+	if (self->gl_state.matrix != run->matrix) {
+		self->gl_state.matrix = run->matrix;
+		glUniformMatrix4fv(xpl_shader_get_uniform(sprite_shader, "mvp"), 1, GL_FALSE, &run->matrix->data[0]);
+	}
+
+	if (self->gl_state.blend_funcs != run->blend_funcs || self->gl_state.unknown) {
+		const int *bf = self->gl_state.blend_funcs = run->blend_funcs;
         glEnable(GL_BLEND);
         glBlendFuncSeparate(bf[0], bf[1], bf[2], bf[3]);
 	}
@@ -130,161 +133,92 @@ static void draw_command(xpl_sprite_batch_t *self, sprite_batch_command_t *cmd)
 	}
 
 	int texno = self->gl_state.active_texture - GL_TEXTURE0;
-	GLuint ftid = cmd->sprite->texture->texture->texture_id;
+	GLuint ftid = run->texture;
 	if (self->gl_state.bound_texture[texno] != ftid || self->gl_state.unknown) {
 		self->gl_state.bound_texture[texno] = ftid;
 		glBindTexture(GL_TEXTURE_2D, ftid);
 		glUniform1i(xpl_shader_get_uniform(sprite_shader, "tex"), 0);
 	}
-    
-	const float scale_x = cmd->scale.x;
-	const float scale_y = cmd->scale.y;
-	const float world_origin_x = cmd->pos.x + cmd->origin.x;
-	const float world_origin_y = cmd->pos.y + cmd->origin.y;
-	float fx = -cmd->origin.x;
-	float fy = -cmd->origin.y;
-	float fx2 = cmd->size.x - cmd->origin.x;
-	float fy2 = cmd->size.y - cmd->origin.y;
-
-	if (scale_x != 1.0f || scale_y != 1.0f) {
-		fx *= scale_x;
-		fy *= scale_y;
-		fx2 *= scale_x;
-		fy2 *= scale_y;
-	}
-
-	const float p1x = fx;
-	const float p1y = fy;
-	const float p2x = fx;
-	const float p2y = fy2;
-	const float p3x = fx2;
-	const float p3y = fy2;
-	const float p4x = fx2;
-	const float p4y = fy;
-
-	float x1;
-	float y1;
-	float x2;
-	float y2;
-	float x3;
-	float y3;
-	float x4;
-	float y4;
-
-	const float rot = cmd->rot_radians;
-	if (rot != 0.0f) {
-		const float cos = cosf(rot);
-		const float sin = sinf(rot);
-
-		x1 = cos * p1x - sin * p1y;
-		y1 = sin * p1x + cos * p1y;
-		x2 = cos * p2x - sin * p2y;
-		y2 = sin * p2x + cos * p2y;
-		x3 = cos * p3x - sin * p3y;
-		y3 = sin * p3x + cos * p3y;
-		x4 = x1 + (x3 - x2);
-		y4 = y3 - (y2 - y1);
-	} else {
-		x1 = p1x;
-		y1 = p1y;
-		x2 = p2x;
-		y2 = p2y;
-		x3 = p3x;
-		y3 = p3y;
-		x4 = p4x;
-		y4 = p4y;
-	}
-
-	// I don't think this is what I had im mind.
-	x1 += world_origin_x;
-	y1 += world_origin_y;
-	x2 += world_origin_x;
-	y2 += world_origin_y;
-	x3 += world_origin_x;
-	y3 += world_origin_y;
-	x4 += world_origin_x;
-	y4 += world_origin_y;
-
-	const float u = sprite->region.x;
-	const float v = sprite->region.y;
-	const float u2 = sprite->region.x + sprite->region.width;
-	const float v2 = sprite->region.y + sprite->region.height;
-
-//	const uint32_t color = RGBA_F(cmd->color);
-//	sprite_vertex_t vtx[4] = {
-//			{ x1, y1, u, v, color },
-//			{ x2, y2, u, v2, color },
-//			{ x3, y3, u2, v2, color },
-//			{ x4, y4, u2, v, color }
-//	};
-    sprite_vertex_t vtx[4] = {
-        { x1, y1, u, v, cmd->color },
-        { x2, y2, u, v2, cmd->color },
-        { x3, y3, u2, v2, cmd->color },
-        { x4, y4, u2, v, cmd->color }
-	};
-
-
-	xpl_bo_append(vao->vbo, vtx, sizeof(vtx));
-
-	// Nothing changes about the indices. Reuse if possible.
-	vao->quads++;
-	if (vao->quads > vao->indexed_quads) {
-		unsigned short i = vao->vertices;
-		unsigned short indices[6] = { i, i+1, i+2, i+2, i+3, i };
-		xpl_bo_append(vao->vao->index_bos[0], indices, sizeof(indices));
-		vao->indexed_quads++;
-	}
-	vao->vertices += 4;
 
 	self->gl_state.unknown = FALSE;
     
     GL_DEBUG();
 }
 
-XPLINLINE int command_similar(sprite_batch_command_t *a, sprite_batch_command_t *b) {
-	if (a->sprite->texture != b->sprite->texture) return FALSE;
-	// other checks? Custom shaders?
-	return TRUE;
+// Nothing changes about the indices, so they're only ever extended.
+static void index_quads(xpl_sprite_batch_t *self, size_t quads) {
+	if (quads <= self->indexed_quads) return;
+    
+	for (size_t q = self->indexed_quads; q < quads; ++q) {
+		unsigned short i = (unsigned short)(q * 4);
+		unsigned short indices[6] = { i, i+1, i+2, i+2, i+3, i };
+		xpl_bo_append(self->ibo, indices, sizeof(indices));
+	}
+	self->indexed_quads = quads;
+	xpl_bo_commit(self->ibo);
+}
+
+#ifdef XPL_GLES
+
+// ES2 has no instancing, so instances become ordinary quads beneath everything else,
+// expanded as the instanced vertex shader would.
+static void queue_instance_runs(xpl_sprite_batch_t *self) {
+	int layer = self->queue->layer;
+	xpl_sprite_queue_set_layer(self->queue, XPL_SPRITE_QUEUE_LAYER_MIN);
+	for (size_t r = 0; r < self->instance_run_count; ++r) {
+		const struct instance_run *run = &self->instance_runs[r];
+		for (size_t i = run->run.first_quad; i < run->run.first_quad + run->run.quads; ++i) {
+			xpl_sprite_vertex_t *vtx = xpl_sprite_queue_add_vertices(self->queue, run->run.texture, run->run.blend_funcs, &run->matrix);
+			xpl_sprite_instance_expand(&self->instances->instances[i], run->region, vtx);
+		}
+	}
+	xpl_sprite_queue_set_layer(self->queue, layer);
 }
 
-// ----------------------------------------------------------------------------------------------
+#else
 
-static void xmat4_icd_init(void *_init) {
-	xmat4 *init = (xmat4 *) _init;
-	xmat4_identity(init);
+// GL 3.2 has no base instance, so each run points the instance attributes at its first instance.
+static void instance_attribs_set_first(xpl_vao_t *vao, size_t first) {
+	xpl_vertex_attrib_t *instance = xpl_vao_get_vertex_attrib(vao, "instance");
+	xpl_vertex_attrib_t *color = xpl_vao_get_vertex_attrib(vao, "color");
+	GLsizei base = (GLsizei)(first * sprite_instance_size);
+	if (instance->offset == base + (GLsizei)offsetof(xpl_sprite_instance_t, center)) return;
+
+	instance->offset = base + (GLsizei)offsetof(xpl_sprite_instance_t, center);
+	instance->configured = 0;
+	color->offset = base + (GLsizei)offsetof(xpl_sprite_instance_t, color);
+	color->configured = 0;
 }
 
-static void sprite_vao_icd_init(void *_init) {
-	sprite_vao_t *init = (sprite_vao_t *)_init;
-	xpl_vao_t *vao = init->vao = xpl_vao_new();
-	xpl_bo_t *vbo = init->vbo = xpl_bo_new(GL_ARRAY_BUFFER,
-			GL_DYNAMIC_DRAW);
-	xpl_vao_define_vertex_attrib(vao, "position", vbo, 2, GL_FLOAT, GL_FALSE,
-			sprite_vertex_size, offsetof(sprite_vertex_t, x) );
-	xpl_vao_define_vertex_attrib(vao, "uv", vbo, 2, GL_FLOAT, GL_FALSE,
-			sprite_vertex_size, offsetof(sprite_vertex_t, u) );
-	xpl_vao_define_vertex_attrib(vao, "color", vbo, 4, GL_FLOAT,
-			GL_FALSE, sprite_vertex_size, offsetof(sprite_vertex_t, color) );
-	xpl_vao_set_index_buffer(vao, 0, xpl_bo_new(GL_ELEMENT_ARRAY_BUFFER, GL_STREAM_DRAW));
+static void draw_instance_runs(xpl_sprite_batch_t *self) {
+	if (! self->instances->count) return;
 
-	init->indexed_quads = 0;
-	init->quads = 0;
-	init->vertices = 0;
+	xpl_instanced_geom_t *geom = self->instanced;
+	xpl_shader_t *shader = self->instanced_shader;
+	xpl_bo_stream(geom->instance_vbo, self->instances->instances, self->instances->count * sprite_instance_size);
 
+	for (size_t r = 0; r < self->instance_run_count; ++r) {
+		struct instance_run *run = &self->instance_runs[r];
+		run->run.matrix = &run->matrix;
+		apply_run_state(self, shader, &run->run);
+		glUniform4f(xpl_shader_get_uniform(shader, "region"),
+					run->region.x, run->region.y, run->region.width, run->region.height);
 
+		instance_attribs_set_first(geom->vao, run->run.first_quad);
+		xpl_vao_program_draw_arrays_instanced(geom->vao, shader, GL_TRIANGLE_FAN, 0, 4, (GLsizei)run->run.quads);
+	}
 }
 
-static void sprite_vao_icd_destroy(void *_destroy) {
-	sprite_vao_t *destroy = (sprite_vao_t *)_destroy;
-	xpl_bo_destroy(&destroy->vbo);
-	xpl_bo_destroy(&destroy->vao->index_bos[0]);
-	xpl_vao_destroy(&destroy->vao);
+#endif
+
+// ----------------------------------------------------------------------------------------------
+
+static void xmat4_icd_init(void *_init) {
+	xmat4 *init = (xmat4 *) _init;
+	xmat4_identity(init);
 }
 
 UT_icd xmat4_icd = { sizeof(xmat4), xmat4_icd_init, NULL, NULL };
-UT_icd command_icd = { sizeof(sprite_batch_command_t), NULL, NULL, NULL };
-UT_icd sprite_vao_icd = { sizeof(sprite_vao_t), sprite_vao_icd_init, NULL, sprite_vao_icd_destroy };
 
 xpl_sprite_batch_t * xpl_sprite_batch_new() {
 	xpl_sprite_batch_t *self = xpl_calloc_type(xpl_sprite_batch_t);
@@ -297,7 +231,40 @@ xpl_sprite_batch_t * xpl_sprite_batch_new() {
 		self->gl_state.bound_texture[i] = -1;
 	}
 
-	utarray_new(self->vaos, &sprite_vao_icd);
+	self->queue = xpl_sprite_queue_new();
+	self->vao = xpl_vao_new();
+	self->vbo = xpl_bo_new(GL_ARRAY_BUFFER, GL_STREAM_DRAW);
+	self->ibo = xpl_bo_new(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+	xpl_vao_define_vertex_attrib(self->vao, "position", self->vbo, 2, GL_FLOAT, GL_FALSE,
+			sprite_vertex_size, offsetof(xpl_sprite_vertex_t, x) );
+	xpl_vao_define_vertex_attrib(self->vao, "uv", self->vbo, 2, GL_FLOAT, GL_FALSE,
+			sprite_vertex_size, offsetof(xpl_sprite_vertex_t, u) );
+	xpl_vao_define_vertex_attrib(self->vao, "color", self->vbo, 4, GL_FLOAT,
+			GL_FALSE, sprite_vertex_size, offsetof(xpl_sprite_vertex_t, color) );
+	xpl_vao_set_index_buffer(self->vao, 0, self->ibo);
+
+	self->instances = xpl_sprite_instances_new();
+#ifndef XPL_GLES
+	// A fan over the unit square, in the same corner order as the queue's quads.
+	static const float corners[] = { 0.f, 0.f, 0.f, 1.f, 1.f, 1.f, 1.f, 0.f };
+	xpl_instanced_geom_t *geom = self->instanced = xpl_instanced_geom_new();
+	xpl_bo_append(geom->vbo, corners, sizeof(corners));
+	xpl_bo_commit(geom->vbo);
+	xpl_vao_define_vertex_attrib_xvec2(geom->vao, "corner", geom->vbo, 0, 0);
+	xpl_vao_define_vertex_attrib(geom->vao, "instance", geom->instance_vbo, 4, GL_FLOAT, GL_FALSE,
+			sprite_instance_size, offsetof(xpl_sprite_instance_t, center));
+	xpl_vao_define_vertex_attrib(geom->vao, "color", geom->instance_vbo, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+			sprite_instance_size, offsetof(xpl_sprite_instance_t, color));
+	xpl_vao_set_vertex_attrib_divisor(geom->vao, "instance", 1);
+	xpl_vao_set_vertex_attrib_divisor(geom->vao, "color", 1);
+
+	xpl_shader_t *instanced_shader = self->instanced_shader = xpl_shader_get("SpriteInstanced");
+	if (! instanced_shader->linked) {
+		xpl_shader_add(instanced_shader, GL_VERTEX_SHADER, "Sprite.InstancedVertex");
+		xpl_shader_add(instanced_shader, GL_FRAGMENT_SHADER, "Sprite.Fragment");
+		xpl_shader_link(instanced_shader);
+	}
+#endif
 
 	xpl_shader_t *sprite_shader = self->current_shader = xpl_shader_get("Sprite");
 	if (! sprite_shader->linked) {
@@ -306,8 +273,6 @@ xpl_sprite_batch_t * xpl_sprite_batch_new() {
 		xpl_shader_link(sprite_shader);
 	}
 
-	utarray_new(self->commands, &command_icd);
-
 	return self;
 }
 
@@ -324,8 +289,16 @@ void xpl_sprite_batch_destroy(xpl_sprite_batch_t **ppbatch) {
 		xpl_free(el);
 	}
 
-	utarray_free(batch->commands);
-	utarray_free(batch->vaos);
+	xpl_sprite_queue_destroy(&batch->queue);
+	xpl_vao_destroy(&batch->vao);
+	xpl_bo_destroy(&batch->vbo);
+	xpl_bo_destroy(&batch->ibo);
+
+	xpl_sprite_instances_destroy(&batch->instances);
+	if (batch->instance_runs) xpl_free(batch->instance_runs);
+#ifndef XPL_GLES
+	xpl_instanced_geom_destroy(&batch->instanced);
+#endif
 
 	xpl_free(batch);
 	*ppbatch = NULL;
@@ -335,63 +308,63 @@ void xpl_sprite_batch_begin(xpl_sprite_batch_t *self) {
 	assert(! self->started);
 	self->started = TRUE;
 	self->gl_state.unknown = TRUE;
-	self->current_vao = NULL;
-	utarray_clear(self->commands);
+	xpl_sprite_queue_clear(self->queue);
+	xpl_sprite_instances_clear(self->instances);
+	self->instance_run_count = 0;
 	while(utarray_len(self->matrix_stack) > 1) {
 		utarray_pop_back(self->matrix_stack);
 	}
-	sprite_vao_t *sv = NULL;
-	while ((sv = (sprite_vao_t *)utarray_next(self->vaos, sv))) {
-		xpl_bo_clear(sv->vbo);
-		sv->quads = 0;
-		sv->vertices = 0;
-	}
 }
 
 void xpl_sprite_batch_end(xpl_sprite_batch_t *self) {
 	assert(self->started);
 
-	// Execute the drawing commands in order, sort of.
-	UT_array *commands = self->commands;
-	LOG_TRACE("Drawing %d commands", utarray_len(commands));
-	sprite_batch_command_t *head_cmd = NULL;
-	self->current_vao = NULL;
-	int finished = FALSE;
-	UT_array *vaos = self->vaos;
-
-	while (!finished && ((head_cmd = (sprite_batch_command_t *)utarray_next(commands, head_cmd)) != NULL)) {
-		if (head_cmd->executed) continue;
-
-		self->current_vao = (sprite_vao_t *)utarray_next(vaos, self->current_vao);
-		if (self->current_vao == NULL) {
-			utarray_extend_back(self->vaos);
-			self->current_vao = (sprite_vao_t *)utarray_back(vaos);
+	xpl_sprite_queue_t *queue = self->queue;
+#ifdef XPL_GLES
+	queue_instance_runs(self);
+#else
+	draw_instance_runs(self);
+#endif
+	LOG_TRACE("Drawing %lu sprites, %lu instanced", (unsigned long)queue->count, (unsigned long)self->instances->count);
+	xpl_sprite_queue_build(queue);
+
+	size_t run_index = 0;
+	size_t run_drawn = 0;
+	for (size_t segment = 0; segment < queue->count; segment += MAX_SEGMENT_QUADS) {
+		size_t segment_quads = xmin(queue->count - segment, (size_t)MAX_SEGMENT_QUADS);
+		index_quads(self, segment_quads);
+		xpl_bo_stream(self->vbo, &queue->vertices[segment * 4], segment_quads * 4 * sprite_vertex_size);
+
+		// Runs that cross the segment boundary are finished in the next segment.
+		size_t segment_end = segment + segment_quads;
+		while (run_index < queue->run_count) {
+			const xpl_sprite_run_t *run = &queue->runs[run_index];
+			size_t first = run->first_quad + run_drawn;
+			if (first >= segment_end) break;
+			size_t quads = xmin(run->first_quad + run->quads, segment_end) - first;
+
+			apply_run_state(self, self->current_shader, run);
+			xpl_vao_program_draw_elements_count_offset(self->vao, self->current_shader, GL_TRIANGLES, 0,
+													   6 * quads, 6 * (first - segment) * sizeof(unsigned short));
+
+			run_drawn += quads;
+			if (run_drawn < run->quads) break;
+			run_drawn = 0;
+			run_index++;
 		}
-
-		draw_command(self, head_cmd);
-		head_cmd->executed = TRUE;
-
-		finished = TRUE;
-		sprite_batch_command_t *linked_cmd = head_cmd;
-		while((linked_cmd = (sprite_batch_command_t *)utarray_next(commands, linked_cmd))) {
-			if (linked_cmd->executed) continue;
-			if (command_similar(head_cmd, linked_cmd)) {
-				draw_command(self, linked_cmd);
-				linked_cmd->executed = TRUE;
-			} else {
-				finished = FALSE;
-			}
-		}
-
-		// When all the similar commands have executed, draw this VAO.
-		sprite_vao_t *sprite_vao = self->current_vao;
-		xpl_bo_commit(sprite_vao->vbo);
-		xpl_bo_commit(sprite_vao->vao->index_bos[0]);
-		xpl_vao_program_draw_elements_count_offset(sprite_vao->vao, self->current_shader, GL_TRIANGLES, 0, 6 * sprite_vao->quads, 0);
 	}
 	self->started = FALSE;
 }
 
+void xpl_sprite_batch_set_layer(xpl_sprite_batch_t *self, int layer) {
+	assert(self->started);
+	xpl_sprite_queue_set_layer(self->queue, layer);
+}
+
+const xpl_sprite_queue_t *xpl_sprite_batch_get_queue(const xpl_sprite_batch_t *self) {
+	return self->queue;
+}
+
 xmat4 *xpl_sprite_batch_matrix_push(xpl_sprite_batch_t *self) {
 	assert(self);
 	UT_array *a = self->matrix_stack;
@@ -473,18 +446,55 @@ void xpl_sprite_draw_transformed(struct xpl_sprite *sprite,
     
     static xvec4 white = {{ 1.f, 1.f, 1.f, 1.f }};
     
-	utarray_extend_back(sprite->batch->commands);
-	sprite_batch_command_t *cmd = (sprite_batch_command_t *) utarray_back(sprite->batch->commands);
-	cmd->pos.x = x;
-	cmd->pos.y = y;
-	cmd->origin.x = origin_x;
-	cmd->origin.y = origin_y;
-	cmd->size.x = width;
-	cmd->size.y = height;
-	cmd->scale.x = scale_x;
-	cmd->scale.y = scale_y;
-	cmd->rot_radians = rotation_rads;
-    cmd->matrix = *((xmat4 *)utarray_back(sprite->batch->matrix_stack));
-    cmd->color = (color ? *color : white);
-	cmd->sprite = sprite;
+	xpl_sprite_batch_t *batch = sprite->batch;
+	xpl_sprite_quad_t *quad = xpl_sprite_queue_add(batch->queue, sprite->texture->texture->texture_id,
+												   sprite->blend_funcs, (xmat4 *)utarray_back(batch->matrix_stack));
+	quad->pos.x = x;
+	quad->pos.y = y;
+	quad->origin.x = origin_x;
+	quad->origin.y = origin_y;
+	quad->size.x = width;
+	quad->size.y = height;
+	quad->scale.x = scale_x;
+	quad->scale.y = scale_y;
+	quad->rot_radians = rotation_rads;
+	quad->color = (color ? *color : white);
+	quad->region = sprite->region;
+}
+
+xpl_sprite_instance_t *xpl_sprite_draw_instance(struct xpl_sprite *sprite) {
+	return xpl_sprite_draw_instances(sprite, 1);
+}
+
+xpl_sprite_instance_t *xpl_sprite_draw_instances(struct xpl_sprite *sprite, size_t count) {
+	assert(sprite);
+	assert(sprite->batch->started);
+
+	xpl_sprite_batch_t *batch = sprite->batch;
+	const xmat4 *matrix = (xmat4 *)utarray_back(batch->matrix_stack);
+	uint32_t texture = sprite->texture->texture->texture_id;
+
+	struct instance_run *run = batch->instance_run_count ? &batch->instance_runs[batch->instance_run_count - 1] : NULL;
+	if (! run ||
+		run->run.texture != texture ||
+		run->run.blend_funcs != sprite->blend_funcs ||
+		memcmp(&run->region, &sprite->region, sizeof(xrect)) ||
+		memcmp(run->matrix.data, matrix->data, sizeof(matrix->data))) {
+
+		if (batch->instance_run_count == batch->instance_run_capacity) {
+			batch->instance_run_capacity = batch->instance_run_capacity ? batch->instance_run_capacity * 2 : 16;
+			batch->instance_runs = xpl_realloc(batch->instance_runs, batch->instance_run_capacity * sizeof(struct instance_run));
+		}
+		run = &batch->instance_runs[batch->instance_run_count++];
+		run->run.first_quad = batch->instances->count;
+		run->run.quads = 0;
+		run->run.texture = texture;
+		run->run.blend_funcs = sprite->blend_funcs;
+		run->run.matrix = NULL;
+		run->matrix = *matrix;
+		run->region = sprite->region;
+	}
+
+	run->run.quads += count;
+	return xpl_sprite_instances_extend(batch->instances, count);
 }
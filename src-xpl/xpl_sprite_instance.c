@@ -0,0 +1,88 @@
+//
+//  xpl_sprite_instance.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-27.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <math.h>
+
+#include "xpl.h"
+#include "xpl_memory.h"
+#include "xpl_color.h"
+#include "xpl_sprite_instance.h"
+
+#define INSTANCES_INITIAL_CAPACITY  1024
+
+// Corner order matches the queue's quads: top-left, bottom-left, bottom-right, top-right
+// in UV space. Sprite.InstancedVertex has the same table.
+static const xvec2 s_corners[4] = {
+	{{ 0.f, 0.f }}, {{ 0.f, 1.f }}, {{ 1.f, 1.f }}, {{ 1.f, 0.f }}
+};
+
+xpl_sprite_instances_t *xpl_sprite_instances_new(void) {
+	xpl_sprite_instances_t *instances = xpl_calloc_type(xpl_sprite_instances_t);
+	instances->capacity = INSTANCES_INITIAL_CAPACITY;
+	instances->instances = xpl_alloc(instances->capacity * sizeof(xpl_sprite_instance_t));
+	return instances;
+}
+
+void xpl_sprite_instances_destroy(xpl_sprite_instances_t **ppinstances) {
+	assert(ppinstances);
+	xpl_sprite_instances_t *instances = *ppinstances;
+	assert(instances);
+
+	xpl_free(instances->instances);
+	xpl_free(instances);
+
+	*ppinstances = NULL;
+}
+
+void xpl_sprite_instances_clear(xpl_sprite_instances_t *self) {
+	self->count = 0;
+}
+
+xpl_sprite_instance_t *xpl_sprite_instances_add(xpl_sprite_instances_t *self) {
+	return xpl_sprite_instances_extend(self, 1);
+}
+
+xpl_sprite_instance_t *xpl_sprite_instances_extend(xpl_sprite_instances_t *self, size_t count) {
+	if (self->count + count > self->capacity) {
+		while (self->count + count > self->capacity) self->capacity *= 2;
+		self->instances = xpl_realloc(self->instances, self->capacity * sizeof(xpl_sprite_instance_t));
+	}
+	xpl_sprite_instance_t *result = &self->instances[self->count];
+	self->count += count;
+	return result;
+}
+
+XPLINLINE uint32_t pack_channel(float c) {
+	return (uint32_t)(xclamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+uint32_t xpl_sprite_instance_pack_color(xvec4 color) {
+	return RGBA(pack_channel(color.r), pack_channel(color.g), pack_channel(color.b), pack_channel(color.a));
+}
+
+xvec4 xpl_sprite_instance_unpack_color(uint32_t color) {
+	xvec4 result = RGBA_F(color);
+	return result;
+}
+
+void xpl_sprite_instance_expand(const xpl_sprite_instance_t *instance, xrect region, xpl_sprite_vertex_t vtx[4]) {
+	const float cos = cosf(instance->rotation);
+	const float sin = sinf(instance->rotation);
+	const xvec4 color = xpl_sprite_instance_unpack_color(instance->color);
+
+	for (int i = 0; i < 4; ++i) {
+		const float ox = (s_corners[i].x - 0.5f) * instance->size;
+		const float oy = (s_corners[i].y - 0.5f) * instance->size;
+		vtx[i].x = instance->center.x + cos * ox - sin * oy;
+		vtx[i].y = instance->center.y + sin * ox + cos * oy;
+		vtx[i].u = region.x + s_corners[i].x * region.width;
+		vtx[i].v = region.y + s_corners[i].y * region.height;
+		vtx[i].color = color;
+	}
+}
@@ -0,0 +1,307 @@
+//
+//  xpl_sprite_queue.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-26.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "xpl.h"
+#include "xpl_memory.h"
+#include "xpl_sprite_queue.h"
+
+#define QUEUE_INITIAL_CAPACITY      1024
+#define QUEUE_INITIAL_STATES        16
+
+// Key layout, most significant first. The low 16 bits are unused, so quads that
+// share all of these are ordered as they were added (the sort is stable).
+#define KEY_LAYER_SHIFT             56
+#define KEY_TEXTURE_SHIFT           40
+#define KEY_BLEND_SHIFT             32
+#define KEY_MATRIX_SHIFT            16
+#define KEY_STATE_MASK              (~(uint64_t)0xffff)
+
+#define SLOT_TEXTURE_MAX            0xffff
+#define SLOT_BLEND_MAX              0xff
+#define SLOT_MATRIX_MAX             0xffff
+
+xpl_sprite_queue_t *xpl_sprite_queue_new(void) {
+	xpl_sprite_queue_t *queue = xpl_calloc_type(xpl_sprite_queue_t);
+	queue->capacity = QUEUE_INITIAL_CAPACITY;
+	queue->quads = xpl_alloc(queue->capacity * sizeof(xpl_sprite_quad_t));
+
+	queue->state_capacity = QUEUE_INITIAL_STATES;
+	queue->textures = xpl_alloc(queue->state_capacity * sizeof(uint32_t));
+	queue->blends = xpl_alloc(queue->state_capacity * sizeof(const int *));
+	queue->matrices = xpl_alloc(queue->state_capacity * sizeof(xmat4));
+	return queue;
+}
+
+void xpl_sprite_queue_destroy(xpl_sprite_queue_t **ppqueue) {
+	assert(ppqueue);
+	xpl_sprite_queue_t *queue = *ppqueue;
+	assert(queue);
+
+	xpl_free(queue->quads);
+	xpl_free(queue->textures);
+	xpl_free(queue->blends);
+	xpl_free(queue->matrices);
+	if (queue->prebuilt) xpl_free(queue->prebuilt);
+	if (queue->vertices) xpl_free(queue->vertices);
+	if (queue->runs) xpl_free(queue->runs);
+	for (int i = 0; i < 2; ++i) {
+		if (queue->sort_keys[i]) xpl_free(queue->sort_keys[i]);
+		if (queue->sort_order[i]) xpl_free(queue->sort_order[i]);
+	}
+	xpl_free(queue);
+
+	*ppqueue = NULL;
+}
+
+void xpl_sprite_queue_clear(xpl_sprite_queue_t *self) {
+	self->count = 0;
+	self->layer = 0;
+	self->texture_count = 0;
+	self->blend_count = 0;
+	self->matrix_count = 0;
+	self->prebuilt_count = 0;
+	self->run_count = 0;
+}
+
+void xpl_sprite_queue_set_layer(xpl_sprite_queue_t *self, int layer) {
+	if (layer < XPL_SPRITE_QUEUE_LAYER_MIN || layer > XPL_SPRITE_QUEUE_LAYER_MAX) {
+		LOG_WARN("Sprite layer %d out of range", layer);
+		layer = xclamp(layer, XPL_SPRITE_QUEUE_LAYER_MIN, XPL_SPRITE_QUEUE_LAYER_MAX);
+	}
+	self->layer = layer;
+}
+
+// ---------------------------------------------------------------------------
+
+static void queue_grow_states(xpl_sprite_queue_t *self) {
+	self->state_capacity *= 2;
+	self->textures = xpl_realloc(self->textures, self->state_capacity * sizeof(uint32_t));
+	self->blends = xpl_realloc(self->blends, self->state_capacity * sizeof(const int *));
+	self->matrices = xpl_realloc(self->matrices, self->state_capacity * sizeof(xmat4));
+}
+
+// Frames use a handful of each, and consecutive sprites nearly always share
+// state, so a backwards linear scan finds the slot almost immediately.
+static uint64_t texture_slot(xpl_sprite_queue_t *self, uint32_t texture) {
+	for (size_t i = self->texture_count; i-- > 0; ) {
+		if (self->textures[i] == texture) return i;
+	}
+	if (self->texture_count == SLOT_TEXTURE_MAX) {
+		LOG_ERROR("Too many sprite textures in one batch");
+		return SLOT_TEXTURE_MAX - 1;
+	}
+	if (self->texture_count == self->state_capacity) queue_grow_states(self);
+	self->textures[self->texture_count] = texture;
+	return self->texture_count++;
+}
+
+static uint64_t blend_slot(xpl_sprite_queue_t *self, const int *blend_funcs) {
+	for (size_t i = self->blend_count; i-- > 0; ) {
+		if (self->blends[i] == blend_funcs) return i;
+	}
+	if (self->blend_count == SLOT_BLEND_MAX) {
+		LOG_ERROR("Too many sprite blend modes in one batch");
+		return SLOT_BLEND_MAX - 1;
+	}
+	if (self->blend_count == self->state_capacity) queue_grow_states(self);
+	self->blends[self->blend_count] = blend_funcs;
+	return self->blend_count++;
+}
+
+static uint64_t matrix_slot(xpl_sprite_queue_t *self, const xmat4 *matrix) {
+	for (size_t i = self->matrix_count; i-- > 0; ) {
+		if (! memcmp(&self->matrices[i], matrix, sizeof(xmat4))) return i;
+	}
+	if (self->matrix_count == SLOT_MATRIX_MAX) {
+		LOG_ERROR("Too many sprite matrices in one batch");
+		return SLOT_MATRIX_MAX - 1;
+	}
+	if (self->matrix_count == self->state_capacity) queue_grow_states(self);
+	self->matrices[self->matrix_count] = *matrix;
+	return self->matrix_count++;
+}
+
+xpl_sprite_quad_t *xpl_sprite_queue_add(xpl_sprite_queue_t *self, uint32_t texture, const int *blend_funcs, const xmat4 *matrix) {
+	if (self->count == self->capacity) {
+		self->capacity *= 2;
+		self->quads = xpl_realloc(self->quads, self->capacity * sizeof(xpl_sprite_quad_t));
+	}
+
+	xpl_sprite_quad_t *quad = &self->quads[self->count++];
+	quad->key = ((uint64_t)(self->layer - XPL_SPRITE_QUEUE_LAYER_MIN) << KEY_LAYER_SHIFT) |
+				(texture_slot(self, texture) << KEY_TEXTURE_SHIFT) |
+				(blend_slot(self, blend_funcs) << KEY_BLEND_SHIFT) |
+				(matrix_slot(self, matrix) << KEY_MATRIX_SHIFT);
+	quad->prebuilt = -1;
+	return quad;
+}
+
+xpl_sprite_vertex_t *xpl_sprite_queue_add_vertices(xpl_sprite_queue_t *self, uint32_t texture, const int *blend_funcs, const xmat4 *matrix) {
+	if (self->prebuilt_count == self->prebuilt_capacity) {
+		self->prebuilt_capacity = self->prebuilt_capacity ? self->prebuilt_capacity * 2 : QUEUE_INITIAL_CAPACITY;
+		self->prebuilt = xpl_realloc(self->prebuilt, self->prebuilt_capacity * 4 * sizeof(xpl_sprite_vertex_t));
+	}
+
+	xpl_sprite_quad_t *quad = xpl_sprite_queue_add(self, texture, blend_funcs, matrix);
+	quad->prebuilt = (int32_t)self->prebuilt_count;
+	return &self->prebuilt[4 * self->prebuilt_count++];
+}
+
+// ---------------------------------------------------------------------------
+
+// LSD radix sort on bytes, skipping any byte that's the same in every key; most
+// frames only need a pass or two. Returns which scratch buffer holds the result.
+static int queue_sort(xpl_sprite_queue_t *self) {
+	const size_t n = self->count;
+	if (n > self->sort_capacity) {
+		self->sort_capacity = self->capacity;
+		for (int i = 0; i < 2; ++i) {
+			self->sort_keys[i] = xpl_realloc(self->sort_keys[i], self->sort_capacity * sizeof(uint64_t));
+			self->sort_order[i] = xpl_realloc(self->sort_order[i], self->sort_capacity * sizeof(uint32_t));
+		}
+	}
+
+	size_t counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	uint64_t *keys = self->sort_keys[0];
+	uint32_t *order = self->sort_order[0];
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t key = self->quads[i].key;
+		keys[i] = key;
+		order[i] = (uint32_t)i;
+		for (int b = 0; b < 8; ++b) {
+			counts[b][(key >> (b * 8)) & 0xff]++;
+		}
+	}
+
+	int src = 0;
+	for (int b = 0; b < 8; ++b) {
+		const int shift = b * 8;
+		if (! n || counts[b][(self->sort_keys[src][0] >> shift) & 0xff] == n) continue;
+
+		size_t offsets[256];
+		size_t total = 0;
+		for (int d = 0; d < 256; ++d) {
+			offsets[d] = total;
+			total += counts[b][d];
+		}
+
+		const uint64_t *in_keys = self->sort_keys[src];
+		const uint32_t *in_order = self->sort_order[src];
+		uint64_t *out_keys = self->sort_keys[src ^ 1];
+		uint32_t *out_order = self->sort_order[src ^ 1];
+		for (size_t i = 0; i < n; ++i) {
+			size_t dest = offsets[(in_keys[i] >> shift) & 0xff]++;
+			out_keys[dest] = in_keys[i];
+			out_order[dest] = in_order[i];
+		}
+		src ^= 1;
+	}
+	return src;
+}
+
+XPLINLINE void emit_quad(const xpl_sprite_quad_t *quad, xpl_sprite_vertex_t *vtx) {
+	// port from
+	// https://github.com/libgdx/libgdx/blob/master/gdx/src/com/badlogic/gdx/graphics/g2d/SpriteBatch.java
+	const float world_origin_x = quad->pos.x + quad->origin.x;
+	const float world_origin_y = quad->pos.y + quad->origin.y;
+	float fx = -quad->origin.x;
+	float fy = -quad->origin.y;
+	float fx2 = quad->size.x - quad->origin.x;
+	float fy2 = quad->size.y - quad->origin.y;
+
+	if (quad->scale.x != 1.0f || quad->scale.y != 1.0f) {
+		fx *= quad->scale.x;
+		fy *= quad->scale.y;
+		fx2 *= quad->scale.x;
+		fy2 *= quad->scale.y;
+	}
+
+	float x1, y1, x2, y2, x3, y3, x4, y4;
+
+	const float rot = quad->rot_radians;
+	if (rot != 0.0f) {
+		const float cos = cosf(rot);
+		const float sin = sinf(rot);
+
+		x1 = cos * fx - sin * fy;
+		y1 = sin * fx + cos * fy;
+		x2 = cos * fx - sin * fy2;
+		y2 = sin * fx + cos * fy2;
+		x3 = cos * fx2 - sin * fy2;
+		y3 = sin * fx2 + cos * fy2;
+		x4 = x1 + (x3 - x2);
+		y4 = y3 - (y2 - y1);
+	} else {
+		x1 = fx;
+		y1 = fy;
+		x2 = fx;
+		y2 = fy2;
+		x3 = fx2;
+		y3 = fy2;
+		x4 = fx2;
+		y4 = fy;
+	}
+
+	const float u = quad->region.x;
+	const float v = quad->region.y;
+	const float u2 = quad->region.x + quad->region.width;
+	const float v2 = quad->region.y + quad->region.height;
+
+	vtx[0] = (xpl_sprite_vertex_t){ x1 + world_origin_x, y1 + world_origin_y, u, v, quad->color };
+	vtx[1] = (xpl_sprite_vertex_t){ x2 + world_origin_x, y2 + world_origin_y, u, v2, quad->color };
+	vtx[2] = (xpl_sprite_vertex_t){ x3 + world_origin_x, y3 + world_origin_y, u2, v2, quad->color };
+	vtx[3] = (xpl_sprite_vertex_t){ x4 + world_origin_x, y4 + world_origin_y, u2, v, quad->color };
+}
+
+static void queue_add_run(xpl_sprite_queue_t *self, size_t first_quad, uint64_t key) {
+	if (self->run_count == self->run_capacity) {
+		self->run_capacity = self->run_capacity ? self->run_capacity * 2 : 16;
+		self->runs = xpl_realloc(self->runs, self->run_capacity * sizeof(xpl_sprite_run_t));
+	}
+	xpl_sprite_run_t *run = &self->runs[self->run_count++];
+	run->first_quad = first_quad;
+	run->quads = 0;
+	run->texture = self->textures[(key >> KEY_TEXTURE_SHIFT) & SLOT_TEXTURE_MAX];
+	run->blend_funcs = self->blends[(key >> KEY_BLEND_SHIFT) & SLOT_BLEND_MAX];
+	run->matrix = &self->matrices[(key >> KEY_MATRIX_SHIFT) & SLOT_MATRIX_MAX];
+}
+
+void xpl_sprite_queue_build(xpl_sprite_queue_t *self) {
+	self->run_count = 0;
+	if (! self->count) return;
+
+	int sorted = queue_sort(self);
+	const uint64_t *keys = self->sort_keys[sorted];
+	const uint32_t *order = self->sort_order[sorted];
+
+	if (self->vertex_capacity < self->capacity) {
+		self->vertex_capacity = self->capacity;
+		self->vertices = xpl_realloc(self->vertices, self->vertex_capacity * 4 * sizeof(xpl_sprite_vertex_t));
+	}
+
+	uint64_t run_state = 0;
+	for (size_t i = 0; i < self->count; ++i) {
+		uint64_t state = keys[i] & KEY_STATE_MASK;
+		if (i == 0 || state != run_state) {
+			queue_add_run(self, i, state);
+			run_state = state;
+		}
+		self->runs[self->run_count - 1].quads++;
+		const xpl_sprite_quad_t *quad = &self->quads[order[i]];
+		if (quad->prebuilt < 0) {
+			emit_quad(quad, &self->vertices[i * 4]);
+		} else {
+			memcpy(&self->vertices[i * 4], &self->prebuilt[quad->prebuilt * 4], 4 * sizeof(xpl_sprite_vertex_t));
+		}
+	}
+}
@@ -6,67 +6,198 @@
 //  Copyright (c) 2013 Informi Software Inc. All rights reserved.
 //
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "xpl_sprite_sheet.h"
 #include "xpl_sprite.h"
 #include "xpl_file.h"
 #include "xpl_dynamic_buffer.h"
+#include "xpl_vfs.h"
 #include "uthash.h"
 #include "cJSON/cJSON.h"
 
+// Binary sheet written by resource_processor.rb (SpriteSheetCompile), little-endian.
+#define SHEET_MAGIC "XSS1"
+#define SHEET_EXTENSION ".xss"
+
+typedef struct sheet_header {
+	char magic[4];
+	uint32_t entry_count;
+	uint32_t names_size;
+	uint32_t image_offset;
+	int32_t width;
+	int32_t height;
+} sheet_header_t;
+
+typedef struct sheet_frame {
+	uint32_t name_offset;
+	int32_t x, y, width, height;
+} sheet_frame_t;
+
 struct xpl_sprite_sheet_entry {
-	char							*name;
+	const char						*name; // in sheet->names
     struct xpl_sprite               *sprite;
     UT_hash_handle                  hh;
 };
 
 struct xpl_sprite_sheet {
     char							*resource;
-    xpl_sprite_sheet_entry_t        *entries;
+	char							*names;
+	size_t							entry_count;
+	xpl_sprite_sheet_entry_t		*entry_array; // indexed by sprite ID
+    xpl_sprite_sheet_entry_t        *entries; // hash over entry_array
 	xivec2							size;
+	uint32_t						signature;
 };
 
-xpl_sprite_sheet_t *xpl_sprite_sheet_new(struct xpl_sprite_batch *batch, const char *json) {
-	xpl_sprite_sheet_t *sheet = xpl_calloc_type(xpl_sprite_sheet_t);
-	
-	char resource[PATH_MAX];
-	xpl_resolve_resource(resource, json, PATH_MAX);
+// FNV-1a over the NUL-terminated names in ID order; matches resource_processor.rb.
+static uint32_t sheet_signature(const char *names, size_t entry_count) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < entry_count; ++i) {
+		do {
+			h ^= (unsigned char)*names;
+			h *= 16777619u;
+		} while (*names++);
+	}
+	return h;
+}
+
+// Frames must be sorted by name, which makes a frame's index its sprite ID.
+static void sheet_add_frames(xpl_sprite_sheet_t *sheet, struct xpl_sprite_batch *batch, const char *image,
+							 const char *names, size_t names_size, const sheet_frame_t *frames, size_t entry_count) {
+	sheet->names = xpl_alloc(names_size);
+	memcpy(sheet->names, names, names_size);
+	sheet->entry_count = entry_count;
+	sheet->entry_array = xpl_calloc(entry_count * sizeof(xpl_sprite_sheet_entry_t));
+	sheet->signature = sheet_signature(sheet->names, entry_count);
+
+	for (size_t i = 0; i < entry_count; ++i) {
+		xpl_sprite_sheet_entry_t *entry = &sheet->entry_array[i];
+		entry->name = sheet->names + frames[i].name_offset;
+
+		xirect region = xirect_set(frames[i].x, frames[i].y, frames[i].width, frames[i].height);
+		entry->sprite = xpl_sprite_new(batch, image, &region);
+
+		HASH_ADD_KEYPTR(hh, sheet->entries, entry->name, strlen(entry->name), entry);
+	}
+}
+
+static bool sheet_load_binary(xpl_sprite_sheet_t *sheet, struct xpl_sprite_batch *batch, const char *resource) {
+	xpl_file_mapping_t *mapping = xpl_vfs_map(resource);
+	if (! mapping) return false;
+
+	const sheet_header_t *header = (const sheet_header_t *)mapping->content;
+	const sheet_frame_t *frames = (const sheet_frame_t *)(mapping->content + sizeof(sheet_header_t));
+	const char *names = (const char *)(frames + (mapping->length >= sizeof(sheet_header_t) ? header->entry_count : 0));
+
+	bool valid = (mapping->length >= sizeof(sheet_header_t) &&
+				  ! memcmp(header->magic, SHEET_MAGIC, sizeof(header->magic)) &&
+				  sizeof(sheet_header_t) + header->entry_count * sizeof(sheet_frame_t) + header->names_size <= mapping->length &&
+				  header->names_size > 0 && names[header->names_size - 1] == '\0' &&
+				  header->image_offset < header->names_size);
+	for (uint32_t i = 0; valid && i < header->entry_count; ++i) {
+		valid = frames[i].name_offset < header->image_offset;
+	}
+	if (! valid) {
+		LOG_ERROR("Invalid sprite sheet %s", resource);
+		xpl_file_unmap(&mapping);
+		return false;
+	}
+
+	sheet->size = xivec2_set(header->width, header->height);
+	sheet_add_frames(sheet, batch, names + header->image_offset,
+					 names, header->names_size, frames, header->entry_count);
+
+	xpl_file_unmap(&mapping);
+	return true;
+}
+
+typedef struct json_frame {
+	const char *name;
+	cJSON *el;
+} json_frame_t;
+
+static int json_frame_compare(const void *a, const void *b) {
+	return strcmp(((const json_frame_t *)a)->name, ((const json_frame_t *)b)->name);
+}
+
+static bool sheet_load_json(xpl_sprite_sheet_t *sheet, struct xpl_sprite_batch *batch, const char *json) {
 	xpl_dynamic_buffer_t *file = xpl_dynamic_buffer_new();
-	xpl_file_get_contents(resource, file);
-	const char *contents = (const char *)file->content;
-	
-	cJSON *root = cJSON_Parse(contents);
+	if (! xpl_vfs_get_contents(json, file)) {
+		xpl_dynamic_buffer_destroy(&file);
+		return false;
+	}
+
+	cJSON *root = cJSON_Parse((const char *)file->content);
+	xpl_dynamic_buffer_destroy(&file);
+	if (! root) {
+		LOG_ERROR("Couldn't parse sprite sheet %s", json);
+		return false;
+	}
 	cJSON *meta = cJSON_GetObjectItem(root, "meta");
-	
+
 	const char *sheet_source = cJSON_GetObjectItem(meta, "image")->valuestring;
 
 	cJSON *meta_size = cJSON_GetObjectItem(meta, "size");
 	sheet->size.x = cJSON_GetObjectItem(meta_size, "w")->valueint;
 	sheet->size.y = cJSON_GetObjectItem(meta_size, "h")->valueint;
-	
+
 	cJSON *frames = cJSON_GetObjectItem(root, "frames");
 	size_t entry_count = cJSON_GetArraySize(frames);
+	json_frame_t *sorted = xpl_alloc(entry_count * sizeof(json_frame_t));
+	size_t names_size = 0;
+	for (size_t i = 0; i < entry_count; ++i) {
+		sorted[i].el = cJSON_GetArrayItem(frames, (int)i);
+		sorted[i].name = sorted[i].el->string;
+		names_size += strlen(sorted[i].name) + 1;
+	}
+	qsort(sorted, entry_count, sizeof(json_frame_t), json_frame_compare);
+
+	char *names = xpl_alloc(names_size ? names_size : 1);
+	sheet_frame_t *sheet_frames = xpl_alloc(entry_count * sizeof(sheet_frame_t));
+	size_t name_offset = 0;
 	for (size_t i = 0; i < entry_count; ++i) {
-		cJSON *el = cJSON_GetArrayItem(frames, (int)i);
-		
-		xpl_sprite_sheet_entry_t *entry = xpl_calloc_type(xpl_sprite_sheet_entry_t);
-		entry->name = strdup(el->string);
-		
-		cJSON *el_frame = cJSON_GetObjectItem(el, "frame");
-		xirect region = xirect_set(cJSON_GetObjectItem(el_frame, "x")->valueint,
-								   cJSON_GetObjectItem(el_frame, "y")->valueint,
-								   cJSON_GetObjectItem(el_frame, "w")->valueint,
-								   cJSON_GetObjectItem(el_frame, "h")->valueint);
+		size_t name_size = strlen(sorted[i].name) + 1;
+		memcpy(names + name_offset, sorted[i].name, name_size);
+
+		cJSON *el_frame = cJSON_GetObjectItem(sorted[i].el, "frame");
+		sheet_frame_t *frame = &sheet_frames[i];
+		frame->name_offset = (uint32_t)name_offset;
+		frame->x = cJSON_GetObjectItem(el_frame, "x")->valueint;
+		frame->width = cJSON_GetObjectItem(el_frame, "w")->valueint;
+		frame->height = cJSON_GetObjectItem(el_frame, "h")->valueint;
 		// invert y. of course
-		region.y = sheet->size.y - region.y - region.height;
-		entry->sprite = xpl_sprite_new(batch, sheet_source, &region);
-		
-		HASH_ADD_KEYPTR(hh, sheet->entries, entry->name, strlen(entry->name), entry);
+		frame->y = sheet->size.y - cJSON_GetObjectItem(el_frame, "y")->valueint - frame->height;
+		name_offset += name_size;
 	}
-	
-	xpl_dynamic_buffer_destroy(&file);
+
+	sheet_add_frames(sheet, batch, sheet_source, names, names_size, sheet_frames, entry_count);
+
+	xpl_free(sheet_frames);
+	xpl_free(names);
+	xpl_free(sorted);
 	cJSON_Delete(root);
-	
-	
+	return true;
+}
+
+xpl_sprite_sheet_t *xpl_sprite_sheet_new(struct xpl_sprite_batch *batch, const char *json) {
+	xpl_sprite_sheet_t *sheet = xpl_calloc_type(xpl_sprite_sheet_t);
+	sheet->resource = strdup(json);
+
+	// Prefer the compiled sheet next to the JSON, if resource_processor.rb has built one.
+	char binary[PATH_MAX];
+	snprintf(binary, PATH_MAX, "%s", json);
+	char *extension = strrchr(binary, '.');
+	if (extension && ! strcmp(extension, ".json")) {
+		snprintf(extension, PATH_MAX - (extension - binary), SHEET_EXTENSION);
+	}
+
+	if (! sheet_load_binary(sheet, batch, binary) && ! sheet_load_json(sheet, batch, json)) {
+		LOG_ERROR("Couldn't load sprite sheet %s", json);
+	}
+
 	return sheet;
 }
 
@@ -77,24 +208,38 @@ struct xpl_sprite *xpl_sprite_get(struct xpl_sprite_sheet *sheet, const char *na
     return NULL;
 }
 
+int xpl_sprite_sheet_find(struct xpl_sprite_sheet *sheet, const char *name) {
+    xpl_sprite_sheet_entry_t *entry;
+    HASH_FIND_STR(sheet->entries, name, entry);
+    if (entry) return (int)(entry - sheet->entry_array);
+    return XPL_SPRITE_SHEET_END;
+}
+
+struct xpl_sprite *xpl_sprite_get_id(struct xpl_sprite_sheet *sheet, int sprite_id) {
+	if (sprite_id < 0 || (size_t)sprite_id >= sheet->entry_count) return NULL;
+	return sheet->entry_array[sprite_id].sprite;
+}
+
+bool xpl_sprite_sheet_check_signature(const struct xpl_sprite_sheet *sheet, uint32_t signature) {
+	if (sheet->signature == signature) return true;
+	LOG_WARN("Sprite sheet %s doesn't match its generated sprite IDs; rerun resource_processor.rb", sheet->resource);
+	return false;
+}
+
 void xpl_sprite_sheet_destroy(xpl_sprite_sheet_t **ppsheet) {
     assert(ppsheet);
     xpl_sprite_sheet_t *sheet = *ppsheet;
     assert(sheet);
-    
-    xpl_sprite_sheet_entry_t *el, *tmp;
-    HASH_ITER(hh, sheet->entries, el, tmp) {
-        HASH_DEL(sheet->entries, el);
-		free(el->name);
-		
+
+    HASH_CLEAR(hh, sheet->entries);
+	for (size_t i = 0; i < sheet->entry_count; ++i) {
 		// I think the batch owns the sprite actually.
-		xpl_sprite_destroy(&el->sprite);
-		
-        xpl_free(el);
-    }
+		xpl_sprite_destroy(&sheet->entry_array[i].sprite);
+	}
+	if (sheet->entry_array) xpl_free(sheet->entry_array);
+	if (sheet->names) xpl_free(sheet->names);
 	free(sheet->resource);
-    
+
     xpl_free(sheet);
     *ppsheet = NULL;
 }
-
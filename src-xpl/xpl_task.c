@@ -0,0 +1,466 @@
+//
+//  xpl_task.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-24.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "xpl.h"
+#include "xpl_mutex.h"
+#include "xpl_thread.h"
+#include "xpl_task.h"
+
+#define TASK_WORKERS_MAX        16
+#define TASK_DEQUE_CAPACITY     1024                // power of two
+#define TASK_DEQUE_MASK         (TASK_DEQUE_CAPACITY - 1)
+#define TASK_CACHE_LINE         64
+
+// gcc, clang and mingw all provide the __atomic builtins.
+#define task_load(ptr)              __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define task_load_relaxed(ptr)      __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define task_store(ptr, value)      __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define task_store_relaxed(ptr, v)  __atomic_store_n((ptr), (v), __ATOMIC_RELAXED)
+#define task_add(ptr, value)        __atomic_add_fetch((ptr), (value), __ATOMIC_SEQ_CST)
+#define task_cas(ptr, old, new)     __atomic_compare_exchange_n((ptr), &(old), (new), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+#define task_exchange(ptr, value)   __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#define task_fence()                __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct task_link {
+	xpl_task_t                  *task;
+	struct task_link            *next;
+} task_link_t;
+
+// Marks a finished task's dependents list so late dependents don't wait forever.
+#define TASK_SEALED             ((task_link_t *)(uintptr_t)1)
+
+struct xpl_task {
+	xpl_task_function           func;
+	void                        *data;
+
+	int                         refs;
+	// Unfinished dependencies, plus one until submitted.
+	int                         blockers;
+	int                         done;
+	task_link_t                 *dependents;
+
+	// Shared queue link.
+	struct xpl_task             *next;
+};
+
+// Chase-Lev deque: the owner pushes and takes at the bottom, thieves steal from the top.
+typedef struct task_worker {
+	int64_t                     top;
+	char                        pad0[TASK_CACHE_LINE - sizeof(int64_t)];
+	int64_t                     bottom;
+	char                        pad1[TASK_CACHE_LINE - sizeof(int64_t)];
+	xpl_task_t                  *buffer[TASK_DEQUE_CAPACITY];
+
+	xpl_thread_id               tid;
+	uint32_t                    steal_seed;
+} task_worker_t;
+
+static task_worker_t *workers = NULL;
+static size_t worker_count = 0;
+static int stopping = 0;
+
+// Tasks submitted off the workers, and deque overflow. Guarded by queue_mutex.
+static xpl_mutex_t *queue_mutex = NULL;
+static xpl_task_t *queue_head = NULL;
+static xpl_task_t *queue_tail = NULL;
+
+// Parking. A worker samples work_epoch before looking for work and only sleeps if
+// nothing has been submitted since; submitters bump the epoch and signal only
+// when someone is asleep. Waiters do the same with done_epoch and completions.
+static xpl_mutex_t *park_mutex = NULL;
+static xpl_condition_t *work_available = NULL;
+static xpl_condition_t *work_done = NULL;
+static unsigned int work_epoch = 0;
+static unsigned int done_epoch = 0;
+static int sleepers = 0;
+static int waiters = 0;
+
+static void task_schedule(xpl_task_t *task);
+
+// ----------------------------------------------------------------------------
+
+static task_worker_t *current_worker(void) {
+	if (! worker_count) return NULL;
+	uintptr_t data = (uintptr_t)xpl_thread_get_local_data();
+	uintptr_t first = (uintptr_t)workers;
+	uintptr_t last = (uintptr_t)(workers + worker_count);
+	if (data < first || data >= last) return NULL;
+	return (task_worker_t *)data;
+}
+
+static bool deque_push(task_worker_t *worker, xpl_task_t *task) {
+	int64_t b = task_load_relaxed(&worker->bottom);
+	int64_t t = task_load(&worker->top);
+	if (b - t >= TASK_DEQUE_CAPACITY) return false;
+
+	task_store_relaxed(&worker->buffer[b & TASK_DEQUE_MASK], task);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	task_store_relaxed(&worker->bottom, b + 1);
+	return true;
+}
+
+static xpl_task_t *deque_take(task_worker_t *worker) {
+	int64_t b = task_load_relaxed(&worker->bottom) - 1;
+	task_store_relaxed(&worker->bottom, b);
+	task_fence();
+	int64_t t = task_load_relaxed(&worker->top);
+
+	xpl_task_t *task = NULL;
+	if (t <= b) {
+		task = task_load_relaxed(&worker->buffer[b & TASK_DEQUE_MASK]);
+		if (t == b) {
+			// Last one: race the thieves for it.
+			if (! task_cas(&worker->top, t, t + 1)) task = NULL;
+			task_store_relaxed(&worker->bottom, b + 1);
+		}
+	} else {
+		task_store_relaxed(&worker->bottom, b + 1);
+	}
+	return task;
+}
+
+static xpl_task_t *deque_steal(task_worker_t *worker) {
+	int64_t t = task_load(&worker->top);
+	task_fence();
+	int64_t b = task_load(&worker->bottom);
+	if (t >= b) return NULL;
+
+	xpl_task_t *task = task_load_relaxed(&worker->buffer[t & TASK_DEQUE_MASK]);
+	if (! task_cas(&worker->top, t, t + 1)) return NULL;
+	return task;
+}
+
+static void queue_push(xpl_task_t *task) {
+	xpl_mutex_enter(queue_mutex);
+	task->next = NULL;
+	if (queue_tail) {
+		queue_tail->next = task;
+	} else {
+		queue_head = task;
+	}
+	queue_tail = task;
+	xpl_mutex_leave(queue_mutex);
+}
+
+static xpl_task_t *queue_pop(void) {
+	xpl_mutex_enter(queue_mutex);
+	xpl_task_t *task = queue_head;
+	if (task) {
+		queue_head = task->next;
+		if (! queue_head) queue_tail = NULL;
+		task->next = NULL;
+	}
+	xpl_mutex_leave(queue_mutex);
+	return task;
+}
+
+// Own deque first, then the shared queue, then the other workers' deques.
+static xpl_task_t *find_task(task_worker_t *self) {
+	xpl_task_t *task = NULL;
+	if (self && (task = deque_take(self))) return task;
+	if ((task = queue_pop())) return task;
+
+	size_t start = 0;
+	if (self) {
+		self->steal_seed = self->steal_seed * 1664525u + 1013904223u;
+		start = (self->steal_seed >> 16) % worker_count;
+	}
+	for (size_t i = 0; i < worker_count; ++i) {
+		task_worker_t *victim = &workers[(start + i) % worker_count];
+		if (victim == self) continue;
+		if ((task = deque_steal(victim))) return task;
+	}
+	return NULL;
+}
+
+static void notify_work(void) {
+	task_add(&work_epoch, 1);
+	if (task_add(&sleepers, 0) > 0) {
+		xpl_mutex_enter(park_mutex);
+		xpl_condition_signal(work_available);
+		xpl_mutex_leave(park_mutex);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void task_run(xpl_task_t *task) {
+	task->func(task->data);
+
+	task_store(&task->done, 1);
+	task_link_t *link = task_exchange(&task->dependents, TASK_SEALED);
+	while (link) {
+		task_link_t *next = link->next;
+		if (task_add(&link->task->blockers, -1) == 0) task_schedule(link->task);
+		xpl_task_release(&link->task);
+		xpl_free(link);
+		link = next;
+	}
+
+	task_add(&done_epoch, 1);
+	if (task_add(&waiters, 0) > 0) {
+		xpl_mutex_enter(park_mutex);
+		xpl_condition_broadcast(work_done);
+		xpl_mutex_leave(park_mutex);
+	}
+
+	// The scheduler's reference, taken in xpl_task_submit.
+	xpl_task_release(&task);
+}
+
+static void task_schedule(xpl_task_t *task) {
+	if (! worker_count) {
+		task_run(task);
+		return;
+	}
+
+	task_worker_t *self = current_worker();
+	if (! self || ! deque_push(self, task)) {
+		queue_push(task);
+	}
+	notify_work();
+}
+
+static void task_worker_work(void) {
+	task_worker_t *self = current_worker();
+	assert(self);
+
+	unsigned int epoch = task_load(&work_epoch);
+	xpl_task_t *task = find_task(self);
+	if (task) {
+		task_run(task);
+		return;
+	}
+
+	xpl_mutex_enter(park_mutex);
+	task_add(&sleepers, 1);
+	while (! task_load(&stopping) && task_add(&work_epoch, 0) == epoch) {
+		xpl_condition_wait(work_available, park_mutex, -1);
+	}
+	task_add(&sleepers, -1);
+	xpl_mutex_leave(park_mutex);
+}
+
+// ----------------------------------------------------------------------------
+
+void xpl_tasks_init(size_t requested_workers) {
+	assert(xpl_threads_initialized());
+	assert(xpl_thread_is_primary());
+	assert(! queue_mutex);
+
+	queue_mutex = xpl_mutex_new();
+	park_mutex = xpl_mutex_new();
+	work_available = xpl_condition_new();
+	work_done = xpl_condition_new();
+	stopping = 0;
+
+	if (requested_workers > TASK_WORKERS_MAX) requested_workers = TASK_WORKERS_MAX;
+	if (! requested_workers) return;
+
+	workers = xpl_calloc(sizeof(task_worker_t) * requested_workers);
+	size_t assigned = 0;
+	for (size_t i = 0; i < requested_workers; ++i) {
+		workers[i].steal_seed = (uint32_t)(i * 2654435761u) | 1u;
+		workers[i].tid = xpl_thread_assign_work(task_worker_work, NULL, &workers[i]);
+		if (workers[i].tid == XPL_THREAD_INVALID) {
+			LOG_WARN("Thread pool exhausted; running tasks with %lu workers", (unsigned long)assigned);
+			break;
+		}
+		assigned++;
+	}
+
+	// Publish the count before starting anyone, so current_worker works from the first call.
+	worker_count = assigned;
+	for (size_t i = 0; i < worker_count; ++i) {
+		xpl_thread_start(workers[i].tid);
+	}
+	LOG_DEBUG("Task scheduler started with %lu workers", (unsigned long)worker_count);
+}
+
+void xpl_tasks_shutdown(void) {
+	assert(xpl_thread_is_primary());
+	if (! queue_mutex) return;
+
+	xpl_mutex_enter(park_mutex);
+	task_store(&stopping, 1);
+	xpl_condition_broadcast(work_available);
+	xpl_mutex_leave(park_mutex);
+
+	// Unassign requests are only honoured between work calls, so keep the parked
+	// workers awake until they've all gone.
+	for (size_t i = 0; i < worker_count; ++i) {
+		if (! xpl_thread_unassign_block(workers[i].tid, 1000)) {
+			LOG_WARN("Task worker %lu didn't stop", (unsigned long)i);
+		}
+	}
+
+	// Anything still queued runs here, with the workers gone; with worker_count
+	// at 0 whatever those tasks unblock runs inline too.
+	size_t count = worker_count;
+	worker_count = 0;
+	size_t stranded = 0;
+	xpl_task_t *task;
+	while ((task = queue_pop())) {
+		task_run(task);
+		stranded++;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		while ((task = deque_steal(&workers[i]))) {
+			task_run(task);
+			stranded++;
+		}
+	}
+	if (stranded) LOG_DEBUG("Ran %lu stranded tasks at shutdown", (unsigned long)stranded);
+
+	if (workers) xpl_free(workers);
+	workers = NULL;
+
+	xpl_condition_destroy(&work_done);
+	xpl_condition_destroy(&work_available);
+	xpl_mutex_destroy(&park_mutex);
+	xpl_mutex_destroy(&queue_mutex);
+}
+
+bool xpl_tasks_initialized(void) {
+	return queue_mutex != NULL;
+}
+
+size_t xpl_tasks_worker_count(void) {
+	return worker_count;
+}
+
+xpl_task_t *xpl_task_new(xpl_task_function func, void *data) {
+	assert(func);
+
+	xpl_task_t *task = xpl_calloc_type(xpl_task_t);
+	task->func = func;
+	task->data = data;
+	task->refs = 1;
+	task->blockers = 1;
+	return task;
+}
+
+void xpl_task_depends(xpl_task_t *task, xpl_task_t *dependency) {
+	assert(task);
+	assert(dependency);
+
+	task_link_t *link = xpl_calloc_type(task_link_t);
+	link->task = task;
+	task_add(&task->refs, 1);
+	task_add(&task->blockers, 1);
+
+	task_link_t *head = task_load(&dependency->dependents);
+	do {
+		if (head == TASK_SEALED) {
+			// Already finished; task still holds its submit blocker, so this can't hit 0.
+			task_add(&task->blockers, -1);
+			task_add(&task->refs, -1);
+			xpl_free(link);
+			return;
+		}
+		link->next = head;
+	} while (! task_cas(&dependency->dependents, head, link));
+}
+
+void xpl_task_submit(xpl_task_t *task) {
+	assert(task);
+
+	task_add(&task->refs, 1);
+	if (task_add(&task->blockers, -1) == 0) task_schedule(task);
+}
+
+bool xpl_task_is_done(const xpl_task_t *task) {
+	return task_load(&task->done) != 0;
+}
+
+void xpl_task_wait(xpl_task_t *task) {
+	assert(task);
+
+	task_worker_t *self = current_worker();
+	while (! xpl_task_is_done(task)) {
+		unsigned int epoch = task_load(&done_epoch);
+		xpl_task_t *other = worker_count ? find_task(self) : NULL;
+		if (other) {
+			task_run(other);
+			continue;
+		}
+
+		// Nothing to help with, so everything left is running elsewhere; sleep
+		// until something finishes and look again.
+		xpl_mutex_enter(park_mutex);
+		task_add(&waiters, 1);
+		if (! xpl_task_is_done(task) && task_add(&done_epoch, 0) == epoch) {
+			xpl_condition_wait(work_done, park_mutex, -1);
+		}
+		task_add(&waiters, -1);
+		xpl_mutex_leave(park_mutex);
+	}
+}
+
+void xpl_task_release(xpl_task_t **pptask) {
+	assert(pptask);
+	xpl_task_t *task = *pptask;
+	*pptask = NULL;
+	if (! task) return;
+
+	if (task_add(&task->refs, -1) == 0) {
+		task_link_t *link = task->dependents;
+		assert(link == NULL || link == TASK_SEALED);
+		xpl_free(task);
+	}
+}
+
+xpl_task_t *xpl_task_run(xpl_task_function func, void *data) {
+	xpl_task_t *task = xpl_task_new(func, data);
+	xpl_task_submit(task);
+	return task;
+}
+
+// ----------------------------------------------------------------------------
+
+typedef struct parallel_chunk {
+	size_t                      begin, end;
+	xpl_task_range_function     func;
+	void                        *data;
+	xpl_task_t                  *task;
+} parallel_chunk_t;
+
+static void parallel_chunk_run(void *data) {
+	parallel_chunk_t *chunk = (parallel_chunk_t *)data;
+	chunk->func(chunk->begin, chunk->end, chunk->data);
+}
+
+void xpl_parallel_for(size_t count, size_t grain, xpl_task_range_function func, void *data) {
+	assert(func);
+	if (! count) return;
+	if (! grain) grain = 1;
+
+	size_t chunk_count = (count + grain - 1) / grain;
+	if (! worker_count || chunk_count == 1) {
+		func(0, count, data);
+		return;
+	}
+
+	parallel_chunk_t *chunks = xpl_calloc(sizeof(parallel_chunk_t) * chunk_count);
+	for (size_t i = 0; i < chunk_count; ++i) {
+		chunks[i].begin = i * grain;
+		chunks[i].end = chunks[i].begin + grain < count ? chunks[i].begin + grain : count;
+		chunks[i].func = func;
+		chunks[i].data = data;
+		chunks[i].task = xpl_task_run(parallel_chunk_run, &chunks[i]);
+	}
+
+	for (size_t i = 0; i < chunk_count; ++i) {
+		xpl_task_wait(chunks[i].task);
+		xpl_task_release(&chunks[i].task);
+	}
+	xpl_free(chunks);
+}
@@ -22,6 +22,7 @@ typedef struct _text_table_entry {
     size_t wtext_length;
     
     xpl_cached_text_t *value;
+    xpl_cached_text_t value_storage;
     
 	UT_hash_handle hh;
 } _text_table_entry_t;
@@ -34,6 +35,7 @@ struct xpl_text_cache {
 	_text_table_t *last_frame;
 	_text_table_t *this_frame;
 	xpl_font_manager_t *font_manager;
+	xpl_pool_t *entry_pool;
 };
 
 // ---------------------------------------------------------------------
@@ -46,9 +48,9 @@ XPLINLINE int text_cache_key(int markup_key, const char *text) {
 	return hash;
 }
 
-static _text_table_entry_t *text_table_entry_new(int markup_key,
+static _text_table_entry_t *text_table_entry_new(xpl_text_cache_t *cache, int markup_key,
                                                  const char *text, xpl_text_buffer_t *buffer) {
-	_text_table_entry_t *entry = xpl_alloc_type(_text_table_entry_t);
+	_text_table_entry_t *entry = xpl_pool_alloc_type(cache->entry_pool, _text_table_entry_t);
     
 	int hash = text_cache_key(markup_key, text);
 #    ifndef DISABLE_CACHES
@@ -67,14 +69,15 @@ static _text_table_entry_t *text_table_entry_new(int markup_key,
     xpl_mbs_to_wcs(entry->text, entry->wtext, entry->wtext_length);
     entry->wtext[entry->wtext_length] = 0;
     
-    entry->value = xpl_calloc_type(xpl_cached_text_t);
+    entry->value = &entry->value_storage;
+	xpl_zero_struct(entry->value);
 	entry->value->buffer = buffer;
 	entry->value->managed_font = NULL;
     
 	return entry;
 }
 
-static void text_table_entry_destroy(_text_table_entry_t **ppentry) {
+static void text_table_entry_destroy(xpl_text_cache_t *cache, _text_table_entry_t **ppentry) {
 	assert(ppentry);
     
 	_text_table_entry_t *entry = *ppentry;
@@ -87,9 +90,7 @@ static void text_table_entry_destroy(_text_table_entry_t **ppentry) {
 	// Managed by font manager
 	// xpl_font_destroy(&entry->managed_font);
     
-    xpl_free(entry->value);
-    
-	xpl_free(entry);
+	xpl_pool_free(cache->entry_pool, entry);
     
 	*ppentry = NULL;
 }
@@ -102,7 +103,7 @@ static _text_table_t *text_table_new() {
 	return table;
 }
 
-static void text_table_destroy(_text_table_t **pptable) {
+static void text_table_destroy(xpl_text_cache_t *cache, _text_table_t **pptable) {
 	assert(pptable);
     
 	_text_table_t *table = *pptable;
@@ -113,7 +114,7 @@ static void text_table_destroy(_text_table_t **pptable) {
 	HASH_ITER(hh, table->entries, entry, tmp)
 	{
 		HASH_DEL(table->entries, entry);
-		text_table_entry_destroy(&entry);
+		text_table_entry_destroy(cache, &entry);
 	}
     
 	xpl_free(table);
@@ -128,6 +129,7 @@ xpl_text_cache_t *xpl_text_cache_new(size_t size) {
 	cache->last_frame = text_table_new();
 	cache->this_frame = text_table_new();
 	cache->font_manager = xpl_font_manager_new(size, size, 1);
+	cache->entry_pool = xpl_pool_new_type(_text_table_entry_t, 64);
 	return cache;
 }
 
@@ -138,11 +140,12 @@ void xpl_text_cache_destroy(xpl_text_cache_t **ppcache) {
 	assert(cache);
     
 	if (cache->last_frame)
-		text_table_destroy(&cache->last_frame);
+		text_table_destroy(cache, &cache->last_frame);
 	if (cache->this_frame)
-		text_table_destroy(&cache->this_frame);
+		text_table_destroy(cache, &cache->this_frame);
     
 	xpl_font_manager_destroy(&cache->font_manager);
+	xpl_pool_destroy(&cache->entry_pool);
     
 	xpl_free(cache);
     
@@ -155,7 +158,7 @@ void xpl_text_cache_advance_frame(xpl_text_cache_t *text_cache) {
 	HASH_ITER(hh, text_cache->last_frame->entries, entry, tmp)
 	{
 		HASH_DEL(text_cache->last_frame->entries, entry);
-		text_table_entry_destroy(&entry);
+		text_table_entry_destroy(text_cache, &entry);
 	}
 	_text_table_t *swap = text_cache->last_frame;
 	text_cache->last_frame = text_cache->this_frame;
@@ -170,7 +173,7 @@ static xpl_cached_text_t * text_cache_create(xpl_text_cache_t *text_cache,
 	xvec2 position = xvec2_set(0, 0);
 	int markup_key = xpl_markup_hash(markup);
     
-	_text_table_entry_t *table_entry = text_table_entry_new(markup_key, text,
+	_text_table_entry_t *table_entry = text_table_entry_new(text_cache, markup_key, text,
                                                             buffer);
 	HASH_ADD_INT(text_cache->this_frame->entries, key, table_entry);
     
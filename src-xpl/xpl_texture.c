@@ -8,14 +8,19 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "xpl_gl.h"
 #include "SOIL.h"
+#include "uthash.h"
 
 #include "xpl_log.h"
 #include "xpl_memory.h"
 #include "xpl_gl_debug.h"
 #include "xpl_platform.h"
+#include "xpl_thread.h"
+#include "xpl_loader.h"
+#include "xpl_vfs.h"
 
 #include "xpl_texture.h"
 
@@ -35,24 +40,110 @@ void xpl_texture_destroy(xpl_texture_t **pptexture) {
 	*pptexture = NULL;
 }
 
+// Decoded pixels waiting for upload.
+typedef struct texture_image {
+	unsigned char			*data;
+	xivec2					size;
+	int						channels;
+} texture_image_t;
+
+typedef struct texture_prefetch {
+	char					resource[PATH_MAX];
+	bool					ready;
+	texture_image_t			*image;
+
+	UT_hash_handle			hh;
+} texture_prefetch_t;
+
+static texture_prefetch_t *prefetch_table = NULL;
+
+static void texture_image_destroy(texture_image_t **ppimage) {
+	texture_image_t *image = *ppimage;
+	SOIL_free_image_data(image->data);
+	xpl_free(image);
+	*ppimage = NULL;
+}
+
+// Runs on loader workers, so no GL here.
+static void *texture_decode(const char *resource, const xpl_file_mapping_t *source, void *context) {
+	texture_image_t *image = xpl_calloc_type(texture_image_t);
+	image->data = SOIL_load_image_from_memory(source->content, (int)source->length,
+			&image->size.x, &image->size.y, &image->channels, FALSE);
+	if (!image->data) {
+		LOG_WARN("Couldn't decode %s", resource);
+		xpl_free(image);
+		return NULL;
+	}
+	return image;
+}
+
+static void texture_prefetch_complete(const char *resource, void *result, void *context) {
+	texture_prefetch_t *entry = (texture_prefetch_t *)context;
+	entry->image = (texture_image_t *)result;
+	entry->ready = true;
+}
+
+void xpl_texture_prefetch(const char *resource_name) {
+	texture_prefetch_t *entry;
+	HASH_FIND_STR(prefetch_table, resource_name, entry);
+	if (entry) return;
+
+	entry = xpl_calloc_type(texture_prefetch_t);
+	strncpy(entry->resource, resource_name, PATH_MAX - 1);
+	HASH_ADD_STR(prefetch_table, resource, entry);
+	xpl_loader_request(resource_name, texture_decode, texture_prefetch_complete, entry);
+}
+
+void xpl_texture_prefetch_purge(void) {
+	xpl_loader_finish();
+	texture_prefetch_t *entry, *tmp;
+	HASH_ITER(hh, prefetch_table, entry, tmp) {
+		HASH_DEL(prefetch_table, entry);
+		if (entry->image) texture_image_destroy(&entry->image);
+		xpl_free(entry);
+	}
+}
+
+// Takes a prefetched image, waiting for it if it's still decoding.
+static texture_image_t *texture_prefetch_take(const char *resource_name) {
+	texture_prefetch_t *entry;
+	HASH_FIND_STR(prefetch_table, resource_name, entry);
+	if (!entry) return NULL;
+
+	while (!entry->ready) {
+		if (!xpl_loader_poll(0.0)) xpl_thread_yield();
+	}
+	texture_image_t *image = entry->image;
+	HASH_DEL(prefetch_table, entry);
+	xpl_free(entry);
+	return image;
+}
+
 GLuint xpl_texture_load(xpl_texture_t *self, const char *resource_name, bool allow_compress) {
-	char filename[PATH_MAX];
-	if (!xpl_resolve_resource(filename, resource_name, PATH_MAX)) {
-		LOG_ERROR("Couldn't load resource: %s", resource_name);
-		return 0;
+	texture_image_t *image = texture_prefetch_take(resource_name);
+	if (!image) {
+		xpl_file_mapping_t *mapping = xpl_vfs_map(resource_name);
+		if (!mapping) {
+			LOG_ERROR("Couldn't load resource: %s", resource_name);
+			return 0;
+		}
+		image = texture_decode(resource_name, mapping, NULL);
+		xpl_file_unmap(&mapping);
+		if (!image) return 0;
 	}
 
+	self->size = image->size;
+	self->channels = image->channels;
+
 	GLint original_unpack_alignment;
 	glGetIntegerv(GL_UNPACK_ALIGNMENT, &original_unpack_alignment);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	unsigned char *data = SOIL_load_image(filename, &self->size.x,
-			&self->size.y, &self->channels, FALSE);
-	self->texture_id = SOIL_create_OGL_texture(data,
+	self->texture_id = SOIL_create_OGL_texture(image->data,
 											   self->size.x, self->size.y,
 											   self->channels,
 											   self->texture_id ? self->texture_id : SOIL_CREATE_NEW_ID,
 											   (allow_compress ? SOIL_FLAG_COMPRESS_TO_DXT : 0) | SOIL_FLAG_INVERT_Y);
-	SOIL_free_image_data(data);
+	texture_image_destroy(&image);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, original_unpack_alignment);
     GL_DEBUG();
 
@@ -85,17 +176,18 @@ GLuint xpl_texture_load_array(xpl_texture_t *self, ...) {
 	glBindTexture(GL_TEXTURE_2D_ARRAY, self->texture_id);
 
 	// For each argument, construct a real filename, load the image, and append it to a buffer.
-	char filename[PATH_MAX];
 	int width, height, channels;
 	for (int i = 0; i < elements; i++) {
 
-		if (!xpl_resolve_resource(filename, resource_name[i], PATH_MAX)) {
+		xpl_file_mapping_t *mapping = xpl_vfs_map(resource_name[i]);
+		if (!mapping) {
 			LOG_ERROR("Failed loading element %s", resource_name[i]);
 			return 0;
 		}
 
-		unsigned char *data = SOIL_load_image(filename, &width, &height,
-				&channels, SOIL_LOAD_AUTO);
+		unsigned char *data = SOIL_load_image_from_memory(mapping->content, (int)mapping->length,
+				&width, &height, &channels, SOIL_LOAD_AUTO);
+		xpl_file_unmap(&mapping);
 
 		GLint format, internal_format;
 		if (i == 0) {
@@ -17,8 +17,6 @@
 
 // ----------------------------------------------------------------------------
 
-#define THREAD_SLEEP_DURATION   50                  // ms
-
 #ifdef XPL_PLATFORM_WINDOWS
 #include <windows.h>
 #include <process.h>
@@ -56,6 +54,9 @@ typedef enum thread_state {
     ts_status_max          = ts_terminate_request
 } thread_state_t;
 
+// Threads park on state_changed whenever there is nothing to run, and every
+// state change wakes them, so idle threads cost nothing and a start request is
+// picked up immediately.
 typedef struct thread_info {
     xpl_thread_id                   id;
     xpl_thread_work_function        work_function;
@@ -65,6 +66,7 @@ typedef struct thread_info {
     thread_calls_counter_t          calls;
     thread_t                        thread;
     xpl_mutex_t						*thread_mutex;
+    xpl_condition_t                 *state_changed;
     void                            *local_data;
 } thread_info_t;
 
@@ -150,12 +152,10 @@ void unlock_thread(xpl_thread_id tid) {
     xpl_mutex_leave(ctx->thread_pool[tid].thread_mutex);
 }
 
-int get_thread_state(xpl_thread_id tid) {
-    assert(ctx);
-    assert(tid >= 0);
-    assert(tid < ctx->thread_pool_size);
-    
-    return ctx->thread_pool[tid].state;
+// Caller holds the thread's lock.
+void set_thread_state_locked(xpl_thread_id tid, int value) {
+    ctx->thread_pool[tid].state = value;
+    xpl_condition_broadcast(ctx->thread_pool[tid].state_changed);
 }
 
 int test_and_set_thread_state(xpl_thread_id tid, int condition, int value) {
@@ -167,7 +167,7 @@ int test_and_set_thread_state(xpl_thread_id tid, int condition, int value) {
     
     int result = ctx->thread_pool[tid].state;
     if (result & condition) {
-        ctx->thread_pool[tid].state = value;
+        set_thread_state_locked(tid, value);
         result = value;
     }
     
@@ -189,11 +189,6 @@ void call_work_function_for_thread(xpl_thread_id tid) {
 #ifdef XPL_PLATFORM_WINDOWS
         InterlockedIncrement(&ctx->thread_pool[tid].calls);
 #else
-        /*
-        lock_thread(tid);
-        ctx->thread_pool[tid].calls++;
-        unlock_thread(tid);
-         */
         xpl_atomic_increment(&ctx->thread_pool[tid].calls);
 #endif
     }
@@ -210,31 +205,34 @@ void call_finalize_function_for_thread(xpl_thread_id tid) {
     }
 }
 
+// Called and returns with the thread locked.
 void callback_handle_status(xpl_thread_id tid, int status) {
-    int result = ts_unassigned;
     switch (status) {
         case ts_running_request:
-            result = test_and_set_thread_state(tid, ts_running_request, ts_running);
-            if (result != ts_running) {
-                // sleep it off and try again later
-                xpl_thread_sleep(THREAD_SLEEP_DURATION);
-                break;
-            }
+            set_thread_state_locked(tid, ts_running);
+            unlock_thread(tid);
             associate_local_data_with_thread(tid);
-            // no break
+            lock_thread(tid);
+            break;
             
         case ts_running:
+            // The work function is called repeatedly for as long as the thread runs.
+            unlock_thread(tid);
             call_work_function_for_thread(tid);
-            xpl_thread_yield();
+            lock_thread(tid);
             break;
             
         case ts_unassign_request:
+            unlock_thread(tid);
             call_finalize_function_for_thread(tid);
-            test_and_set_thread_state(tid, ts_unassign_request, ts_unassigned);
-            // no break
+            lock_thread(tid);
+            if (ctx->thread_pool[tid].state == ts_unassign_request) {
+                set_thread_state_locked(tid, ts_unassigned);
+            }
+            break;
             
         default:
-            xpl_thread_sleep(THREAD_SLEEP_DURATION);
+            xpl_condition_wait(ctx->thread_pool[tid].state_changed, ctx->thread_pool[tid].thread_mutex, -1);
             break;
     }
 }
@@ -244,11 +242,13 @@ thread_callback_t XPLCALL thread_callback(void *param) {
     
     xpl_thread_id tid = *(xpl_thread_id *)param;
     
-    int state = get_thread_state(tid);
+    lock_thread(tid);
+    int state = ctx->thread_pool[tid].state;
     while (state != ts_terminate_request) {
         callback_handle_status(tid, state);
-        state = get_thread_state(tid);
+        state = ctx->thread_pool[tid].state;
     }
+    unlock_thread(tid);
     
 #ifdef XPL_PLATFORM_WINDOWS
     _endthreadex(0);
@@ -268,10 +268,12 @@ void create_thread(size_t i) {
 	ctx->thread_pool[i].thread              = INVALID_THREAD;
 	ctx->thread_pool[i].local_data          = NULL;
 	
-	// Initialize the thread's critical section
+	// Initialize the thread's critical section and wakeup condition
 	ctx->thread_pool[i].thread_mutex = xpl_mutex_new();
+	ctx->thread_pool[i].state_changed = xpl_condition_new();
 	if ((ctx->thread_pool[i].thread_mutex == NULL) ||
-		(!xpl_mutex_is_valid(ctx->thread_pool[i].thread_mutex))) {
+		(!xpl_mutex_is_valid(ctx->thread_pool[i].thread_mutex)) ||
+		(ctx->thread_pool[i].state_changed == NULL)) {
 		// Thread allocation failed here. Remember this and quit trying.
 		LOG_ERROR("Failed to create mutex %lu", (long unsigned)i);
 		ctx->thread_pool_size = i;
@@ -308,24 +310,16 @@ void cleanup(bool wait_for_termination) {
         test_and_set_thread_state(i, ts_all, ts_terminate_request);
     }
     
-#ifndef XPL_PLATFORM_WINDOWS
-    struct timespec join_delay;
-    join_delay.tv_sec = 1;
-#endif
-    
     for (xpl_thread_id i = 0; i < ctx->thread_pool_size; ++i) {
 #ifdef XPL_PLATFORM_WINDOWS
         WaitForSingleObject(ctx->thread_pool[i].thread, wait_for_termination ? INFINITE : 1000);
         CloseHandle(ctx->thread_pool[i].thread);
 #else
-        if (wait_for_termination) {
-            pthread_join(ctx->thread_pool[i].thread, NULL);
-        } else {
-            pthread_timedjoin_np(ctx->thread_pool[i].thread, NULL, &join_delay);
-        }
-        
-        pthread_detach(ctx->thread_pool[i].thread);
+        // Parked threads wake on the terminate request, so this only waits for
+        // work functions that are still running.
+        pthread_join(ctx->thread_pool[i].thread, NULL);
 #endif
+        xpl_condition_destroy(&ctx->thread_pool[i].state_changed);
         xpl_mutex_destroy(&ctx->thread_pool[i].thread_mutex);
     }
     
@@ -416,19 +410,17 @@ xpl_thread_id xpl_thread_assign_work(xpl_thread_work_function work_func, xpl_thr
     
     xpl_mutex_enter(ctx->singleton_mutex);
     {
-        for (xpl_thread_id i = 0; i < ctx->thread_pool_size; ++i) {
+        for (xpl_thread_id i = 0; i < ctx->thread_pool_size && id == XPL_THREAD_INVALID; ++i) {
+            lock_thread(i);
             if (ctx->thread_pool[i].state == ts_unassigned) {
                 id = i;
-                break;
+                ctx->thread_pool[id].work_function      = work_func;
+                ctx->thread_pool[id].finalize_function  = finalize_func;
+                ctx->thread_pool[id].calls              = 0;
+                ctx->thread_pool[id].local_data         = thread_local_data;
+                set_thread_state_locked(id, ts_stopped);
             }
-        }
-        
-        if (id != XPL_THREAD_INVALID) {
-            ctx->thread_pool[id].state              = ts_stopped;
-            ctx->thread_pool[id].work_function      = work_func;
-            ctx->thread_pool[id].finalize_function  = finalize_func;
-            ctx->thread_pool[id].calls              = 0;
-            ctx->thread_pool[id].local_data         = thread_local_data;
+            unlock_thread(i);
         }
     }
     xpl_mutex_leave(ctx->singleton_mutex);
@@ -451,12 +443,17 @@ bool xpl_thread_unassign_block(xpl_thread_id tid, int timeout) {
     assert(ctx);
     assert(is_primary_thread());
     
-    int state;
-    for (int t = 0; t < timeout; t += 100) {
-        state = test_and_set_thread_state(tid, ~ts_unassigned, ts_unassign_request);
-        if (state == ts_unassigned) break;
-        xpl_thread_sleep(100);
+    test_and_set_thread_state(tid, ~ts_unassigned, ts_unassign_request);
+    
+    lock_thread(tid);
+    double deadline = xpl_get_time() + timeout / 1000.0;
+    while (ctx->thread_pool[tid].state != ts_unassigned) {
+        int remaining = (int)((deadline - xpl_get_time()) * 1000.0);
+        if (remaining <= 0) break;
+        xpl_condition_wait(ctx->thread_pool[tid].state_changed, ctx->thread_pool[tid].thread_mutex, remaining);
     }
+    int state = ctx->thread_pool[tid].state;
+    unlock_thread(tid);
     
     return state == ts_unassigned;
 }
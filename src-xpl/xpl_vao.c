@@ -73,6 +73,9 @@ xpl_vao_t *xpl_vao_clone(const xpl_vao_t *old_vao) {
 		if (!vattrib->enabled) {
 			xpl_vao_disable_vertex_attrib(new_vao, vattrib->name);
 		}
+		if (vattrib->divisor) {
+			xpl_vao_set_vertex_attrib_divisor(new_vao, vattrib->name, vattrib->divisor);
+		}
 	}
 
 	new_vao->do_teardown = old_vao->do_teardown;
@@ -169,6 +172,21 @@ void xpl_vao_disable_vertex_attrib(xpl_vao_t *vao, const char *name) {
 	va->configured = 0;
 }
 
+void xpl_vao_set_vertex_attrib_divisor(xpl_vao_t *vao, const char *name, GLuint divisor) {
+	assert(vao);
+
+	xpl_vertex_attrib_t *va = xpl_vao_get_vertex_attrib(vao, name);
+	if (!va) return;
+#ifdef XPL_GLES
+	if (divisor) {
+		LOG_ERROR("Vertex attribute divisors aren't supported on GLES; %s stays per-vertex", name);
+		return;
+	}
+#endif
+	va->divisor = divisor;
+	va->configured = 0;
+}
+
 xpl_bo_t *xpl_vao_set_index_buffer(xpl_vao_t *vao, int buffer_index,
 								   xpl_bo_t *ibo) {
 	assert(vao);
@@ -214,6 +232,9 @@ static void vao_prepare_program_draw(xpl_vao_t *vao, xpl_shader_t *shader) {
 			if (! el->configured) {
 				glBindBuffer(GL_ARRAY_BUFFER, el->vbo_source->bo_id);
 				glVertexAttribPointer(va_id, el->size, el->type, el->normalize, el->stride, (GLvoid *)(intptr_t)el->offset);
+#ifndef XPL_GLES
+				glVertexAttribDivisor(va_id, el->divisor);
+#endif
 				glEnableVertexAttribArray(va_id);
 				el->configured = 1;
 			}
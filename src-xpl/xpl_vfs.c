@@ -0,0 +1,237 @@
+//
+//  xpl_vfs.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-22.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "uthash.h"
+
+#include "xpl.h"
+#include "xpl_file.h"
+#include "xpl_vfs.h"
+
+#if defined(XPL_PLATFORM_WINDOWS)
+#	include <windows.h>
+#else
+#	include <dirent.h>
+#	include <sys/stat.h>
+#endif
+
+#define VFS_SCAN_DEPTH_MAX 8
+
+// Layout written by build/scripts/resource_pack_update.rb (little-endian).
+#define VFS_PACK_MAGIC "XPK1"
+
+typedef struct vfs_pack_header {
+	char magic[4];
+	uint32_t entry_count;
+	uint32_t names_size;
+	uint32_t reserved;
+} vfs_pack_header_t;
+
+typedef struct vfs_pack_entry {
+	uint32_t name_offset;
+	uint32_t data_offset;
+	uint32_t length;
+} vfs_pack_entry_t;
+
+typedef struct vfs_entry {
+	char *name;
+	xpl_vfs_location_t location;
+	size_t pack_offset;
+	size_t pack_length;
+
+	UT_hash_handle hh;
+} vfs_entry_t;
+
+static bool indexed = false;
+static vfs_entry_t *vfs_index = NULL;
+static xpl_file_mapping_t *pack = NULL;
+
+static vfs_entry_t *index_find(const char *name) {
+	vfs_entry_t *entry;
+	HASH_FIND_STR(vfs_index, name, entry);
+	return entry;
+}
+
+static vfs_entry_t *index_add(const char *name, xpl_vfs_location_t location) {
+	vfs_entry_t *entry = index_find(name);
+	if (entry) return entry;
+
+	entry = xpl_calloc_type(vfs_entry_t);
+	entry->name = strdup(name);
+	entry->location = location;
+	HASH_ADD_KEYPTR(hh, vfs_index, entry->name, strlen(entry->name), entry);
+	return entry;
+}
+
+#if defined(XPL_PLATFORM_WINDOWS)
+static void index_directory(const char *root, const char *relative, xpl_vfs_location_t location, int depth) {
+	if (depth > VFS_SCAN_DEPTH_MAX) return;
+
+	char pattern[PATH_MAX];
+	snprintf(pattern, PATH_MAX, "%s%s*", root, relative);
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(pattern, &data);
+	if (find == INVALID_HANDLE_VALUE) return;
+
+	do {
+		if (data.cFileName[0] == '.') continue;
+		char child[PATH_MAX];
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			snprintf(child, PATH_MAX, "%s%s/", relative, data.cFileName);
+			index_directory(root, child, location, depth + 1);
+		} else {
+			snprintf(child, PATH_MAX, "%s%s", relative, data.cFileName);
+			index_add(child, location);
+		}
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+}
+#else
+static void index_directory(const char *root, const char *relative, xpl_vfs_location_t location, int depth) {
+	if (depth > VFS_SCAN_DEPTH_MAX) return;
+
+	char path[PATH_MAX];
+	snprintf(path, PATH_MAX, "%s%s", root, relative);
+	DIR *dir = opendir(path);
+	if (! dir) return;
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir))) {
+		if (dirent->d_name[0] == '.') continue;
+		char child[PATH_MAX];
+		struct stat st;
+		snprintf(child, PATH_MAX, "%s%s", relative, dirent->d_name);
+		snprintf(path, PATH_MAX, "%s%s", root, child);
+		if (stat(path, &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) {
+			snprintf(child, PATH_MAX, "%s%s/", relative, dirent->d_name);
+			index_directory(root, child, location, depth + 1);
+		} else {
+			index_add(child, location);
+		}
+	}
+
+	closedir(dir);
+}
+#endif
+
+static bool pack_validate(const xpl_file_mapping_t *mapping) {
+	const vfs_pack_header_t *header = (const vfs_pack_header_t *)mapping->content;
+	if (mapping->length < sizeof(vfs_pack_header_t)) return false;
+	if (memcmp(header->magic, VFS_PACK_MAGIC, sizeof(header->magic))) return false;
+
+	size_t names_offset = sizeof(vfs_pack_header_t) + header->entry_count * sizeof(vfs_pack_entry_t);
+	if (names_offset + header->names_size > mapping->length) return false;
+	if (header->names_size && mapping->content[names_offset + header->names_size - 1] != '\0') return false;
+
+	const vfs_pack_entry_t *entries = (const vfs_pack_entry_t *)(mapping->content + sizeof(vfs_pack_header_t));
+	for (uint32_t i = 0; i < header->entry_count; ++i) {
+		if (entries[i].name_offset >= header->names_size) return false;
+		if ((size_t)entries[i].data_offset + entries[i].length > mapping->length) return false;
+	}
+	return true;
+}
+
+static void index_pack(void) {
+	char pack_file[PATH_MAX];
+	xpl_resource_path(pack_file, XPL_VFS_PACK_RESOURCE, PATH_MAX);
+	pack = xpl_file_map(pack_file);
+	if (! pack) return;
+
+	if (! pack_validate(pack)) {
+		LOG_WARN("Resource pack %s is invalid; ignoring", pack_file);
+		xpl_file_unmap(&pack);
+		return;
+	}
+
+	const vfs_pack_header_t *header = (const vfs_pack_header_t *)pack->content;
+	const vfs_pack_entry_t *entries = (const vfs_pack_entry_t *)(pack->content + sizeof(vfs_pack_header_t));
+	const char *names = (const char *)(entries + header->entry_count);
+	for (uint32_t i = 0; i < header->entry_count; ++i) {
+		vfs_entry_t *entry = index_add(names + entries[i].name_offset, XPL_VFS_PACK);
+		// Loose app resources override the pack, so single files can be patched.
+		if (entry->location == XPL_VFS_APP_RESOURCE) continue;
+		entry->location = XPL_VFS_PACK;
+		entry->pack_offset = entries[i].data_offset;
+		entry->pack_length = entries[i].length;
+	}
+	LOG_INFO("Resource pack %s: %u entries", pack_file, header->entry_count);
+}
+
+void xpl_vfs_init(void) {
+	if (indexed) return;
+	indexed = true;
+
+	char root[PATH_MAX];
+
+	xpl_resource_path(root, "", PATH_MAX);
+	index_directory(root, "", XPL_VFS_APP_RESOURCE, 0);
+	index_pack();
+	xpl_library_resource_path(root, "", PATH_MAX);
+	index_directory(root, "", XPL_VFS_LIBRARY_RESOURCE, 0);
+	xpl_dev_resource_path(root, "", PATH_MAX);
+	index_directory(root, "", XPL_VFS_DEV_RESOURCE, 0);
+
+	LOG_INFO("Indexed %u resources", HASH_COUNT(vfs_index));
+}
+
+void xpl_vfs_shutdown(void) {
+	vfs_entry_t *entry, *tmp;
+	HASH_ITER(hh, vfs_index, entry, tmp) {
+		HASH_DEL(vfs_index, entry);
+		free(entry->name); // strdup
+		xpl_free(entry);
+	}
+	if (pack) xpl_file_unmap(&pack);
+	indexed = false;
+}
+
+void xpl_vfs_invalidate(void) {
+	xpl_vfs_shutdown();
+}
+
+xpl_vfs_location_t xpl_vfs_locate(const char *resource_name) {
+	xpl_vfs_init();
+	// An empty index means none of the resource paths could be read; probe instead.
+	if (! vfs_index) return XPL_VFS_UNINDEXED;
+
+	char name[PATH_MAX];
+	xpl_create_generic_path(name, resource_name, PATH_MAX);
+	vfs_entry_t *entry = index_find(name);
+	return entry ? entry->location : XPL_VFS_NOT_FOUND;
+}
+
+xpl_file_mapping_t *xpl_vfs_map(const char *resource_name) {
+	if (xpl_vfs_locate(resource_name) == XPL_VFS_PACK) {
+		char name[PATH_MAX];
+		xpl_create_generic_path(name, resource_name, PATH_MAX);
+		vfs_entry_t *entry = index_find(name);
+		return xpl_file_mapping_slice(pack, entry->pack_offset, entry->pack_length);
+	}
+
+	char path[PATH_MAX];
+	if (! xpl_resolve_resource(path, resource_name, PATH_MAX)) return NULL;
+	return xpl_file_map(path);
+}
+
+bool xpl_vfs_get_contents(const char *resource_name, xpl_dynamic_buffer_t *buffer) {
+	xpl_file_mapping_t *mapping = xpl_vfs_map(resource_name);
+	if (! mapping) {
+		LOG_ERROR("Couldn't open resource %s", resource_name);
+		return false;
+	}
+	xpl_dynamic_buffer_append(buffer, mapping->content, mapping->length);
+	xpl_dynamic_buffer_append(buffer, (const unsigned char *)"", 1);
+	buffer->length--;
+	xpl_file_unmap(&mapping);
+	return true;
+}
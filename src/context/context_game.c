@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 
 #include "xpl.h"
@@ -36,10 +37,12 @@
 #include "game/game.h"
 #include "game/hotspots.h"
 #include "game/layout.h"
+#include "game/match.h"
 #include "game/packet.h"
 #include "game/palette.h"
 #include "game/prefs.h"
 #include "game/projectile_config.h"
+#include "game/replay.h"
 #include "game/sprites.h"
 #include "game/util.h"
 
@@ -80,10 +83,6 @@ typedef struct log {
 
 #define THRUST			2.0f
 #define TORQUE			192.0f
-#define INITIAL_HEALTH	255
-
-#define SPAWN_BOX		1024
-
 #define DEFAULT_SCANLINE	0.7f
 
 #define UI_FONT			"Chicago"
@@ -149,6 +148,19 @@ static uint32_t							packet_seq = 0;
 static int								sock;
 static UDPNET_ADDRESS					*server_addr = NULL;
 
+// Replays
+static bool								replay_record;
+static replay_writer_t					*replay_writer = NULL;
+static replay_reader_t					*replay_reader = NULL;
+static double							replay_time;
+static bool								replay_has_pending;
+static replay_record_t					replay_pending;
+static uint8_t							replay_datagram[REPLAY_DATAGRAM_MAX];
+
+// Spectating
+static bool								spectating;
+static watch_t							spectate_watch;
+
 // Text
 static log_t							ui_log;
 static xpl_text_cache_t					*name_cache;
@@ -193,12 +205,15 @@ static void packet_handle_hello(uint16_t client_id, packet_t *packet);
 static void packet_handle_goodbye(uint16_t client_id, packet_t *packet);
 static void packet_handle_player(uint16_t client_id, packet_t *packet);
 static void packet_handle_projectile(uint16_t client_id, packet_t *packet);
+static void packet_handle_watch(uint16_t client_id, packet_t *packet);
 static void packet_receive(void);
+static bool packet_receive_datagram(uint8_t *buffer, size_t length);
 static void packet_send(packet_t *packet);
 static void packet_send_chat(void);
 static void packet_send_hello(void);
 static void packet_send_player(void);
 static void packet_send_projectile(int i);
+static void packet_send_watch(void);
 
 static void particle_add(position_t position, xvec2 velocity, xvec4 color, int size, float life, bool color_decay);
 static int particle_find_new(void);
@@ -209,6 +224,7 @@ static void player_add_thrust_particle(int i);
 static void player_add_explode_effect(int i);
 static xvec2 player_calculate_oriented_thrust(int i);
 static xvec2 player_get_direction_vector(int i);
+static void player_audio_init(int i);
 static void player_init(int i);
 static void player_local_connect(void);
 static void player_local_disconnect(void);
@@ -220,7 +236,6 @@ static void player_local_update_rotation(double time);
 static void player_local_update_thrust(double time);
 static void player_local_update_weapon(void);
 static const char *player_name(int i, bool as_object);
-static void player_update_position(int i, double timestep);
 static int player_with_client_id_get(uint16_t client_id, bool allow_allocate, bool *was_new_player);
 static xvec2 player_v2velocity_get(int i);
 
@@ -228,10 +243,16 @@ static void projectile_add(void);
 static void projectile_explode_effect(int pi, int target);
 static bool projectile_type_is_mine(int type);
 static void projectile_update(int i, bool jiffy_elapsed, double time);
-static int projectile_with_pid_get(uint16_t pid, int ti, bool allow_dead, bool *was_new);
+
+static void replay_advance(double time);
+static void replay_playback_start(const char *name);
+static void replay_recording_start(void);
 
 static void server_resolve_addr(void);
 
+static void spectate_start(void);
+static void spectate_update(double time);
+
 static void text_particle_add(position_t position, xvec2 velocity, const char *text, xvec4 color, float life);
 static int text_particle_find_new(void);
 static void text_particle_update(int i, double time);
@@ -255,23 +276,14 @@ static xvec3 v3_relative_audio(position_t position);
 // ------------------------------------------------------------------------------
 
 
-static xvec4 color_variant(uint32_t color, float variance) {
-	xvec4 max = RGBA_F(color);
-	xvec4 min = xvec4_scale(max, 1.0 - variance);
-	return xvec4_set(xpl_frand_range(min.r, max.r),
-					 xpl_frand_range(min.g, max.g),
-					 xpl_frand_range(min.b, max.b),
-					 xpl_frand_range(min.a, max.a));
-}
-
-// ------------------------------------------------------------------------------
-
 static void game_destroy(xpl_context_t *self, void *data) {
 	xpl_imui_context_destroy(&imui);
 	xpl_imui_theme_destroy(&theme);
 	
 	xpl_input_disable_keyboard();
 	
+	replay_writer_destroy(&replay_writer);
+	replay_reader_destroy(&replay_reader);
 	udp_socket_exit();
 }
 
@@ -291,6 +303,14 @@ static void game_engine(xpl_context_t *self, double time, void *data) {
 	
 	network.latency_time += time;
 	
+	if (replay_reader) {
+		replay_advance(time);
+	}
+	
+	if (spectating) {
+		spectate_update(time);
+	}
+	
 	if (game.player_connected[0]) {
 		scanline_strength = DEFAULT_SCANLINE;
 		
@@ -401,7 +421,7 @@ static void game_engine(xpl_context_t *self, double time, void *data) {
 		for (int i = 0; i < MAX_PLAYERS; ++i) {
 			if (! game.player_connected[i]) continue;
 			
-			player_update_position(i, time);
+			match_player_move(i, time / timestep);
 			//			LOG_DEBUG("%d: %u,%u", i, game.player[i].position.px, game.player[i].position.py);
 		}
 		
@@ -458,8 +478,16 @@ static void *game_init(xpl_context_t *self) {
 	
 	strncpy(network.server_host, prefs.server, SERVER_SIZE);
 	strncpy(game.player_id[0].name, prefs.name, NAME_SIZE);
+	game.player_id[0].room = (uint16_t)prefs.room;
 	network.server_port = prefs.port;
 	
+	replay_record = prefs.record_replay;
+	if (strlen(prefs.replay)) {
+		replay_playback_start(prefs.replay);
+	} else if (prefs.spectate) {
+		spectate_start();
+	}
+	
 	float ratio = xmax(1024 / self->size.width, 1.0);
 
 	camera.dc = xirect_set(0, 0, self->size.width, self->size.height);
@@ -709,10 +737,12 @@ static void game_render_ui(xpl_context_t *self) {
 static void game_reset(void) {
 	char name[NAME_SIZE];
 	strncpy(name, game.player_id[0].name, NAME_SIZE);
+	uint16_t room = game.player_id[0].room;
 	
 	memset(&game, 0, sizeof(game));
 	
 	strncpy(game.player_id[0].name, name, NAME_SIZE);
+	game.player_id[0].room = room;
 	
 	chat_showing = false;
 }
@@ -792,6 +822,10 @@ static void packet_handle(uint16_t client_id, packet_t *packet) {
 			packet_handle_chat(client_id, packet);
 			break;
 			
+		case pt_watch:
+			packet_handle_watch(client_id, packet);
+			break;
+			
 		default:
 			break;
 	}
@@ -812,7 +846,7 @@ static void packet_handle_damage(uint16_t client_id, packet_t *packet) {
 	
 	int origin = player_with_client_id_get(packet->damage.player_id, false, NULL);
 	int target = player_with_client_id_get(client_id, false, NULL);
-	int projectile = projectile_with_pid_get(packet->damage.projectile_id, -1, true, NULL);
+	int projectile = match_projectile_slot(packet->damage.projectile_id, -1, true, NULL);
 
 	xvec2 velocity = xvec2_from_polar(xpl_frand() * 64.f, xpl_frand() * M_2PI);
 	xvec4 color = RGBA_F(0x80ffc0a0);
@@ -846,15 +880,13 @@ static void packet_handle_damage(uint16_t client_id, packet_t *packet) {
 	
 	if (packet->damage.flags & DAMAGE_FLAG_EXPLODES) {
 		player_add_explode_effect(target);
-		game.player_local[target].visible = false;
 		log_add_text("%s %s %s", player_name(origin, false), random_word("destroyed"), player_name(target, origin == target));
 	}
 	
-	// Destroys projectile, including mines.
 	if (projectile >= 0) {
 		projectile_explode_effect(projectile, target);
-		game.projectile[projectile].health = 0;
 	}
+	match_damage(origin, target, projectile, &packet->damage);
 	
 	if (origin == 0 && target != 0) {
 		if (packet->damage.flags & DAMAGE_FLAG_EXPLODES) {
@@ -862,12 +894,19 @@ static void packet_handle_damage(uint16_t client_id, packet_t *packet) {
 			game.combo_start_audio = true;
 			game.combo_timeout = COMBO_TIMEOUT;
 		}
-		game.player[0].score += packet->damage.amount;
 		packet_send_player();
 	}
 }
 
 static void packet_handle_hello(uint16_t client_id, packet_t *packet) {
+	if (client_id == 0 && packet->hello.cookie && packet->hello.nonce == game.player_id[0].nonce) {
+		// The server wants its cookie back before it'll take us in.
+		game.player_id[0].cookie = packet->hello.cookie;
+		network.hello_timeout = HELLO_TIMEOUT;
+		packet_send_hello();
+		return;
+	}
+	
 	if (client_id == 0) {
 		ui_error_packet_set(pe_client_id);
 		return;
@@ -878,15 +917,16 @@ static void packet_handle_hello(uint16_t client_id, packet_t *packet) {
 		// This is a welcome packet
 		if (game.player_id[0].nonce == packet->hello.nonce) {
 			LOG_DEBUG("Matching nonce, logged in");
-			game.player_id[0] = packet->hello;
+			match_player_join(0, &packet->hello);
 			player_init(0);
 			log_add_text("You have %s the %s", random_word("joined"), random_word("battle"));
 		}
 	} else {
 		// This is a notify packet
 		int pi = player_with_client_id_get(packet->hello.client_id, true, &was_new);
+		if (pi == -1) return;
 		bool had_name = !! strlen(game.player_id[pi].name);
-		game.player_id[pi] = packet->hello;
+		match_player_join(pi, &packet->hello);
 		LOG_DEBUG("Player alive: %s %u", player_name(pi, false), game.player_id[pi].client_id);
 		if (was_new || !had_name) {
 			log_add_text("%s has joined", player_name(pi, false));
@@ -902,8 +942,7 @@ static void packet_handle_goodbye(uint16_t client_id, packet_t *packet) {
 	}
 	LOG_DEBUG("Player leaving: %s %u", player_name(pi, false), game.player_id[pi].client_id);
 	log_add_text("%s quit", player_name(pi, false));
-	game.player_connected[pi] = false;
-	memset(&game.player_id[pi], 0, sizeof(player_id_t));
+	match_player_leave(pi);
 	player_add_explode_effect(pi);
 	
 }
@@ -911,6 +950,7 @@ static void packet_handle_goodbye(uint16_t client_id, packet_t *packet) {
 static void packet_handle_player(uint16_t client_id, packet_t *packet) {
 	LOG_DEBUG("Updating player %d", client_id);
 	int pi = player_with_client_id_get(client_id, true, NULL);
+	if (pi == -1) return;
 	if (pi == 0) {
 		double this_latency = network.latency_time - network.latency_timestamp;
 		double sum = network.latency + this_latency;
@@ -927,10 +967,9 @@ static void packet_handle_player(uint16_t client_id, packet_t *packet) {
 		// Assume remote latency is same as local.
 		game.player_local[pi].latency = network.latency;
 
-		game.player_local[pi].visible = true;
-		game.player[pi] = packet->player;
+		match_player_set(pi, &packet->player);
 		LOG_DEBUG("New remote latency: %f", game.player_local[pi].latency);
-		player_update_position(pi, game.player_local[pi].latency);
+		match_player_move(pi, game.player_local[pi].latency / timestep);
 	}
 }
 
@@ -941,20 +980,27 @@ static void packet_handle_projectile(uint16_t client_id, packet_t *packet) {
 		return;
 	}
 	bool is_new;
-	int pi = projectile_with_pid_get(packet->projectile.pid, packet->projectile.type, false, &is_new);
-	game.projectile_local[pi].owner = client_id;
-	game.projectile[pi] = packet->projectile;
+	int type = packet->projectile.type;
+	if (type >= projectile_type_count) return; // drop
+	int pi = match_projectile_slot(packet->projectile.pid, type, false, &is_new);
+	if (pi == -1) return;
+	match_projectile_set(pi, client_id, &packet->projectile);
 	LOG_DEBUG("Projectile: %u, %u", game.projectile[pi].position.px, game.projectile[pi].position.py);
 	if (is_new) {
-		int type = game.projectile[pi].type;
-		
-		if (type < 0 || type >= projectile_type_count) return; // drop
-		
 		audio_quickplay_position(projectile_config[type].fire_effect, FIRE_VOLUME, v3_relative_audio(game.projectile[pi].position));
 	}
 	projectile_update(pi, false, network.latency);
 }
 
+static void packet_handle_watch(uint16_t client_id, packet_t *packet) {
+	// The only watch we get back is a challenge.
+	if (! spectating || client_id != 0 || ! packet->watch.cookie ||
+		packet->watch.nonce != spectate_watch.nonce) return;
+	spectate_watch.cookie = packet->watch.cookie;
+	network.hello_timeout = HELLO_TIMEOUT;
+	packet_send_watch();
+}
+
 
 static void packet_receive(void) {
 	
@@ -979,18 +1025,34 @@ static void packet_receive(void) {
 		if (strcmp(receive_addr.address, server_addr->address) != 0) {
 			LOG_WARN("Discarding packet from unknown host %s", receive_addr.address);
 		}
-		uint16_t packet_source;
-		packet_t packet;
-		if (! packet_decode(&packet, &packet_source, buffer)) {
+		if (replay_writer) replay_write(replay_writer, buffer, (size_t)n);
+		if (! packet_receive_datagram(buffer, (size_t)n)) {
 			ui_error_set("Invalid response from server.");
 			player_local_disconnect();
 		} else {
 			network.receive_timeout = RECEIVE_TIMEOUT;
-			packet_handle(packet_source, &packet);
 		}
 	}
 }
 
+// The server may pack several packets into one datagram (e.g. the snapshot
+// sent on joining). Stops at the first that doesn't decode.
+static bool packet_receive_datagram(uint8_t *buffer, size_t length) {
+	size_t offset = 0;
+	while (offset < length) {
+		packet_header_t header;
+		uint16_t packet_source;
+		packet_t packet;
+		if (! packet_decode_header(&header, buffer + offset, length - offset) ||
+			! packet_decode(&packet, &packet_source, buffer + offset)) {
+			return false;
+		}
+		packet_handle(packet_source, &packet);
+		offset += packet_size(header.type);
+	}
+	return true;
+}
+
 
 static void packet_send(packet_t *packet) {
 	if (! server_addr) {
@@ -1106,6 +1168,14 @@ static void packet_send_projectile(int i) {
 	packet_send(&packet);
 }
 
+static void packet_send_watch(void) {
+	packet_t packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.type = pt_watch;
+	packet.watch = spectate_watch;
+	packet_send(&packet);
+}
+
 // ------------------------------------------------------------------------------
 
 static void particle_add(position_t position, xvec2 velocity, xvec4 color, int size, float life, bool color_decay) {
@@ -1210,16 +1280,7 @@ static xvec2 player_get_direction_vector(int i) {
 	return r;
 }
 
-static void player_init(int i) {
-	game.player[i].position.px = (PLAYFIELD_MAX / 2) + SPAWN_BOX * xpl_frand() - (SPAWN_BOX / 2);
-	game.player[i].position.py = (PLAYFIELD_MAX / 2) + SPAWN_BOX * xpl_frand() - (SPAWN_BOX / 2);
-	game.player[i].health = INITIAL_HEALTH;
-	game.player[i].orientation = xpl_irand_range(0, UINT8_MAX);
-	game.player_local[i].visible = false;
-
-	game.player[i].velocity.dx = 0;
-	game.player[i].velocity.dy = 0;
-	
+static void player_audio_init(int i) {
 	if (! game.player_local[i].rotate_audio) {
 		game.player_local[i].rotate_audio = audio_create("rotate", false);
 		game.player_local[i].rotate_audio->volume = ROTATE_VOLUME;
@@ -1235,7 +1296,11 @@ static void player_init(int i) {
 			game.player_local[i].thrust_audio->loop = true;
 		}
 	}
+}
 
+static void player_init(int i) {
+	match_player_spawn(i);
+	player_audio_init(i);
 	
 #ifdef DEBUG
 	game.player[0].score = 500;
@@ -1245,16 +1310,23 @@ static void player_init(int i) {
 }
 
 static void player_local_connect(void) {
+	if (spectating) {
+		spectating = false;
+		replay_writer_destroy(&replay_writer);
+		game_reset();
+	}
 	game.player_id[0].nonce = xpl_irand_range(0, UINT16_MAX);
 	game.player_connected[0] = true;
 	game.combo_count = 0;
 	game.combo_timeout = 0.0;
 	network.hello_timeout = 0.f;
 	network.receive_timeout = RECEIVE_TIMEOUT;
+	if (replay_record && ! replay_reader) replay_recording_start();
 }
 
 static void player_local_disconnect(void) {
 	game.player_connected[0] = false;
+	replay_writer_destroy(&replay_writer);
 	game_reset();
 }
 
@@ -1444,66 +1516,23 @@ static const char *player_name(int i, bool as_object) {
 }
 
 
-static void player_update_position(int i, double time) {
-	xvec2 velocity = xvec2_set(game.player[i].velocity.dx / VELOCITY_SCALE,
-							   game.player[i].velocity.dy / VELOCITY_SCALE);
-	double scale = time / timestep;
-	if (scale < 0.f || scale > 1.f) {
-		LOG_DEBUG("Projecting %f ticks", scale);
-	}
-	velocity = xvec2_scale(velocity, scale);
-	
-	game.player_position_buffer[i] = xvec2_add(game.player_position_buffer[i], velocity);
-	
-	int dx = (int)truncf(game.player_position_buffer[i].x);
-	int dy = (int)truncf(game.player_position_buffer[i].y);
-	if (dx) {
-		game.player[i].position.px += dx;
-		game.player_position_buffer[i].x -= dx;
-	}
-	if (dy) {
-		game.player[i].position.py += dy;
-		game.player_position_buffer[i].y -= dy;
-	}
-	position_mod(&game.player[i].position);
-}
-
 static xvec2 player_v2velocity_get(int i) {
 	return v2_for_velocity(game.player[i].velocity);
 }
 
 static int player_with_client_id_get(uint16_t client_id, bool allow_allocate, bool *was_new_player) {
-	int i;
-	int empty_slot = -1;
-	for (i = 0; i < MAX_PLAYERS; ++i) {
-		if (game.player_connected[i]) {
-			if (game.player_id[i].client_id == client_id) {
-				if (was_new_player) *was_new_player = false;
-				return i;
-			}
-		} else if (empty_slot == -1) {
-			empty_slot = i;
+	bool was_new;
+	int i = match_player_slot(client_id, allow_allocate, &was_new);
+	if (was_new) {
+		if (i == 0) {
+			LOG_ERROR("Self leaving; had better be exiting");
+			ui_error_set("You have disconnected.");
 		}
+		player_audio_init(i);
 	}
 	
-	if (! allow_allocate) {
-		if (was_new_player) *was_new_player = false;
-		return -1;
-	}
-	
-	// Not found. Allocate a player slot.
-	if (empty_slot == 0) {
-		LOG_ERROR("Self leaving; had better be exiting");
-		ui_error_set("You have disconnected.");
-	}
-	
-	game.player_connected[empty_slot] = true;
-	game.player_id[empty_slot].client_id = client_id;
-	player_init(empty_slot);
-	
-	if (was_new_player) *was_new_player = true;
-	
-	return empty_slot;
+	if (was_new_player) *was_new_player = was_new;
+	return i;
 }
 
 
@@ -1521,7 +1550,8 @@ static void projectile_add(void) {
 	xvec2 direction_vector = player_get_direction_vector(0);
 	
 	uint16_t pid = xpl_irand_range(0, UINT16_MAX);
-	int i = projectile_with_pid_get(pid, weapon, false, NULL);
+	int i = match_projectile_slot(pid, weapon, false, NULL);
+	if (i == -1) return;
 	// Add a little margin to get slow projectiles clear of the nose
 	float position = projectile_type_is_mine(weapon) ? -0.7 : 0.7;
 	xvec2 front = xvec2_scale(direction_vector, position * PLAYER_SIZE);
@@ -1580,45 +1610,6 @@ static void projectile_explode_effect(int pi, int target) {
 
 }
 
-static void projectile_initialize(uint16_t pid, int pi, int ti) {
-	game.projectile[pi].pid = pid;
-	game.projectile[pi].health = projectile_config[ti].initial_health;
-	game.projectile[pi].type = (uint8_t)ti;
-	game.projectile_local[pi].trail_timeout = projectile_config[ti].trail_timeout;
-	game.projectile_local[pi].color = color_variant(projectile_config[ti].color, projectile_config[ti].variance);
-	game.projectile_local[pi].force_detonate = false;
-	game.projectile_local[pi].exploded = false;
-}
-
-// Get a projectile. Pass a negative projectile type to prevent creation.
-static int projectile_with_pid_get(uint16_t pid, int ti, bool allow_dead, bool *was_new) {
-	int allocate_index = -1;    
-	for (int i = 0; i < MAX_PROJECTILES; ++i) {
-		if (pid == game.projectile[i].pid) {
-			if (allow_dead) return i;
-			if (game.projectile[i].health > 0) {
-				if (was_new) *was_new = false;
-				return i;
-			} else if (ti >= 0 && allocate_index == -1) {
-				allocate_index = i;
-				break;
-			}
-		} else if (ti >= 0 && allocate_index == -1 && game.projectile[i].health == 0) {
-			allocate_index = i;
-			// can't break, not finished searching for pid
-		}
-	}
-	
-	if (ti >= 0) {
-		projectile_initialize(pid, allocate_index, ti);
-		if (was_new) *was_new = true;
-		return allocate_index;
-	} else {
-		if (was_new) *was_new = false;
-		return -1;
-	}
-}
-
 XPLINLINE bool projectile_type_is_mine(int type) {
 	return projectile_config[type].is_mine;
 }
@@ -1637,36 +1628,11 @@ static void projectile_update(int i, bool jiffy_elapsed, double time) {
 	int64_t pdx, pdy;
 	
 	// Allow non-fixed timestamps so we can do latency compensation
-	xvec2 velocity = xvec2_set(game.projectile[i].velocity.dx / VELOCITY_SCALE,
-							   game.projectile[i].velocity.dy / VELOCITY_SCALE);
-	double scale = time / timestep;
-	velocity = xvec2_scale(velocity, scale);
-
-	game.projectile_position_buffer[i] = xvec2_add(game.projectile_position_buffer[i], velocity);
-	
-	int dx = (int)truncf(game.projectile_position_buffer[i].x);
-	int dy = (int)truncf(game.projectile_position_buffer[i].y);
-	if (dx) {
-		game.projectile[i].position.px += dx;
-		game.projectile_position_buffer[i].x -= dx;
-	}
-	if (dy) {
-		game.projectile[i].position.py += dy;
-		game.projectile_position_buffer[i].y -= dy;
-	}
-	position_mod(&game.projectile[i].position);
-	
+	match_projectile_move(i, time / timestep);
 	
 	float current_explosion_radius = 0.f;
 	if (jiffy_elapsed && ! projectile_type_is("health_kit", type)) {
-		if (projectile_type_is_mine(type) && game.projectile[i].health == 1) {
-			// Mines linger at 1 health
-			game.projectile[i].health++;
-			// They change to trail color when armed
-			game.projectile_local[i].color = color_variant(projectile_config[type].trail_color, projectile_config[type].trail_life);
-		}
-		--game.projectile[i].health;
-		--game.projectile_local[i].trail_timeout;
+		match_projectile_age(i);
 		if (game.projectile_local[i].trail_timeout) {
 			xvec4 trail_color = color_variant(projectile_config[type].trail_color, projectile_config[type].trail_variance);
 			particle_add(game.projectile[i].position, v2_for_velocity(game.projectile[i].velocity),
@@ -1784,6 +1750,73 @@ static void projectile_update(int i, bool jiffy_elapsed, double time) {
 }
 
 
+// ------------------------------------------------------------------------------
+
+// Feeds the replay's datagrams to packet_handle as their time comes round,
+// as if the server had sent them.
+static void replay_advance(double time) {
+	replay_time += time;
+	while (replay_reader) {
+		if (! replay_has_pending) {
+			if (! replay_reader_next(replay_reader, &replay_pending, replay_datagram)) {
+				log_add_text("The replay is over");
+				replay_reader_destroy(&replay_reader);
+				return;
+			}
+			replay_has_pending = true;
+		}
+		if (replay_pending.time_ms > replay_time * 1000.0) return;
+		
+		replay_has_pending = false;
+		if (! packet_receive_datagram(replay_datagram, replay_pending.length)) {
+			LOG_WARN("Skipping a replay datagram that didn't decode");
+		}
+	}
+}
+
+// Recordings are written straight to a file. xpl_data_resource_path is only a
+// real directory on Windows, OS X and iOS; elsewhere they go in $HOME, or the
+// working directory without one.
+static void replay_recording_path(char *path_out, const char *name) {
+#if defined(XPL_PLATFORM_UNIX)
+	const char *home = getenv("HOME");
+	if (home && home[0]) {
+		snprintf(path_out, PATH_MAX, "%s/%s", home, name);
+	} else {
+		snprintf(path_out, PATH_MAX, "%s", name);
+	}
+#else
+	xpl_data_resource_path(path_out, name, PATH_MAX);
+#endif
+}
+
+static void replay_playback_start(const char *name) {
+	char resource[PATH_MAX];
+	if (name[0] == '/') {
+		strncpy(resource, name, PATH_MAX);
+	} else if (! xpl_resolve_resource(resource, name, PATH_MAX)) {
+		replay_recording_path(resource, name);
+	}
+	replay_reader = replay_reader_new(resource);
+	if (! replay_reader) {
+		ui_error_set("Couldn't open the replay.");
+		return;
+	}
+	replay_time = 0.0;
+	replay_has_pending = false;
+	log_add_text("Playing back room %u", replay_reader_header(replay_reader)->room);
+}
+
+static void replay_recording_start(void) {
+	char name[64], path[PATH_MAX];
+	time_t seconds = time(NULL);
+	strftime(name, sizeof(name), "replay-%Y%m%d-%H%M%S" REPLAY_EXTENSION, localtime(&seconds));
+	replay_recording_path(path, name);
+	replay_writer_destroy(&replay_writer);
+	replay_writer = replay_writer_new(path, game.player_id[0].room);
+}
+
+
 // ------------------------------------------------------------------------------
 
 
@@ -1808,6 +1841,34 @@ static void server_resolve_addr(void) {
 }
 
 
+// ------------------------------------------------------------------------------
+
+
+// Spectators only ever send watches, as often as players say hello; the
+// server or relay answers with keyframes and whatever changed between them.
+static void spectate_start(void) {
+	if (! server_addr) {
+		server_resolve_addr();
+	}
+	memset(&spectate_watch, 0, sizeof(spectate_watch));
+	spectate_watch.room = game.player_id[0].room;
+	spectate_watch.nonce = xpl_irand_range(1, UINT16_MAX);
+	spectating = true;
+	network.hello_timeout = 0.f;
+	if (replay_record) replay_recording_start();
+	log_add_text("Watching room %u", spectate_watch.room);
+}
+
+static void spectate_update(double time) {
+	network.hello_timeout -= time;
+	if (network.hello_timeout <= 0.f) {
+		network.hello_timeout = HELLO_TIMEOUT;
+		packet_send_watch();
+	}
+	packet_receive();
+}
+
+
 // ------------------------------------------------------------------------------
 
 static void text_particle_add(position_t position, xvec2 velocity, const char *text, xvec4 color, float life) {
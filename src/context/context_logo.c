@@ -12,6 +12,7 @@
 #include "xpl_text_cache.h"
 #include "xpl_easing.h"
 #include "xpl_rand.h"
+#include "xpl_texture.h"
 
 #include "audio/audio.h"
 #include "models/informi_brick.h"
@@ -182,6 +183,9 @@ static void *init(xpl_context_t *self) {
 		title_bgm->volume = 0.0f;
 	}
 	
+	// Decode the menu's textures while the logo plays.
+	xpl_texture_prefetch("bitmaps/menu.png");
+	
     return NULL;
 }
 
@@ -23,7 +23,9 @@
 
 #include "context/context_menu.h"
 
+#include "game/menu_sprites.h"
 #include "game/prefs.h"
+#include "game/sprites.h"
 
 typedef void(* menu_func)(xpl_app_t *app, xrect area);
 
@@ -101,8 +103,9 @@ static void create_background() {
 	bg_batch = xpl_sprite_batch_new();
 	xpl_sprite_sheet_t *bg_sheet = xpl_sprite_sheet_new(bg_batch, "bitmaps/menu.json");
 	
-	bg_sprite = xpl_sprite_get(bg_sheet, "star.png");
-	up_sprite = xpl_sprite_get(bg_sheet, "tile_up.png");
+	xpl_sprite_sheet_check_signature(bg_sheet, SPRITE_MENU_SIGNATURE);
+	bg_sprite = xpl_sprite_get_id(bg_sheet, SPRITE_MENU_STAR);
+	up_sprite = xpl_sprite_get_id(bg_sheet, SPRITE_MENU_TILE_UP);
 	for (int i = 0; i < BG_PARTICLE_COUNT; ++i) {
 		bg_particle[i] = xvec2_all(-10.f);
 	}
@@ -405,6 +408,7 @@ static void *init(xpl_context_t *self) {
     context_next = self;
     
     app_config = xpl_app_params_load(FALSE);
+    sprites_prefetch();
     
 #ifndef XPL_PLATFORM_IOS
     populate_video_modes();
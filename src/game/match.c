@@ -0,0 +1,237 @@
+//
+//  match.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-12.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+#include "xpl_rand.h"
+
+#include "game/match.h"
+#include "game/projectile_config.h"
+#include "game/util.h"
+
+#define INITIAL_HEALTH	255
+
+#define SPAWN_BOX		1024
+
+// ------------------------------------------------------------------------------
+// Slots
+
+int match_player_slot(uint16_t client_id, bool allow_allocate, bool *was_new) {
+	int empty_slot = -1;
+	for (int i = 0; i < MAX_PLAYERS; ++i) {
+		if (game.player_connected[i]) {
+			if (game.player_id[i].client_id == client_id) {
+				if (was_new) *was_new = false;
+				return i;
+			}
+		} else if (empty_slot == -1) {
+			empty_slot = i;
+		}
+	}
+
+	if (was_new) *was_new = false;
+	if (! allow_allocate || empty_slot == -1) return -1;
+
+	game.player_connected[empty_slot] = true;
+	game.player_id[empty_slot].client_id = client_id;
+	match_player_spawn(empty_slot);
+
+	if (was_new) *was_new = true;
+	return empty_slot;
+}
+
+void match_player_spawn(int i) {
+	game.player[i].position.px = (PLAYFIELD_MAX / 2) + SPAWN_BOX * xpl_frand() - (SPAWN_BOX / 2);
+	game.player[i].position.py = (PLAYFIELD_MAX / 2) + SPAWN_BOX * xpl_frand() - (SPAWN_BOX / 2);
+	game.player[i].health = INITIAL_HEALTH;
+	game.player[i].orientation = xpl_irand_range(0, UINT8_MAX);
+	game.player_local[i].visible = false;
+
+	game.player[i].velocity.dx = 0;
+	game.player[i].velocity.dy = 0;
+}
+
+static void projectile_initialize(uint16_t pid, int pi, int ti) {
+	game.projectile[pi].pid = pid;
+	game.projectile[pi].health = projectile_config[ti].initial_health;
+	game.projectile[pi].type = (uint8_t)ti;
+	game.projectile_local[pi].trail_timeout = projectile_config[ti].trail_timeout;
+	game.projectile_local[pi].color = color_variant(projectile_config[ti].color, projectile_config[ti].variance);
+	game.projectile_local[pi].force_detonate = false;
+	game.projectile_local[pi].exploded = false;
+}
+
+int match_projectile_slot(uint16_t pid, int ti, bool allow_dead, bool *was_new) {
+	int allocate_index = -1;
+	for (int i = 0; i < MAX_PROJECTILES; ++i) {
+		if (pid == game.projectile[i].pid) {
+			if (allow_dead) return i;
+			if (game.projectile[i].health > 0) {
+				if (was_new) *was_new = false;
+				return i;
+			} else if (ti >= 0 && allocate_index == -1) {
+				allocate_index = i;
+				break;
+			}
+		} else if (ti >= 0 && allocate_index == -1 && game.projectile[i].health == 0) {
+			allocate_index = i;
+			// can't break, not finished searching for pid
+		}
+	}
+
+	if (was_new) *was_new = false;
+	if (allocate_index == -1) return -1;
+
+	projectile_initialize(pid, allocate_index, ti);
+	if (was_new) *was_new = true;
+	return allocate_index;
+}
+
+// ------------------------------------------------------------------------------
+// Packets
+
+void match_player_join(int i, const player_id_t *id) {
+	game.player_id[i] = *id;
+}
+
+void match_player_leave(int i) {
+	game.player_connected[i] = false;
+	memset(&game.player_id[i], 0, sizeof(player_id_t));
+}
+
+void match_player_set(int i, const player_t *player) {
+	game.player_local[i].visible = true;
+	game.player[i] = *player;
+}
+
+void match_projectile_set(int i, uint16_t owner, const projectile_t *projectile) {
+	game.projectile_local[i].owner = owner;
+	game.projectile[i] = *projectile;
+}
+
+void match_damage(int origin, int target, int projectile, const damage_t *damage) {
+	if (target >= 0 && (damage->flags & DAMAGE_FLAG_EXPLODES)) {
+		game.player_local[target].visible = false;
+	}
+
+	// Destroys projectile, including mines.
+	if (projectile >= 0) {
+		game.projectile[projectile].health = 0;
+	}
+
+	if (origin == 0 && target != 0) {
+		game.player[0].score += damage->amount;
+	}
+}
+
+void match_packet_apply(uint16_t client_id, const packet_t *packet) {
+	int pi;
+	switch (packet->type) {
+		case pt_hello:
+			// Client 0 is the server, challenging a hello.
+			if (client_id == 0) break;
+			if (packet->hello.nonce) {
+				match_player_join(0, &packet->hello);
+				match_player_spawn(0);
+			} else {
+				pi = match_player_slot(packet->hello.client_id, true, NULL);
+				if (pi >= 0) match_player_join(pi, &packet->hello);
+			}
+			break;
+
+		case pt_goodbye:
+			pi = match_player_slot(client_id, false, NULL);
+			if (pi >= 0) match_player_leave(pi);
+			break;
+
+		case pt_player:
+			pi = match_player_slot(client_id, true, NULL);
+			if (pi > 0) match_player_set(pi, &packet->player);
+			break;
+
+		case pt_projectile:
+			if (client_id == game.player_id[0].client_id) break;
+			if (packet->projectile.type >= projectile_type_count) break;
+			pi = match_projectile_slot(packet->projectile.pid, packet->projectile.type, false, NULL);
+			if (pi >= 0) match_projectile_set(pi, client_id, &packet->projectile);
+			break;
+
+		case pt_damage:
+			match_damage(match_player_slot(packet->damage.player_id, false, NULL),
+						 match_player_slot(client_id, false, NULL),
+						 match_projectile_slot(packet->damage.projectile_id, -1, true, NULL),
+						 &packet->damage);
+			break;
+
+		default:
+			break;
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Time
+
+void match_player_move(int i, double ticks) {
+	xvec2 velocity = xvec2_set(game.player[i].velocity.dx / VELOCITY_SCALE,
+							   game.player[i].velocity.dy / VELOCITY_SCALE);
+	if (ticks < 0.f || ticks > 1.f) {
+		LOG_DEBUG("Projecting %f ticks", ticks);
+	}
+	velocity = xvec2_scale(velocity, ticks);
+
+	game.player_position_buffer[i] = xvec2_add(game.player_position_buffer[i], velocity);
+
+	int dx = (int)truncf(game.player_position_buffer[i].x);
+	int dy = (int)truncf(game.player_position_buffer[i].y);
+	if (dx) {
+		game.player[i].position.px += dx;
+		game.player_position_buffer[i].x -= dx;
+	}
+	if (dy) {
+		game.player[i].position.py += dy;
+		game.player_position_buffer[i].y -= dy;
+	}
+	position_mod(&game.player[i].position);
+}
+
+void match_projectile_move(int i, double ticks) {
+	xvec2 velocity = xvec2_set(game.projectile[i].velocity.dx / VELOCITY_SCALE,
+							   game.projectile[i].velocity.dy / VELOCITY_SCALE);
+	velocity = xvec2_scale(velocity, ticks);
+
+	game.projectile_position_buffer[i] = xvec2_add(game.projectile_position_buffer[i], velocity);
+
+	int dx = (int)truncf(game.projectile_position_buffer[i].x);
+	int dy = (int)truncf(game.projectile_position_buffer[i].y);
+	if (dx) {
+		game.projectile[i].position.px += dx;
+		game.projectile_position_buffer[i].x -= dx;
+	}
+	if (dy) {
+		game.projectile[i].position.py += dy;
+		game.projectile_position_buffer[i].y -= dy;
+	}
+	position_mod(&game.projectile[i].position);
+}
+
+void match_projectile_age(int i) {
+	int type = game.projectile[i].type;
+	if (! strcmp(projectile_config[type].identifier, "health_kit")) return;
+
+	if (projectile_config[type].is_mine && game.projectile[i].health == 1) {
+		// Mines linger at 1 health
+		game.projectile[i].health++;
+		// They change to trail color when armed
+		game.projectile_local[i].color = color_variant(projectile_config[type].trail_color, projectile_config[type].trail_life);
+	}
+	--game.projectile[i].health;
+	--game.projectile_local[i].trail_timeout;
+}
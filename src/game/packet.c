@@ -33,7 +33,27 @@
 	ptr += sizeof(type);
 
 static const uint16_t ultrapew_magic = (uint16_t)0xff37;
-static const uint8_t protocol_version = 0x03;
+static const uint8_t protocol_version = 0x06;
+
+static const size_t packet_payload_sizes[PACKET_TYPE_COUNT] = {
+	10 + NAME_SIZE,	// hello: client id, nonce, room, cookie, name
+	10 + NAME_SIZE,	// goodbye
+	15,				// player
+	13,				// projectile
+	6,				// damage
+	CHAT_MAX,		// chat
+	8				// watch: room, nonce, cookie
+};
+
+static const char *packet_type_names[PACKET_TYPE_COUNT] = {
+	"hello",
+	"goodbye",
+	"player",
+	"projectile",
+	"damage",
+	"chat",
+	"watch"
+};
 
 size_t packet_encode(packet_t *packet, uint16_t client_id, uint8_t *buffer) {
 	uint8_t *p = buffer;
@@ -50,6 +70,8 @@ size_t packet_encode(packet_t *packet, uint16_t client_id, uint8_t *buffer) {
 		case pt_goodbye:
 			encode(packet->hello.client_id, uint16_t, p);
 			encode(packet->hello.nonce, uint16_t, p);
+			encode(packet->hello.room, uint16_t, p);
+			encode(packet->hello.cookie, uint32_t, p);
 			memmove(p, packet->hello.name, NAME_SIZE);
 			p += NAME_SIZE;
 			break;
@@ -88,6 +110,12 @@ size_t packet_encode(packet_t *packet, uint16_t client_id, uint8_t *buffer) {
 			p += CHAT_MAX;
 			break;
 			
+		case pt_watch:
+			encode(packet->watch.room, uint16_t, p);
+			encode(packet->watch.nonce, uint16_t, p);
+			encode(packet->watch.cookie, uint32_t, p);
+			break;
+			
 		default:
 			break;
 	}
@@ -115,6 +143,8 @@ bool packet_decode(packet_t *packet, uint16_t *client_source, uint8_t *buffer) {
 		case pt_goodbye:
 			decode(p, uint16_t, packet->hello.client_id);
 			decode(p, uint16_t, packet->hello.nonce);
+			decode(p, uint16_t, packet->hello.room);
+			decode(p, uint32_t, packet->hello.cookie);
 			memmove(packet->hello.name, p, NAME_SIZE);
 			p += NAME_SIZE;
 			break;
@@ -152,9 +182,48 @@ bool packet_decode(packet_t *packet, uint16_t *client_source, uint8_t *buffer) {
 			memmove(packet->chat, p, CHAT_MAX);
 			break;
 			
+		case pt_watch:
+			decode(p, uint16_t, packet->watch.room);
+			decode(p, uint16_t, packet->watch.nonce);
+			decode(p, uint32_t, packet->watch.cookie);
+			break;
+			
 		default:
 			return false;
 	}
 	
 	return true;
 }
+
+bool packet_decode_header(packet_header_t *header, const uint8_t *buffer, size_t length) {
+	if (length < PACKET_HEADER_SIZE) return false;
+	uint8_t *p = (uint8_t *)buffer;
+	
+	uint16_t magic;
+	decode(p, uint16_t, magic);
+	if (magic != ultrapew_magic) return false;
+	
+	uint8_t protocol;
+	decode(p, uint8_t, protocol);
+	if (protocol != protocol_version) return false;
+	
+	decode(p, uint16_t, header->client_source);
+	decode(p, uint32_t, header->seq);
+	decode(p, uint8_t, header->type);
+	
+	size_t size = packet_size(header->type);
+	return size && length >= size;
+}
+
+void packet_set_client_source(uint8_t *buffer, uint16_t client_source) {
+	uint8_t *p = buffer + 3; // past the magic and version
+	encode(client_source, uint16_t, p);
+}
+
+size_t packet_size(uint8_t type) {
+	return type < PACKET_TYPE_COUNT ? PACKET_HEADER_SIZE + packet_payload_sizes[type] : 0;
+}
+
+const char *packet_type_name(uint8_t type) {
+	return type < PACKET_TYPE_COUNT ? packet_type_names[type] : "unknown";
+}
@@ -20,6 +20,10 @@ static prefs_t prefs_default(void) {
 	strncpy(prefs.name, "", NAME_SIZE);
 	snprintf(prefs.server, SERVER_SIZE, "gs.ultrapew.com");
 	prefs.port = 3001;
+	prefs.room = 0;
+	prefs.record_replay = false;
+	strncpy(prefs.replay, "", REPLAY_PATH_SIZE);
+	prefs.spectate = false;
 	
 	return prefs;
 }
@@ -40,6 +44,10 @@ prefs_t prefs_get(void) {
 	ini_gets("prefs", "name", defaults.name, prefs.name, NAME_SIZE, resource);
 	ini_gets("prefs", "server", defaults.server, prefs.server, SERVER_SIZE, resource);
 	prefs.port = (unsigned short)ini_getl("prefs", "port_v2", defaults.port, resource);
+	prefs.room = (unsigned short)ini_getl("prefs", "room", defaults.room, resource);
+	prefs.record_replay = ini_getbool("prefs", "record_replay", defaults.record_replay, resource);
+	ini_gets("prefs", "replay", defaults.replay, prefs.replay, REPLAY_PATH_SIZE, resource);
+	prefs.spectate = ini_getbool("prefs", "spectate", defaults.spectate, resource);
 	
 	return prefs;
 }
@@ -52,5 +60,9 @@ void prefs_set(prefs_t prefs) {
 	ini_puts("prefs", "name", prefs.name, resource);
 	ini_puts("prefs", "server", prefs.server, resource);
 	ini_putl("prefs", "port_v2", (unsigned short)prefs.port, resource);
+	ini_putl("prefs", "room", (unsigned short)prefs.room, resource);
+	ini_puts("prefs", "record_replay", prefs.record_replay ? "true" : "false", resource);
+	ini_puts("prefs", "replay", prefs.replay, resource);
+	ini_puts("prefs", "spectate", prefs.spectate ? "true" : "false", resource);
 }
 
@@ -0,0 +1,140 @@
+//
+//  replay.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-05.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+
+#include "game/replay.h"
+
+#define REPLAY_FLUSH_INTERVAL   1.0
+
+struct replay_writer {
+	FILE                    *file;
+	char                    *path;
+	double                  start_time;
+	double                  last_flush;
+	size_t                  records;
+};
+
+struct replay_reader {
+	FILE                    *file;
+	replay_header_t         header;
+};
+
+// ------------------------------------------------------------------------------
+// Writing
+
+replay_writer_t *replay_writer_new(const char *path, uint16_t room) {
+	FILE *file = fopen(path, "wb");
+	if (! file) {
+		LOG_ERROR("Couldn't open replay %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	replay_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+	header.version = REPLAY_VERSION;
+	header.byte_order = REPLAY_BYTE_ORDER;
+	header.room = room;
+	header.start_ms = (uint64_t)time(NULL) * 1000;
+	fwrite(&header, sizeof(header), 1, file);
+
+	replay_writer_t *writer = xpl_calloc_type(replay_writer_t);
+	writer->file = file;
+	writer->path = strdup(path);
+	writer->start_time = xpl_get_time();
+	writer->last_flush = writer->start_time;
+	LOG_INFO("Recording replay %s", path);
+	return writer;
+}
+
+void replay_writer_destroy(replay_writer_t **ppwriter) {
+	replay_writer_t *writer = *ppwriter;
+	if (! writer) return;
+
+	fclose(writer->file);
+	if (writer->records) {
+		LOG_INFO("Closed replay %s (%lu datagrams)", writer->path, (unsigned long)writer->records);
+	} else {
+		unlink(writer->path);
+	}
+	free(writer->path);
+	xpl_free(writer);
+	*ppwriter = NULL;
+}
+
+void replay_write(replay_writer_t *writer, const uint8_t *datagram, size_t length) {
+	if (length > REPLAY_DATAGRAM_MAX) return;
+	double now = xpl_get_time();
+
+	replay_record_t record;
+	record.time_ms = (uint32_t)((now - writer->start_time) * 1000.0);
+	record.length = (uint16_t)length;
+	// Field by field, so the record header is six bytes on disk.
+	fwrite(&record.time_ms, sizeof(record.time_ms), 1, writer->file);
+	fwrite(&record.length, sizeof(record.length), 1, writer->file);
+	fwrite(datagram, length, 1, writer->file);
+	++writer->records;
+
+	if (now - writer->last_flush >= REPLAY_FLUSH_INTERVAL) {
+		fflush(writer->file);
+		writer->last_flush = now;
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Reading
+
+replay_reader_t *replay_reader_new(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (! file) {
+		LOG_ERROR("Couldn't open replay %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	replay_reader_t *reader = xpl_calloc_type(replay_reader_t);
+	reader->file = file;
+	if (fread(&reader->header, sizeof(reader->header), 1, file) != 1 ||
+		memcmp(reader->header.magic, REPLAY_MAGIC, sizeof(reader->header.magic)) != 0) {
+		LOG_ERROR("%s isn't a replay", path);
+		replay_reader_destroy(&reader);
+		return NULL;
+	}
+	if (reader->header.byte_order != REPLAY_BYTE_ORDER || reader->header.version != REPLAY_VERSION) {
+		LOG_ERROR("%s was written by another version or byte order", path);
+		replay_reader_destroy(&reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void replay_reader_destroy(replay_reader_t **ppreader) {
+	replay_reader_t *reader = *ppreader;
+	if (! reader) return;
+	fclose(reader->file);
+	xpl_free(reader);
+	*ppreader = NULL;
+}
+
+const replay_header_t *replay_reader_header(replay_reader_t *reader) {
+	return &reader->header;
+}
+
+bool replay_reader_next(replay_reader_t *reader, replay_record_t *record_out, uint8_t *datagram_out) {
+	if (fread(&record_out->time_ms, sizeof(record_out->time_ms), 1, reader->file) != 1) return false;
+	if (fread(&record_out->length, sizeof(record_out->length), 1, reader->file) != 1) return false;
+	if (record_out->length > REPLAY_DATAGRAM_MAX) return false;
+	return fread(datagram_out, 1, record_out->length, reader->file) == record_out->length;
+}
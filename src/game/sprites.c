@@ -9,24 +9,36 @@
 #include "xpl_rand.h"
 #include "xpl_color.h"
 #include "xpl_sprite_sheet.h"
+#include "xpl_texture.h"
 
 #include "game/game.h"
 
 #include "game/camera.h"
 #include "game/palette.h"
+#include "game/playfield_sprites.h"
+#include "game/ui_sprites.h"
 #include "game/sprites.h"
+#include "game/starfield.h"
 #include "game/util.h"
 #include "game/projectile_config.h"
 #include "game/hotspots.h"
 #include "game/layout.h"
 
-#include "science/star_generator.h"
 #include "random/det_rng.h"
 
 sprites_t						sprites;
-xivec3							star_layers[STAR_LAYERS][STARS_PER_LAYER];
 xivec3							debris_layer[DEBRIS_PER_LAYER];
 
+void sprites_prefetch(void) {
+	xpl_texture_prefetch("bitmaps/playfield.png");
+	xpl_texture_prefetch("bitmaps/ui.png");
+	for (int i = 0; i < TUTORIAL_PAGES; ++i) {
+		char resource[PATH_MAX];
+		snprintf(resource, PATH_MAX, "bitmaps/tutorial_%d.png", i);
+		xpl_texture_prefetch(resource);
+	}
+}
+
 void sprites_init(void) {
 	
 	rng_seq_t rng;
@@ -42,47 +54,37 @@ void sprites_init(void) {
 	sprites.ui_batch = xpl_sprite_batch_new();
 
 	xpl_sprite_sheet_t *playfield_sheet = xpl_sprite_sheet_new(sprites.playfield_batch, "bitmaps/playfield.json");
-	sprites.ship_sprite = xpl_sprite_get(playfield_sheet, "ship.png");
-	sprites.indicator_sprite = xpl_sprite_get(playfield_sheet, "indicator.png");
-	sprites.particle_sprite = xpl_sprite_get(playfield_sheet, "particle.png");
-	sprites.playfield_coin_sprite = xpl_sprite_get(playfield_sheet, "coin.png");
-	sprites.star_sprite = xpl_sprite_get(playfield_sheet, "star.png");
+	xpl_sprite_sheet_check_signature(playfield_sheet, SPRITE_PLAYFIELD_SIGNATURE);
+	sprites.ship_sprite = xpl_sprite_get_id(playfield_sheet, SPRITE_PLAYFIELD_SHIP);
+	sprites.indicator_sprite = xpl_sprite_get_id(playfield_sheet, SPRITE_PLAYFIELD_INDICATOR);
+	sprites.particle_sprite = xpl_sprite_get_id(playfield_sheet, SPRITE_PLAYFIELD_PARTICLE);
+	sprites.playfield_coin_sprite = xpl_sprite_get_id(playfield_sheet, SPRITE_PLAYFIELD_COIN);
+	sprites.star_sprite = xpl_sprite_get_id(playfield_sheet, SPRITE_PLAYFIELD_STAR);
 	
 	xpl_sprite_sheet_t *ui_sheet = xpl_sprite_sheet_new(sprites.ui_batch, "bitmaps/ui.json");
-	sprites.panel_background_sprite = xpl_sprite_get(ui_sheet, "panel_background.png");
-	sprites.solid_sprite = xpl_sprite_get(ui_sheet, "tile_solid.png");
-	sprites.grid8_sprite = xpl_sprite_get(ui_sheet, "tile_grid.png");
+	xpl_sprite_sheet_check_signature(ui_sheet, SPRITE_UI_SIGNATURE);
+	sprites.panel_background_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_PANEL_BACKGROUND);
+	sprites.solid_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_TILE_SOLID);
+	sprites.grid8_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_TILE_GRID);
 	
 	for (int i = 0; i < projectile_type_count; ++i) {
 		char resource[PATH_MAX];
 		snprintf(resource, PATH_MAX, "%s.png", projectile_config[i].fire_effect);
 		sprites.weapon_key_sprites[i] = xpl_sprite_get(ui_sheet, resource);
 	}
-	const char *key_sprites[3] = { "key_thrust.png", "key_left.png", "key_right.png" };
+	const int key_sprites[3] = { SPRITE_UI_KEY_THRUST, SPRITE_UI_KEY_LEFT, SPRITE_UI_KEY_RIGHT };
 	for (int i = 0; i < 3; ++i) {
-		sprites.control_key_sprites[i] = xpl_sprite_get(ui_sheet, key_sprites[i]);
+		sprites.control_key_sprites[i] = xpl_sprite_get_id(ui_sheet, key_sprites[i]);
 	}
 	
-	sprites.joystick_pen_sprite = xpl_sprite_get(ui_sheet, "thrust_stick_pen.png");
-	sprites.joystick_sprite = xpl_sprite_get(ui_sheet, "thrust_stick.png");
+	sprites.joystick_pen_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_THRUST_STICK_PEN);
+	sprites.joystick_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_THRUST_STICK);
 	
-	sprites.ui_coin_sprite = xpl_sprite_get(ui_sheet, "coin.png");
-	sprites.fire_button_lit = xpl_sprite_get(ui_sheet, "fire_button_lit.png");
-	sprites.fire_button_dark = xpl_sprite_get(ui_sheet, "fire_button_dark.png");
+	sprites.ui_coin_sprite = xpl_sprite_get_id(ui_sheet, SPRITE_UI_COIN);
+	sprites.fire_button_lit = xpl_sprite_get_id(ui_sheet, SPRITE_UI_FIRE_BUTTON_LIT);
+	sprites.fire_button_dark = xpl_sprite_get_id(ui_sheet, SPRITE_UI_FIRE_BUTTON_DARK);
 	
-	for (int i = 0; i < STAR_LAYERS; ++i) {
-		for (int j = 0; j < STARS_PER_LAYER; ++j) {
-			star_t star;
-			star_randomize(&star, &rng);
-			star_layers[i][j].x = xpl_irand_range(0, STAR_LAYER_SIZE);
-			star_layers[i][j].y = xpl_irand_range(0, STAR_LAYER_SIZE);
-			
-			star_layers[i][j].z = (int)RGBA((int)(star.color.r * 0xff),
-											(int)(star.color.g * 0xff),
-											(int)(star.color.b * 0xff),
-											(int)(star.sradii * 0x40 + 0x40));
-		}
-	}
+	starfield_init((int)rng_ui64(&rng));
 	for (int j = 0; j < DEBRIS_PER_LAYER; ++j) {
 		debris_layer[j].x = xpl_irand_range(0, STAR_LAYER_SIZE);
 		debris_layer[j].y = xpl_irand_range(0, STAR_LAYER_SIZE);
@@ -105,54 +107,17 @@ void sprites_playfield_render(xpl_context_t *self, xmat4 *ortho) {
 		*sprite_ortho = *ortho;
 		
 		// Background stars
-		// Need to draw back to front
-		for (int i = STAR_LAYERS - 1; i >= 0; --i) {
-			for (int j = 0; j < STARS_PER_LAYER; ++j) {
-				int64_t px = (star_layers[i][j].x - (camera.center.px >> (2 * i + 2))) % STAR_LAYER_SIZE;
-				int64_t py = (star_layers[i][j].y - (camera.center.py >> (2 * i + 2))) % STAR_LAYER_SIZE;
-				if (px > camera.draw_area.x &&
-					py > camera.draw_area.y &&
-					px < camera.draw_area.x + camera.draw_area.width &&
-					py < camera.draw_area.y + camera.draw_area.height) {
-					xvec4 color = RGBA_F((uint32_t)star_layers[i][j].z);
-					float k = 50.f * color.a;
-					color.a = 0.5f;
-					float size = k / (i + 1);
-					float hsize = size / 2;
-					xpl_sprite_draw_transformed(sprites.star_sprite,
-												px - hsize, py - hsize, hsize, hsize,
-												size, size,
-												1.f, 1.f,
-												0.f,
-												&color);
-					color.a = 1.0f;
-					float rsize = k / (i + 2);
-					float hrsize = rsize / 2;
-					xpl_sprite_draw_transformed(sprites.star_sprite,
-												px - hrsize, py - hrsize, hsize, hsize,
-												rsize, rsize,
-												1.f, 1.f,
-												0.f,
-												&color);
-				}
-			}
-		}
+		starfield_draw(sprites.star_sprite);
 		
 		// Particles
 		for (int i = 0; i < MAX_PARTICLES; ++i) {
 			if (game.particle[i].life >= 0.f) {
 				if (position_in_bounds(game.particle[i].position, game.particle[i].size, camera.min, camera.max)) {
-					xvec2 v = camera_get_draw_position(game.particle[i].position);
-					xvec2 s = xvec2_set(game.particle[i].size, game.particle[i].size);
-					xvec2 half_s = xvec2_scale(s, 0.5f);
-					v = xvec2_sub(v, half_s);
-					xpl_sprite_draw_transformed(sprites.particle_sprite,
-												v.x, v.y,
-												half_s.x, half_s.y,
-												s.x, s.y,
-												1.f, 1.f,
-												game.particle[i].orientation,
-												&game.particle[i].color);
+					xpl_sprite_instance_t *instance = xpl_sprite_draw_instance(sprites.particle_sprite);
+					instance->center = camera_get_draw_position(game.particle[i].position);
+					instance->size = game.particle[i].size;
+					instance->rotation = game.particle[i].orientation;
+					instance->color = xpl_sprite_instance_pack_color(game.particle[i].color);
 				}
 			}
 		}
@@ -161,17 +126,11 @@ void sprites_playfield_render(xpl_context_t *self, xmat4 *ortho) {
 			if (game.projectile[i].health) {
 				int pt = game.projectile[i].type;
 				if (position_in_bounds(game.projectile[i].position, projectile_config[pt].size, camera.min, camera.max)) {
-					xvec2 v = camera_get_draw_position(game.projectile[i].position);
-					xvec2 s = xvec2_set(projectile_config[pt].size, projectile_config[pt].size);
-					xvec2 half_s = xvec2_scale(s, 0.5f);
-					v = xvec2_sub(v, half_s);
-					xpl_sprite_draw_transformed(sprites.particle_sprite,
-												v.x, v.y,
-												half_s.x, half_s.y,
-												s.x, s.y,
-												1.f, 1.f,
-												game.projectile[i].orientation,
-												&game.projectile_local[i].color);
+					xpl_sprite_instance_t *instance = xpl_sprite_draw_instance(sprites.particle_sprite);
+					instance->center = camera_get_draw_position(game.projectile[i].position);
+					instance->size = projectile_config[pt].size;
+					instance->rotation = game.projectile[i].orientation;
+					instance->color = xpl_sprite_instance_pack_color(game.projectile_local[i].color);
 				}
 			}
 		}
@@ -0,0 +1,113 @@
+//
+//  starfield.c
+//  app
+//
+//  Created by Justin Bowes on 2013-07-28.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <string.h>
+
+#include "xpl_color.h"
+#include "xpl_sprite_instance.h"
+
+#include "game/camera.h"
+#include "game/sprites.h"
+#include "game/starfield.h"
+
+#include "science/star_generator.h"
+#include "random/det_rng.h"
+
+// The largest star is 50 pixels across, so tiles within half that of the view can still show.
+#define STARFIELD_MARGIN		32
+#define STAR_INSTANCES			(2 * STARS_PER_TILE)
+
+typedef struct starfield_tile {
+	int						valid;
+	int64_t					tx;
+	int64_t					ty;
+	// Centres are relative to the tile's corner.
+	xpl_sprite_instance_t	instances[STAR_INSTANCES];
+} starfield_tile_t;
+
+static int					starfield_seed;
+static starfield_tile_t		starfield_tiles[STAR_LAYERS][STARFIELD_CACHE_SPAN][STARFIELD_CACHE_SPAN];
+
+XPLINLINE int64_t floor_div(int64_t a, int64_t b) {
+	return (a >= 0 ? a : a - b + 1) / b;
+}
+
+static void tile_generate(starfield_tile_t *tile, int layer, int64_t tx, int64_t ty) {
+	int seed_ints[4] = { starfield_seed, layer, (int)tx, (int)ty };
+	rng_seq_t rng;
+	rng_seq_init_ints(seed_ints, 4, &rng);
+
+	for (int j = 0; j < STARS_PER_TILE; ++j) {
+		star_t star;
+		star_randomize(&star, &rng);
+		xvec2 center = xvec2_set(rng_float(&rng) * STARFIELD_TILE_SIZE, rng_float(&rng) * STARFIELD_TILE_SIZE);
+		uint32_t color = xpl_sprite_instance_pack_color(xvec4_set(star.color.r, star.color.g, star.color.b, 0.f));
+
+		// Bigger stars are brighter; a dim halo goes under a solid core.
+		float k = 50.f * xmin(star.sradii * 0x40 + 0x40, 0xff) / 255.f;
+		xpl_sprite_instance_t *halo = &tile->instances[2 * j];
+		halo->center = center;
+		halo->size = k / (layer + 1);
+		halo->rotation = 0.f;
+		halo->color = color | (128u << 24);
+		xpl_sprite_instance_t *core = &tile->instances[2 * j + 1];
+		core->center = center;
+		core->size = k / (layer + 2);
+		core->rotation = 0.f;
+		core->color = color | (255u << 24);
+	}
+
+	tile->tx = tx;
+	tile->ty = ty;
+	tile->valid = TRUE;
+}
+
+static const starfield_tile_t *tile_get(int layer, int64_t tx, int64_t ty) {
+	starfield_tile_t *tile = &starfield_tiles[layer]
+										[(size_t)tx & (STARFIELD_CACHE_SPAN - 1)]
+										[(size_t)ty & (STARFIELD_CACHE_SPAN - 1)];
+	if (! tile->valid || tile->tx != tx || tile->ty != ty) {
+		tile_generate(tile, layer, tx, ty);
+	}
+	return tile;
+}
+
+void starfield_init(int seed) {
+	starfield_seed = seed;
+	memset(starfield_tiles, 0, sizeof(starfield_tiles));
+}
+
+void starfield_draw(xpl_sprite_t *star_sprite) {
+	// Need to draw back to front
+	for (int layer = STAR_LAYERS - 1; layer >= 0; --layer) {
+		// Deeper layers scroll slower.
+		int shift = 2 * layer + 2;
+		int64_t scroll_x = camera.center.px >> shift;
+		int64_t scroll_y = camera.center.py >> shift;
+
+		int64_t min_x = scroll_x + camera.draw_area.x - STARFIELD_MARGIN;
+		int64_t min_y = scroll_y + camera.draw_area.y - STARFIELD_MARGIN;
+		int64_t max_x = min_x + camera.draw_area.width + 2 * STARFIELD_MARGIN;
+		int64_t max_y = min_y + camera.draw_area.height + 2 * STARFIELD_MARGIN;
+
+		for (int64_t ty = floor_div(min_y, STARFIELD_TILE_SIZE); ty <= floor_div(max_y, STARFIELD_TILE_SIZE); ++ty) {
+			for (int64_t tx = floor_div(min_x, STARFIELD_TILE_SIZE); tx <= floor_div(max_x, STARFIELD_TILE_SIZE); ++tx) {
+				const starfield_tile_t *tile = tile_get(layer, tx, ty);
+				float offset_x = (float)(tx * STARFIELD_TILE_SIZE - scroll_x);
+				float offset_y = (float)(ty * STARFIELD_TILE_SIZE - scroll_y);
+
+				xpl_sprite_instance_t *instances = xpl_sprite_draw_instances(star_sprite, STAR_INSTANCES);
+				for (int i = 0; i < STAR_INSTANCES; ++i) {
+					instances[i] = tile->instances[i];
+					instances[i].center.x += offset_x;
+					instances[i].center.y += offset_y;
+				}
+			}
+		}
+	}
+}
@@ -14,14 +14,8 @@
 
 
 const char *random_word(const char *key_prefix) {
-	int count = 0;
 	char key[256];
-	while (1) {
-		snprintf(key, 256, "%s_%d", key_prefix, count);
-		if (! xl_exists(key)) break;
-		count++;
-	}
-	
+	int count = xpl_l10n_family_count(key_prefix);
 	if (count == 0) {
 		LOG_WARN("No random word keys for %s_#", key_prefix);
 		return key_prefix;
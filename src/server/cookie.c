@@ -0,0 +1,67 @@
+//
+//  cookie.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-06.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+#include "xpl_hash.h"
+
+#include "server/cookie.h"
+
+void cookie_jar_init(cookie_jar_t *jar) {
+	FILE *random = fopen("/dev/urandom", "rb");
+	size_t got = random ? fread(jar->secret, 1, sizeof(jar->secret), random) : 0;
+	if (random) fclose(random);
+	if (got == sizeof(jar->secret)) return;
+
+	LOG_WARN("No /dev/urandom; cookies are keyed from the clock");
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	int seed = xpl_hashi((int)tv.tv_usec, (int)tv.tv_sec);
+	for (size_t i = 0; i < sizeof(jar->secret); ++i) {
+		seed = xpl_hashi(seed, (int)i);
+		jar->secret[i] = (uint8_t)seed;
+	}
+}
+
+static uint32_t cookie_digest(const cookie_jar_t *jar, const UDPNET_ADDRESS *source, uint16_t nonce, uint32_t epoch) {
+	uint8_t input[sizeof(jar->secret) + sizeof(source->address) + 8];
+	memset(input, 0, sizeof(input));
+	uint8_t *p = input;
+	memcpy(p, jar->secret, sizeof(jar->secret));
+	p += sizeof(jar->secret);
+	memcpy(p, source->address, strnlen(source->address, sizeof(source->address)));
+	p += sizeof(source->address);
+	uint16_t port = (uint16_t)source->port;
+	memcpy(p, &port, sizeof(port));
+	memcpy(p + 2, &nonce, sizeof(nonce));
+	memcpy(p + 4, &epoch, sizeof(epoch));
+
+	// On the stack: this runs for every unrouted hello and watch, before anything is allocated.
+	xpl_md5_context_t md5;
+	xpl_md5_init(&md5);
+	xpl_md5_update(&md5, input, sizeof(input));
+	xpl_md5_finish(&md5);
+	uint32_t cookie;
+	memcpy(&cookie, md5.digest_raw, sizeof(cookie));
+	return cookie ? cookie : 1;
+}
+
+uint32_t cookie_make(const cookie_jar_t *jar, const UDPNET_ADDRESS *source, uint16_t nonce, double now) {
+	return cookie_digest(jar, source, nonce, (uint32_t)(now / COOKIE_LIFETIME));
+}
+
+bool cookie_check(const cookie_jar_t *jar, const UDPNET_ADDRESS *source, uint16_t nonce, uint32_t cookie, double now) {
+	if (! cookie) return false;
+	uint32_t epoch = (uint32_t)(now / COOKIE_LIFETIME);
+	return cookie == cookie_digest(jar, source, nonce, epoch) ||
+		cookie == cookie_digest(jar, source, nonce, epoch - 1);
+}
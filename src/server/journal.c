@@ -0,0 +1,360 @@
+//
+//  journal.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-01.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+
+#include "server/journal.h"
+
+#define JOURNAL_BUFFER_SIZE     (64 * 1024)
+#define JOURNAL_FLUSH_MS        1000
+#define JOURNAL_PATH_MAX        1024
+#define JOURNAL_COMPRESS_CHUNK  (64 * 1024)
+
+struct journal {
+	journal_config_t        config;
+	char                    *directory;
+	char                    *prefix;
+
+	FILE                    *file;
+	char                    path[JOURNAL_PATH_MAX];
+	char                    *buffer;
+	uint32_t                sequence;
+	uint64_t                start_ms;
+	uint64_t                last_flush_ms;
+	size_t                  bytes;
+	size_t                  records;
+	bool                    opening;    // inside segment_opened
+};
+
+struct journal_reader {
+	gzFile                  file;
+	journal_segment_header_t header;
+};
+
+static const char *event_names[je_type_count] = {
+	NULL,
+	"join",
+	"delete",
+	"full",
+	"hello",
+	"chat",
+	"damage",
+	"send_drop",
+	"roster"
+};
+
+static uint64_t journal_clock_ms(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
+
+const char *journal_event_name(journal_event_type_t type) {
+	if (type <= 0 || type >= je_type_count) return "unknown";
+	return event_names[type];
+}
+
+journal_event_type_t journal_event_type(const char *name) {
+	for (int i = 1; i < je_type_count; ++i) {
+		if (strcmp(name, event_names[i]) == 0) return (journal_event_type_t)i;
+	}
+	return 0;
+}
+
+// ------------------------------------------------------------------------------
+// Sealing
+
+static void *compress_main(void *data) {
+	char *path = data;
+	char gz_path[JOURNAL_PATH_MAX + 8], tmp_path[JOURNAL_PATH_MAX + 16];
+	snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.gz.tmp", path);
+
+	FILE *in = fopen(path, "rb");
+	gzFile out = in ? gzopen(tmp_path, "wb6") : NULL;
+	bool ok = (out != NULL);
+	if (ok) {
+		char chunk[JOURNAL_COMPRESS_CHUNK];
+		size_t n;
+		while (ok && (n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+			ok = gzwrite(out, chunk, (unsigned int)n) == (int)n;
+		}
+		ok = (gzclose(out) == Z_OK) && ok;
+	}
+	if (in) fclose(in);
+
+	if (ok && rename(tmp_path, gz_path) == 0) {
+		unlink(path);
+	} else {
+		LOG_WARN("Couldn't compress journal segment %s", path);
+		unlink(tmp_path);
+	}
+	free(path);
+	return NULL;
+}
+
+// On shutdown the process won't wait for a background thread, so the last
+// segment is compressed in place.
+static void compress_segment(const char *path, bool wait) {
+	char *copy = strdup(path);
+	if (copy && wait) {
+		compress_main(copy);
+		return;
+	}
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (! copy || pthread_create(&thread, &attr, compress_main, copy) != 0) {
+		LOG_WARN("Couldn't start compressing journal segment %s", path);
+		free(copy);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+static int segment_name_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static bool is_sealed_segment(const journal_t *journal, const char *name) {
+	size_t prefix_length = strlen(journal->prefix);
+	if (strncmp(name, journal->prefix, prefix_length) != 0 || name[prefix_length] != '-') return false;
+	const char *extension = strstr(name + prefix_length, JOURNAL_EXTENSION);
+	if (! extension) return false;
+	return strcmp(extension, JOURNAL_EXTENSION) == 0 || strcmp(extension, JOURNAL_EXTENSION ".gz") == 0;
+}
+
+// Names sort by date, so the oldest come first.
+static void apply_retention(journal_t *journal) {
+	if (journal->config.keep_segments <= 0) return;
+
+	DIR *dir = opendir(journal->directory);
+	if (! dir) return;
+
+	size_t count = 0, capacity = 64;
+	char **names = malloc(capacity * sizeof(char *));
+	const char *current = strrchr(journal->path, '/') + 1;
+	struct dirent *entry;
+	while (names && (entry = readdir(dir))) {
+		if (! is_sealed_segment(journal, entry->d_name)) continue;
+		if (journal->file && strcmp(entry->d_name, current) == 0) continue;
+		if (count == capacity) {
+			capacity *= 2;
+			char **grown = realloc(names, capacity * sizeof(char *));
+			if (! grown) break;
+			names = grown;
+		}
+		names[count++] = strdup(entry->d_name);
+	}
+	closedir(dir);
+	if (! names) return;
+
+	qsort(names, count, sizeof(char *), segment_name_cmp);
+	size_t keep = (size_t)journal->config.keep_segments;
+	for (size_t i = 0; i < count; ++i) {
+		if (i + keep < count) {
+			char path[JOURNAL_PATH_MAX];
+			snprintf(path, sizeof(path), "%s/%s", journal->directory, names[i]);
+			if (unlink(path) != 0) LOG_WARN("Couldn't delete old journal segment %s: %s", path, strerror(errno));
+		}
+		free(names[i]);
+	}
+	free(names);
+}
+
+static void segment_close(journal_t *journal, bool final) {
+	if (! journal->file) return;
+	fclose(journal->file);
+	journal->file = NULL;
+	LOG_INFO("Sealed journal segment %s (%lu records, %lu bytes)",
+			 journal->path, (unsigned long)journal->records, (unsigned long)journal->bytes);
+	if (journal->config.compress && journal->records) compress_segment(journal->path, final);
+}
+
+static bool segment_open(journal_t *journal) {
+	uint64_t now = journal_clock_ms();
+	time_t seconds = (time_t)(now / 1000);
+	struct tm tm;
+	localtime_r(&seconds, &tm);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	snprintf(journal->path, sizeof(journal->path), "%s/%s-%s-%06u" JOURNAL_EXTENSION,
+			 journal->directory, journal->prefix, stamp, journal->sequence % 1000000);
+
+	journal->file = fopen(journal->path, "wb");
+	if (! journal->file) {
+		LOG_ERROR("Couldn't open journal segment %s: %s", journal->path, strerror(errno));
+		return false;
+	}
+	setvbuf(journal->file, journal->buffer, _IOFBF, JOURNAL_BUFFER_SIZE);
+
+	journal_segment_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.version = JOURNAL_VERSION;
+	header.byte_order = JOURNAL_BYTE_ORDER;
+	header.sequence = journal->sequence++;
+	header.start_ms = now;
+	fwrite(&header, sizeof(header), 1, journal->file);
+
+	journal->start_ms = now;
+	journal->last_flush_ms = now;
+	journal->bytes = sizeof(header);
+	journal->records = 0;
+
+	apply_retention(journal);
+
+	if (journal->config.segment_opened) {
+		journal->opening = true;
+		journal->config.segment_opened(journal, journal->config.segment_opened_data);
+		journal->opening = false;
+	}
+	return true;
+}
+
+static void segment_rotate(journal_t *journal) {
+	segment_close(journal, false);
+	segment_open(journal);
+}
+
+// ------------------------------------------------------------------------------
+
+journal_t *journal_new(const journal_config_t *config) {
+	if (mkdir(config->directory, 0755) != 0 && errno != EEXIST) {
+		LOG_ERROR("Couldn't create journal directory %s: %s", config->directory, strerror(errno));
+		return NULL;
+	}
+
+	journal_t *journal = xpl_calloc_type(journal_t);
+	journal->config = *config;
+	journal->directory = strdup(config->directory);
+	journal->prefix = strdup(config->prefix);
+	journal->buffer = xpl_alloc(JOURNAL_BUFFER_SIZE);
+
+	if (! segment_open(journal)) {
+		journal_destroy(&journal);
+		return NULL;
+	}
+	return journal;
+}
+
+void journal_destroy(journal_t **ppjournal) {
+	journal_t *journal = *ppjournal;
+	if (! journal) return;
+
+	segment_close(journal, true);
+	free(journal->directory);
+	free(journal->prefix);
+	xpl_free(journal->buffer);
+	xpl_free(journal);
+	*ppjournal = NULL;
+}
+
+void journal_write(journal_t *journal, journal_event_type_t type, uint16_t client_id, const void *payload, size_t length) {
+	if (! journal->file) return;
+	uint64_t now = journal_clock_ms();
+
+	size_t size = sizeof(journal_record_t) + length;
+	if (! journal->opening && journal->records &&
+		(journal->bytes + size > journal->config.max_segment_bytes ||
+		 (now - journal->start_ms) >= journal->config.max_segment_seconds * 1000.0)) {
+		segment_rotate(journal);
+		if (! journal->file) return;
+	}
+
+	journal_record_t record;
+	record.time_ms = (uint32_t)(now - journal->start_ms);
+	record.client_id = client_id;
+	record.type = (uint8_t)type;
+	record.length = (uint8_t)xmin(length, JOURNAL_PAYLOAD_MAX);
+	fwrite(&record, sizeof(record), 1, journal->file);
+	if (record.length) fwrite(payload, record.length, 1, journal->file);
+
+	journal->bytes += sizeof(record) + record.length;
+	++journal->records;
+}
+
+void journal_tick(journal_t *journal) {
+	if (! journal->file) {
+		// Retry a segment that couldn't be opened, at most once a flush interval.
+		uint64_t now = journal_clock_ms();
+		if (now - journal->last_flush_ms < JOURNAL_FLUSH_MS) return;
+		journal->last_flush_ms = now;
+		segment_open(journal);
+		return;
+	}
+
+	uint64_t now = journal_clock_ms();
+	if (journal->records && (now - journal->start_ms) >= journal->config.max_segment_seconds * 1000.0) {
+		segment_rotate(journal);
+		return;
+	}
+	if (now - journal->last_flush_ms >= JOURNAL_FLUSH_MS) {
+		fflush(journal->file);
+		journal->last_flush_ms = now;
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Reading
+
+journal_reader_t *journal_reader_new(const char *path) {
+	gzFile file = gzopen(path, "rb");
+	if (! file) {
+		LOG_ERROR("Couldn't open journal segment %s", path);
+		return NULL;
+	}
+
+	journal_reader_t *reader = xpl_calloc_type(journal_reader_t);
+	reader->file = file;
+	if (gzread(file, &reader->header, sizeof(reader->header)) != (int)sizeof(reader->header) ||
+		memcmp(reader->header.magic, JOURNAL_MAGIC, sizeof(reader->header.magic)) != 0) {
+		LOG_ERROR("%s isn't a journal segment", path);
+		journal_reader_destroy(&reader);
+		return NULL;
+	}
+	if (reader->header.byte_order != JOURNAL_BYTE_ORDER || reader->header.version != JOURNAL_VERSION) {
+		LOG_ERROR("%s was written by another version or byte order", path);
+		journal_reader_destroy(&reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void journal_reader_destroy(journal_reader_t **ppreader) {
+	journal_reader_t *reader = *ppreader;
+	if (! reader) return;
+	gzclose(reader->file);
+	xpl_free(reader);
+	*ppreader = NULL;
+}
+
+const journal_segment_header_t *journal_reader_header(journal_reader_t *reader) {
+	return &reader->header;
+}
+
+bool journal_reader_next(journal_reader_t *reader, journal_record_t *record_out, uint8_t *payload_out) {
+	if (gzread(reader->file, record_out, sizeof(*record_out)) != (int)sizeof(*record_out)) return false;
+	if (record_out->length &&
+		gzread(reader->file, payload_out, record_out->length) != (int)record_out->length) return false;
+	payload_out[record_out->length] = '\0';
+	return true;
+}
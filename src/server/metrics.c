@@ -0,0 +1,254 @@
+//
+//  metrics.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-02.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "xpl.h"
+#include "xpl_log.h"
+
+#include "server/metrics.h"
+
+#define METRICS_POLL_MS         250
+#define METRICS_REQUEST_MAX     4096
+
+static metric_t *metrics_head = NULL;
+static metric_t *metrics_tail = NULL;
+
+static int listen_socket = -1;
+static char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static pthread_t listen_thread;
+static int listening = 0;
+
+void metrics_register(metric_t *metric) {
+	assert(metric->type != mt_histogram || metric->bound_count <= METRICS_BUCKETS_MAX);
+	metric->next = NULL;
+	if (metrics_tail) {
+		metrics_tail->next = metric;
+	} else {
+		metrics_head = metric;
+	}
+	metrics_tail = metric;
+}
+
+static double bits_to_double(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void metrics_observe(metric_t *metric, double value) {
+	size_t bucket = 0;
+	while (bucket < metric->bound_count && value > metric->bounds[bucket]) ++bucket;
+	__atomic_fetch_add(&metric->buckets[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&metric->count, 1, __ATOMIC_RELAXED);
+
+	uint64_t old_bits = __atomic_load_n(&metric->sum, __ATOMIC_RELAXED), new_bits;
+	do {
+		double sum = bits_to_double(old_bits) + value;
+		memcpy(&new_bits, &sum, sizeof(new_bits));
+	} while (! __atomic_compare_exchange_n(&metric->sum, &old_bits, new_bits, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// ------------------------------------------------------------------------------
+
+static const char *type_names[] = { "counter", "gauge", "histogram" };
+
+// Writes name{labels,extra} with the braces only where there are labels.
+static void write_series(FILE *out, const char *name, const char *suffix, const char *labels, const char *extra) {
+	fputs(name, out);
+	fputs(suffix, out);
+	if (labels || extra) {
+		fputc('{', out);
+		if (labels) fputs(labels, out);
+		if (labels && extra) fputc(',', out);
+		if (extra) fputs(extra, out);
+		fputc('}', out);
+	}
+	fputc(' ', out);
+}
+
+void metrics_write(FILE *out) {
+	const char *family = NULL;
+	for (metric_t *metric = metrics_head; metric; metric = metric->next) {
+		if (! family || strcmp(family, metric->name) != 0) {
+			family = metric->name;
+			fprintf(out, "# HELP %s %s\n", metric->name, metric->help);
+			fprintf(out, "# TYPE %s %s\n", metric->name, type_names[metric->type]);
+		}
+
+		uint64_t value = __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+		switch (metric->type) {
+			case mt_counter:
+				write_series(out, metric->name, "", metric->labels, NULL);
+				fprintf(out, "%llu\n", (unsigned long long)value);
+				break;
+
+			case mt_gauge:
+				write_series(out, metric->name, "", metric->labels, NULL);
+				fprintf(out, "%.17g\n", bits_to_double(value));
+				break;
+
+			case mt_histogram: {
+				// Buckets are cumulative in the exposition format.
+				uint64_t cumulative = 0;
+				char le[48];
+				for (size_t i = 0; i <= metric->bound_count; ++i) {
+					cumulative += __atomic_load_n(&metric->buckets[i], __ATOMIC_RELAXED);
+					if (i < metric->bound_count) {
+						snprintf(le, sizeof(le), "le=\"%g\"", metric->bounds[i]);
+					} else {
+						snprintf(le, sizeof(le), "le=\"+Inf\"");
+					}
+					write_series(out, metric->name, "_bucket", metric->labels, le);
+					fprintf(out, "%llu\n", (unsigned long long)cumulative);
+				}
+				write_series(out, metric->name, "_sum", metric->labels, NULL);
+				fprintf(out, "%.17g\n", bits_to_double(__atomic_load_n(&metric->sum, __ATOMIC_RELAXED)));
+				write_series(out, metric->name, "_count", metric->labels, NULL);
+				fprintf(out, "%llu\n", (unsigned long long)cumulative);
+				break;
+			}
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+
+static void serve_connection(int fd) {
+	// Read the request so the client doesn't see a reset, but whatever was
+	// asked for, the answer is the metrics.
+	struct timeval timeout = { 1, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	char request[METRICS_REQUEST_MAX + 1];
+	size_t length = 0;
+	while (length < METRICS_REQUEST_MAX) {
+		ssize_t n = recv(fd, request + length, METRICS_REQUEST_MAX - length, 0);
+		if (n <= 0) break;
+		length += (size_t)n;
+		request[length] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+	}
+
+	FILE *out = fdopen(fd, "w");
+	if (! out) {
+		close(fd);
+		return;
+	}
+	fputs("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n", out);
+	metrics_write(out);
+	fclose(out);
+}
+
+static void *listen_main(void *data) {
+	struct pollfd pfd = { listen_socket, POLLIN, 0 };
+	while (__atomic_load_n(&listening, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) continue;
+		int fd = accept(listen_socket, NULL, NULL);
+		if (fd < 0) continue;
+		serve_connection(fd);
+	}
+	return NULL;
+}
+
+static int open_tcp(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	int reuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((uint16_t)port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int open_unix(const char *path) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path); // left behind by a previous run
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	strncpy(unix_path, path, sizeof(unix_path) - 1);
+	return fd;
+}
+
+bool metrics_listen(const char *address) {
+	if (listen_socket >= 0) return false;
+
+	char *end;
+	long port = strtol(address, &end, 10);
+	bool is_port = (*address && *end == '\0');
+	if (is_port && (port <= 0 || port > 65535)) {
+		LOG_ERROR("Invalid metrics port %s", address);
+		return false;
+	}
+
+	listen_socket = is_port ? open_tcp((int)port) : open_unix(address);
+	if (listen_socket < 0 || listen(listen_socket, 8) != 0) {
+		LOG_ERROR("Couldn't listen for metrics on %s: %s", address, strerror(errno));
+		metrics_shutdown();
+		return false;
+	}
+
+	// A scraper hanging up mid-response shouldn't take the server down.
+	signal(SIGPIPE, SIG_IGN);
+
+	__atomic_store_n(&listening, 1, __ATOMIC_RELEASE);
+	if (pthread_create(&listen_thread, NULL, listen_main, NULL) != 0) {
+		LOG_ERROR("Couldn't start the metrics thread");
+		__atomic_store_n(&listening, 0, __ATOMIC_RELEASE);
+		metrics_shutdown();
+		return false;
+	}
+	LOG_INFO("Serving metrics on %s%s", is_port ? "127.0.0.1:" : "", address);
+	return true;
+}
+
+void metrics_shutdown(void) {
+	if (__atomic_load_n(&listening, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&listening, 0, __ATOMIC_RELEASE);
+		pthread_join(listen_thread, NULL);
+	}
+	if (listen_socket >= 0) {
+		close(listen_socket);
+		listen_socket = -1;
+	}
+	if (unix_path[0]) {
+		unlink(unix_path);
+		unix_path[0] = '\0';
+	}
+}
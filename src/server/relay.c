@@ -0,0 +1,349 @@
+//
+//  relay.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-06.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "uthash.h"
+
+#include "xpl.h"
+#include "xpl_log.h"
+#include "xpl_hash.h"
+
+#include "game/packet.h"
+
+#include "server/cookie.h"
+#include "server/metrics.h"
+#include "server/relay.h"
+#include "server/token_bucket.h"
+
+#define RELAY_QUEUE_SIZE        1024        // datagrams held back per room
+#define RELAY_DATAGRAM_MAX      1024
+#define RELAY_WATCH_INTERVAL    2.0         // as often as a client says hello
+#define RELAY_RECEIVE_MAX       64          // upstream datagrams read per room per tick
+
+// Shared by every address the relay doesn't know yet, as the game server
+// limits hellos it hasn't routed.
+static const token_bucket_limit_t relay_watch_limit = { 500.0, 1000.0 };
+// Each watcher's renewals, as the game server limits a routed watch.
+static const token_bucket_limit_t watcher_watch_limit = { 2.0, 5.0 };
+
+typedef struct relay_datagram {
+	double                  time;
+	uint16_t                length;
+	uint8_t                 bytes[RELAY_DATAGRAM_MAX];
+} relay_datagram_t;
+
+typedef struct relay_watcher {
+	int                     key;            // address hash
+	UDPNET_ADDRESS          address;
+	double                  last_seen;
+	token_bucket_t          bucket;
+	UT_hash_handle          hh;
+} relay_watcher_t;
+
+// The queue is a ring: head is where the next datagram from upstream goes and
+// tail the next to be passed on.
+typedef struct relay_room {
+	int                     id;
+	int                     socket;         // upstream
+	uint16_t                nonce;
+	uint32_t                cookie;
+	uint32_t                seq;
+	double                  last_watch;
+
+	relay_watcher_t         *watchers;
+	int                     watcher_count;
+
+	relay_datagram_t        *queue;
+	uint32_t                head;
+	uint32_t                tail;
+	UT_hash_handle          hh;
+} relay_room_t;
+
+struct relay {
+	relay_config_t          config;
+	UDPNET_ADDRESS          upstream;
+	cookie_jar_t            cookies;
+	token_bucket_t          watch_bucket;
+	relay_room_t            *rooms;
+	int                     room_count;
+	int                     watcher_count;
+};
+
+static metric_t		rooms_gauge			= { "up_relay_rooms", "Rooms being relayed.", mt_gauge };
+static metric_t		watchers_gauge		= { "up_relay_watchers", "Spectators and relays watching through this relay.", mt_gauge };
+static metric_t		received_bytes		= { "up_relay_received_bytes_total", "Bytes received from upstream.", mt_counter };
+static metric_t		sent_bytes			= { "up_relay_sent_bytes_total", "Bytes passed on to watchers.", mt_counter };
+static metric_t		queue_drops			= { "up_relay_queue_drops_total", "Datagrams dropped because a room's delay queue was full.", mt_counter };
+static metric_t		rejected_packets	= { "up_relay_rejected_packets_total", "Packets that weren't watches, or watches over a limit.", mt_counter };
+static metric_t		watch_challenges	= { "up_relay_watch_challenges_total", "Cookie challenges sent to watches from new addresses.", mt_counter };
+
+static void relay_metrics_init(void) {
+	static bool registered = false;
+	if (registered) return;
+	registered = true;
+
+	metrics_register(&rooms_gauge);
+	metrics_register(&watchers_gauge);
+	metrics_register(&received_bytes);
+	metrics_register(&sent_bytes);
+	metrics_register(&queue_drops);
+	metrics_register(&rejected_packets);
+	metrics_register(&watch_challenges);
+}
+
+// ------------------------------------------------------------------------------
+// Upstream
+
+static void send_watch(relay_t *relay, relay_room_t *room, double now) {
+	packet_t packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.seq = ++room->seq;
+	packet.type = pt_watch;
+	packet.watch.room = (uint16_t)room->id;
+	packet.watch.nonce = room->nonce;
+	packet.watch.cookie = room->cookie;
+
+	uint8_t buf[PACKET_SIZE_MAX];
+	size_t size = packet_encode(&packet, 0, buf);
+	udp_send(room->socket, buf, (int)size, relay->upstream.address, relay->upstream.port);
+	room->last_watch = now;
+}
+
+static relay_room_t *room_open(relay_t *relay, int id, double now) {
+	int sock = udp_create_endpoint(0);
+	if (sock < 0) {
+		LOG_ERROR("Couldn't open an upstream socket for room %d", id);
+		return NULL;
+	}
+
+	relay_room_t *room = xpl_calloc_type(relay_room_t);
+	room->id = id;
+	room->socket = sock;
+	room->nonce = (uint16_t)xpl_hashi(id, xpl_hashi((int)(now * 1000.0), XPL_HASH_INIT));
+	if (! room->nonce) room->nonce = 1;
+	room->queue = xpl_calloc(sizeof(relay_datagram_t) * RELAY_QUEUE_SIZE);
+	HASH_ADD_INT(relay->rooms, id, room);
+	++relay->room_count;
+
+	LOG_INFO("Relaying room %d from %s:%d", id, relay->upstream.address, relay->upstream.port);
+	send_watch(relay, room, now);
+	return room;
+}
+
+static void room_close(relay_t *relay, relay_room_t *room) {
+	relay_watcher_t *watcher, *tmp;
+	HASH_ITER(hh, room->watchers, watcher, tmp) {
+		HASH_DEL(room->watchers, watcher);
+		--relay->watcher_count;
+		xpl_free(watcher);
+	}
+	udp_close_endpoint(room->socket);
+	xpl_free(room->queue);
+
+	LOG_INFO("Stopped relaying room %d", room->id);
+	HASH_DEL(relay->rooms, room);
+	--relay->room_count;
+	xpl_free(room);
+}
+
+// Everything from upstream is queued as it came, but for the answer to our
+// own watch, which only the relay needs.
+static void room_receive(relay_t *relay, relay_room_t *room, double now) {
+	uint8_t buf[RELAY_DATAGRAM_MAX];
+	UDPNET_ADDRESS source;
+	for (int i = 0; i < RELAY_RECEIVE_MAX; ++i) {
+		int n = udp_receive(room->socket, buf, sizeof(buf), &source);
+		if (n <= 0) return;
+		if (strcmp(source.address, relay->upstream.address) != 0 || source.port != relay->upstream.port) continue;
+		metrics_add(&received_bytes, (uint64_t)n);
+
+		packet_header_t header;
+		if (! packet_decode_header(&header, buf, (size_t)n)) continue;
+		if (header.type == pt_watch) {
+			packet_t packet;
+			uint16_t client_source;
+			if (packet_decode(&packet, &client_source, buf) && packet.watch.nonce == room->nonce && packet.watch.cookie) {
+				room->cookie = packet.watch.cookie;
+				send_watch(relay, room, now);
+			}
+			continue;
+		}
+
+		if (room->head - room->tail == RELAY_QUEUE_SIZE) {
+			++room->tail;
+			metrics_inc(&queue_drops);
+		}
+		relay_datagram_t *datagram = &room->queue[room->head++ % RELAY_QUEUE_SIZE];
+		datagram->time = now;
+		datagram->length = (uint16_t)n;
+		memcpy(datagram->bytes, buf, (size_t)n);
+	}
+}
+
+static void room_forward(relay_t *relay, relay_room_t *room, double now) {
+	for (; room->tail != room->head; ++room->tail) {
+		relay_datagram_t *datagram = &room->queue[room->tail % RELAY_QUEUE_SIZE];
+		if (now - datagram->time < relay->config.delay) return;
+
+		relay_watcher_t *watcher, *tmp;
+		HASH_ITER(hh, room->watchers, watcher, tmp) {
+			int ret = udp_send(relay->config.socket, datagram->bytes, datagram->length,
+							   watcher->address.address, watcher->address.port);
+			if (! ret) metrics_add(&sent_bytes, datagram->length);
+		}
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Watchers
+
+// The challenge is no bigger than the watch it answers.
+static void send_challenge(relay_t *relay, const UDPNET_ADDRESS *source, const watch_t *watch, double now) {
+	packet_t challenge;
+	memset(&challenge, 0, sizeof(challenge));
+	challenge.type = pt_watch;
+	challenge.watch.room = watch->room;
+	challenge.watch.nonce = watch->nonce;
+	challenge.watch.cookie = cookie_make(&relay->cookies, source, watch->nonce, now);
+
+	uint8_t buf[PACKET_SIZE_MAX];
+	size_t size = packet_encode(&challenge, 0, buf);
+	udp_send(relay->config.socket, buf, (int)size, source->address, source->port);
+	metrics_inc(&watch_challenges);
+}
+
+void relay_dispatch(relay_t *relay, const UDPNET_ADDRESS *source, uint8_t *buffer, size_t length) {
+	// Spectators only receive; a watch is all they can send.
+	packet_header_t header;
+	packet_t packet;
+	uint16_t client_source;
+	if (! packet_decode_header(&header, buffer, length) || header.type != pt_watch ||
+		! packet_decode(&packet, &client_source, buffer)) {
+		metrics_inc(&rejected_packets);
+		return;
+	}
+
+	// A watcher renewing its subscription has already answered a challenge.
+	double now = xpl_get_time();
+	int key = xpl_hashs(source->address, XPL_HASH_INIT);
+	key = xpl_hashi(source->port, key);
+	int id = packet.watch.room;
+	relay_room_t *room;
+	HASH_FIND_INT(relay->rooms, &id, room);
+	relay_watcher_t *watcher = NULL;
+	if (room) HASH_FIND_INT(room->watchers, &key, watcher);
+	if (watcher) {
+		if (! token_bucket_take(&watcher->bucket, &watcher_watch_limit, now)) {
+			metrics_inc(&rejected_packets);
+			return;
+		}
+	} else {
+		if (! token_bucket_take(&relay->watch_bucket, &relay_watch_limit, now)) {
+			metrics_inc(&rejected_packets);
+			return;
+		}
+		if (! cookie_check(&relay->cookies, source, packet.watch.nonce, packet.watch.cookie, now)) {
+			send_challenge(relay, source, &packet.watch, now);
+			return;
+		}
+		if (relay->watcher_count >= relay->config.max_watchers) {
+			metrics_inc(&rejected_packets);
+			return;
+		}
+		if (! room) room = room_open(relay, id, now);
+		if (! room) return;
+
+		watcher = xpl_calloc_type(relay_watcher_t);
+		watcher->key = key;
+		watcher->address = *source;
+		token_bucket_init(&watcher->bucket, &watcher_watch_limit, now);
+		HASH_ADD_INT(room->watchers, key, watcher);
+		++room->watcher_count;
+		++relay->watcher_count;
+		LOG_DEBUG("Watcher %s:%d on room %d", source->address, source->port, id);
+	}
+	watcher->last_seen = now;
+}
+
+void relay_tick(relay_t *relay) {
+	double now = xpl_get_time();
+
+	relay_room_t *room, *room_tmp;
+	HASH_ITER(hh, relay->rooms, room, room_tmp) {
+		relay_watcher_t *watcher, *tmp;
+		HASH_ITER(hh, room->watchers, watcher, tmp) {
+			if (now - watcher->last_seen > relay->config.timeout) {
+				HASH_DEL(room->watchers, watcher);
+				--room->watcher_count;
+				--relay->watcher_count;
+				xpl_free(watcher);
+			}
+		}
+		if (! room->watchers) {
+			room_close(relay, room);
+			continue;
+		}
+
+		if (now - room->last_watch >= RELAY_WATCH_INTERVAL) send_watch(relay, room, now);
+		room_receive(relay, room, now);
+		room_forward(relay, room, now);
+	}
+
+	metrics_set(&rooms_gauge, relay->room_count);
+	metrics_set(&watchers_gauge, relay->watcher_count);
+}
+
+// ------------------------------------------------------------------------------
+
+relay_t *relay_new(const relay_config_t *config) {
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_family = AF_INET;
+	int err = getaddrinfo(config->upstream_host, NULL, &hints, &res);
+	if (err != 0) {
+		LOG_ERROR("Couldn't look up upstream %s: %s", config->upstream_host, gai_strerror(err));
+		return NULL;
+	}
+
+	relay_metrics_init();
+
+	relay_t *relay = xpl_calloc_type(relay_t);
+	relay->config = *config;
+	relay->config.upstream_host = NULL;
+	inet_ntop(AF_INET, &((struct sockaddr_in *)res->ai_addr)->sin_addr,
+			  relay->upstream.address, sizeof(relay->upstream.address));
+	relay->upstream.port = config->upstream_port;
+	freeaddrinfo(res);
+
+	cookie_jar_init(&relay->cookies);
+	token_bucket_init(&relay->watch_bucket, &relay_watch_limit, xpl_get_time());
+
+	LOG_INFO("Relaying from %s:%d to up to %d watchers, %.1f s behind",
+			 relay->upstream.address, relay->upstream.port, relay->config.max_watchers, relay->config.delay);
+	return relay;
+}
+
+void relay_destroy(relay_t **pprelay) {
+	relay_t *relay = *pprelay;
+	if (! relay) return;
+
+	relay_room_t *room, *tmp;
+	HASH_ITER(hh, relay->rooms, room, tmp) {
+		room_close(relay, room);
+	}
+	xpl_free(relay);
+	*pprelay = NULL;
+}
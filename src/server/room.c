@@ -0,0 +1,1362 @@
+//
+//  room.c
+//  app
+//
+//  Created by Justin Bowes on 2013-08-03.
+//  Copyright (c) 2013 Informi Software Inc. All rights reserved.
+//
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "uthash.h"
+
+#include "xpl.h"
+#include "xpl_log.h"
+#include "xpl_hash.h"
+
+#include "game/game.h"
+#include "game/packet.h"
+#include "game/projectile_config.h"
+#include "game/replay.h"
+
+#include "server/cookie.h"
+#include "server/metrics.h"
+#include "server/room.h"
+#include "server/token_bucket.h"
+
+#define ROOM_QUEUE_SIZE         1024        // messages per worker
+#define ROOM_WAIT_MS            10          // worker sleep between purges
+#define ROUTE_EXPIRY_FACTOR     2.0         // routes outlive the clients they lead to
+#define ROUTE_EXPIRY_INTERVAL   1.0
+
+#define ROOM_PROJECTILES_MAX    256         // lasting projectiles remembered per room
+#define PROJECTILE_TTL          600.0
+#define SNAPSHOT_DATAGRAM_MAX   1024        // the client reads into a buffer this size
+#define JIFFIES_PER_SECOND      60.0        // the client ages projectiles a jiffy at a time
+
+#define WATCH_INTERVAL          0.1         // watchers get the room coalesced this often
+#define WATCH_KEYFRAME_INTERVAL 2.0         // and all of it this often
+#define WATCH_EVENTS_MAX        8192        // bytes broadcast between updates
+
+/*
+ * Per address and packet type, comfortably above what a client sends: player
+ * updates at 10 Hz under thrust plus one per shot, shots at up to 60 Hz, a
+ * hello or watch every two seconds.
+ */
+static const token_bucket_limit_t packet_limits[PACKET_TYPE_COUNT] = {
+	{ 2.0, 5.0 },       // hello
+	{ 1.0, 2.0 },       // goodbye
+	{ 90.0, 90.0 },     // player
+	{ 90.0, 90.0 },     // projectile
+	{ 120.0, 240.0 },   // damage
+	{ 1.0, 5.0 },       // chat
+	{ 2.0, 5.0 }        // watch
+};
+
+// Shared by every address that hasn't joined, so a spoofed flood of hellos
+// costs at most this many challenges a second.
+static const token_bucket_limit_t unrouted_hello_limit = { 500.0, 1000.0 };
+
+typedef enum room_message_kind {
+	rm_packet,          // decoded, for the types the server acts on
+	rm_relay,           // still encoded; forwarded as it came
+	rm_leave,           // the address said hello to another room
+	rm_watch            // a spectator's subscription, cookie already checked
+} room_message_kind_t;
+
+typedef struct room_message {
+	uint8_t                 kind;
+	uint8_t                 type;
+	uint8_t                 length;         // of bytes
+	uint16_t                room;
+	uint16_t                client_source;
+	uint32_t                seq;
+	int                     key;            // source address hash
+	UDPNET_ADDRESS          source;
+	union {
+		packet_t            packet;
+		uint8_t             bytes[PACKET_SIZE_MAX];
+	};
+} room_message_t;
+
+typedef struct client_info {
+	int                     id;
+	UDPNET_ADDRESS          remote_addr;
+	uint32_t                seq;
+	double                  last_packet_time;
+	player_id_t             player_id;
+	double                  hello_reply_time;   // until the client first uses its id
+	bool                    drop;
+	uint8_t                 player_packet[PACKET_SIZE_MAX];    // the last one relayed
+	uint8_t                 player_packet_length;
+	bool                    player_dirty;       // relayed since the last watch update
+	UT_hash_handle          hh;
+} client_info_t;
+
+// Mines, black holes and health kits stay on the field until something sets
+// them off, so a joining client has to be told about them.
+typedef struct lasting_projectile {
+	int                     key;            // owner << 16 | pid
+	uint16_t                owner;
+	projectile_t            projectile;
+	double                  launch_time;
+	UT_hash_handle          hh;
+} lasting_projectile_t;
+
+typedef struct room {
+	int                     id;
+	client_info_t           *clients;
+	int                     client_count;
+	lasting_projectile_t    *projectiles;   // oldest first
+	int                     projectile_count;
+	replay_writer_t         *replay;        // everything broadcast, when recording
+
+	client_info_t           *watchers;      // spectators and relays, by address
+	int                     watcher_count;
+	double                  next_watch_time;
+	double                  next_keyframe_time;
+	uint8_t                 watch_events[WATCH_EVENTS_MAX];    // broadcast since the last update
+	size_t                  watch_events_length;
+	UT_hash_handle          hh;
+} room_t;
+
+// The queue is single-producer, single-consumer: the receiving thread moves
+// head and the worker moves tail. The mutex only guards sleeping.
+typedef struct room_worker {
+	room_host_t             *host;
+	int                     index;
+	pthread_t               thread;
+	pthread_mutex_t         mutex;
+	pthread_cond_t          wake;
+	int                     sleeping;
+	uint32_t                head;
+	uint32_t                tail;
+	room_message_t          *queue;
+
+	room_t                  *rooms;         // worker thread only
+	double                  last_purge;
+
+	int                     load;           // routes into its rooms; receiving thread only
+} room_worker_t;
+
+// The receiving thread's view: which room each address is in, and which
+// worker each room lives on.
+typedef struct room_slot {
+	int                     id;
+	room_worker_t           *worker;
+	int                     routes;
+	UT_hash_handle          hh;
+} room_slot_t;
+
+typedef struct route {
+	int                     key;
+	room_slot_t             *slot;
+	double                  last_seen;
+	token_bucket_t          buckets[PACKET_TYPE_COUNT];
+	UT_hash_handle          hh;
+} route_t;
+
+// An address that has answered a watch challenge, so its renewals are
+// limited on their own and not against unrouted hellos.
+typedef struct watch_route {
+	int                     key;
+	double                  last_seen;
+	token_bucket_t          bucket;
+	UT_hash_handle          hh;
+} watch_route_t;
+
+typedef struct roster_entry {
+	int                     client_id;
+	uint16_t                room;
+	char                    name[NAME_SIZE];
+	UT_hash_handle          hh;
+} roster_entry_t;
+
+struct room_host {
+	room_host_config_t      config;
+	char                    *motd;
+	char                    *replay_directory;
+	double                  start_time;
+	int                     running;
+
+	room_worker_t           *workers;
+	room_slot_t             *slots;
+	route_t                 *routes;
+	watch_route_t           *watch_routes;
+	int                     watch_route_count;
+	int                     room_count;
+	double                  last_expiry;
+	token_bucket_t          hello_bucket;       // for addresses without a route
+	cookie_jar_t            cookies;
+
+	int                     client_count;       // atomic
+	uint16_t                client_uid_counter; // atomic
+	uint32_t                replay_counter;     // atomic
+	int                     watcher_count;      // atomic
+
+	// Workers share the journal; the roster mirrors who's connected so each
+	// new segment can restate it.
+	pthread_mutex_t         journal_mutex;
+	journal_t               *journal;
+	roster_entry_t          *roster;
+};
+
+/*
+ * Metrics. There's no ping in the protocol, so round trip time is taken from
+ * the handshake: from the hello reply to the first packet carrying the id it
+ * assigned, which overstates it by up to one client send interval.
+ */
+static const double rtt_bounds[] = { 0.005, 0.01, 0.025, 0.05, 0.075, 0.1, 0.15, 0.25, 0.5, 1.0 };
+static const double broadcast_bounds[] = { 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01 };
+
+static char			packet_type_labels[PACKET_TYPE_COUNT][32];
+static metric_t		packets_received[PACKET_TYPE_COUNT];
+static metric_t		packets_sent[PACKET_TYPE_COUNT];
+static metric_t		bytes_received		= { "up_received_bytes_total", "Bytes received in valid packets.", mt_counter };
+static metric_t		bytes_sent			= { "up_sent_bytes_total", "Bytes sent.", mt_counter };
+static metric_t		decode_failures		= { "up_decode_failures_total", "Packets dropped because they didn't decode.", mt_counter };
+static metric_t		stale_packets		= { "up_stale_packets_total", "Packets dropped for an old sequence number.", mt_counter };
+static metric_t		throttled_packets[PACKET_TYPE_COUNT];
+static metric_t		hello_challenges	= { "up_hello_challenges_total", "Cookie challenges sent to hellos and watches from new addresses.", mt_counter };
+static metric_t		unrouted_packets	= { "up_unrouted_packets_total", "Packets dropped from addresses that haven't said hello.", mt_counter };
+static metric_t		queue_drops			= { "up_queue_drops_total", "Packets dropped because a room worker was behind.", mt_counter };
+static metric_t		send_drops			= { "up_send_drops_total", "Sends that failed and dropped the client.", mt_counter };
+static metric_t		clients_gauge		= { "up_clients", "Connected clients.", mt_gauge };
+static metric_t		rooms_gauge			= { "up_rooms", "Rooms with at least one client.", mt_gauge };
+static metric_t		watchers_gauge		= { "up_watchers", "Spectators and relays watching rooms.", mt_gauge };
+static metric_t		watch_event_drops	= { "up_watch_event_drops_total", "Broadcasts left out of a watch update that was already full.", mt_counter };
+static metric_t		client_rtt			= { "up_client_rtt_seconds", "Handshake round trip time per client.", mt_histogram, NULL,
+											rtt_bounds, sizeof(rtt_bounds) / sizeof(rtt_bounds[0]) };
+static metric_t		broadcast_time		= { "up_broadcast_seconds", "Time to send one packet to every client in a room.", mt_histogram, NULL,
+											broadcast_bounds, sizeof(broadcast_bounds) / sizeof(broadcast_bounds[0]) };
+
+static void room_metrics_init(void) {
+	static bool registered = false;
+	if (registered) return;
+	registered = true;
+
+	for (int i = 0; i < PACKET_TYPE_COUNT; ++i) {
+		snprintf(packet_type_labels[i], sizeof(packet_type_labels[i]), "type=\"%s\"", packet_type_name(i));
+		packets_received[i] = (metric_t){ "up_packets_received_total", "Valid packets received, by type.", mt_counter, packet_type_labels[i] };
+		metrics_register(&packets_received[i]);
+	}
+	for (int i = 0; i < PACKET_TYPE_COUNT; ++i) {
+		packets_sent[i] = (metric_t){ "up_packets_sent_total", "Packets sent, by type; a broadcast counts each recipient.", mt_counter, packet_type_labels[i] };
+		metrics_register(&packets_sent[i]);
+	}
+	for (int i = 0; i < PACKET_TYPE_COUNT; ++i) {
+		throttled_packets[i] = (metric_t){ "up_throttled_packets_total", "Packets dropped for exceeding their sender's rate, by type.", mt_counter, packet_type_labels[i] };
+		metrics_register(&throttled_packets[i]);
+	}
+	metrics_register(&bytes_received);
+	metrics_register(&bytes_sent);
+	metrics_register(&decode_failures);
+	metrics_register(&stale_packets);
+	metrics_register(&hello_challenges);
+	metrics_register(&unrouted_packets);
+	metrics_register(&queue_drops);
+	metrics_register(&send_drops);
+	metrics_register(&clients_gauge);
+	metrics_register(&rooms_gauge);
+	metrics_register(&watchers_gauge);
+	metrics_register(&watch_event_drops);
+	metrics_register(&client_rtt);
+	metrics_register(&broadcast_time);
+}
+
+// ------------------------------------------------------------------------------
+// Journal
+
+static uint16_t event_client_id(const client_info_t *client_info) {
+	return client_info ? client_info->player_id.client_id : 0;
+}
+
+static XPL_UNUSED const char *event_client_name(const client_info_t *client_info) {
+	return client_info ? client_info->player_id.name : "";
+}
+
+static void roster_update(room_host_t *host, journal_event_type_t type, uint16_t client_id, const void *payload) {
+	roster_entry_t *entry;
+	int key = client_id;
+	HASH_FIND_INT(host->roster, &key, entry);
+	switch (type) {
+		case je_join:
+			if (! entry) {
+				entry = xpl_calloc_type(roster_entry_t);
+				entry->client_id = key;
+				HASH_ADD_INT(host->roster, client_id, entry);
+			}
+			entry->room = ((const journal_join_t *)payload)->room;
+			break;
+
+		case je_hello:
+			if (entry) strncpy(entry->name, ((const journal_hello_t *)payload)->name, NAME_SIZE);
+			break;
+
+		case je_delete:
+			if (entry) {
+				HASH_DEL(host->roster, entry);
+				xpl_free(entry);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * journal_event - client events go to the journal as records; debug builds also
+ * log them as text. Read the journal with journal_tool.
+ */
+static void journal_event(room_host_t *host, journal_event_type_t type, const client_info_t *client_info, const void *payload, size_t length) {
+	if (! host->journal) return;
+	pthread_mutex_lock(&host->journal_mutex);
+	journal_write(host->journal, type, event_client_id(client_info), payload, length);
+	roster_update(host, type, event_client_id(client_info), payload);
+	pthread_mutex_unlock(&host->journal_mutex);
+}
+
+#define log_event(type, client_info, format, ...) \
+	LOG_DEBUG("[%s] client_id=[%u,\"%s\"] data=[" format "]", type, \
+			 event_client_id(client_info), event_client_name(client_info), ##__VA_ARGS__)
+
+/*
+ * journal_roster - restate who's connected at the top of each segment, so a
+ * segment read alone still has names and rooms for its client ids. Runs with
+ * the journal mutex held.
+ */
+static void journal_roster(journal_t *journal, void *data) {
+	room_host_t *host = data;
+	roster_entry_t *entry, *tmp;
+	HASH_ITER(hh, host->roster, entry, tmp) {
+		journal_roster_t event;
+		memset(&event, 0, sizeof(event));
+		event.room = entry->room;
+		strncpy(event.name, entry->name, NAME_SIZE);
+		journal_write(journal, je_roster, (uint16_t)entry->client_id, &event, sizeof(event));
+	}
+}
+
+// ------------------------------------------------------------------------------
+// Sending
+
+static void pointcast_buffer(room_host_t *host, uint8_t *buf, int size, client_info_t *client) {
+	int ret = udp_send(host->config.socket, buf, size, client->remote_addr.address, client->remote_addr.port);
+	if (! ret) metrics_add(&bytes_sent, (uint64_t)size);
+	if (ret) {
+		metrics_inc(&send_drops);
+		journal_send_drop_t event = { (uint16_t)size };
+		journal_event(host, je_send_drop, client, &event, sizeof(event));
+		log_event("send_drop", client, "size=%d", size);
+		client->drop = true;
+	}
+}
+
+static void pointcast_packet(room_host_t *host, uint16_t subject, packet_t *packet, client_info_t *client) {
+	uint8_t buf[PACKET_SIZE_MAX];
+	size_t size = packet_encode(packet, subject, buf);
+	pointcast_buffer(host, buf, (int)size, client);
+	if (packet->type < PACKET_TYPE_COUNT) metrics_inc(&packets_sent[packet->type]);
+}
+
+static void broadcast_buffer(room_host_t *host, room_t *room, uint8_t type, uint8_t *buf, int size) {
+	double start = xpl_get_time();
+	client_info_t *dest, *tmp;
+	HASH_ITER(hh, room->clients, dest, tmp) {
+		pointcast_buffer(host, buf, size, dest);
+	}
+	if (room->replay) replay_write(room->replay, buf, (size_t)size);
+	// Player packets are coalesced; see watch_update.
+	if (room->watchers && type != pt_player) {
+		if (room->watch_events_length + size <= sizeof(room->watch_events)) {
+			memcpy(room->watch_events + room->watch_events_length, buf, size);
+			room->watch_events_length += size;
+		} else {
+			metrics_inc(&watch_event_drops);
+		}
+	}
+	metrics_observe(&broadcast_time, xpl_get_time() - start);
+	if (type < PACKET_TYPE_COUNT) metrics_add(&packets_sent[type], (uint64_t)room->client_count);
+}
+
+static void broadcast_packet(room_host_t *host, room_t *room, uint16_t subject, packet_t *packet) {
+	uint8_t buf[PACKET_SIZE_MAX];
+	size_t size = packet_encode(packet, subject, buf);
+	broadcast_buffer(host, room, packet->type, buf, (int)size);
+}
+
+static void client_send_motd(room_host_t *host, room_t *room, client_info_t *client) {
+
+	packet_t packet;
+	packet.type = pt_chat;
+
+	char stat_message[CHAT_MAX] = { 0 };
+	snprintf(stat_message, CHAT_MAX, "Welcome to UltraPew! Room %d, %d users, uptime %.2f h",
+			 room->id, room->client_count, (xpl_get_time() - host->start_time) / 3600.0);
+	strncpy(packet.chat, stat_message, CHAT_MAX);
+	pointcast_packet(host, 0, &packet, client);
+
+	size_t bytes_read = 0;
+
+	char file_message[CHAT_MAX] = { 0 };
+	FILE *file = fopen(host->motd, "r");
+	if (file) {
+		bytes_read = fread(file_message, 1, CHAT_MAX - 1, file);
+		fclose(file);
+	}
+	if (bytes_read) strncpy(packet.chat, file_message, CHAT_MAX);
+	pointcast_packet(host, 0, &packet, client);
+
+}
+
+// ------------------------------------------------------------------------------
+// Workers
+
+// One replay per room, from when it opens until the last client leaves.
+static replay_writer_t *replay_open(room_host_t *host, int id) {
+	if (! host->config.replay_directory) return NULL;
+
+	time_t seconds = time(NULL);
+	struct tm tm;
+	localtime_r(&seconds, &tm);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/room%d-%s-%06u" REPLAY_EXTENSION, host->config.replay_directory, id, stamp,
+			 __atomic_fetch_add(&host->replay_counter, 1, __ATOMIC_RELAXED) % 1000000);
+	return replay_writer_new(path, (uint16_t)id);
+}
+
+static room_t *get_room(room_worker_t *worker, int id) {
+	room_t *room;
+	HASH_FIND_INT(worker->rooms, &id, room);
+	if (! room) {
+		room = xpl_calloc_type(room_t);
+		room->id = id;
+		room->replay = replay_open(worker->host, id);
+		HASH_ADD_INT(worker->rooms, id, room);
+		LOG_DEBUG("Room %d opened on worker %d", id, worker->index);
+	}
+	return room;
+}
+
+static void projectile_forget(room_t *room, lasting_projectile_t *entry) {
+	HASH_DEL(room->projectiles, entry);
+	--room->projectile_count;
+	xpl_free(entry);
+}
+
+static void watcher_forget(room_host_t *host, room_t *room, client_info_t *watcher) {
+	HASH_DEL(room->watchers, watcher);
+	--room->watcher_count;
+	__atomic_fetch_sub(&host->watcher_count, 1, __ATOMIC_RELAXED);
+	xpl_free(watcher);
+}
+
+static void room_free(room_host_t *host, room_t *room) {
+	lasting_projectile_t *entry, *tmp;
+	HASH_ITER(hh, room->projectiles, entry, tmp) {
+		projectile_forget(room, entry);
+	}
+	client_info_t *watcher, *watcher_tmp;
+	HASH_ITER(hh, room->watchers, watcher, watcher_tmp) {
+		watcher_forget(host, room, watcher);
+	}
+	replay_writer_destroy(&room->replay);
+	xpl_free(room);
+}
+
+static void release_room(room_worker_t *worker, room_t *room) {
+	if (room->client_count) return;
+	LOG_DEBUG("Room %d closed on worker %d", room->id, worker->index);
+	HASH_DEL(worker->rooms, room);
+	room_free(worker->host, room);
+}
+
+static client_info_t *get_client(room_host_t *host, room_t *room, const room_message_t *message) {
+	client_info_t *client;
+	HASH_FIND_INT(room->clients, &message->key, client);
+
+	if (! client) {
+		client = xpl_calloc_type(client_info_t);
+		client->id = message->key;
+		client->remote_addr = message->source;
+		client->player_id.client_id = __atomic_fetch_add(&host->client_uid_counter, 1, __ATOMIC_RELAXED);
+		client->player_id.room = (uint16_t)room->id;
+		++room->client_count;
+		__atomic_fetch_add(&host->client_count, 1, __ATOMIC_RELAXED);
+		journal_join_t event;
+		memset(&event, 0, sizeof(event));
+		event.port = (uint16_t)message->source.port;
+		event.room = (uint16_t)room->id;
+		strncpy(event.address, message->source.address, sizeof(event.address));
+		journal_event(host, je_join, client, &event, sizeof(event));
+		log_event("join", client, "ip=\"%s\",port=%d,room=%d", message->source.address, message->source.port, room->id);
+		HASH_ADD_INT(room->clients, id, client);
+	}
+
+	return client;
+}
+
+static void delete_client(room_host_t *host, room_t *room, client_info_t *client, journal_delete_reason_t reason) {
+	journal_delete_t event = { (uint8_t)reason };
+	journal_event(host, je_delete, client, &event, sizeof(event));
+	log_event("delete", client, "reason=%u", reason);
+
+	packet_t bye;
+	memset(&bye, 0, sizeof(bye));
+	bye.type = pt_goodbye;
+	bye.goodbye = client->player_id;
+	broadcast_packet(host, room, client->player_id.client_id, &bye);
+
+	HASH_DEL(room->clients, client);
+	--room->client_count;
+	__atomic_fetch_sub(&host->client_count, 1, __ATOMIC_RELAXED);
+
+	xpl_free(client);
+}
+
+static void worker_purge(room_worker_t *worker) {
+	room_host_t *host = worker->host;
+	double time = xpl_get_time();
+	if (time - worker->last_purge < ROOM_WAIT_MS / 1000.0) return;
+	worker->last_purge = time;
+
+	room_t *room, *room_tmp;
+	HASH_ITER(hh, worker->rooms, room, room_tmp) {
+		client_info_t *dest, *tmp;
+		HASH_ITER(hh, room->clients, dest, tmp) {
+
+			if (dest->drop) {
+				delete_client(host, room, dest, jdr_drop);
+				continue;
+			}
+
+			if (time - dest->last_packet_time > host->config.timeout) {
+				delete_client(host, room, dest, jdr_timeout);
+			}
+		}
+
+		lasting_projectile_t *entry = room->projectiles;
+		while (entry && time - entry->launch_time > PROJECTILE_TTL) {
+			lasting_projectile_t *next = entry->hh.next;
+			projectile_forget(room, entry);
+			entry = next;
+		}
+
+		release_room(worker, room);
+	}
+}
+
+static void worker_leave(room_worker_t *worker, const room_message_t *message) {
+	room_t *room;
+	int id = message->room;
+	HASH_FIND_INT(worker->rooms, &id, room);
+	if (! room) return;
+
+	client_info_t *client;
+	HASH_FIND_INT(room->clients, &message->key, client);
+	if (client) delete_client(worker->host, room, client, jdr_leave);
+	release_room(worker, room);
+}
+
+// ------------------------------------------------------------------------------
+// Late-join snapshots
+
+static bool projectile_is_lasting(uint8_t type) {
+	return type < projectile_type_count &&
+		(projectile_config[type].is_mine || strcmp(projectile_config[type].identifier, "health_kit") == 0);
+}
+
+static int projectile_key(uint16_t owner, uint16_t pid) {
+	return (int)((uint32_t)owner << 16 | pid);
+}
+
+static void projectile_remember(room_t *room, uint16_t owner, const projectile_t *projectile, double now) {
+	int key = projectile_key(owner, projectile->pid);
+	lasting_projectile_t *entry;
+	HASH_FIND_INT(room->projectiles, &key, entry);
+	if (! projectile_is_lasting(projectile->type) || projectile->health == 0) {
+		if (entry) projectile_forget(room, entry);
+		return;
+	}
+
+	if (! entry) {
+		if (room->projectile_count >= ROOM_PROJECTILES_MAX) projectile_forget(room, room->projectiles);
+		entry = xpl_calloc_type(lasting_projectile_t);
+		entry->key = key;
+		entry->owner = owner;
+		entry->launch_time = now;
+		HASH_ADD_INT(room->projectiles, key, entry);
+		++room->projectile_count;
+	}
+	entry->projectile = *projectile;
+}
+
+// Whoever touches a mine or picks up a kit reports it as damage.
+static void projectile_detonated(room_t *room, uint16_t owner, uint16_t pid) {
+	int key = projectile_key(owner, pid);
+	lasting_projectile_t *entry;
+	HASH_FIND_INT(room->projectiles, &key, entry);
+	if (entry) projectile_forget(room, entry);
+}
+
+static uint16_t position_advance(uint16_t position, int16_t velocity, double jiffies) {
+	double moved = fmod(position + velocity / VELOCITY_SCALE * jiffies, PLAYFIELD_MAX);
+	return (uint16_t)(moved < 0.0 ? moved + PLAYFIELD_MAX : moved);
+}
+
+// As the client would have it by now: mines count down to armed and then
+// hold at 1, and black holes drift.
+static projectile_t projectile_aged(const lasting_projectile_t *entry, double now) {
+	projectile_t projectile = entry->projectile;
+	double jiffies = (now - entry->launch_time) * JIFFIES_PER_SECOND;
+	if (projectile_config[projectile.type].is_mine) {
+		double health = projectile.health - jiffies;
+		projectile.health = (uint8_t)(health > 1.0 ? health : 1.0);
+	}
+	projectile.position.px = position_advance(projectile.position.px, projectile.velocity.dx, jiffies);
+	projectile.position.py = position_advance(projectile.position.py, projectile.velocity.dy, jiffies);
+	return projectile;
+}
+
+// Packs packets several to a datagram, for one client or every watcher of a room.
+typedef struct snapshot {
+	uint8_t                 buffer[SNAPSHOT_DATAGRAM_MAX];
+	size_t                  length;
+	client_info_t           *client;
+	room_t                  *watched;
+} snapshot_t;
+
+static void snapshot_flush(room_host_t *host, snapshot_t *snapshot) {
+	if (! snapshot->length) return;
+	if (snapshot->client) {
+		pointcast_buffer(host, snapshot->buffer, (int)snapshot->length, snapshot->client);
+	} else {
+		client_info_t *watcher, *tmp;
+		HASH_ITER(hh, snapshot->watched->watchers, watcher, tmp) {
+			pointcast_buffer(host, snapshot->buffer, (int)snapshot->length, watcher);
+		}
+	}
+	snapshot->length = 0;
+}
+
+static void snapshot_add(room_host_t *host, snapshot_t *snapshot, const uint8_t *bytes, size_t size) {
+	if (snapshot->length + size > sizeof(snapshot->buffer)) snapshot_flush(host, snapshot);
+	memcpy(snapshot->buffer + snapshot->length, bytes, size);
+	snapshot->length += size;
+	int recipients = snapshot->client ? 1 : snapshot->watched->watcher_count;
+	metrics_add(&packets_sent[bytes[PACKET_HEADER_SIZE - 1]], (uint64_t)recipients);
+}
+
+static void snapshot_add_packet(room_host_t *host, snapshot_t *snapshot, uint16_t subject, packet_t *packet) {
+	uint8_t buf[PACKET_SIZE_MAX];
+	size_t size = packet_encode(packet, subject, buf);
+	snapshot_add(host, snapshot, buf, size);
+}
+
+/*
+ * Everything a joining client would otherwise learn piecemeal over the next
+ * hello and position cycles: who's in the room and where, and what's been
+ * left lying on the field.
+ */
+static void snapshot_add_room(room_host_t *host, snapshot_t *snapshot, room_t *room, double now) {
+	client_info_t *other, *tmp;
+	HASH_ITER(hh, room->clients, other, tmp) {
+		if (other == snapshot->client) continue;
+		packet_t hello;
+		memset(&hello, 0, sizeof(hello));
+		hello.type = pt_hello;
+		hello.hello = other->player_id;
+		hello.hello.nonce = 0;
+		hello.hello.cookie = 0;
+		snapshot_add_packet(host, snapshot, other->player_id.client_id, &hello);
+		if (other->player_packet_length) {
+			snapshot_add(host, snapshot, other->player_packet, other->player_packet_length);
+		}
+	}
+
+	lasting_projectile_t *entry, *entry_tmp;
+	HASH_ITER(hh, room->projectiles, entry, entry_tmp) {
+		packet_t packet;
+		memset(&packet, 0, sizeof(packet));
+		packet.type = pt_projectile;
+		packet.projectile = projectile_aged(entry, now);
+		snapshot_add_packet(host, snapshot, entry->owner, &packet);
+	}
+}
+
+static void client_send_snapshot(room_host_t *host, room_t *room, client_info_t *client) {
+	snapshot_t snapshot;
+	snapshot.length = 0;
+	snapshot.client = client;
+	snapshot.watched = NULL;
+	snapshot_add_room(host, &snapshot, room, xpl_get_time());
+	snapshot_flush(host, &snapshot);
+}
+
+// ------------------------------------------------------------------------------
+// Spectators
+
+static void worker_watch(room_worker_t *worker, const room_message_t *message) {
+	room_host_t *host = worker->host;
+	room_t *room;
+	int id = message->room;
+	HASH_FIND_INT(worker->rooms, &id, room);
+	if (! room) return;
+
+	double now = xpl_get_time();
+	client_info_t *watcher;
+	HASH_FIND_INT(room->watchers, &message->key, watcher);
+	if (! watcher) {
+		if (room->watcher_count >= host->config.max_room_watchers) return;
+		watcher = xpl_calloc_type(client_info_t);
+		watcher->id = message->key;
+		watcher->remote_addr = message->source;
+		if (! room->watchers) {
+			room->next_watch_time = now + WATCH_INTERVAL;
+			room->next_keyframe_time = now + WATCH_KEYFRAME_INTERVAL;
+			room->watch_events_length = 0;
+		}
+		HASH_ADD_INT(room->watchers, id, watcher);
+		++room->watcher_count;
+		__atomic_fetch_add(&host->watcher_count, 1, __ATOMIC_RELAXED);
+		LOG_DEBUG("Watcher %s:%d on room %d", watcher->remote_addr.address, watcher->remote_addr.port, room->id);
+		client_send_snapshot(host, room, watcher);
+	}
+	watcher->last_packet_time = now;
+}
+
+/*
+ * Watchers get the room coalesced: each client's latest player packet, and
+ * everything else broadcast since the last update. Every keyframe restates
+ * the whole room, so a relay's new viewers catch up without the relay keeping
+ * any state of its own.
+ */
+static void watch_update(room_host_t *host, room_t *room, double now) {
+	room->next_watch_time = now + WATCH_INTERVAL;
+
+	snapshot_t snapshot;
+	snapshot.length = 0;
+	snapshot.client = NULL;
+	snapshot.watched = room;
+
+	bool keyframe = now >= room->next_keyframe_time;
+	if (keyframe) {
+		room->next_keyframe_time = now + WATCH_KEYFRAME_INTERVAL;
+		snapshot_add_room(host, &snapshot, room, now);
+	}
+	client_info_t *client, *tmp;
+	HASH_ITER(hh, room->clients, client, tmp) {
+		if (! keyframe && client->player_dirty) {
+			snapshot_add(host, &snapshot, client->player_packet, client->player_packet_length);
+		}
+		client->player_dirty = false;
+	}
+
+	size_t offset = 0;
+	while (offset < room->watch_events_length) {
+		const uint8_t *event = room->watch_events + offset;
+		size_t size = packet_size(event[PACKET_HEADER_SIZE - 1]);
+		snapshot_add(host, &snapshot, event, size);
+		offset += size;
+	}
+	room->watch_events_length = 0;
+
+	snapshot_flush(host, &snapshot);
+}
+
+static void worker_update_watchers(room_worker_t *worker) {
+	room_host_t *host = worker->host;
+	double now = xpl_get_time();
+
+	room_t *room, *room_tmp;
+	HASH_ITER(hh, worker->rooms, room, room_tmp) {
+		client_info_t *watcher, *tmp;
+		HASH_ITER(hh, room->watchers, watcher, tmp) {
+			if (watcher->drop || now - watcher->last_packet_time > host->config.timeout) {
+				watcher_forget(host, room, watcher);
+			}
+		}
+		if (room->watchers && now >= room->next_watch_time) watch_update(host, room, now);
+	}
+}
+
+// ------------------------------------------------------------------------------
+
+/*
+ * Player, projectile and goodbye packets pass through untouched but for the
+ * client id, which is stamped with the one the sender was assigned. The last
+ * player packet and any lasting projectiles are kept for late joiners.
+ */
+static void worker_relay(room_worker_t *worker, room_t *room, client_info_t *client_info, room_message_t *message) {
+	if (message->client_source != client_info->player_id.client_id) {
+		LOG_WARN("Packet client_id mismatch (claim %u, have %u); relaying as %u",
+				 message->client_source, client_info->player_id.client_id, client_info->player_id.client_id);
+	}
+
+	double now = xpl_get_time();
+	client_info->last_packet_time = now;
+
+	packet_set_client_source(message->bytes, client_info->player_id.client_id);
+
+	if (message->type == pt_player) {
+		memcpy(client_info->player_packet, message->bytes, message->length);
+		client_info->player_packet_length = message->length;
+		client_info->player_dirty = true;
+	} else if (message->type == pt_projectile) {
+		packet_t packet;
+		uint16_t client_source;
+		if (packet_decode(&packet, &client_source, message->bytes)) {
+			projectile_remember(room, client_info->player_id.client_id, &packet.projectile, now);
+		}
+	}
+
+	broadcast_buffer(worker->host, room, message->type, message->bytes, message->length);
+}
+
+static void worker_packet(room_worker_t *worker, room_message_t *message) {
+	room_host_t *host = worker->host;
+	room_t *room = get_room(worker, message->room);
+	client_info_t *client_info = get_client(host, room, message);
+	packet_t *packet = &message->packet;
+	uint16_t client_source = message->client_source;
+
+	if (client_info->hello_reply_time > 0.0 && client_source == client_info->player_id.client_id) {
+		metrics_observe(&client_rtt, xpl_get_time() - client_info->hello_reply_time);
+		client_info->hello_reply_time = 0.0;
+	}
+
+	if (message->seq <= client_info->seq) {
+		metrics_inc(&stale_packets);
+		LOG_DEBUG("Dropping old packet %d", message->seq);
+		return;
+	}
+	client_info->seq = message->seq;
+
+	if (message->kind == rm_relay) {
+		worker_relay(worker, room, client_info, message);
+		return;
+	}
+
+	if (packet->type == pt_hello) {
+
+		if (packet->hello.nonce && client_source == 0) {
+			client_source = client_info->player_id.client_id;
+			journal_hello_t event;
+			memset(&event, 0, sizeof(event));
+			event.nonce = packet->hello.nonce;
+			strncpy(event.name, packet->hello.name, NAME_SIZE);
+			journal_event(host, je_hello, client_info, &event, sizeof(event));
+			log_event("hello", client_info, "nonce=%u", packet->hello.nonce);
+			packet->hello.client_id = client_info->player_id.client_id;
+			pointcast_packet(host, client_source, packet, client_info);
+			client_info->hello_reply_time = xpl_get_time();
+			client_send_motd(host, room, client_info);
+			client_send_snapshot(host, room, client_info);
+			assert(client_source != 0);
+		}
+		strncpy(client_info->player_id.name, packet->hello.name, NAME_SIZE);
+		// Overwrite the nonce and cookie so they're not shared
+		packet->hello.nonce = 0;
+		packet->hello.cookie = 0;
+	}
+
+	if (packet->type == pt_chat) {
+		packet->chat[63] = '\0';
+		journal_event(host, je_chat, client_info, packet->chat, strlen(packet->chat));
+		log_event("chat", client_info, "message=\"%s\"", packet->chat);
+	}
+
+	if (packet->type == pt_damage) {
+		journal_damage_t event = {
+			packet->damage.player_id,
+			packet->damage.projectile_id,
+			packet->damage.amount,
+			packet->damage.flags
+		};
+		journal_event(host, je_damage, client_info, &event, sizeof(event));
+		projectile_detonated(room, packet->damage.player_id, packet->damage.projectile_id);
+		log_event("damage", client_info, "damage=%u,origin=%u,flags=%u",
+				  packet->damage.amount,
+				  packet->damage.player_id,
+				  packet->damage.flags);
+	}
+
+	if (client_source != client_info->player_id.client_id) {
+		LOG_WARN("Packet client_id mismatch (claim %u, have %u); kicking packet",
+				 client_source, client_info->player_id.client_id);
+	}
+
+	client_info->last_packet_time = xpl_get_time();
+
+	broadcast_packet(host, room, client_source, packet);
+}
+
+static void worker_wait(room_worker_t *worker) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	long nsec = now.tv_usec * 1000L + ROOM_WAIT_MS * 1000000L;
+	struct timespec deadline = { now.tv_sec + nsec / 1000000000L, nsec % 1000000000L };
+
+	// The producer stores head before it reads sleeping, and we store
+	// sleeping before we read head, so one of us sees the other.
+	pthread_mutex_lock(&worker->mutex);
+	__atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&worker->head, __ATOMIC_SEQ_CST) == worker->tail &&
+		__atomic_load_n(&worker->host->running, __ATOMIC_ACQUIRE)) {
+		pthread_cond_timedwait(&worker->wake, &worker->mutex, &deadline);
+	}
+	__atomic_store_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+static void *worker_main(void *data) {
+	room_worker_t *worker = data;
+	while (__atomic_load_n(&worker->host->running, __ATOMIC_ACQUIRE)) {
+		uint32_t tail = worker->tail;
+		uint32_t head = __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE);
+		for (; tail != head; ++tail) {
+			room_message_t *message = &worker->queue[tail % ROOM_QUEUE_SIZE];
+			if (message->kind == rm_leave) {
+				worker_leave(worker, message);
+			} else if (message->kind == rm_watch) {
+				worker_watch(worker, message);
+			} else {
+				worker_packet(worker, message);
+			}
+			__atomic_store_n(&worker->tail, tail + 1, __ATOMIC_RELEASE);
+		}
+
+		worker_purge(worker);
+		worker_update_watchers(worker);
+		if (tail == __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE)) worker_wait(worker);
+	}
+	return NULL;
+}
+
+static bool worker_enqueue(room_worker_t *worker, const room_message_t *message) {
+	uint32_t head = worker->head;
+	if (head - __atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE) == ROOM_QUEUE_SIZE) {
+		metrics_inc(&queue_drops);
+		return false;
+	}
+	worker->queue[head % ROOM_QUEUE_SIZE] = *message;
+	__atomic_store_n(&worker->head, head + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&worker->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&worker->mutex);
+		pthread_cond_signal(&worker->wake);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------
+// Routing
+
+static room_slot_t *slot_new(room_host_t *host, int id) {
+	room_worker_t *worker = &host->workers[0];
+	for (int i = 1; i < host->config.workers; ++i) {
+		if (host->workers[i].load < worker->load) worker = &host->workers[i];
+	}
+
+	room_slot_t *slot = xpl_calloc_type(room_slot_t);
+	slot->id = id;
+	slot->worker = worker;
+	HASH_ADD_INT(host->slots, id, slot);
+	++host->room_count;
+	return slot;
+}
+
+static void route_attach(room_host_t *host, route_t *route, room_slot_t *slot) {
+	route->slot = slot;
+	++slot->routes;
+	++slot->worker->load;
+}
+
+static void route_detach(room_host_t *host, route_t *route) {
+	room_slot_t *slot = route->slot;
+	route->slot = NULL;
+	--slot->worker->load;
+	if (--slot->routes == 0) {
+		HASH_DEL(host->slots, slot);
+		--host->room_count;
+		xpl_free(slot);
+	}
+}
+
+// The challenge is no bigger than the hello it answers, so it can't be used
+// to amplify a spoofed flood.
+static void send_challenge(room_host_t *host, const UDPNET_ADDRESS *source, const packet_t *hello, double now) {
+	client_info_t temp_client;
+	memset(&temp_client, 0, sizeof(temp_client));
+	temp_client.remote_addr = *source;
+
+	packet_t challenge;
+	memset(&challenge, 0, sizeof(challenge));
+	challenge.type = pt_hello;
+	challenge.hello.nonce = hello->hello.nonce;
+	challenge.hello.room = hello->hello.room;
+	challenge.hello.cookie = cookie_make(&host->cookies, source, hello->hello.nonce, now);
+
+	metrics_inc(&hello_challenges);
+	pointcast_packet(host, 0, &challenge, &temp_client);
+}
+
+static void send_watch_challenge(room_host_t *host, const UDPNET_ADDRESS *source, const watch_t *watch, double now) {
+	client_info_t temp_client;
+	memset(&temp_client, 0, sizeof(temp_client));
+	temp_client.remote_addr = *source;
+
+	packet_t challenge;
+	memset(&challenge, 0, sizeof(challenge));
+	challenge.type = pt_watch;
+	challenge.watch.room = watch->room;
+	challenge.watch.nonce = watch->nonce;
+	challenge.watch.cookie = cookie_make(&host->cookies, source, watch->nonce, now);
+
+	metrics_inc(&hello_challenges);
+	pointcast_packet(host, 0, &challenge, &temp_client);
+}
+
+static void reply_full(room_host_t *host, const UDPNET_ADDRESS *source) {
+	client_info_t temp_client;
+	memset(&temp_client, 0, sizeof(temp_client));
+	temp_client.remote_addr = *source;
+
+	packet_t full_packet;
+	memset(&full_packet, 0, sizeof(full_packet));
+	full_packet.type = pt_chat;
+	strncpy(full_packet.chat, "Server is full", CHAT_MAX);
+
+	pointcast_packet(host, 0, &full_packet, &temp_client);
+
+	journal_event(host, je_full, NULL, NULL, 0);
+	log_event("full", NULL, "");
+}
+
+// The types whose payload the server reads; the rest are relayed undecoded.
+static bool needs_decode(uint8_t type) {
+	return type == pt_hello || type == pt_chat || type == pt_damage;
+}
+
+// Watchers never get a player route. Each watch is checked here and handed
+// to the room's worker, which keeps the subscription; a room nobody's
+// playing in has nothing to watch. Once an address has answered a challenge
+// it gets a watch route, and its renewals skip the cookie and the shared
+// hello bucket.
+static void dispatch_watch(room_host_t *host, const UDPNET_ADDRESS *source, int key, bool routed, uint8_t *buffer, double now) {
+	room_message_t message;
+	if (! packet_decode(&message.packet, &message.client_source, buffer)) {
+		metrics_inc(&decode_failures);
+		LOG_WARN("Malformed packet, dropping");
+		return;
+	}
+	const watch_t *watch = &message.packet.watch;
+	int id = watch->room;
+
+	watch_route_t *watch_route;
+	HASH_FIND_INT(host->watch_routes, &key, watch_route);
+	// A player's route already charged its own bucket.
+	if (! routed) {
+		bool allowed = watch_route ?
+			token_bucket_take(&watch_route->bucket, &packet_limits[pt_watch], now) :
+			token_bucket_take(&host->hello_bucket, &unrouted_hello_limit, now);
+		if (! allowed) {
+			metrics_inc(&throttled_packets[pt_watch]);
+			return;
+		}
+	}
+	if (! watch_route) {
+		if (! cookie_check(&host->cookies, source, watch->nonce, watch->cookie, now)) {
+			send_watch_challenge(host, source, watch, now);
+			return;
+		}
+		if (host->watch_route_count < host->config.max_rooms * host->config.max_room_watchers) {
+			watch_route = xpl_calloc_type(watch_route_t);
+			watch_route->key = key;
+			token_bucket_init(&watch_route->bucket, &packet_limits[pt_watch], now);
+			token_bucket_take(&watch_route->bucket, &packet_limits[pt_watch], now);
+			HASH_ADD_INT(host->watch_routes, key, watch_route);
+			++host->watch_route_count;
+		}
+	}
+	if (watch_route) watch_route->last_seen = now;
+
+	room_slot_t *slot;
+	HASH_FIND_INT(host->slots, &id, slot);
+	if (! slot) return;
+
+	message.kind = rm_watch;
+	message.type = pt_watch;
+	message.room = (uint16_t)id;
+	message.key = key;
+	message.source = *source;
+	worker_enqueue(slot->worker, &message);
+}
+
+void room_host_dispatch(room_host_t *host, const UDPNET_ADDRESS *source, uint8_t *buffer, size_t length) {
+	packet_header_t header;
+	if (! packet_decode_header(&header, buffer, length)) {
+		metrics_inc(&decode_failures);
+		LOG_WARN("Malformed packet, dropping");
+		return;
+	}
+	metrics_inc(&packets_received[header.type]);
+	metrics_add(&bytes_received, (uint64_t)length);
+
+	double now = xpl_get_time();
+	int key = xpl_hashs(source->address, XPL_HASH_INIT);
+	key = xpl_hashi(source->port, key);
+
+	route_t *route;
+	HASH_FIND_INT(host->routes, &key, route);
+	if (route && ! token_bucket_take(&route->buckets[header.type], &packet_limits[header.type], now)) {
+		metrics_inc(&throttled_packets[header.type]);
+		return;
+	}
+	if (header.type == pt_watch) {
+		dispatch_watch(host, source, key, route != NULL, buffer, now);
+		return;
+	}
+	if (! route && header.type != pt_hello) {
+		metrics_inc(&unrouted_packets);
+		LOG_DEBUG("Packet from %s:%d before hello, dropping", source->address, source->port);
+		return;
+	}
+
+	room_message_t message;
+	if (needs_decode(header.type)) {
+		if (! packet_decode(&message.packet, &message.client_source, buffer)) {
+			metrics_inc(&decode_failures);
+			LOG_WARN("Malformed packet, dropping");
+			return;
+		}
+		message.kind = rm_packet;
+	} else {
+		message.kind = rm_relay;
+		message.length = (uint8_t)packet_size(header.type);
+		memcpy(message.bytes, buffer, message.length);
+	}
+	message.type = header.type;
+	message.client_source = header.client_source;
+	message.seq = header.seq;
+
+	if (header.type == pt_hello) {
+		// Nothing is kept for an address until it proves it can receive.
+		if (! route) {
+			if (! token_bucket_take(&host->hello_bucket, &unrouted_hello_limit, now)) {
+				metrics_inc(&throttled_packets[pt_hello]);
+				return;
+			}
+			if (! cookie_check(&host->cookies, source, message.packet.hello.nonce, message.packet.hello.cookie, now)) {
+				send_challenge(host, source, &message.packet, now);
+				return;
+			}
+		}
+
+		int id = message.packet.hello.room;
+		if (! route || route->slot->id != id) {
+			room_slot_t *slot;
+			HASH_FIND_INT(host->slots, &id, slot);
+			if ((! slot && host->room_count >= host->config.max_rooms) ||
+				(slot && slot->routes >= host->config.max_room_clients)) {
+				reply_full(host, source);
+				return;
+			}
+
+			if (route) {
+				room_message_t leave;
+				memset(&leave, 0, sizeof(leave));
+				leave.kind = rm_leave;
+				leave.room = (uint16_t)route->slot->id;
+				leave.key = key;
+				worker_enqueue(route->slot->worker, &leave);
+				route_detach(host, route);
+			} else {
+				route = xpl_calloc_type(route_t);
+				route->key = key;
+				for (int i = 0; i < PACKET_TYPE_COUNT; ++i) {
+					token_bucket_init(&route->buckets[i], &packet_limits[i], now);
+				}
+				token_bucket_take(&route->buckets[pt_hello], &packet_limits[pt_hello], now);
+				HASH_ADD_INT(host->routes, key, route);
+			}
+			// Looked up again: leaving may have closed the slot.
+			HASH_FIND_INT(host->slots, &id, slot);
+			if (! slot) slot = slot_new(host, id);
+			route_attach(host, route, slot);
+		}
+	}
+
+	route->last_seen = now;
+	message.room = (uint16_t)route->slot->id;
+	message.key = key;
+	message.source = *source;
+	worker_enqueue(route->slot->worker, &message);
+}
+
+static void expire_routes(room_host_t *host) {
+	double time = xpl_get_time();
+	if (time - host->last_expiry < ROUTE_EXPIRY_INTERVAL) return;
+	host->last_expiry = time;
+
+	route_t *route, *tmp;
+	HASH_ITER(hh, host->routes, route, tmp) {
+		if (time - route->last_seen > host->config.timeout * ROUTE_EXPIRY_FACTOR) {
+			route_detach(host, route);
+			HASH_DEL(host->routes, route);
+			xpl_free(route);
+		}
+	}
+
+	watch_route_t *watch_route, *watch_tmp;
+	HASH_ITER(hh, host->watch_routes, watch_route, watch_tmp) {
+		if (time - watch_route->last_seen > host->config.timeout * ROUTE_EXPIRY_FACTOR) {
+			HASH_DEL(host->watch_routes, watch_route);
+			--host->watch_route_count;
+			xpl_free(watch_route);
+		}
+	}
+}
+
+void room_host_tick(room_host_t *host) {
+	expire_routes(host);
+
+	if (host->journal) {
+		pthread_mutex_lock(&host->journal_mutex);
+		journal_tick(host->journal);
+		pthread_mutex_unlock(&host->journal_mutex);
+	}
+
+	metrics_set(&clients_gauge, __atomic_load_n(&host->client_count, __ATOMIC_RELAXED));
+	metrics_set(&rooms_gauge, host->room_count);
+	metrics_set(&watchers_gauge, __atomic_load_n(&host->watcher_count, __ATOMIC_RELAXED));
+}
+
+// ------------------------------------------------------------------------------
+
+room_host_t *room_host_new(const room_host_config_t *config) {
+	room_metrics_init();
+
+	room_host_t *host = xpl_calloc_type(room_host_t);
+	host->config = *config;
+	host->config.journal = NULL;
+	if (host->config.workers < 1) host->config.workers = 1;
+	host->motd = strdup(config->motd);
+	if (config->replay_directory) {
+		host->config.replay_directory = NULL;
+		if (mkdir(config->replay_directory, 0755) != 0 && errno != EEXIST) {
+			LOG_ERROR("Couldn't create replay directory %s: %s", config->replay_directory, strerror(errno));
+		} else {
+			host->replay_directory = strdup(config->replay_directory);
+			host->config.replay_directory = host->replay_directory;
+		}
+	}
+	host->start_time = xpl_get_time();
+	host->client_uid_counter = 1;
+	host->running = 1;
+	cookie_jar_init(&host->cookies);
+	token_bucket_init(&host->hello_bucket, &unrouted_hello_limit, host->start_time);
+	pthread_mutex_init(&host->journal_mutex, NULL);
+
+	if (config->journal) {
+		journal_config_t journal_config = *config->journal;
+		journal_config.segment_opened = journal_roster;
+		journal_config.segment_opened_data = host;
+		host->journal = journal_new(&journal_config);
+		if (! host->journal) LOG_WARN("Running without an event journal");
+	}
+
+	host->workers = xpl_calloc(sizeof(room_worker_t) * host->config.workers);
+	for (int i = 0; i < host->config.workers; ++i) {
+		room_worker_t *worker = &host->workers[i];
+		worker->host = host;
+		worker->index = i;
+		worker->queue = xpl_calloc(sizeof(room_message_t) * ROOM_QUEUE_SIZE);
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_cond_init(&worker->wake, NULL);
+		if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+			LOG_ERROR("Couldn't start room worker %d", i);
+			pthread_cond_destroy(&worker->wake);
+			pthread_mutex_destroy(&worker->mutex);
+			xpl_free(worker->queue);
+			host->config.workers = i;
+			room_host_destroy(&host);
+			return NULL;
+		}
+	}
+
+	LOG_INFO("Hosting up to %d rooms of %d players and %d watchers on %d workers",
+			 host->config.max_rooms, host->config.max_room_clients, host->config.max_room_watchers, host->config.workers);
+	return host;
+}
+
+void room_host_destroy(room_host_t **pphost) {
+	room_host_t *host = *pphost;
+	if (! host) return;
+
+	__atomic_store_n(&host->running, 0, __ATOMIC_RELEASE);
+	for (int i = 0; i < host->config.workers; ++i) {
+		room_worker_t *worker = &host->workers[i];
+		pthread_mutex_lock(&worker->mutex);
+		pthread_cond_signal(&worker->wake);
+		pthread_mutex_unlock(&worker->mutex);
+		pthread_join(worker->thread, NULL);
+
+		room_t *room, *room_tmp;
+		HASH_ITER(hh, worker->rooms, room, room_tmp) {
+			client_info_t *client, *tmp;
+			HASH_ITER(hh, room->clients, client, tmp) {
+				HASH_DEL(room->clients, client);
+				xpl_free(client);
+			}
+			HASH_DEL(worker->rooms, room);
+			room_free(host, room);
+		}
+		pthread_cond_destroy(&worker->wake);
+		pthread_mutex_destroy(&worker->mutex);
+		xpl_free(worker->queue);
+	}
+	xpl_free(host->workers);
+
+	route_t *route, *route_tmp;
+	HASH_ITER(hh, host->routes, route, route_tmp) {
+		HASH_DEL(host->routes, route);
+		xpl_free(route);
+	}
+	watch_route_t *watch_route, *watch_tmp;
+	HASH_ITER(hh, host->watch_routes, watch_route, watch_tmp) {
+		HASH_DEL(host->watch_routes, watch_route);
+		xpl_free(watch_route);
+	}
+	room_slot_t *slot, *slot_tmp;
+	HASH_ITER(hh, host->slots, slot, slot_tmp) {
+		HASH_DEL(host->slots, slot);
+		xpl_free(slot);
+	}
+
+	journal_destroy(&host->journal);
+	roster_entry_t *entry, *entry_tmp;
+	HASH_ITER(hh, host->roster, entry, entry_tmp) {
+		HASH_DEL(host->roster, entry);
+		xpl_free(entry);
+	}
+	pthread_mutex_destroy(&host->journal_mutex);
+
+	free(host->motd);
+	free(host->replay_directory);
+	xpl_free(host);
+	*pphost = NULL;
+}